@@ -22,6 +22,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "app.h"
 #include "bookmarks.h"
+#include "contentcache.h"
 #include "defs.h"
 #include "export.h"
 #include "feeds.h"
@@ -30,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gmutil.h"
 #include "history.h"
 #include "ipc.h"
+#include "lookupindex.h"
 #include "mimehooks.h"
 #include "periodic.h"
 #include "resources.h"
@@ -152,6 +154,7 @@ struct Impl_App {
     iMimeHooks * mimehooks;
     iGmCerts *   certs;
     iVisited *   visited;
+    iLookupIndex *lookupIndex;
     iBookmarks * bookmarks;
     iMainOrExtraWindow *window; /* currently active MainWindow or extra Window */
     iPtrArray    mainWindows;
@@ -293,6 +296,7 @@ static iString *serializePrefs_App_(const iApp *d) {
     appendFormat_String(str, "cachesize.set arg:%d\n", d->prefs.maxCacheSize);
     appendFormat_String(str, "memorysize.set arg:%d\n", d->prefs.maxMemorySize);
     appendFormat_String(str, "urlsize.set arg:%d\n", d->prefs.maxUrlSize);
+    appendFormat_String(str, "feeds.concurrency.set arg:%d\n", d->prefs.maxFeedRequests);
     appendFormat_String(str, "decodeurls arg:%d\n", d->prefs.decodeUserVisibleURLs);
     appendFormat_String(str, "linewidth.set arg:%d\n", d->prefs.lineWidth);
     appendFormat_String(str, "linespacing.set arg:%f\n", d->prefs.lineSpacing);
@@ -864,6 +868,7 @@ static void saveState_App_(const iApp *d) {
        by the user manually. */
     iFile *f = newCStr_File(concatPath_CStr(dataDir_App_(), tempStateFileName_App_));
     if (open_File(f, writeOnly_FileMode)) {
+        beginSave_ContentCache();
         writeData_File(f, magicState_App_, 4);
         writeU32_File(f, latest_FileVersion); /* version */
         iConstForEach(PtrArray, winIter, &d->mainWindows) {
@@ -920,6 +925,8 @@ static void saveState_App_(const iApp *d) {
        before the state file is fully written. */
     commitFile_App(concatPath_CStr(dataDir_App_(), stateFileName_App_),
                    concatPath_CStr(dataDir_App_(), tempStateFileName_App_));
+    /* Cached responses not referenced by the saved state can now be removed. */
+    endSave_ContentCache();
 }
 
 void commitFile_App(const char *path, const char *tempPathWithNewContents) {
@@ -1232,6 +1239,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
     init_Prefs(&d->prefs);
     d->prefs.detachedPrefs = !contains_CommandLine(&d->args, "prefs-sheet");
     init_SiteSpec(dataDir_App_());
+    init_ContentCache(dataDir_App_());
     setCStr_String(&d->prefs.strings[downloadDir_PrefsString], downloadDir_App_());
     set_Atomic(&d->pendingRefresh, iFalse);
     d->isRunning = iFalse;
@@ -1240,6 +1248,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
     d->certs     = new_GmCerts(dataDir_App_());
     d->visited   = new_Visited();
     d->bookmarks = new_Bookmarks();
+    d->lookupIndex = new_LookupIndex();
     /* Dumping requested pages. */
     if (doDump) {
         const iGmIdentity *ident = NULL;
@@ -1331,6 +1340,7 @@ static void init_App_(iApp *d, int argc, char **argv) {
                       0x1f306);
     }
     init_Feeds(dataDir_App_());
+    update_LookupIndex(d->lookupIndex); /* history gets indexed in the background */
     /* Widget state init. */
     processEvents_App(postedEventsOnly_AppEventMode);
     if (!loadState_App_(d)) {
@@ -1417,12 +1427,15 @@ static void deinit_App(iApp *d) {
     iAssert(isEmpty_PtrArray(&d->mainWindows));
     deinit_PtrArray(&d->mainWindows);
     d->window = NULL;
+    deinitImageDecoder_Media();
     deinit_Feeds();
     save_Keys(dataDir_App_());
     deinit_Keys();
     deinit_Fonts();
     deinit_SiteSpec();
+    deinit_ContentCache();
     deinit_Prefs(&d->prefs);
+    delete_LookupIndex(d->lookupIndex);
     save_Bookmarks(d->bookmarks, dataDir_App_());
     delete_Bookmarks(d->bookmarks);
     save_Visited(d->visited, dataDir_App_());
@@ -1551,6 +1564,19 @@ const iString *temporaryPathForUrl_App(const iString *url, const iString *mime)
         tmpPath,
         collect_String(concat_Path(collectNewRange_String(tmpDir),
                                    fileNameForUrl_App(url, mime))));
+    if (contains_StringSet(d->tempFilesPendingDeletion, tmpPath)) {
+        /* The same URL may be open in several tabs, so each gets its own file. */
+        size_t insPos = lastIndexOfCStr_String(tmpPath, ".");
+        if (insPos == iInvalidPos || insPos < size_Range(&tmpDir)) {
+            insPos = size_String(tmpPath);
+        }
+        const iString *base = collect_String(copy_String(tmpPath));
+        for (unsigned int n = 2; contains_StringSet(d->tempFilesPendingDeletion, tmpPath); n++) {
+            set_String(tmpPath, base);
+            const char *suffix = format_CStr("_%u", n);
+            insertData_Block(&tmpPath->chars, insPos, suffix, strlen(suffix));
+        }
+    }
     insert_StringSet(d->tempFilesPendingDeletion, tmpPath); /* deleted in `deinit_App` */
     return tmpPath;
 }
@@ -1572,6 +1598,22 @@ const iString *debugInfo_App(void) {
         appendFormat_String(msg, "Total cache: %.3f MB\n", total.cacheSize / 1.0e6f);
         appendFormat_String(msg, "Total memory: %.3f MB\n", total.memorySize / 1.0e6f);
     }
+    appendFormat_String(msg, "## Text rendering\n"); {
+        const iGlyphCacheStats   glyphs = glyphCacheStats_Text();
+        const iFontRunCacheStats runs   = fontRunCacheStats_Text();
+        appendFormat_String(msg,
+                            "Glyph cache: %zu pages, %u hits, %u misses, %u evictions\n",
+                            glyphs.numPages,
+                            glyphs.hits,
+                            glyphs.misses,
+                            glyphs.evictions);
+        appendFormat_String(msg,
+                            "Font run cache: %zu runs (%.3f MB), %u hits of %u lookups\n",
+                            runs.numRuns,
+                            runs.size / 1.0e6f,
+                            runs.hits,
+                            runs.lookups);
+    }
     appendFormat_String(msg, "## Documents\n");
     iForEach(ObjectList, k, docs) {
         iDocumentWidget *doc = k.object;
@@ -1622,58 +1664,24 @@ iObjectList *listAllDocuments_App(void) {
     return allDocs;
 }
 
-void trimCache_App(void) {
-    iApp *d = &app_;
-    size_t cacheSize = 0;
-    const size_t limit = d->prefs.maxCacheSize * 1000000;
+static iPtrArray *listHistories_App_(void) {
+    iPtrArray *histories = collectNew_PtrArray();
     iObjectList *docs = listAllDocuments_App();
     iForEach(ObjectList, i, docs) {
-        cacheSize += cacheSize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (cacheSize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportant_History(history_DocumentWidget(doc));
-        if (pruned) {
-            cacheSize -= pruned;
-            wasPruned = iTrue;
-        }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
-        }
+        pushBack_PtrArray(histories, history_DocumentWidget(i.object));
     }
     iRelease(docs);
+    return histories;
+}
+
+void trimCache_App(void) {
+    iApp *d = &app_;
+    pruneCache_History(listHistories_App_(), d->prefs.maxCacheSize * 1000000);
 }
 
 void trimMemory_App(void) {
     iApp *d = &app_;
-    size_t memorySize = 0;
-    const size_t limit = d->prefs.maxMemorySize * 1000000;
-    iObjectList *docs = listAllDocuments_App();
-    iForEach(ObjectList, i, docs) {
-        memorySize += memorySize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (memorySize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportantMemory_History(history_DocumentWidget(doc));
-        if (pruned) {
-            memorySize -= pruned;
-            wasPruned = iTrue;
-        }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
-        }
-    }
-    iRelease(docs);
+    pruneMemory_History(listHistories_App_(), d->prefs.maxMemorySize * 1000000);
 }
 
 static iPtrArray *listWindows_App_(const iApp *d, iPtrArray *windows) {
@@ -1710,6 +1718,13 @@ iPtrArray *listWindows_App(void) {
     return wins;
 }
 
+static void damageMainWindows_App_(iApp *d) {
+    iConstForEach(PtrArray, i, &d->mainWindows) {
+        iWindow *win = i.ptr;
+        damage_Window(win, (iRect){ zero_I2(), win->size });
+    }
+}
+
 iLocalDef iBool isWaitingAllowed_App_(iApp *d) {
     if (d->warmupFrames > 0) {
         return iFalse;
@@ -1896,6 +1911,11 @@ void processEvents_App(enum iAppEventMode eventMode) {
                 d->isIdling = iFalse;
                 gotEvents = iTrue;
 #endif /* LAGRANGE_ENABLE_IDLE_SLEEP */
+                if (isDamaging_SDLEvent(&ev)) {
+                    /* Handling input may change any part of the UI, so the next frame
+                       is drawn in full. */
+                    damageMainWindows_App_(d);
+                }
                 /* Keyboard modifier mapping. */
                 if (ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) {
                     /* Track Caps Lock state as a modifier. */
@@ -2400,6 +2420,14 @@ int run_App(int argc, char **argv) {
 }
 
 void postRefresh_App(void) {
+    iWindow *win = get_Window();
+    if (win) {
+        damage_Window(win, (iRect){ zero_I2(), win->size });
+    }
+    postDamageRefresh_App();
+}
+
+void postDamageRefresh_App(void) {
     iApp *d = &app_;
 #if defined (LAGRANGE_ENABLE_IDLE_SLEEP)
     d->isIdling = iFalse;
@@ -2507,13 +2535,13 @@ iAny *findWidget_App(const char *id) {
 void addTicker_App(iTickerFunc ticker, iAny *context) {
     iApp *d = &app_;
     insert_SortedArray(&d->tickers, &(iTicker){ context, get_Root(), ticker });
-    postRefresh_App();
+    postDamageRefresh_App(); /* tickers refresh what they change */
 }
 
 void addTickerRoot_App(iTickerFunc ticker, iRoot *root, iAny *context) {
     iApp *d = &app_;
     insert_SortedArray(&d->tickers, &(iTicker){ context, root, ticker });
-    postRefresh_App();
+    postDamageRefresh_App();
 }
 
 void removeTicker_App(iTickerFunc ticker, iAny *context) {
@@ -2671,6 +2699,10 @@ iBookmarks *bookmarks_App(void) {
     return app_.bookmarks;
 }
 
+iLookupIndex *lookupIndex_App(void) {
+    return app_.lookupIndex;
+}
+
 static void updatePrefsThemeButtons_(iWidget *d) {
     for (size_t i = 0; i < max_ColorTheme; i++) {
         setFlags_Widget(findChild_Widget(d, format_CStr("prefs.theme.%u", i)),
@@ -3579,6 +3611,10 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         }
         return iTrue;
     }
+    else if (equal_Command(cmd, "feeds.concurrency.set")) {
+        d->prefs.maxFeedRequests = iClamp(arg_Command(cmd), 1, 32);
+        return iTrue;
+    }
     else if (equal_Command(cmd, "searchurl")) {
         iString *url = &d->prefs.strings[searchUrl_PrefsString];
         setCStr_String(url, suffixPtr_Command(cmd, "address"));
@@ -3673,6 +3709,9 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
     }
     else if (equal_Command(cmd, "bookmarks.changed")) {
         save_Bookmarks(d->bookmarks, dataDir_App_());
+        /* Feed entries show the bookmark's title and icon. */
+        invalidate_LookupIndex(d->lookupIndex,
+                               bookmarks_LookupIndexSource | feeds_LookupIndexSource);
         return iFalse;
     }
     else if (equal_Command(cmd, "bookmarks.sort")) {
@@ -3693,7 +3732,7 @@ static iBool handleNonWindowRelatedCommand_App_(iApp *d, const char *cmd) {
         return iTrue;
     }
     else if (equal_Command(cmd, "visited.changed")) {
-        save_Visited(d->visited, dataDir_App_());
+        flush_Visited(d->visited, dataDir_App_());
         return iFalse;
     }
     else if (equal_Command(cmd, "idents.changed")) {
@@ -4504,6 +4543,10 @@ iBool handleCommand_App(const char *cmd) {
         return iTrue;
     }
     else if (startsWith_CStr(cmd, "feeds.update.")) {
+        if (equal_Command(cmd, "feeds.update.finished") ||
+            equal_Command(cmd, "feeds.update.loaded")) {
+            invalidate_LookupIndex(d->lookupIndex, feeds_LookupIndexSource);
+        }
         const iWidget *navBar = findChild_Widget(get_Window()->roots[0]->widget, "navbar");
         iAnyObject *prog = findChild_Widget(navBar, "feeds.progress");
         if (!navBar || !prog) {
@@ -34,6 +34,7 @@ iDeclareType(Bookmarks)
 iDeclareType(DocumentWidget)
 iDeclareType(CommandLine)
 iDeclareType(GmCerts)
+iDeclareType(LookupIndex)
 iDeclareType(MainWindow)
 iDeclareType(MimeHooks)
 iDeclareType(Periodic)
@@ -101,6 +102,7 @@ const iCommandLine *commandLine_App     (void);
 iGmCerts *          certs_App           (void);
 iVisited *          visited_App         (void);
 iBookmarks *        bookmarks_App       (void);
+iLookupIndex *      lookupIndex_App     (void);
 iMimeHooks *        mimeHooks_App       (void);
 iPeriodic *         periodic_App        (void);
 iDocumentWidget *   document_App        (void);
@@ -151,7 +153,8 @@ void        removePopup_App     (iWindow *popup);
 void        closePopups_App     (iBool doForce);
 iWindow *   findWindow_App      (int windowType, const char *widgetId);
 
-void        postRefresh_App     (void);
+void        postRefresh_App     (void); /* redraws the entire window */
+void        postDamageRefresh_App(void); /* redraws only the areas passed to `damage_Window()` */
 void        postCommand_Root    (iRoot *, const char *command);
 void        postCommandf_Root   (iRoot *, const char *command, ...);
 void        postCommandf_App    (const char *command, ...);
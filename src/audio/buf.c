@@ -24,21 +24,98 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 iDefineTypeConstruction(InputBuf)
 
+#define spoolThreshold_InputBuf_  (256 * 1024)
+
 void init_InputBuf(iInputBuf *d) {
     init_Mutex(&d->mtx);
     init_Condition(&d->changed);
-    init_Block(&d->data, 0);
+    init_Block(&d->window, 0);
+    d->windowPos  = 0;
+    d->spool      = NULL;
+    d->canSpool   = iTrue;
     d->isComplete = iTrue;
 }
 
 void deinit_InputBuf(iInputBuf *d) {
-    deinit_Block(&d->data);
+    if (d->spool) {
+        fclose(d->spool); /* temporary file is deleted */
+    }
+    deinit_Block(&d->window);
     deinit_Condition(&d->changed);
     deinit_Mutex(&d->mtx);
 }
 
 size_t size_InputBuf(const iInputBuf *d) {
-    return size_Block(&d->data);
+    return d->windowPos + size_Block(&d->window);
+}
+
+size_t memorySize_InputBuf(const iInputBuf *d) {
+    return size_Block(&d->window);
+}
+
+void clear_InputBuf(iInputBuf *d) {
+    if (d->spool) {
+        fclose(d->spool);
+        d->spool = NULL;
+    }
+    clear_Block(&d->window);
+    d->windowPos = 0;
+    d->canSpool  = iTrue;
+}
+
+static void spool_InputBuf_(iInputBuf *d) {
+    if (isEmpty_Block(&d->window)) {
+        return;
+    }
+    if (!d->spool && d->canSpool) {
+        d->spool    = tmpfile();
+        d->canSpool = (d->spool != NULL);
+    }
+    if (d->spool) {
+        fseek(d->spool, 0, SEEK_END);
+        if (fwrite(constData_Block(&d->window), size_Block(&d->window), 1, d->spool) == 1) {
+            fflush(d->spool);
+            d->windowPos += size_Block(&d->window);
+            clear_Block(&d->window);
+        }
+    }
+}
+
+void append_InputBuf(iInputBuf *d, const void *data, size_t size) {
+    appendData_Block(&d->window, data, size);
+    if (size_Block(&d->window) >= spoolThreshold_InputBuf_) {
+        spool_InputBuf_(d);
+    }
+}
+
+void complete_InputBuf(iInputBuf *d) {
+    d->isComplete = iTrue;
+    spool_InputBuf_(d);
+}
+
+size_t read_InputBuf(iInputBuf *d, size_t pos, size_t size, void *data_out) {
+    const size_t total = size_InputBuf(d);
+    if (pos >= total) {
+        return 0;
+    }
+    size = iMin(size, total - pos);
+    char *out = data_out;
+    if (pos < d->windowPos) {
+        /* Spooled part. */
+        iAssert(d->spool);
+        const size_t n = iMin(size, d->windowPos - pos);
+        fseek(d->spool, (long) pos, SEEK_SET);
+        if (fread(out, n, 1, d->spool) != 1) {
+            return 0;
+        }
+        out += n;
+        pos += n;
+    }
+    if (out < (char *) data_out + size) {
+        memcpy(out, constData_Block(&d->window) + (pos - d->windowPos),
+               (char *) data_out + size - out);
+    }
+    return size;
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -52,18 +129,21 @@ void init_SampleBuf(iSampleBuf *d, SDL_AudioFormat format, size_t numChannels, s
     d->sampleSize  = SDL_AUDIO_BITSIZE(format) / 8 * numChannels;
     d->count       = count + 1; /* considered empty if head==tail */
     d->data        = malloc(d->sampleSize * d->count);
-    d->head        = 0;
-    d->tail        = 0;
-    init_Condition(&d->moreNeeded);
+    set_Atomic(&d->head, 0);
+    set_Atomic(&d->tail, 0);
+    set_Atomic(&d->isWaiting, iFalse);
+    d->moreNeeded  = SDL_CreateSemaphore(0);
 }
 
 void deinit_SampleBuf(iSampleBuf *d) {
-    deinit_Condition(&d->moreNeeded);
+    SDL_DestroySemaphore(d->moreNeeded);
     free(d->data);
 }
 
 size_t size_SampleBuf(const iSampleBuf *d) {
-    return d->head - d->tail;
+    const size_t head = value_Atomic(&d->head);
+    const size_t tail = value_Atomic(&d->tail);
+    return (head + d->count - tail) % d->count;
 }
 
 size_t vacancy_SampleBuf(const iSampleBuf *d) {
@@ -75,8 +155,9 @@ iBool isFull_SampleBuf(const iSampleBuf *d) {
 }
 
 void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
+    /* Note: Only called by the producer. */
     iAssert(n <= vacancy_SampleBuf(d));
-    const size_t headPos = d->head % d->count;
+    const size_t headPos = value_Atomic(&d->head);
     const size_t avail   = d->count - headPos;
     if (n > avail) {
         const char *in = samples;
@@ -87,12 +168,14 @@ void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
     else {
         memcpy(ptr_SampleBuf_(d, headPos), samples, d->sampleSize * n);
     }
-    d->head += n;
+    /* The samples are in place before they become visible to the consumer. */
+    set_Atomic(&d->head, (headPos + n) % d->count);
 }
 
 void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
+    /* Note: Only called by the consumer. */
     iAssert(n <= size_SampleBuf(d));
-    const size_t tailPos = d->tail % d->count;
+    const size_t tailPos = value_Atomic(&d->tail);
     const size_t avail   = d->count - tailPos;
     if (n > avail) {
         char *out = samples_out;
@@ -103,5 +186,28 @@ void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
     else {
         memcpy(samples_out, ptr_SampleBuf_(d, tailPos), d->sampleSize * n);
     }
-    d->tail += n;
+    set_Atomic(&d->tail, (tailPos + n) % d->count);
+}
+
+void waitVacancy_SampleBuf(iSampleBuf *d, size_t n, iSampleBufWaitFunc shouldWait,
+                           iAny *context) {
+    /* Note: Only called by the producer. Returns after the consumer has read something, if
+       there wasn't room for `n` samples. The flag is raised before checking the conditions,
+       so a wakeup for anything that happens after the check is not missed. */
+    set_Atomic(&d->isWaiting, iTrue);
+    if (vacancy_SampleBuf(d) < n && (!shouldWait || shouldWait(context))) {
+        SDL_SemWait(d->moreNeeded);
+    }
+    else if (!exchange_Atomic(&d->isWaiting, iFalse)) {
+        SDL_SemWait(d->moreNeeded); /* someone already took the flag and will post */
+    }
+}
+
+iBool wake_SampleBuf(iSampleBuf *d) {
+    /* Only the caller that takes down the flag posts, so posts never pile up. */
+    if (exchange_Atomic(&d->isWaiting, iFalse)) {
+        SDL_SemPost(d->moreNeeded);
+        return iTrue;
+    }
+    return iFalse;
 }
@@ -24,10 +24,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #if defined (LAGRANGE_ENABLE_AUDIO)
 
+#include "the_Foundation/atomic.h"
 #include "the_Foundation/block.h"
 #include "the_Foundation/mutex.h"
 
+#include <stdio.h>
+
 #include <SDL_audio.h>
+#include <SDL_mutex.h>
 
 iDeclareType(InputBuf)
 iDeclareType(SampleBuf)
@@ -39,27 +43,45 @@ iDeclareType(SampleBuf)
 #   define AUDIO_F64LSB     0x8140  /* 64-bit floating point samples */
 #endif
 
+/* Compressed audio stream, readable from any byte offset. Received data is collected in a
+   small in-memory window that is spooled to a temporary file when full, and when the input
+   is complete. If no temporary file can be created, everything is kept in memory.
+   Lock `mtx` when accessing. */
 struct Impl_InputBuf {
     iMutex     mtx;
     iCondition changed;
-    iBlock     data;
+    iBlock     window;      /* latest received data, not yet spooled */
+    size_t     windowPos;   /* stream offset of the first byte in `window` */
+    FILE *     spool;
+    iBool      canSpool;
     iBool      isComplete;
 };
 
 iDeclareTypeConstruction(InputBuf)
 
-size_t  size_InputBuf   (const iInputBuf *);
+size_t  size_InputBuf       (const iInputBuf *);
+size_t  memorySize_InputBuf (const iInputBuf *);
+void    clear_InputBuf      (iInputBuf *);
+void    append_InputBuf     (iInputBuf *, const void *data, size_t size);
+void    complete_InputBuf   (iInputBuf *);
+size_t  read_InputBuf       (iInputBuf *, size_t pos, size_t size, void *data_out);
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* Ring buffer with a single producer (the decoder thread) and a single consumer (the audio
+   callback). Neither side takes a lock: the producer only advances `head` and the consumer
+   only advances `tail`. A producer waiting for vacancy raises `isWaiting`; the consumer
+   calls `wake_SampleBuf` after reading, which posts `moreNeeded` only if it was raised. */
 struct Impl_SampleBuf {
     SDL_AudioFormat format;
     uint8_t         numChannels;
     uint8_t         sampleSize; /* as bytes; one sample includes values for all channels */
     void *          data;
     size_t          count;
-    size_t          head, tail;
-    iCondition      moreNeeded;
+    iAtomicInt      head; /* position in [0, count) */
+    iAtomicInt      tail;
+    iAtomicInt      isWaiting;
+    SDL_sem *       moreNeeded;
 };
 
 iDeclareTypeConstructionArgs(SampleBuf, SDL_AudioFormat format, size_t numChannels, size_t count)
@@ -75,4 +97,9 @@ iLocalDef void *ptr_SampleBuf_(iSampleBuf *d, size_t pos) {
 void    write_SampleBuf     (iSampleBuf *, const void *samples, const size_t n);
 void    read_SampleBuf      (iSampleBuf *, const size_t n, void *samples_out);
 
+typedef iBool (*iSampleBufWaitFunc)(iAny *context); /* False to stop waiting */
+
+void    waitVacancy_SampleBuf   (iSampleBuf *, size_t n, iSampleBufWaitFunc shouldWait, iAny *context);
+iBool   wake_SampleBuf          (iSampleBuf *); /* True if the producer was waiting */
+
 #endif /* LAGRANGE_ENABLE_AUDIO */
@@ -0,0 +1,252 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "mixer.h"
+#include "defs.h"
+
+#include <the_Foundation/ptrarray.h>
+#include <SDL.h>
+
+#define fixedOne_Mixer_     ((uint64_t) 1 << 32)
+
+struct Impl_MixerVoice {
+    iSampleBuf output;      /* written by the decoder, read by the audio callback */
+    float      volume;
+    iAtomicInt isPaused;
+    uint64_t   step;        /* source samples per device sample (32.32 fixed point) */
+    uint64_t   frac;        /* position between `frames` (32.32 fixed point) */
+    float      frames[2][2];/* two latest source samples, as stereo */
+    void *     input;       /* source samples read during one callback */
+    size_t     maxInput;
+};
+
+iDeclareType(Mixer)
+
+struct Impl_Mixer {
+    SDL_AudioDeviceID device;
+    SDL_AudioSpec     spec; /* always stereo AUDIO_F32SYS */
+    iPtrArray         voices;
+};
+
+static iMixer *mixer_;
+
+static void sample_MixerVoice_(const iMixerVoice *d, size_t index, float *out) {
+    const iSampleBuf *buf = &d->output;
+    const void *      in  = (const char *) d->input + buf->sampleSize * index;
+    for (size_t ch = 0; ch < buf->numChannels; ch++) {
+        switch (buf->format) {
+            case AUDIO_U8:
+                out[ch] = (((const uint8_t *) in)[ch] - 128) / 128.0f;
+                break;
+            case AUDIO_S16:
+                out[ch] = ((const int16_t *) in)[ch] / 32768.0f;
+                break;
+            case AUDIO_S32:
+                out[ch] = ((const int32_t *) in)[ch] / 2147483648.0f;
+                break;
+            default:
+                out[ch] = ((const float *) in)[ch];
+                break;
+        }
+    }
+    if (buf->numChannels == 1) {
+        out[1] = out[0];
+    }
+}
+
+static void mix_MixerVoice_(iMixerVoice *d, float *stream, size_t count) {
+    /* Resample linearly to the device rate. The exact number of source samples needed is
+       known beforehand, so a voice either plays the full period or is silent. */
+    const size_t numInput = (size_t) ((d->frac + count * d->step) >> 32);
+    if (numInput > d->maxInput || size_SampleBuf(&d->output) < numInput) {
+        return; /* underrun */
+    }
+    read_SampleBuf(&d->output, numInput, d->input);
+    const float volume = d->volume;
+    size_t      pos    = 0;
+    for (size_t i = 0; i < count; i++, stream += 2) {
+        const float t = (float) d->frac / (float) fixedOne_Mixer_;
+        for (size_t ch = 0; ch < 2; ch++) {
+            const float a = d->frames[0][ch];
+            stream[ch] += volume * (a + t * (d->frames[1][ch] - a));
+        }
+        for (d->frac += d->step; d->frac >= fixedOne_Mixer_; d->frac -= fixedOne_Mixer_) {
+            memcpy(d->frames[0], d->frames[1], sizeof(d->frames[0]));
+            sample_MixerVoice_(d, pos++, d->frames[1]);
+        }
+    }
+    iAssert(pos == numInput);
+}
+
+static void writeOutput_Mixer_(void *mixer, Uint8 *stream, int len) {
+    /* Note: Called in the audio thread, which must never block. */
+    iMixer *     d     = mixer;
+    float *      out   = (float *) stream;
+    const size_t count = len / (2 * sizeof(float));
+    memset(stream, 0, len);
+    iConstForEach(PtrArray, i, &d->voices) {
+        iMixerVoice *voice = i.ptr;
+        if (!value_Atomic(&voice->isPaused)) {
+            mix_MixerVoice_(voice, out, count);
+            wake_SampleBuf(&voice->output);
+        }
+    }
+    for (size_t i = 0; i < 2 * count; i++) {
+        out[i] = iClamp(out[i], -1.0f, 1.0f);
+    }
+}
+
+static iBool setupSDLAudio_(iBool init) {
+    static iBool isAudioInited_ = iFalse;
+    if (init && !isAudioInited_) {
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+            fprintf(stderr, "[SDL] audio init failed: %s\n", SDL_GetError());
+            return iFalse;
+        }
+        isAudioInited_ = iTrue;
+    }
+    else if (!init && isAudioInited_ && !isAndroid_Platform()) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        isAudioInited_ = iFalse;
+    }
+    return isAudioInited_;
+}
+
+static iBool open_Mixer_(void) {
+    if (mixer_) {
+        return iTrue;
+    }
+    if (!setupSDLAudio_(iTrue)) {
+        return iFalse;
+    }
+    iMixer *d = iMalloc(Mixer);
+    SDL_AudioSpec desired;
+    iZap(desired);
+    desired.freq     = 48000;
+    desired.format   = AUDIO_F32SYS;
+    desired.channels = 2;
+    desired.samples  = isAndroid_Platform() ? 16384 : 4096;
+    desired.callback = writeOutput_Mixer_;
+    desired.userdata = d;
+    d->device = SDL_OpenAudioDevice(NULL, SDL_FALSE /* playback */, &desired, &d->spec,
+                                    SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                        SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (!d->device) {
+        fprintf(stderr, "[SDL] failed to open audio device: %s\n", SDL_GetError());
+        free(d);
+        setupSDLAudio_(iFalse);
+        return iFalse;
+    }
+    init_PtrArray(&d->voices);
+    mixer_ = d;
+    return iTrue;
+}
+
+static void close_Mixer_(void) {
+    iMixer *d = mixer_;
+    iAssert(isEmpty_PtrArray(&d->voices));
+    SDL_CloseAudioDevice(d->device);
+    deinit_PtrArray(&d->voices);
+    free(d);
+    mixer_ = NULL;
+    setupSDLAudio_(iFalse);
+}
+
+static void updatePaused_Mixer_(iMixer *d) {
+    /* The device only runs while something is playing. */
+    iBool isPlaying = iFalse;
+    iConstForEach(PtrArray, i, &d->voices) {
+        if (!isPaused_MixerVoice(i.ptr)) {
+            isPlaying = iTrue;
+            break;
+        }
+    }
+    SDL_PauseAudioDevice(d->device, isPlaying ? SDL_FALSE : SDL_TRUE);
+}
+
+iMixerVoice *newVoice_Mixer(SDL_AudioFormat format, uint8_t numChannels, int freq) {
+    iAssert(numChannels == 1 || numChannels == 2);
+    if (!open_Mixer_()) {
+        return NULL;
+    }
+    iMixer *     d     = mixer_;
+    iMixerVoice *voice = iMalloc(MixerVoice);
+    voice->volume   = 1.0f;
+    set_Atomic(&voice->isPaused, iFalse);
+    voice->step     = ((uint64_t) freq << 32) / d->spec.freq;
+    voice->frac     = 0;
+    iZap(voice->frames);
+    voice->maxInput = (size_t) ((d->spec.samples * voice->step) >> 32) + 1;
+    /* Buffer at least half a second ahead, and always more than one period's worth. */
+    init_SampleBuf(&voice->output, format, numChannels, iMax(2 * voice->maxInput, (size_t) freq / 2));
+    voice->input = malloc(voice->output.sampleSize * voice->maxInput);
+    SDL_LockAudioDevice(d->device);
+    pushBack_PtrArray(&d->voices, voice);
+    SDL_UnlockAudioDevice(d->device);
+    updatePaused_Mixer_(d);
+    return voice;
+}
+
+void deleteVoice_Mixer(iMixerVoice *voice) {
+    if (!voice) return;
+    iMixer *d = mixer_;
+    iAssert(d);
+    SDL_LockAudioDevice(d->device);
+    removeOne_PtrArray(&d->voices, voice);
+    SDL_UnlockAudioDevice(d->device);
+    deinit_SampleBuf(&voice->output);
+    free(voice->input);
+    free(voice);
+    if (isEmpty_PtrArray(&d->voices)) {
+        close_Mixer_();
+    }
+    else {
+        updatePaused_Mixer_(d);
+    }
+}
+
+iSampleBuf *buffer_MixerVoice(iMixerVoice *d) {
+    return &d->output;
+}
+
+void flush_MixerVoice(iMixerVoice *d) {
+    /* Discard all buffered samples. Only the producer moves `head`, and the audio callback is
+       locked out, so the buffer can be emptied from this side. */
+    SDL_LockAudioDevice(mixer_->device);
+    set_Atomic(&d->output.tail, value_Atomic(&d->output.head));
+    d->frac = 0;
+    iZap(d->frames);
+    SDL_UnlockAudioDevice(mixer_->device);
+}
+
+iBool isPaused_MixerVoice(const iMixerVoice *d) {
+    return value_Atomic(&d->isPaused) != 0;
+}
+
+void setPaused_MixerVoice(iMixerVoice *d, iBool isPaused) {
+    set_Atomic(&d->isPaused, isPaused);
+    updatePaused_Mixer_(mixer_);
+}
+
+void setVolume_MixerVoice(iMixerVoice *d, float volume) {
+    d->volume = volume;
+}
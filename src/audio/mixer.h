@@ -0,0 +1,43 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "buf.h"
+
+/* All players share one output device. Each player is a voice of the mixer: the decoder
+   fills the voice's sample buffer, and the audio callback sums all unpaused voices,
+   converting them to the device's sample format and rate. The device is opened when the
+   first voice is created and closed when the last one is deleted.
+
+   Voices are created and deleted in the main thread. */
+
+iDeclareType(MixerVoice)
+
+iMixerVoice *   newVoice_Mixer      (SDL_AudioFormat format, uint8_t numChannels, int freq);
+void            deleteVoice_Mixer   (iMixerVoice *);
+
+iSampleBuf *    buffer_MixerVoice   (iMixerVoice *);
+void            flush_MixerVoice    (iMixerVoice *); /* call in the producer thread */
+iBool           isPaused_MixerVoice (const iMixerVoice *);
+void            setPaused_MixerVoice(iMixerVoice *, iBool isPaused);
+void            setVolume_MixerVoice(iMixerVoice *, float volume);
@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "player.h"
 #include "defs.h"
 #include "buf.h"
+#include "mixer.h"
 #include "lang.h"
 
 #define STB_VORBIS_HEADER_ONLY
@@ -46,17 +47,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(AVFAudioPlayer) /* iOS */
 
 iDeclareType(ContentSpec)
+iDeclareType(Decoder)
+iDeclareType(DecoderClass)
 
-enum iDecoderType {
-    none_DecoderType,
-    wav_DecoderType,
-    vorbis_DecoderType,
-    mpeg_DecoderType,
-    midi_DecoderType,
+enum iDecoderStatus {
+    ok_DecoderStatus,
+    needMoreInput_DecoderStatus,
+};
+
+/* Each supported format has a decoder class. The class whose probe best recognizes the
+   beginning of the stream is chosen, so the MIME type is only used as a hint. */
+struct Impl_DecoderClass {
+    const char *mediaTypes[6]; /* NULL-terminated; the first one is used when sniffing */
+    int       (*probe)      (iRangecc header); /* 0: not recognized, 100: certain */
+    iBool     (*contentSpec)(iContentSpec *, const iBlock *header);
+    enum iDecoderStatus
+              (*decode)     (iDecoder *, iRanges inputRange);
+    iBool     (*seek)       (iDecoder *, uint64_t *sample); /* sample may be adjusted */
+    void      (*deinit)     (iDecoder *);
 };
 
 struct Impl_ContentSpec {
-    enum iDecoderType type;
+    const iDecoderClass *decoder;
     SDL_AudioFormat   inputFormat;
     SDL_AudioSpec     output;
     size_t            totalInputSize;
@@ -64,25 +76,28 @@ struct Impl_ContentSpec {
     size_t            inputStartPos;
 };
 
-iDeclareType(Decoder)
-
 struct Impl_Decoder {
-    enum iDecoderType type;
-    float             gain;
+    const iDecoderClass *decoderClass;
+    iBool             isQuitting;
     iThread *         thread;
     SDL_AudioFormat   inputFormat;
     iInputBuf *       input;
-    size_t            inputPos;
+    size_t            inputPos; /* byte offset of the next input to decode */
+    size_t            inputStartPos; /* byte offset of the first encoded samples */
     size_t            totalInputSize;
+    iBlock            inputChunk; /* copy of input at `inputChunkPos` */
+    size_t            inputChunkPos;
+    int64_t           seekSample; /* requested seek, or -1; protected by `input->mtx` */
     unsigned int      outputFreq;
-    iSampleBuf        output;
-    iMutex            outputMutex;
+    iMixerVoice *     voice;
+    iSampleBuf *      output; /* owned by `voice` */
     iArray            pendingOutput;
     uint64_t          currentSample;
     uint64_t          totalSamples; /* zero if unknown */
     iMutex            tagMutex;
     iString           tags[max_PlayerTag];
     stb_vorbis *      vorbis;
+    size_t            vorbisHeaderSize;
 #if defined (LAGRANGE_ENABLE_MPG123)
     mpg123_handle *   mpeg;
     mpg123_id3v1 *    id3v1;
@@ -90,17 +105,49 @@ struct Impl_Decoder {
 #endif
 };
 
-enum iDecoderStatus {
-    ok_DecoderStatus,
-    needMoreInput_DecoderStatus,
-};
+#define inputChunkSize_Decoder_     (256 * 1024)
+#define vorbisFrameSize_Decoder_    (128 * 1024) /* larger than any Ogg page */
+
+static iRangecc input_Decoder_(iDecoder *d, size_t minSize) {
+    /* Input is read in chunks so the input buffer doesn't need to be locked for every decoded
+       frame. At least `minSize` bytes are returned if that much has been received. */
+    const size_t chunkEnd = d->inputChunkPos + size_Block(&d->inputChunk);
+    if (d->inputPos < d->inputChunkPos || d->inputPos + iMax(minSize, 1) > chunkEnd) {
+        lock_Mutex(&d->input->mtx);
+        resize_Block(&d->inputChunk, iMax(minSize, inputChunkSize_Decoder_));
+        truncate_Block(&d->inputChunk,
+                       read_InputBuf(d->input,
+                                     d->inputPos,
+                                     size_Block(&d->inputChunk),
+                                     data_Block(&d->inputChunk)));
+        d->inputChunkPos = d->inputPos;
+        unlock_Mutex(&d->input->mtx);
+    }
+    const char *chunk = constData_Block(&d->inputChunk);
+    return (iRangecc){ chunk + (d->inputPos - d->inputChunkPos),
+                       chunk + size_Block(&d->inputChunk) };
+}
+
+static void writePending_Decoder_(iDecoder *d) {
+    /* Write as much as we can. */
+    size_t avail = vacancy_SampleBuf(d->output);
+    size_t n = iMin(avail, size_Array(&d->pendingOutput));
+    write_SampleBuf(d->output, constData_Array(&d->pendingOutput), n);
+    removeN_Array(&d->pendingOutput, 0, n);
+    d->currentSample += n;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static size_t inputSampleSize_Decoder_(const iDecoder *d) {
+    return d->output->numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
+}
 
 static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
-    const uint8_t numChannels     = d->output.numChannels;
-    const size_t  inputSampleSize = numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
-    const size_t  vacancy         = vacancy_SampleBuf(&d->output);
-    const size_t  inputBytePos    = inputSampleSize * d->inputPos;
-    const size_t  avail           = (inputRange.end - inputBytePos) / inputSampleSize;
+    const uint8_t numChannels     = d->output->numChannels;
+    const size_t  inputSampleSize = inputSampleSize_Decoder_(d);
+    const size_t  vacancy         = vacancy_SampleBuf(d->output);
+    const size_t  avail           = (inputRange.end - inputRange.start) / inputSampleSize;
     if (avail == 0) {
         return needMoreInput_DecoderStatus;
     }
@@ -111,141 +158,233 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
     void *samples = malloc(inputSampleSize * n);
     /* Get a copy of the input for further processing. */ {
         lock_Mutex(&d->input->mtx);
-        iAssert(inputSampleSize * d->inputPos < size_Block(&d->input->data));
-        memcpy(samples,
-               constData_Block(&d->input->data) + inputSampleSize * d->inputPos,
-               inputSampleSize * n);
-        d->inputPos += n;
+        read_InputBuf(d->input, d->inputPos, inputSampleSize * n, samples);
+        d->inputPos += inputSampleSize * n;
         unlock_Mutex(&d->input->mtx);
     }
-    /* Gain. */ {
-        const float gain = d->gain;
+    /* Convert to the output format. Volume is applied by the mixer. */ {
         if (d->inputFormat == AUDIO_F64LSB) {
-            iAssert(d->output.format == AUDIO_F32);
+            iAssert(d->output->format == AUDIO_F32);
             double *inValue  = samples;
             float * outValue = samples;
             for (size_t count = numChannels * n; count; count--) {
-                *outValue++ = gain * *inValue++;
-            }
-        }
-        else if (d->inputFormat == AUDIO_F32) {
-            float *value = samples;
-            for (size_t count = numChannels * n; count; count--, value++) {
-                *value *= gain;
+                *outValue++ = *inValue++;
             }
         }
         else if (d->inputFormat == AUDIO_S24LSB) {
-            iAssert(d->output.format == AUDIO_S16);
+            iAssert(d->output->format == AUDIO_S16);
             const char *inValue  = samples;
             int16_t *   outValue = samples;
             for (size_t count = numChannels * n; count; count--, inValue += 3, outValue++) {
-                memcpy(outValue, inValue, 2);
-                *outValue *= gain;
-            }
-        }
-        else {
-            switch (SDL_AUDIO_BITSIZE(d->output.format)) {
-                case 8: {
-                    uint8_t *value = samples;
-                    for (size_t count = numChannels * n; count; count--, value++) {
-                        *value = (int) (*value - 127) * gain + 127;
-                    }
-                    break;
-                }
-                case 16: {
-                    int16_t *value = samples;
-                    for (size_t count = numChannels * n; count; count--, value++) {
-                        *value *= gain;
-                    }
-                    break;
-                }
-                case 32: {
-                    int32_t *value = samples;
-                    for (size_t count = numChannels * n; count; count--, value++) {
-                        *value *= gain;
-                    }
-                    break;
-                }
+                memcpy(outValue, inValue + 1, 2); /* most significant bytes */
             }
         }
     }
-    iGuardMutex(&d->outputMutex, write_SampleBuf(&d->output, samples, n));
+    write_SampleBuf(d->output, samples, n);
     d->currentSample += n;
     free(samples);
     return ok_DecoderStatus;
 }
 
-static void writePending_Decoder_(iDecoder *d) {
-    /* Write as much as we can. */
-    lock_Mutex(&d->outputMutex);
-    size_t avail = vacancy_SampleBuf(&d->output);
-    size_t n = iMin(avail, size_Array(&d->pendingOutput));
-    write_SampleBuf(&d->output, constData_Array(&d->pendingOutput), n);
-    removeN_Array(&d->pendingOutput, 0, n);
-    unlock_Mutex(&d->outputMutex);
-    d->currentSample += n;
+static int probeWav_(iRangecc header) {
+    if (size_Range(&header) >= 12 && !memcmp(header.start, "RIFF", 4) &&
+        !memcmp(header.start + 8, "WAVE", 4)) {
+        return 100;
+    }
+    return 0;
+}
+
+static iBool contentSpecWav_(iContentSpec *content, const iBlock *header) {
+    if (size_Block(header) < 44) {
+        return iFalse;
+    }
+    iBuffer *buf = iClob(new_Buffer());
+    open_Buffer(buf, header);
+    /* Read the RIFF/WAVE header. */
+    iStream *is = stream_Buffer(buf);
+    char magic[4];
+    readData_Buffer(buf, 4, magic);
+    if (memcmp(magic, "RIFF", 4)) {
+        /* Not WAV. */
+        return iFalse;
+    }
+    content->totalInputSize = readU32_Stream(is); /* file size */
+    readData_Buffer(buf, 4, magic);
+    if (memcmp(magic, "WAVE", 4)) {
+        /* Not WAV. */
+        return iFalse;
+    }
+    /* Read all the chunks. */
+    int16_t blockAlign = 0;
+    while (!atEnd_Buffer(buf)) {
+        readData_Buffer(buf, 4, magic);
+        const size_t size = read32_Stream(is);
+        if (memcmp(magic, "fmt ", 4) == 0) {
+            if (size != 16 && size != 18) {
+                return iFalse;
+            }
+            enum iWavFormat {
+                pcm_WavFormat = 1,
+                ieeeFloat_WavFormat = 3,
+            };
+            const int16_t  mode           = read16_Stream(is); /* 1 = PCM, 3 = IEEE_FLOAT */
+            const int16_t  numChannels    = read16_Stream(is);
+            const int32_t  freq           = read32_Stream(is);
+            const uint32_t bytesPerSecond = readU32_Stream(is);
+            blockAlign                    = read16_Stream(is);
+            const int16_t  bitsPerSample  = read16_Stream(is);
+            const uint16_t extSize        = (size == 18 ? readU16_Stream(is) : 0);
+            iUnused(bytesPerSecond);
+            if (mode != pcm_WavFormat && mode != ieeeFloat_WavFormat) { /* PCM or float */
+                return iFalse;
+            }
+            if (extSize != 0) {
+                return iFalse;
+            }
+            if (numChannels != 1 && numChannels != 2) {
+                return iFalse;
+            }
+            if (bitsPerSample != 8 && bitsPerSample != 16 && bitsPerSample != 24 &&
+                bitsPerSample != 32 && bitsPerSample != 64) {
+                return iFalse;
+            }
+            if (bitsPerSample == 24 && blockAlign != 3 * numChannels) {
+                return iFalse;
+            }
+            content->output.freq     = freq;
+            content->output.channels = numChannels;
+            if (mode == ieeeFloat_WavFormat) {
+                content->inputFormat   = (bitsPerSample == 32 ? AUDIO_F32 : AUDIO_F64LSB);
+                content->output.format = AUDIO_F32;
+            }
+            else if (bitsPerSample == 24) {
+                content->inputFormat   = AUDIO_S24LSB;
+                content->output.format = AUDIO_S16;
+            }
+            else {
+                content->inputFormat = content->output.format =
+                    (bitsPerSample == 8 ? AUDIO_U8
+                                        : bitsPerSample == 16 ? AUDIO_S16 : AUDIO_S32);
+            }
+        }
+        else if (memcmp(magic, "data", 4) == 0) {
+            content->inputStartPos = pos_Stream(is);
+            content->totalSamples  = (uint64_t) size / blockAlign;
+            break;
+        }
+        else {
+            seek_Stream(is, pos_Stream(is) + size);
+        }
+    }
+    return content->inputStartPos != 0;
+}
+
+static iBool seekWav_Decoder_(iDecoder *d, uint64_t *sample) {
+    d->inputPos = d->inputStartPos + *sample * inputSampleSize_Decoder_(d);
+    return iTrue;
+}
+
+static const iDecoderClass wavDecoderClass_ = {
+    .mediaTypes  = { "audio/wav", "audio/wave", "audio/x-wav", "audio/x-pn-wav", NULL },
+    .probe       = probeWav_,
+    .contentSpec = contentSpecWav_,
+    .decode      = decodeWav_Decoder_,
+    .seek        = seekWav_Decoder_,
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void readVorbisTags_Decoder_(iDecoder *d) {
+    const stb_vorbis_comment com = stb_vorbis_get_comment(d->vorbis);
+    lock_Mutex(&d->tagMutex);
+    for (int i = 0; i < com.comment_list_length; ++i) {
+        const char *comStr = com.comment_list[i];
+        if (!iCmpStrN(comStr, "ARTIST=", 7)) {
+            setCStr_String(&d->tags[artist_PlayerTag], comStr + 7);
+        }
+        else if (!iCmpStrN(comStr, "DATE=", 5)) {
+            setCStr_String(&d->tags[date_PlayerTag], comStr + 5);
+        }
+        else if (!iCmpStrN(comStr, "TITLE=", 6)) {
+            setCStr_String(&d->tags[title_PlayerTag], comStr + 6);
+        }
+        else if (!iCmpStrN(comStr, "GENRE=", 6)) {
+            setCStr_String(&d->tags[genre_PlayerTag], comStr + 6);
+        }
+    }
+    unlock_Mutex(&d->tagMutex);
 }
 
-static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
-    const iBlock *input = &d->input->data;
+static uint64_t lastGranulePos_Ogg_(iRangecc data) {
+    /* The granule position of the last page is the length of the stream in samples. */
+    if (size_Range(&data) < 27) {
+        return 0;
+    }
+    for (const char *page = data.end - 27; page >= data.start; page--) {
+        if (!memcmp(page, "OggS", 4)) {
+            uint64_t granulePos = 0;
+            for (int i = 7; i >= 0; i--) {
+                granulePos = (granulePos << 8) | (uint8_t) page[6 + i];
+            }
+            if (granulePos != UINT64_MAX) { /* -1: no packet finishes on this page */
+                return granulePos;
+            }
+        }
+    }
+    return 0;
+}
+
+static void checkVorbisLength_Decoder_(iDecoder *d) {
+    /* Only the end of the stream needs to be looked at. */
+    iBlock *tail = new_Block(0);
+    lock_Mutex(&d->input->mtx);
+    if (d->input->isComplete) {
+        d->totalInputSize = size_InputBuf(d->input);
+        const size_t tailSize = iMin(d->totalInputSize, vorbisFrameSize_Decoder_);
+        resize_Block(tail, tailSize);
+        read_InputBuf(d->input, d->totalInputSize - tailSize, tailSize, data_Block(tail));
+    }
+    unlock_Mutex(&d->input->mtx);
+    d->totalSamples = lastGranulePos_Ogg_(range_Block(tail));
+    delete_Block(tail);
+}
+
+static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d, iRanges inputRange) {
+    iUnused(inputRange);
     if (!d->vorbis) {
-        lock_Mutex(&d->input->mtx);
+        /* All the headers must be available at once. */
+        const iRangecc input = input_Decoder_(d, d->vorbisHeaderSize);
         int error;
         int consumed;
         d->vorbis = stb_vorbis_open_pushdata(
-            constData_Block(input), (int) size_Block(input), &consumed, &error, NULL);
+            (const uint8_t *) input.start, (int) size_Range(&input), &consumed, &error, NULL);
         if (!d->vorbis) {
+            if (error == VORBIS_need_more_data && size_Range(&input) >= d->vorbisHeaderSize) {
+                d->vorbisHeaderSize *= 2; /* there may be cover art in the comments */
+                return ok_DecoderStatus;
+            }
             return needMoreInput_DecoderStatus;
         }
         d->inputPos += consumed;
-        unlock_Mutex(&d->input->mtx);
-        /* Check the metadata. */ {
-            const stb_vorbis_comment com = stb_vorbis_get_comment(d->vorbis);
-            //        printf("vendor: {%s}\n", comment.vendor);
-            lock_Mutex(&d->tagMutex);
-            for (int i = 0; i < com.comment_list_length; ++i) {
-                const char *comStr = com.comment_list[i];
-                if (!iCmpStrN(comStr, "ARTIST=", 7)) {
-                    setCStr_String(&d->tags[artist_PlayerTag], comStr + 7);
-                }
-                else if (!iCmpStrN(comStr, "DATE=", 5)) {
-                    setCStr_String(&d->tags[date_PlayerTag], comStr + 5);
-                }
-                else if (!iCmpStrN(comStr, "TITLE=", 6)) {
-                    setCStr_String(&d->tags[title_PlayerTag], comStr + 6);
-                }
-                else if (!iCmpStrN(comStr, "GENRE=", 6)) {
-                    setCStr_String(&d->tags[genre_PlayerTag], comStr + 6);
-                }
-            }
-            unlock_Mutex(&d->tagMutex);
-        }
+        d->inputStartPos = d->inputPos;
+        readVorbisTags_Decoder_(d);
     }
-    if (d->totalSamples == 0 && d->input->isComplete) {
-        /* Time to check the stream size. */
-        lock_Mutex(&d->input->mtx);
-        d->totalInputSize = size_Block(input);
-        int error = 0;
-        stb_vorbis *vrb = stb_vorbis_open_memory(constData_Block(input), (int) size_Block(input),
-                                                 &error, NULL);
-        if (vrb) {
-            d->totalSamples = stb_vorbis_stream_length_in_samples(vrb);
-            stb_vorbis_close(vrb);
-        }
-        unlock_Mutex(&d->input->mtx);
+    if (d->totalInputSize == 0) {
+        checkVorbisLength_Decoder_(d);
     }
     enum iDecoderStatus status = ok_DecoderStatus;
-    while (size_Array(&d->pendingOutput) < d->output.count) {
+    while (size_Array(&d->pendingOutput) < d->output->count) {
         /* Try to decode some input. */
-        lock_Mutex(&d->input->mtx);
-        int     count     = 0;
-        float **samples   = NULL;
-        int     remaining = d->inputPos < size_Block(input) ? size_Block(input) - d->inputPos : 0;
-        int     consumed  = stb_vorbis_decode_frame_pushdata(
-            d->vorbis, constData_Block(input) + d->inputPos, remaining, NULL, &samples, &count);
+        const iRangecc input     = input_Decoder_(d, vorbisFrameSize_Decoder_);
+        int            count     = 0;
+        float **       samples   = NULL;
+        const int      consumed  = stb_vorbis_decode_frame_pushdata(d->vorbis,
+                                                                    (const uint8_t *) input.start,
+                                                                    (int) size_Range(&input),
+                                                                    NULL,
+                                                                    &samples,
+                                                                    &count);
         d->inputPos += consumed;
-        iAssert(d->inputPos <= size_Block(input));
-        unlock_Mutex(&d->input->mtx);
         if (count == 0) {
             if (consumed == 0) {
                 status = needMoreInput_DecoderStatus;
@@ -253,12 +392,11 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
             }
             else continue;
         }
-        /* Apply gain. */ {
-            const float gain = d->gain;
+        /* Interleave the channels. */ {
             float sample[2];
             for (size_t i = 0; i < (size_t) count; ++i) {
-                for (size_t chan = 0; chan < d->output.numChannels; chan++) {
-                    sample[chan] = samples[chan][i] * gain;
+                for (size_t chan = 0; chan < d->output->numChannels; chan++) {
+                    sample[chan] = samples[chan][i];
                 }
                 pushBack_Array(&d->pendingOutput, sample);
             }
@@ -268,53 +406,115 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
     return status;
 }
 
+static int probeVorbis_(iRangecc header) {
+    /* The identification header is in the first Ogg page. */
+    if (size_Range(&header) < 35 || memcmp(header.start, "OggS", 4)) {
+        return 0;
+    }
+    const iRangecc firstPage = { header.start, header.start + iMin(size_Range(&header), 512) };
+    for (const char *pos = firstPage.start; pos + 7 <= firstPage.end; pos++) {
+        if (!memcmp(pos, "\x01vorbis", 7)) {
+            return 100;
+        }
+    }
+    return 0; /* some other codec, like Opus */
+}
+
+static iBool contentSpecVorbis_(iContentSpec *content, const iBlock *header) {
+    /* Try to decode what we have and see if it looks like Vorbis. */
+    int consumed = 0;
+    int error = 0;
+    stb_vorbis *vrb = stb_vorbis_open_pushdata(
+        constData_Block(header), (int) size_Block(header), &consumed, &error, NULL);
+    if (!vrb) {
+        return iFalse;
+    }
+    const stb_vorbis_info info = stb_vorbis_get_info(vrb);
+    stb_vorbis_close(vrb);
+    if (info.channels != 1 && info.channels != 2) {
+        return iFalse;
+    }
+    content->output.freq     = info.sample_rate;
+    content->output.channels = info.channels;
+    content->output.format   = AUDIO_F32;
+    content->inputFormat     = AUDIO_F32; /* actually stb_vorbis provides floats */
+    return iTrue;
+}
+
+static iBool seekVorbis_Decoder_(iDecoder *d, uint64_t *sample) {
+    if (*sample == 0) {
+        /* Start over by reopening the stream. */
+        if (d->vorbis) {
+            stb_vorbis_close(d->vorbis);
+            d->vorbis = NULL;
+        }
+        d->inputPos = 0;
+        return iTrue;
+    }
+    if (d->vorbis && d->totalSamples && d->totalInputSize > d->inputStartPos) {
+        /* Estimate the position; decoding resumes at the next page. */
+        d->inputPos = d->inputStartPos +
+                      (size_t) ((double) *sample / (double) d->totalSamples *
+                                (double) (d->totalInputSize - d->inputStartPos));
+        stb_vorbis_flush_pushdata(d->vorbis);
+        return iTrue;
+    }
+    return iFalse;
+}
+
+static void deinitVorbis_Decoder_(iDecoder *d) {
+    if (d->vorbis) {
+        stb_vorbis_close(d->vorbis);
+    }
+}
+
+static const iDecoderClass vorbisDecoderClass_ = {
+    .mediaTypes  = { "audio/ogg", "audio/vorbis", "audio/x-vorbis+ogg", NULL },
+    .probe       = probeVorbis_,
+    .contentSpec = contentSpecVorbis_,
+    .decode      = decodeVorbis_Decoder_,
+    .seek        = seekVorbis_Decoder_,
+    .deinit      = deinitVorbis_Decoder_,
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
 #if defined (LAGRANGE_ENABLE_MPG123)
 static const char *mpegStr_(const mpg123_string *str) {
     return str ? str->p : "";
 }
-#endif
-
-enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
+static enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d, iRanges inputRange) {
+    iUnused(inputRange);
     enum iDecoderStatus status = ok_DecoderStatus;
-#if defined (LAGRANGE_ENABLE_MPG123)
-    const iBlock *input = &d->input->data;
     if (!d->mpeg) {
-        d->inputPos = 0;
         d->mpeg = mpg123_new(NULL, NULL);
         mpg123_format_none(d->mpeg);
-        mpg123_format(d->mpeg, d->outputFreq, d->output.numChannels, MPG123_ENC_SIGNED_16);
+        mpg123_format(d->mpeg, d->outputFreq, d->output->numChannels, MPG123_ENC_SIGNED_16);
         mpg123_open_feed(d->mpeg);
     }
-    /* Feed more input. */ {
+    if (d->totalInputSize == 0) {
+        /* Knowing the size improves the length estimate and seek offsets. */
         lock_Mutex(&d->input->mtx);
         if (d->input->isComplete) {
-            d->totalInputSize = size_Block(input);
-        }
-        if (d->inputPos < size_Block(input)) {
-            mpg123_feed(d->mpeg, constData_Block(input) + d->inputPos, size_Block(input) - d->inputPos);
-            if (d->inputPos == 0) {
-                long r; int ch, enc;
-                mpg123_getformat(d->mpeg, &r, &ch, &enc);
-                iAssert(r == d->outputFreq);
-                iAssert(ch == d->output.numChannels);
-                iAssert(enc == MPG123_ENC_SIGNED_16);
-            }
-            d->inputPos = size_Block(input);
+            d->totalInputSize = size_InputBuf(d->input);
+            mpg123_set_filesize(d->mpeg, (off_t) d->totalInputSize);
         }
         unlock_Mutex(&d->input->mtx);
     }
-    while (size_Array(&d->pendingOutput) < d->output.count) {
+    while (size_Array(&d->pendingOutput) < d->output->count) {
         int16_t buffer[512];
         size_t bytesRead = 0;
         const int rc = mpg123_read(d->mpeg, (uint8_t *) buffer, sizeof(buffer), &bytesRead);
-        const float gain = d->gain;
-        for (size_t i = 0; i < bytesRead / 2; i++) {
-            buffer[i] *= gain;
-        }
-        pushBackN_Array(&d->pendingOutput, buffer, bytesRead / 2 / d->output.numChannels);
+        pushBackN_Array(&d->pendingOutput, buffer, bytesRead / 2 / d->output->numChannels);
         if (rc == MPG123_NEED_MORE) {
-            status = needMoreInput_DecoderStatus;
-            break;
+            /* Feed one chunk at a time so mpg123 doesn't end up buffering the whole stream. */
+            const iRangecc input = input_Decoder_(d, 0);
+            if (isEmpty_Range(&input)) {
+                status = needMoreInput_DecoderStatus;
+                break;
+            }
+            mpg123_feed(d->mpeg, (const uint8_t *) input.start, size_Range(&input));
+            d->inputPos += size_Range(&input);
         }
         else if (rc == MPG123_DONE || bytesRead == 0) {
             break;
@@ -339,115 +539,224 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
         d->totalSamples = off;
     }
     writePending_Decoder_(d);
-#endif
     return status;
 }
 
+static int probeMpeg_(iRangecc header) {
+    const uint8_t *bytes = (const uint8_t *) header.start;
+    if (size_Range(&header) >= 3 && !memcmp(bytes, "ID3", 3)) {
+        return 75; /* ID3 tags are mostly used with MP3 */
+    }
+    if (size_Range(&header) >= 4 && bytes[0] == 0xff && (bytes[1] & 0xe0) == 0xe0 &&
+        (bytes[1] & 0x06) != 0 /* layer */ && (bytes[2] & 0xf0) != 0xf0 /* bitrate */) {
+        return 50; /* frame sync */
+    }
+    return 0;
+}
+
+static iBool contentSpecMpeg_(iContentSpec *content, const iBlock *header) {
+    mpg123_handle *mh = mpg123_new(NULL, NULL);
+    mpg123_open_feed(mh);
+    mpg123_feed(mh, constData_Block(header), size_Block(header));
+    long rate     = 0;
+    int  channels = 0;
+    int  encoding = 0;
+    const iBool ok = (mpg123_getformat(mh, &rate, &channels, &encoding) == MPG123_OK);
+    if (ok) {
+        content->output.freq     = rate;
+        content->output.channels = channels;
+        content->inputFormat     = AUDIO_S16;
+        content->output.format   = AUDIO_S16;
+    }
+    mpg123_close(mh);
+    mpg123_delete(mh);
+    return ok;
+}
+
+static iBool seekMpeg_Decoder_(iDecoder *d, uint64_t *sample) {
+    off_t inputOffset = 0;
+    const off_t pos =
+        d->mpeg ? mpg123_feedseek(d->mpeg, (off_t) *sample, SEEK_SET, &inputOffset) : -1;
+    if (pos < 0) {
+        return iFalse;
+    }
+    d->inputPos = (size_t) inputOffset;
+    *sample     = (uint64_t) pos;
+    return iTrue;
+}
+
+static void deinitMpeg_Decoder_(iDecoder *d) {
+    if (d->mpeg) {
+        mpg123_close(d->mpeg);
+        mpg123_delete(d->mpeg);
+    }
+}
+
+static const iDecoderClass mpegDecoderClass_ = {
+    .mediaTypes  = { "audio/mpeg", "audio/mp3", NULL },
+    .probe       = probeMpeg_,
+    .contentSpec = contentSpecMpeg_,
+    .decode      = decodeMpeg_Decoder_,
+    .seek        = seekMpeg_Decoder_,
+    .deinit      = deinitMpeg_Decoder_,
+};
+#endif /* LAGRANGE_ENABLE_MPG123 */
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Opus and FLAC would be added here; the decoder thread only goes through the class. */
+static const iDecoderClass *decoderClasses_[] = {
+    &wavDecoderClass_,
+    &vorbisDecoderClass_,
+#if defined (LAGRANGE_ENABLE_MPG123)
+    &mpegDecoderClass_,
+#endif
+};
+
+static int score_DecoderClass_(const iDecoderClass *d, iRangecc header, iRangecc mediaType) {
+    int score = d->probe(header);
+    for (const char *const *mt = d->mediaTypes; *mt; mt++) {
+        if (equalCase_Rangecc(mediaType, *mt)) {
+            score += 25; /* the stream may just be too short to recognize yet */
+            break;
+        }
+    }
+    return score;
+}
+
+static const iDecoderClass *find_DecoderClass_(iRangecc header, iRangecc mediaType) {
+    const iDecoderClass *best      = NULL;
+    int                  bestScore = 0;
+    iForIndices(i, decoderClasses_) {
+        const int score = score_DecoderClass_(decoderClasses_[i], header, mediaType);
+        if (score > bestScore) {
+            best      = decoderClasses_[i];
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+static iBool seek_Decoder_(iDecoder *d, uint64_t sample) {
+    if (d->totalSamples) {
+        sample = iMin(sample, d->totalSamples);
+    }
+    if (!d->decoderClass->seek || !d->decoderClass->seek(d, &sample)) {
+        return iFalse;
+    }
+    clear_Array(&d->pendingOutput);
+    flush_MixerVoice(d->voice);
+    d->currentSample = sample;
+    return iTrue;
+}
+
+static iBool shouldWaitVacancy_Decoder_(iAny *context) {
+    iDecoder *d = context;
+    iBool wait;
+    lock_Mutex(&d->input->mtx);
+    wait = !d->isQuitting && d->seekSample < 0;
+    unlock_Mutex(&d->input->mtx);
+    return wait;
+}
+
 static iThreadResult run_Decoder_(iThread *thread) {
     iDecoder *d = userData_Thread(thread);
-    while (d->type) {
-        /* Check amount of data available. */
+    while (!d->isQuitting) {
+        /* Check amount of data available and whether to seek. */
         lock_Mutex(&d->input->mtx);
         size_t inputSize = size_InputBuf(d->input);
+        const int64_t seekSample = d->seekSample;
+        d->seekSample = -1;
         unlock_Mutex(&d->input->mtx);
-        iRanges inputRange = { d->inputPos, inputSize };
-        iAssert(inputRange.start <= inputRange.end);
-        if (!d->type) break;
-        /* Have data to work on and a place to save output? */
-        enum iDecoderStatus status = ok_DecoderStatus;
-        switch (d->type) {
-            case wav_DecoderType:
-                status = decodeWav_Decoder_(d, inputRange);
-                break;
-            case vorbis_DecoderType:
-                status = decodeVorbis_Decoder_(d);
-                break;
-            case mpeg_DecoderType:
-                status = decodeMpeg_Decoder_(d);
-                break;
-            default:
-                break;
+        if (d->isQuitting) break;
+        if (seekSample >= 0) {
+            seek_Decoder_(d, (uint64_t) seekSample);
         }
+        iRanges inputRange = { d->inputPos, iMax(d->inputPos, inputSize) };
+        /* Have data to work on and a place to save output? */
+        const enum iDecoderStatus status = d->decoderClass->decode(d, inputRange);
         if (status == needMoreInput_DecoderStatus) {
             lock_Mutex(&d->input->mtx);
-            if (size_InputBuf(d->input) == inputSize) {
+            if (!d->isQuitting && size_InputBuf(d->input) == inputSize &&
+                d->seekSample < 0) {
                 wait_Condition(&d->input->changed, &d->input->mtx);
             }
             unlock_Mutex(&d->input->mtx);
         }
-        else {
-            iGuardMutex(
-                &d->outputMutex, if (isFull_SampleBuf(&d->output)) {
-                    wait_Condition(&d->output.moreNeeded, &d->outputMutex);
-                });
+        else if (isFull_SampleBuf(d->output)) {
+            waitVacancy_SampleBuf(d->output, 1, shouldWaitVacancy_Decoder_, d);
         }
     }
     return 0;
 }
 
-void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
-    d->type           = spec->type;
-    d->gain           = 1.0f;
+static void requestSeek_Decoder_(iDecoder *d, uint64_t sample) {
+    lock_Mutex(&d->input->mtx);
+    d->seekSample = (int64_t) sample;
+    signal_Condition(&d->input->changed);
+    unlock_Mutex(&d->input->mtx);
+    wake_SampleBuf(d->output);
+}
+
+void init_Decoder(iDecoder *d, iInputBuf *input, iMixerVoice *voice, const iContentSpec *spec) {
+    d->decoderClass   = spec->decoder;
+    d->isQuitting     = iFalse;
     d->input          = input;
     d->inputPos       = spec->inputStartPos;
+    d->inputStartPos  = spec->inputStartPos;
     d->inputFormat    = spec->inputFormat;
     d->totalInputSize = spec->totalInputSize;
+    init_Block(&d->inputChunk, 0);
+    d->inputChunkPos  = 0;
+    d->seekSample     = -1;
     d->outputFreq     = spec->output.freq;
     d->currentSample  = 0;
     d->totalSamples   = spec->totalSamples;
     init_Array(&d->pendingOutput, spec->output.channels * SDL_AUDIO_BITSIZE(spec->output.format) / 8);
-    init_SampleBuf(&d->output,
-                   spec->output.format,
-                   spec->output.channels,
-                   spec->output.samples * 2);
+    d->voice          = voice;
+    d->output         = buffer_MixerVoice(voice);
     init_Mutex(&d->tagMutex);
     iForIndices(i, d->tags) {
         init_String(&d->tags[i]);
     }
     d->vorbis = NULL;
+    d->vorbisHeaderSize = vorbisFrameSize_Decoder_;
 #if defined (LAGRANGE_ENABLE_MPG123)
     d->mpeg  = NULL;
     d->id3v1 = NULL;
     d->id3v2 = NULL;
 #endif
-    init_Mutex(&d->outputMutex);
     d->thread = new_Thread(run_Decoder_);
     setUserData_Thread(d->thread, d);
     start_Thread(d->thread);
 }
 
 void deinit_Decoder(iDecoder *d) {
-    d->type = none_DecoderType;
-    signal_Condition(&d->output.moreNeeded);
+    iGuardMutex(&d->input->mtx, d->isQuitting = iTrue);
+    wake_SampleBuf(d->output);
     signal_Condition(&d->input->changed);
     join_Thread(d->thread);
     iRelease(d->thread);
-    deinit_Mutex(&d->outputMutex);
-    deinit_SampleBuf(&d->output);
     deinit_Array(&d->pendingOutput);
+    deinit_Block(&d->inputChunk);
     iForIndices(i, d->tags) {
         deinit_String(&d->tags[i]);
     }
     deinit_Mutex(&d->tagMutex);
-    if (d->vorbis) {
-        stb_vorbis_close(d->vorbis);
-    }
-#if defined (LAGRANGE_ENABLE_MPG123)
-    if (d->mpeg) {
-        mpg123_close(d->mpeg);
-        mpg123_delete(d->mpeg);
+    if (d->decoderClass->deinit) {
+        d->decoderClass->deinit(d);
     }
-#endif
 }
 
-iDefineTypeConstructionArgs(Decoder, (iInputBuf *input, const iContentSpec *spec),
-                            input, spec)
+iDefineTypeConstructionArgs(Decoder,
+                            (iInputBuf *input, iMixerVoice *voice, const iContentSpec *spec),
+                            input, voice, spec)
 
 /*----------------------------------------------------------------------------------------------*/
 
 struct Impl_Player {
-    SDL_AudioSpec     spec;
-    SDL_AudioDeviceID device;
+    SDL_AudioSpec     spec; /* of the source */
+    iMixerVoice *     voice;
     iString           mime;
     float             volume;
     int               flags;
@@ -461,13 +770,7 @@ static iPlayer *activePlayer_;
 
 iDefineTypeConstruction(Player)
 
-static size_t sampleSize_Player_(const iPlayer *d) {
-    return d->spec.channels * SDL_AUDIO_BITSIZE(d->spec.format) / 8;
-}
-
-static int silence_Player_(const iPlayer *d) {
-    return d->spec.silence;
-}
+#define maxHeaderSize_Player_   (4 * 1024 * 1024)
 
 static iRangecc mediaType_(const iString *str) {
     iRangecc part = iNullRange;
@@ -478,173 +781,27 @@ static iRangecc mediaType_(const iString *str) {
 static iContentSpec contentSpec_Player_(const iPlayer *d) {
     iContentSpec content;
     iZap(content);
-    const size_t dataSize = size_InputBuf(d->data);
-    iBuffer *buf = iClob(new_Buffer());
-    open_Buffer(buf, &d->data->data);
-    const iRangecc mediaType = mediaType_(&d->mime);
-    if (equal_Rangecc(mediaType, "audio/wave") || equal_Rangecc(mediaType, "audio/wav") ||
-        equal_Rangecc(mediaType, "audio/x-wav") || equal_Rangecc(mediaType, "audio/x-pn-wav")) {
-        content.type = wav_DecoderType;
-    }
-    else if (equal_Rangecc(mediaType, "audio/vorbis") || equal_Rangecc(mediaType, "audio/ogg") ||
-             equal_Rangecc(mediaType, "audio/x-vorbis+ogg")) {
-        content.type = vorbis_DecoderType;
-    }
-#if defined (LAGRANGE_ENABLE_MPG123)
-    else if (equal_Rangecc(mediaType, "audio/mpeg") || equal_Rangecc(mediaType, "audio/mp3")) {
-        content.type = mpeg_DecoderType;
-    }
-#endif
-    else {
-        /* TODO: Could try decoders to see if one works? */
-        content.type = none_DecoderType;
-    }
-    if (content.type == wav_DecoderType && dataSize >= 44) {
-        /* Read the RIFF/WAVE header. */
-        iStream *is = stream_Buffer(buf);
-        char magic[4];
-        readData_Buffer(buf, 4, magic);
-        if (memcmp(magic, "RIFF", 4)) {
-            /* Not WAV. */
-            return content;
-        }
-        content.totalInputSize = readU32_Stream(is); /* file size */
-        readData_Buffer(buf, 4, magic);
-        if (memcmp(magic, "WAVE", 4)) {
-            /* Not WAV. */
-            return content;
-        }
-        /* Read all the chunks. */
-        int16_t blockAlign = 0;
-        while (!atEnd_Buffer(buf)) {
-            readData_Buffer(buf, 4, magic);
-            const size_t size = read32_Stream(is);
-            if (memcmp(magic, "fmt ", 4) == 0) {
-                if (size != 16 && size != 18) {
-                    return content;
-                }
-                enum iWavFormat {
-                    pcm_WavFormat = 1,
-                    ieeeFloat_WavFormat = 3,
-                };
-                const int16_t  mode           = read16_Stream(is); /* 1 = PCM, 3 = IEEE_FLOAT */
-                const int16_t  numChannels    = read16_Stream(is);
-                const int32_t  freq           = read32_Stream(is);
-                const uint32_t bytesPerSecond = readU32_Stream(is);
-                blockAlign                    = read16_Stream(is);
-                const int16_t  bitsPerSample  = read16_Stream(is);
-                const uint16_t extSize        = (size == 18 ? readU16_Stream(is) : 0);
-                iUnused(bytesPerSecond);
-                if (mode != pcm_WavFormat && mode != ieeeFloat_WavFormat) { /* PCM or float */
-                    return content;
-                }
-                if (extSize != 0) {
-                    return content;
-                }
-                if (numChannels != 1 && numChannels != 2) {
-                    return content;
-                }
-                if (bitsPerSample != 8 && bitsPerSample != 16 && bitsPerSample != 24 &&
-                    bitsPerSample != 32 && bitsPerSample != 64) {
-                    return content;
-                }
-                if (bitsPerSample == 24 && blockAlign != 3 * numChannels) {
-                    return content;
-                }
-                content.output.freq     = freq;
-                content.output.channels = numChannels;
-                if (mode == ieeeFloat_WavFormat) {
-                    content.inputFormat   = (bitsPerSample == 32 ? AUDIO_F32 : AUDIO_F64LSB);
-                    content.output.format = AUDIO_F32;
-                }
-                else if (bitsPerSample == 24) {
-                    content.inputFormat   = AUDIO_S24LSB;
-                    content.output.format = AUDIO_S16;
-                }
-                else {
-                    content.inputFormat = content.output.format =
-                        (bitsPerSample == 8 ? AUDIO_U8
-                                            : bitsPerSample == 16 ? AUDIO_S16 : AUDIO_S32);
-                }
-            }
-            else if (memcmp(magic, "data", 4) == 0) {
-                content.inputStartPos = pos_Stream(is);
-                content.totalSamples  = (uint64_t) size / blockAlign;
-                break;
-            }
-            else {
-                seek_Stream(is, pos_Stream(is) + size);
-            }
-        }
-    }
-    else if (content.type == vorbis_DecoderType) {
-        /* Try to decode what we have and see if it looks like Vorbis. */
-        int consumed = 0;
-        int error = 0;
-        stb_vorbis *vrb = stb_vorbis_open_pushdata(
-            constData_Block(&d->data->data), size_Block(&d->data->data), &consumed, &error, NULL);
-        if (!vrb) {
-            if (error != VORBIS_need_more_data) {
-                content.type = none_DecoderType;
-            }
-            return content;
-        }
-        const stb_vorbis_info info = stb_vorbis_get_info(vrb);
-        const int numChannels = info.channels;
-        if (numChannels != 1 && numChannels != 2) {
-            return content;
-        }
-        content.output.freq     = info.sample_rate;
-        content.output.channels = numChannels;
-        content.output.format   = AUDIO_F32;
-        content.inputFormat     = AUDIO_F32; /* actually stb_vorbis provides floats */
-        stb_vorbis_close(vrb);
-    }
-    else if (content.type == mpeg_DecoderType) {
-#if defined (LAGRANGE_ENABLE_MPG123)
-        mpg123_handle *mh = mpg123_new(NULL, NULL);
-        mpg123_open_feed(mh);
-        mpg123_feed(mh, constData_Block(&d->data->data), size_Block(&d->data->data));
-        long rate     = 0;
-        int  channels = 0;
-        int  encoding = 0;
-        if (mpg123_getformat(mh, &rate, &channels, &encoding) == MPG123_OK) {
-            content.output.freq     = rate;
-            content.output.channels = channels;
-            content.inputFormat     = AUDIO_S16;
-            content.output.format   = AUDIO_S16;
-        }
-        mpg123_close(mh);
-        mpg123_delete(mh);
-#endif
+    /* Only the beginning of the stream is needed for recognizing the format. */
+    iBlock *header = collect_Block(new_Block(0));
+    lock_Mutex(&d->data->mtx);
+    resize_Block(header, iMin(size_InputBuf(d->data), maxHeaderSize_Player_));
+    read_InputBuf(d->data, 0, size_Block(header), data_Block(header));
+    unlock_Mutex(&d->data->mtx);
+    content.decoder = find_DecoderClass_(range_Block(header), mediaType_(&d->mime));
+    if (!content.decoder || !content.decoder->contentSpec(&content, header)) {
+        iZap(content.output);
+        return content;
     }
     iAssert(content.inputFormat == content.output.format ||
             (content.inputFormat == AUDIO_S24LSB && content.output.format == AUDIO_S16) ||
             (content.inputFormat == AUDIO_F64LSB && content.output.format == AUDIO_F32));
-    content.output.samples = isAndroid_Platform() ? content.output.freq / 2 : 8192;
     return content;
 }
 
-static void writeOutputSamples_Player_(void *plr, Uint8 *stream, int len) {
-    iPlayer *d = plr;
-    iAssert(d->decoder);
-    const size_t sampleSize = sampleSize_Player_(d);
-    const size_t count      = len / sampleSize;
-    lock_Mutex(&d->decoder->outputMutex);
-    if (size_SampleBuf(&d->decoder->output) >= count) {
-        read_SampleBuf(&d->decoder->output, count, stream);
-    }
-    else {
-        memset(stream, d->spec.silence, len);
-    }
-    signal_Condition(&d->decoder->output.moreNeeded);
-    unlock_Mutex(&d->decoder->outputMutex);
-}
-
 void init_Player(iPlayer *d) {
     iZap(d->spec);
     init_String(&d->mime);
-    d->device    = 0;
+    d->voice     = NULL;
     d->decoder   = NULL;
     d->avfPlayer = NULL;
     d->data      = new_InputBuf();
@@ -675,7 +832,7 @@ iBool isStarted_Player(const iPlayer *d) {
         return isStarted_AVFAudioPlayer(d->avfPlayer);
     }
 #endif
-    return d->device != 0;
+    return d->voice != NULL;
 }
 
 iBool isPaused_Player(const iPlayer *d) {
@@ -684,8 +841,8 @@ iBool isPaused_Player(const iPlayer *d) {
         return isPaused_AVFAudioPlayer(d->avfPlayer);
     }
 #endif
-    if (!d->device) return iTrue;
-    return SDL_GetAudioDeviceStatus(d->device) == SDL_AUDIO_PAUSED;
+    if (!d->voice) return iTrue;
+    return isPaused_MixerVoice(d->voice);
 }
 
 float volume_Player(const iPlayer *d) {
@@ -702,30 +859,39 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
     }
     switch (update) {
         case replace_PlayerUpdate:
-            set_Block(&input->data, data);
+            clear_InputBuf(input);
+            append_InputBuf(input, constData_Block(data), size_Block(data));
             input->isComplete = iFalse;
             break;
         case append_PlayerUpdate: {
-            const size_t oldSize = size_Block(&input->data);
+            const size_t oldSize = size_InputBuf(input);
             const size_t newSize = size_Block(data);
             if (input->isComplete) {
                 iAssert(newSize == oldSize);
                 break;
             }
             /* The old parts cannot have changed. */
-            appendData_Block(&input->data, constBegin_Block(data) + oldSize, newSize - oldSize);
+            append_InputBuf(input, constBegin_Block(data) + oldSize, newSize - oldSize);
             break;
         }
+        case continue_PlayerUpdate:
+            if (!input->isComplete) {
+                append_InputBuf(input, constData_Block(data), size_Block(data));
+            }
+            break;
         case complete_PlayerUpdate:
             if (!input->isComplete) {
-                input->isComplete = iTrue;
+                complete_InputBuf(input);
 #if defined (iPlatformAppleMobile)
                 iAssert(d->avfPlayer == NULL);
+                iBlock *fileData = new_Block(size_InputBuf(input));
+                read_InputBuf(input, 0, size_Block(fileData), data_Block(fileData));
                 d->avfPlayer = new_AVFAudioPlayer();
-                if (!setInput_AVFAudioPlayer(d->avfPlayer, &d->mime, &input->data)) {
+                if (!setInput_AVFAudioPlayer(d->avfPlayer, &d->mime, fileData)) {
                     delete_AVFAudioPlayer(d->avfPlayer);
                     d->avfPlayer = NULL;
                 }
+                delete_Block(fileData);
 #endif
             }
             break;
@@ -734,27 +900,20 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
     unlock_Mutex(&input->mtx);
 }
 
-size_t sourceDataSize_Player(const iPlayer *d) {
+size_t memorySize_Player(const iPlayer *d) {
     lock_Mutex(&d->data->mtx);
-    const size_t size = size_Block(&d->data->data);
+    const size_t size = memorySize_InputBuf(d->data);
     unlock_Mutex(&d->data->mtx);
     return size;
 }
 
-static iBool setupSDLAudio_(iBool init) {
-    static iBool isAudioInited_ = iFalse;
-    if (init && !isAudioInited_) {
-        if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
-            fprintf(stderr, "[SDL] audio init failed: %s\n", SDL_GetError());
-            return iFalse;
-        }
-        isAudioInited_ = iTrue;
-    }
-    else if (!init && isAudioInited_ && !isAndroid_Platform()) {
-        SDL_QuitSubSystem(SDL_INIT_AUDIO);
-        isAudioInited_ = iFalse;
-    }
-    return isAudioInited_;
+iBlock *sourceData_Player(const iPlayer *d) {
+    iBlock *data = new_Block(0);
+    lock_Mutex(&d->data->mtx);
+    resize_Block(data, size_InputBuf(d->data));
+    truncate_Block(data, read_InputBuf(d->data, 0, size_Block(data), data_Block(data)));
+    unlock_Mutex(&d->data->mtx);
+    return data;
 }
 
 iBool start_Player(iPlayer *d) {
@@ -773,18 +932,13 @@ iBool start_Player(iPlayer *d) {
     if (!content.output.freq) {
         return iFalse;
     }
-    content.output.callback = writeOutputSamples_Player_;
-    content.output.userdata = d;
-    if (!setupSDLAudio_(iTrue)) {
+    d->voice = newVoice_Mixer(content.output.format, content.output.channels, content.output.freq);
+    if (!d->voice) {
         return iFalse;
     }
-    d->device = SDL_OpenAudioDevice(NULL, SDL_FALSE /* playback */, &content.output, &d->spec, 0);
-    if (!d->device) {
-        return iFalse;
-    }
-    d->decoder = new_Decoder(d->data, &content);
-    d->decoder->gain = d->volume;
-    SDL_PauseAudioDevice(d->device, SDL_FALSE);
+    d->spec = content.output;
+    setVolume_MixerVoice(d->voice, d->volume);
+    d->decoder = new_Decoder(d->data, d->voice, &content);
     setNotIdle_Player(d);
     activePlayer_ = d;
     return iTrue;
@@ -798,7 +952,7 @@ void setPaused_Player(iPlayer *d, iBool isPaused) {
     }
 #endif
     if (isStarted_Player(d)) {
-        SDL_PauseAudioDevice(d->device, isPaused ? SDL_TRUE : SDL_FALSE);
+        setPaused_MixerVoice(d->voice, isPaused);
         setNotIdle_Player(d);
     }
 }
@@ -811,20 +965,35 @@ void stop_Player(iPlayer *d) {
     }
 #endif
     if (isStarted_Player(d)) {
-        /* TODO: Stop the stream/decoder. */
-        SDL_PauseAudioDevice(d->device, SDL_TRUE);
-        SDL_CloseAudioDevice(d->device);
-        d->device = 0;
+        /* The decoder writes to the voice's buffer, so it must stop first. */
         delete_Decoder(d->decoder);
         d->decoder = NULL;
-        setupSDLAudio_(iFalse);
+        deleteVoice_Mixer(d->voice);
+        d->voice = NULL;
+    }
+}
+
+void seek_Player(iPlayer *d, float time) {
+#if defined (iPlatformAppleMobile)
+    if (d->avfPlayer) {
+        /* Can only go back to the beginning. */
+        if (time <= 0) {
+            stop_AVFAudioPlayer(d->avfPlayer);
+            play_AVFAudioPlayer(d->avfPlayer);
+        }
+        return;
+    }
+#endif
+    if (d->decoder) {
+        requestSeek_Decoder_(d->decoder, (uint64_t) (iMax(0.0f, time) * d->spec.freq));
+        setNotIdle_Player(d);
     }
 }
 
 void setVolume_Player(iPlayer *d, float volume) {
     d->volume = iClamp(volume, 0, 1);
-    if (d->decoder) {
-        d->decoder->gain = d->volume;
+    if (d->voice) {
+        setVolume_MixerVoice(d->voice, d->volume);
     }
 #if defined (iPlatformAppleMobile)
     if (d->avfPlayer) {
@@ -925,3 +1094,11 @@ iString *metadataLabel_Player(const iPlayer *d) {
 iPlayer *active_Player(void) {
     return activePlayer_;
 }
+
+const char *sniffMediaType_Player(const iBlock *header) {
+    const iDecoderClass *dc = find_DecoderClass_(range_Block(header), iNullRange);
+    if (dc && dc->probe(range_Block(header)) >= 50) {
+        return dc->mediaTypes[0];
+    }
+    return NULL;
+}
@@ -29,7 +29,8 @@ iDeclareTypeConstruction(Player)
 
 enum iPlayerUpdate {
     replace_PlayerUpdate,
-    append_PlayerUpdate,
+    append_PlayerUpdate,   /* data: everything received so far */
+    continue_PlayerUpdate, /* data: only what was received since the previous update */
     complete_PlayerUpdate,
 };
 
@@ -48,11 +49,13 @@ enum iPlayerTag {
 
 void    updateSourceData_Player (iPlayer *, const iString *mimeType, const iBlock *data,
                                  enum iPlayerUpdate update);
-size_t  sourceDataSize_Player   (const iPlayer *);
+size_t  memorySize_Player       (const iPlayer *); /* source data kept in memory */
+iBlock *sourceData_Player       (const iPlayer *); /* read back from the spool; caller deletes */
 
 iBool   	start_Player            (iPlayer *);
 void    	stop_Player             (iPlayer *);
 void    	setPaused_Player        (iPlayer *, iBool isPaused);
+void    	seek_Player             (iPlayer *, float time);
 void    	setVolume_Player        (iPlayer *, float volume);
 void    	setFlags_Player         (iPlayer *, int flags, iBool set);
 void    	setNotIdle_Player       (iPlayer *);
@@ -70,3 +73,4 @@ uint32_t    idleTimeMs_Player       (const iPlayer *);
 iString *   metadataLabel_Player    (const iPlayer *);
 
 iPlayer *   active_Player           (void);
+const char *sniffMediaType_Player   (const iBlock *header); /* NULL if not recognized as audio */
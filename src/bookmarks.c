@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/stringset.h>
 #include <the_Foundation/toml.h>
+#include <ctype.h>
 
 void init_Bookmark(iBookmark *d) {
     init_String(&d->url);
@@ -158,10 +159,66 @@ static const char *oldFileName_Bookmarks_  = "bookmarks.txt";
 static const char *fileName_Bookmarks_     = "bookmarks.ini"; /* since v1.7 (TOML subset) */
 static const char *tempFileName_Bookmarks_ = "bookmarks.ini.tmp";
 
+/* Bookmarks are indexed by URL and by URL root. Index nodes are keyed by a case-insensitive
+   hash so the bookmarks in a node must still be compared with the actual URL. */
+iDeclareType(BookmarkIndexNode)
+
+struct Impl_BookmarkIndexNode {
+    iHashNode node;
+    iPtrArray bookmarks;
+};
+
+static uint32_t hashCase_(iRangecc text) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (const char *ch = text.start; ch < text.end; ch++) {
+        hash = (hash ^ (uint8_t) tolower(*ch)) * 16777619u;
+    }
+    return hash;
+}
+
+static void insert_BookmarkIndex_(iHash *index, uint32_t key, iBookmark *bm) {
+    iBookmarkIndexNode *node = (iBookmarkIndexNode *) value_Hash(index, key);
+    if (!node) {
+        node = iMalloc(BookmarkIndexNode);
+        node->node.key = key;
+        init_PtrArray(&node->bookmarks);
+        insert_Hash(index, &node->node);
+    }
+    pushBack_PtrArray(&node->bookmarks, bm);
+}
+
+static void remove_BookmarkIndex_(iHash *index, uint32_t key, const iBookmark *bm) {
+    iBookmarkIndexNode *node = (iBookmarkIndexNode *) value_Hash(index, key);
+    if (node) {
+        removeOne_PtrArray(&node->bookmarks, bm);
+        if (isEmpty_PtrArray(&node->bookmarks)) {
+            remove_Hash(index, key);
+            deinit_PtrArray(&node->bookmarks);
+            free(node);
+        }
+    }
+}
+
+static const iPtrArray *find_BookmarkIndex_(const iHash *index, uint32_t key) {
+    const iBookmarkIndexNode *node = (const iBookmarkIndexNode *) value_Hash(index, key);
+    return node ? &node->bookmarks : NULL;
+}
+
+static void clear_BookmarkIndex_(iHash *index) {
+    iForEach(Hash, i, index) {
+        iBookmarkIndexNode *node = (iBookmarkIndexNode *) i.value;
+        deinit_PtrArray(&node->bookmarks);
+        free(node);
+    }
+    clear_Hash(index);
+}
+
 struct Impl_Bookmarks {
     iMutex *  mtx;
     int       idEnum;
     iHash     bookmarks; /* bookmark ID is the hash key */
+    iHash     urlIndex;  /* BookmarkIndexNode */
+    iHash     rootIndex; /* BookmarkIndexNode */
     uint32_t  recentFolderId; /* recently interacted with */
     iPtrArray remoteRequests;   
 };
@@ -172,10 +229,31 @@ void init_Bookmarks(iBookmarks *d) {
     d->mtx = new_Mutex();
     d->idEnum = 0;
     init_Hash(&d->bookmarks);
+    init_Hash(&d->urlIndex);
+    init_Hash(&d->rootIndex);
     d->recentFolderId = 0;
     init_PtrArray(&d->remoteRequests);
 }
 
+/* Note: The URL of an indexed bookmark must only be changed via `setUrl_Bookmarks`. */
+static void index_Bookmarks_(iBookmarks *d, iBookmark *bm) {
+    insert_BookmarkIndex_(&d->urlIndex, hashCase_(range_String(&bm->url)), bm);
+    insert_BookmarkIndex_(&d->rootIndex, hashCase_(urlRoot_String(&bm->url)), bm);
+}
+
+static void unindex_Bookmarks_(iBookmarks *d, const iBookmark *bm) {
+    remove_BookmarkIndex_(&d->urlIndex, hashCase_(range_String(&bm->url)), bm);
+    remove_BookmarkIndex_(&d->rootIndex, hashCase_(urlRoot_String(&bm->url)), bm);
+}
+
+static iBookmark *take_Bookmarks_(iBookmarks *d, uint32_t id) {
+    iBookmark *bm = (iBookmark *) remove_Hash(&d->bookmarks, id);
+    if (bm) {
+        unindex_Bookmarks_(d, bm);
+    }
+    return bm;
+}
+
 void deinit_Bookmarks(iBookmarks *d) {
     iForEach(PtrArray, i, &d->remoteRequests) {
         cancel_GmRequest(i.ptr);
@@ -184,6 +262,8 @@ void deinit_Bookmarks(iBookmarks *d) {
     }
     deinit_PtrArray(&d->remoteRequests);
     clear_Bookmarks(d);
+    deinit_Hash(&d->rootIndex);
+    deinit_Hash(&d->urlIndex);
     deinit_Hash(&d->bookmarks);
     delete_Mutex(d->mtx);
 }
@@ -194,6 +274,8 @@ void clear_Bookmarks(iBookmarks *d) {
         delete_Bookmark((iBookmark *) i.value);
     }
     clear_Hash(&d->bookmarks);
+    clear_BookmarkIndex_(&d->urlIndex);
+    clear_BookmarkIndex_(&d->rootIndex);
     d->idEnum = 0;
     unlock_Mutex(d->mtx);
 }
@@ -201,6 +283,7 @@ void clear_Bookmarks(iBookmarks *d) {
 static void insertId_Bookmarks_(iBookmarks *d, iBookmark *bookmark, int id) {
     bookmark->node.key = id;
     insert_Hash(&d->bookmarks, &bookmark->node);
+    index_Bookmarks_(d, bookmark);
 }
 
 static void insert_Bookmarks_(iBookmarks *d, iBookmark *bookmark) {
@@ -408,6 +491,7 @@ static void mergeFolders_BookmarkLoader(iBookmarkLoader *d) {
                 if (isFolder_Bookmark(old) && id_Bookmark(old) <= d->baseId &&
                     equal_String(&imported->title, &old->title)) {
                     replaceParentFolder_Bookmarks_(d->bookmarks, id_Bookmark(imported), id_Bookmark(old));
+                    unindex_Bookmarks_(d->bookmarks, imported);
                     remove_HashIterator(&i);
                     delete_Bookmark(imported);
                     break;
@@ -547,11 +631,11 @@ uint32_t add_Bookmarks(iBookmarks *d, const iString *url, const iString *title,
 
 iBool remove_Bookmarks(iBookmarks *d, uint32_t id) {
     lock_Mutex(d->mtx);
-    iBookmark *bm = (iBookmark *) remove_Hash(&d->bookmarks, id);
+    iBookmark *bm = take_Bookmarks_(d, id);
     if (bm) {
         /* Remove all the contained bookmarks as well. */
         iConstForEach(PtrArray, i, list_Bookmarks(d, NULL, filterInsideFolder_Bookmark, bm)) {
-            delete_Bookmark((iBookmark *) remove_Hash(&d->bookmarks, id_Bookmark(i.ptr)));
+            delete_Bookmark(take_Bookmarks_(d, id_Bookmark(i.ptr)));
         }
         delete_Bookmark(bm);
     }
@@ -562,12 +646,15 @@ iBool remove_Bookmarks(iBookmarks *d, uint32_t id) {
 iBool updateBookmarkIcon_Bookmarks(iBookmarks *d, const iString *url, iChar icon) {
     iBool changed = iFalse;
     lock_Mutex(d->mtx);
-    iForEach(Hash, i, &d->bookmarks) {
-        iBookmark *bm = (iBookmark *) i.value;    
-        if (~bm->flags & remote_BookmarkFlag && ~bm->flags & userIcon_BookmarkFlag) {
-            if (equalCase_String(&bm->url, url) && icon != bm->icon) {
-                bm->icon = icon;
-                changed = iTrue;
+    const iPtrArray *found = find_BookmarkIndex_(&d->urlIndex, hashCase_(range_String(url)));
+    if (found) {
+        iConstForEach(PtrArray, i, found) {
+            iBookmark *bm = i.ptr;
+            if (~bm->flags & remote_BookmarkFlag && ~bm->flags & userIcon_BookmarkFlag) {
+                if (equalCase_String(&bm->url, url) && icon != bm->icon) {
+                    bm->icon = icon;
+                    changed = iTrue;
+                }
             }
         }
     }
@@ -575,6 +662,17 @@ iBool updateBookmarkIcon_Bookmarks(iBookmarks *d, const iString *url, iChar icon
     return changed;
 }
 
+void setUrl_Bookmarks(iBookmarks *d, uint32_t id, const iString *url) {
+    lock_Mutex(d->mtx);
+    iBookmark *bm = get_Bookmarks(d, id);
+    if (bm) {
+        unindex_Bookmarks_(d, bm);
+        set_String(&bm->url, url);
+        index_Bookmarks_(d, bm);
+    }
+    unlock_Mutex(d->mtx);
+}
+
 void setRecentFolder_Bookmarks(iBookmarks *d, uint32_t folderId) {
     iBookmark *bm = get_Bookmarks(d, folderId);
     if (bm && isFolder_Bookmark(bm)) {
@@ -593,8 +691,13 @@ iChar siteIcon_Bookmarks(const iBookmarks *d, const iString *url) {
     size_t         matchingSize = iInvalidSize; /* we'll pick the shortest matching */
     iChar          icon         = 0;
     lock_Mutex(d->mtx);
-    iConstForEach(Hash, i, &d->bookmarks) {
-        const iBookmark *bm = (const iBookmark *) i.value;
+    const iPtrArray *sameRoot = find_BookmarkIndex_(&d->rootIndex, hashCase_(urlRoot));
+    if (!sameRoot) {
+        unlock_Mutex(d->mtx);
+        return 0;
+    }
+    iConstForEach(PtrArray, i, sameRoot) {
+        const iBookmark *bm = i.ptr;
         if (bm->icon && bm->flags & userIcon_BookmarkFlag) {
             const iRangecc bmRoot = urlRoot_String(&bm->url);
             if (equalRangeCase_Rangecc(urlRoot, bmRoot)) {
@@ -658,13 +761,21 @@ static iBool matchUrlAndIdent_(iMatchUrlArgs *args, const iBookmark *bm) {
 
 uint32_t findUrlIdent_Bookmarks(const iBookmarks *d, const iString *url, const iString *identFp) {
     iMatchUrlArgs args = { .url = canonicalUrl_String(url), .identityFp = identFp };
-    /* TODO: O(n), boo */
-    const iPtrArray *found =
-        list_Bookmarks(d, NULL, (iBookmarksFilterFunc) matchUrlAndIdent_, &args);
-    if (isEmpty_PtrArray(found)) {
-        return 0;
+    const iBookmark *newest = NULL;
+    lock_Mutex(d->mtx);
+    const iPtrArray *found = find_BookmarkIndex_(&d->urlIndex, hashCase_(range_String(args.url)));
+    if (found) {
+        /* Same result as the default sort order of `list_Bookmarks`, but without sorting. */
+        iConstForEach(PtrArray, i, found) {
+            const iBookmark *bm = i.ptr;
+            if (matchUrlAndIdent_(&args, bm) &&
+                (!newest || cmpTimeDescending_Bookmark_(&bm, &newest) < 0)) {
+                newest = bm;
+            }
+        }
     }
-    return id_Bookmark(constFront_PtrArray(found));    
+    unlock_Mutex(d->mtx);
+    return newest ? id_Bookmark(newest) : 0;
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -875,6 +986,7 @@ void fetchRemote_Bookmarks(iBookmarks *d) {
         iForEach(Hash, i, &d->bookmarks) {
             iBookmark *bm = (iBookmark *) i.value;
             if (bm->flags & remote_BookmarkFlag) {
+                unindex_Bookmarks_(d, bm);
                 remove_HashIterator(&i);
                 delete_Bookmark(bm);
                 numRemoved++;
@@ -0,0 +1,342 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "contentcache.h"
+#include "defs.h"
+
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/stringhash.h>
+#include <the_Foundation/stringset.h>
+
+iDeclareClass(ContentCacheEntry)
+iDeclareObjectConstruction(ContentCacheEntry)
+
+struct Impl_ContentCacheEntry {
+    iObject  object;
+    uint64_t size;
+    iTime    when; /* response timestamp */
+};
+
+void init_ContentCacheEntry(iContentCacheEntry *d) {
+    d->size = 0;
+    iZap(d->when);
+}
+
+void deinit_ContentCacheEntry(iContentCacheEntry *d) {
+    iUnused(d);
+}
+
+iDefineClass(ContentCacheEntry)
+iDefineObjectConstruction(ContentCacheEntry)
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(ContentCache)
+
+struct Impl_ContentCache {
+    iMutex *    mtx;
+    iString     dir;
+    iStringHash entries; /* ContentCacheEntry objects keyed by hash */
+    iStringSet  marked;  /* entries in use by the state being saved */
+    iBool       isSaving;
+};
+
+static iContentCache contentCache_;
+static const char    *dirName_ContentCache_   = "cache";
+static const char    *indexName_ContentCache_ = "index.bin";
+static const char    *tempSuffix_ContentCache_ = ".tmp";
+
+static const iString *entryPath_ContentCache_(const iContentCache *d, const iString *key) {
+    return collect_String(concat_Path(&d->dir, key));
+}
+
+static iString *hash_ContentCache_(const iBlock *data) {
+    /* FNV-1a, 64-bit. */
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t *bytes = constData_Block(data);
+    for (size_t i = 0; i < size_Block(data); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return newFormat_String("%016llx", (unsigned long long) hash);
+}
+
+static void load_ContentCache_(iContentCache *d) {
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->dir, indexName_ContentCache_)));
+    if (open_File(f, readOnly_FileMode)) {
+        iStream *ins = stream_File(f);
+        setVersion_Stream(ins, readU32_Stream(ins));
+        uint32_t count = readU32_Stream(ins);
+        iString key;
+        init_String(&key);
+        while (count-- && !atEnd_Stream(ins)) {
+            iContentCacheEntry *entry = new_ContentCacheEntry();
+            deserialize_String(&key, ins);
+            entry->size = readU64_Stream(ins);
+            entry->when.ts.tv_sec = readU64_Stream(ins);
+            insert_StringHash(&d->entries, &key, entry);
+            iRelease(entry);
+        }
+        deinit_String(&key);
+    }
+    iRelease(f);
+}
+
+static iBool isKey_ContentCache_(iRangecc name) {
+    if (size_Range(&name) != 16) {
+        return iFalse;
+    }
+    for (const char *ch = name.start; ch != name.end; ch++) {
+        if (!((*ch >= '0' && *ch <= '9') || (*ch >= 'a' && *ch <= 'f'))) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static iBool adopt_ContentCache_(iContentCache *d, const iString *key) {
+    /* The entry was written but the index wasn't saved afterwards. Entry files are only
+       renamed into place when complete, so the contents can be trusted. */
+    iBool ok = iFalse;
+    iFile *f = new_File(entryPath_ContentCache_(d, key));
+    if (open_File(f, readOnly_FileMode)) {
+        setVersion_Stream(stream_File(f), readU32_File(f));
+        iGmResponse *resp = new_GmResponse();
+        deserialize_GmResponse(resp, stream_File(f));
+        iContentCacheEntry *entry = new_ContentCacheEntry();
+        entry->size = size_String(&resp->meta) + size_Block(&resp->body);
+        entry->when = resp->when;
+        insert_StringHash(&d->entries, key, entry);
+        iRelease(entry);
+        delete_GmResponse(resp);
+        ok = iTrue;
+    }
+    iRelease(f);
+    return ok;
+}
+
+static iBool sweep_ContentCache_(iContentCache *d) {
+    /* Reconcile the index with the directory contents after an unclean exit: unfinished
+       writes are deleted, complete entries missing from the index are adopted, and index
+       entries without a file are dropped. Returns iTrue if the index changed. */
+    iBool changed = iFalse;
+    iStringSet *present = new_StringSet();
+    iForEach(DirFileInfo, i, iClob(newCStr_DirFileInfo(cstr_String(&d->dir)))) {
+        const iString *path = path_FileInfo(i.value);
+        const iRangecc name = baseName_Path(path);
+        if (equal_Rangecc(name, indexName_ContentCache_)) {
+            continue;
+        }
+        iString *key = newRange_String(name);
+        if (isKey_ContentCache_(name) && contains_StringHash(&d->entries, key)) {
+            insert_StringSet(present, key);
+        }
+        else if (isKey_ContentCache_(name) && adopt_ContentCache_(d, key)) {
+            insert_StringSet(present, key);
+            changed = iTrue;
+        }
+        else {
+            remove(cstr_String(path)); /* unfinished write or unknown file */
+        }
+        delete_String(key);
+    }
+    iForEach(StringHash, j, &d->entries) {
+        if (!contains_StringSet(present, key_StringHashIterator(&j))) {
+            remove_StringHashIterator(&j);
+            changed = iTrue;
+        }
+    }
+    iRelease(present);
+    return changed;
+}
+
+static void save_ContentCache_(const iContentCache *d) {
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->dir, indexName_ContentCache_)));
+    if (open_File(f, writeOnly_FileMode)) {
+        iStream *outs = stream_File(f);
+        writeU32_Stream(outs, latest_FileVersion);
+        writeU32_Stream(outs, (uint32_t) size_StringHash(&d->entries));
+        iConstForEach(StringHash, i, &d->entries) {
+            const iContentCacheEntry *entry = value_StringHashNode(i.value);
+            serialize_String(key_StringHashConstIterator(&i), outs);
+            writeU64_Stream(outs, entry->size);
+            writeU64_Stream(outs, entry->when.ts.tv_sec);
+        }
+    }
+    iRelease(f);
+}
+
+void init_ContentCache(const char *saveDir) {
+    iContentCache *d = &contentCache_;
+    d->mtx = new_Mutex();
+    initCStr_String(&d->dir, concatPath_CStr(saveDir, dirName_ContentCache_));
+    init_StringHash(&d->entries);
+    init_StringSet(&d->marked);
+    d->isSaving = iFalse;
+    makeDirs_Path(&d->dir);
+    load_ContentCache_(d);
+    if (sweep_ContentCache_(d)) {
+        save_ContentCache_(d);
+    }
+}
+
+void deinit_ContentCache(void) {
+    iContentCache *d = &contentCache_;
+    deinit_StringSet(&d->marked);
+    deinit_StringHash(&d->entries);
+    deinit_String(&d->dir);
+    delete_Mutex(d->mtx);
+}
+
+void beginSave_ContentCache(void) {
+    iContentCache *d = &contentCache_;
+    iGuardMutex(d->mtx, {
+        clear_StringSet(&d->marked);
+        d->isSaving = iTrue;
+    });
+}
+
+void endSave_ContentCache(void) {
+    iContentCache *d = &contentCache_;
+    lock_Mutex(d->mtx);
+    if (d->isSaving) {
+        /* Entries no longer referenced by the saved state are deleted. */
+        iForEach(StringHash, i, &d->entries) {
+            const iString *key = key_StringHashIterator(&i);
+            if (!contains_StringSet(&d->marked, key)) {
+                remove(cstr_String(entryPath_ContentCache_(d, key)));
+                remove_StringHashIterator(&i);
+            }
+        }
+        clear_StringSet(&d->marked);
+        d->isSaving = iFalse;
+        save_ContentCache_(d);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void mark_ContentCache(const iString *key) {
+    iContentCache *d = &contentCache_;
+    iGuardMutex(d->mtx, {
+        if (d->isSaving) {
+            insert_StringSet(&d->marked, key);
+        }
+    });
+}
+
+iString *store_ContentCache(const iGmResponse *resp) {
+    iContentCache *d = &contentCache_;
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    serialize_GmResponse(resp, stream_Buffer(buf));
+    iString *key = hash_ContentCache_(data_Buffer(buf));
+    lock_Mutex(d->mtx);
+    if (!contains_StringHash(&d->entries, key)) {
+        /* Written under a temporary name so a crash never leaves a truncated entry. */
+        const iString *path     = entryPath_ContentCache_(d, key);
+        iString       *tempPath = copy_String(path);
+        iBool          ok       = iFalse;
+        appendCStr_String(tempPath, tempSuffix_ContentCache_);
+        iFile *f = new_File(tempPath);
+        if (open_File(f, writeOnly_FileMode)) {
+            const iBlock *data = data_Buffer(buf);
+            writeU32_File(f, latest_FileVersion);
+            ok = writeData_File(f, constData_Block(data), size_Block(data)) == size_Block(data);
+            close_File(f);
+            ok = ok && rename(cstr_String(tempPath), cstr_String(path)) == 0;
+            if (!ok) {
+                remove(cstr_String(tempPath));
+            }
+        }
+        if (ok) {
+            iContentCacheEntry *entry = new_ContentCacheEntry();
+            entry->size = size_String(&resp->meta) + size_Block(&resp->body);
+            entry->when = resp->when;
+            insert_StringHash(&d->entries, key, entry);
+            iRelease(entry);
+        }
+        else {
+            clear_String(key);
+        }
+        iRelease(f);
+        delete_String(tempPath);
+    }
+    if (!isEmpty_String(key)) {
+        mark_ContentCache(key);
+    }
+    unlock_Mutex(d->mtx);
+    iRelease(buf);
+    return key;
+}
+
+iGmResponse *load_ContentCache(const iString *key) {
+    iContentCache *d = &contentCache_;
+    iGmResponse *resp = NULL;
+    lock_Mutex(d->mtx);
+    if (contains_StringHash(&d->entries, key)) {
+        iFile *f = new_File(entryPath_ContentCache_(d, key));
+        if (open_File(f, readOnly_FileMode)) {
+            setVersion_Stream(stream_File(f), readU32_File(f));
+            resp = new_GmResponse();
+            deserialize_GmResponse(resp, stream_File(f));
+        }
+        iRelease(f);
+    }
+    unlock_Mutex(d->mtx);
+    return resp;
+}
+
+iBool contains_ContentCache(const iString *key) {
+    iContentCache *d = &contentCache_;
+    iBool found;
+    iGuardMutex(d->mtx, found = contains_StringHash(&d->entries, key));
+    return found;
+}
+
+size_t size_ContentCache(const iString *key) {
+    iContentCache *d = &contentCache_;
+    size_t size = 0;
+    lock_Mutex(d->mtx);
+    const iContentCacheEntry *entry = constValue_StringHash(&d->entries, key);
+    if (entry) {
+        size = entry->size;
+    }
+    unlock_Mutex(d->mtx);
+    return size;
+}
+
+iTime time_ContentCache(const iString *key) {
+    iContentCache *d = &contentCache_;
+    iTime when;
+    iZap(when);
+    lock_Mutex(d->mtx);
+    const iContentCacheEntry *entry = constValue_StringHash(&d->entries, key);
+    if (entry) {
+        when = entry->when;
+    }
+    unlock_Mutex(d->mtx);
+    return when;
+}
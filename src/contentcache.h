@@ -0,0 +1,41 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "gmrequest.h"
+
+/* Cached responses of the navigation history are stored on disk, one file per response,
+   named after a hash of the serialized response. The state file only refers to them by key. */
+
+void            init_ContentCache       (const char *saveDir);
+void            deinit_ContentCache     (void);
+
+void            beginSave_ContentCache  (void);
+void            endSave_ContentCache    (void); /* deletes entries not stored/marked since begin */
+
+iString *       store_ContentCache      (const iGmResponse *); /* returns key; marks entry */
+void            mark_ContentCache       (const iString *key);
+iGmResponse *   load_ContentCache       (const iString *key); /* NULL if not found */
+iBool           contains_ContentCache   (const iString *key);
+size_t          size_ContentCache       (const iString *key);
+iTime           time_ContentCache       (const iString *key);
@@ -0,0 +1,591 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "feedparser.h"
+#include "lang.h"
+
+#include <the_Foundation/block.h>
+#include <the_Foundation/regexp.h>
+#include <ctype.h>
+
+static const size_t maxFieldSize_FeedParser_ = 4096;  /* further text is ignored */
+static const size_t maxTagSize_FeedParser_   = 65536; /* XML is considered malformed */
+
+static const char *atomNamespace_FeedParser_ = "http://www.w3.org/2005/Atom";
+
+enum iFeedFormat {
+    unknown_FeedFormat,
+    atom_FeedFormat,
+    rss_FeedFormat, /* RSS 2.0 and RSS 1.0 (RDF) */
+};
+
+enum iFeedField {
+    none_FeedField,
+    title_FeedField,
+    subtitle_FeedField,
+    entryTitle_FeedField,
+    entryLink_FeedField,
+    entryPublished_FeedField,
+    entryUpdated_FeedField,
+};
+
+enum iFeedParserMode {
+    markup_FeedParserMode,
+    comment_FeedParserMode,
+    cdata_FeedParserMode,
+};
+
+struct Impl_FeedParser {
+    enum iFeedParserState state;
+    enum iFeedFormat      format;
+    enum iFeedParserMode  mode;
+    iBlock                pending; /* input that has not been parsed yet */
+    int                   depth;
+    int                   channelDepth; /* element that has the feed title */
+    int                   entryDepth;   /* zero when not inside an entry */
+    int                   captureDepth; /* zero when text is not being collected */
+    enum iFeedField       field;
+    iString               text;
+    iString               title;
+    iString               subtitle;
+    iFeedParserEntry      entry;
+    int                   entryLinkRank;
+    iString               entryPublished;
+    iString               entryUpdated;
+    iAny *                context;
+    iFeedParserHeaderFunc headerFunc;
+    iFeedParserEntryFunc  entryFunc;
+    iString *             gemini;
+};
+
+iDefineTypeConstruction(FeedParser)
+
+void init_FeedParser(iFeedParser *d) {
+    d->state         = undetermined_FeedParserState;
+    d->format        = unknown_FeedFormat;
+    d->mode          = markup_FeedParserMode;
+    init_Block(&d->pending, 0);
+    d->depth         = 0;
+    d->channelDepth  = 0;
+    d->entryDepth    = 0;
+    d->captureDepth  = 0;
+    d->field         = none_FeedField;
+    init_String(&d->text);
+    init_String(&d->title);
+    init_String(&d->subtitle);
+    init_String(&d->entry.title);
+    init_String(&d->entry.url);
+    init_String(&d->entry.date);
+    d->entryLinkRank = 0;
+    init_String(&d->entryPublished);
+    init_String(&d->entryUpdated);
+    d->context       = NULL;
+    d->headerFunc    = NULL;
+    d->entryFunc     = NULL;
+    d->gemini        = NULL;
+}
+
+void deinit_FeedParser(iFeedParser *d) {
+    deinit_String(&d->entryUpdated);
+    deinit_String(&d->entryPublished);
+    deinit_String(&d->entry.date);
+    deinit_String(&d->entry.url);
+    deinit_String(&d->entry.title);
+    deinit_String(&d->subtitle);
+    deinit_String(&d->title);
+    deinit_String(&d->text);
+    deinit_Block(&d->pending);
+}
+
+void setHandlers_FeedParser(iFeedParser *d, iAny *context, iFeedParserHeaderFunc header,
+                            iFeedParserEntryFunc entry) {
+    d->context    = context;
+    d->headerFunc = header;
+    d->entryFunc  = entry;
+}
+
+void setGeminiOutput_FeedParser(iFeedParser *d, iString *out) {
+    d->gemini = out;
+}
+
+enum iFeedParserState state_FeedParser(const iFeedParser *d) {
+    return d->state;
+}
+
+iBool isFeedMime_FeedParser(const iString *mime) {
+    static iRegExp *xmlMime_;
+    if (!xmlMime_) {
+        xmlMime_ = new_RegExp("(application|text)/((atom|rss)\\+)?xml", caseInsensitive_RegExpOption);
+    }
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    return matchString_RegExp(xmlMime_, mime, &m);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void appendDecoded_String_(iString *d, iRangecc text) {
+    /* Character and predefined entity references are decoded. */
+    while (!isEmpty_Range(&text)) {
+        const char *amp = memchr(text.start, '&', size_Range(&text));
+        if (!amp) {
+            appendCStrN_String(d, text.start, size_Range(&text));
+            break;
+        }
+        appendCStrN_String(d, text.start, amp - text.start);
+        text.start = amp + 1;
+        const char *semi = memchr(text.start, ';', iMin(size_Range(&text), 10));
+        iChar ch = 0;
+        if (semi) {
+            const iRangecc ref = { text.start, semi };
+            if (equal_Rangecc(ref, "amp"))       ch = '&';
+            else if (equal_Rangecc(ref, "lt"))   ch = '<';
+            else if (equal_Rangecc(ref, "gt"))   ch = '>';
+            else if (equal_Rangecc(ref, "quot")) ch = '"';
+            else if (equal_Rangecc(ref, "apos")) ch = '\'';
+            else if (size_Range(&ref) > 1 && ref.start[0] == '#') {
+                ch = (ref.start[1] == 'x' || ref.start[1] == 'X')
+                         ? (iChar) strtoul(ref.start + 2, NULL, 16)
+                         : (iChar) strtoul(ref.start + 1, NULL, 10);
+            }
+        }
+        if (ch) {
+            appendChar_String(d, ch);
+            text.start = semi + 1;
+        }
+        else {
+            appendCStr_String(d, "&"); /* not a reference we know of */
+        }
+    }
+}
+
+static void normalizeSpace_String_(iString *d) {
+    /* Runs of whitespace become a single space; leading and trailing whitespace is removed. */
+    iString norm;
+    init_String(&norm);
+    iBool isSpace = iFalse;
+    for (const char *ch = constBegin_String(d); ch != constEnd_String(d); ch++) {
+        if (isspace((unsigned char) *ch)) {
+            isSpace = iTrue;
+            continue;
+        }
+        if (isSpace && !isEmpty_String(&norm)) {
+            appendCStr_String(&norm, " ");
+        }
+        isSpace = iFalse;
+        appendCStrN_String(&norm, ch, 1);
+    }
+    set_String(d, &norm);
+    deinit_String(&norm);
+}
+
+static iBool normalizeDate_(const iString *src, iString *date_out) {
+    /* Atom uses RFC 3339 dates, RSS uses RFC 822 dates. */
+    static const char *months_[] = { "jan", "feb", "mar", "apr", "may", "jun",
+                                     "jul", "aug", "sep", "oct", "nov", "dec" };
+    const char *str = cstr_String(src);
+    int year = 0, month = 0, day = 0;
+    while (isspace((unsigned char) *str)) {
+        str++;
+    }
+    if (isdigit((unsigned char) *str) && sscanf(str, "%4d-%2d-%2d", &year, &month, &day) == 3) {
+        /* Fine as is. */
+    }
+    else {
+        const char *comma = strchr(str, ',');
+        char monthName[4];
+        iZap(monthName);
+        if (comma) {
+            str = comma + 1; /* skip day of week */
+        }
+        if (sscanf(str, "%d %3s %d", &day, monthName, &year) != 3) {
+            return iFalse;
+        }
+        for (size_t i = 0; i < iElemCount(months_); i++) {
+            if (equalCase_Rangecc(range_CStr(monthName), months_[i])) {
+                month = i + 1;
+                break;
+            }
+        }
+        if (year < 100) {
+            year += 2000;
+        }
+    }
+    if (year < 1000 || year > 9999 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return iFalse;
+    }
+    format_String(date_out, "%04d-%02d-%02d", year, month, day);
+    return iTrue;
+}
+
+static iRangecc localName_(iRangecc tag) {
+    /* Tag name without the namespace prefix. */
+    iRangecc name = { tag.start, tag.start };
+    while (name.end < tag.end && !isspace((unsigned char) *name.end)) {
+        if (*name.end == ':') {
+            name.start = name.end + 1;
+        }
+        name.end++;
+    }
+    return name;
+}
+
+static iRangecc attribute_(iRangecc tag, const char *attrib) {
+    const size_t len = strlen(attrib);
+    const char *pos = tag.start;
+    while (pos < tag.end && !isspace((unsigned char) *pos)) {
+        pos++; /* element name */
+    }
+    while (pos < tag.end) {
+        while (pos < tag.end && isspace((unsigned char) *pos)) {
+            pos++;
+        }
+        const char *nameStart = pos;
+        while (pos < tag.end && *pos != '=' && !isspace((unsigned char) *pos)) {
+            pos++;
+        }
+        const iRangecc attrName = { nameStart, pos };
+        while (pos < tag.end && (*pos == '=' || isspace((unsigned char) *pos))) {
+            pos++;
+        }
+        if (pos == tag.end || (*pos != '"' && *pos != '\'')) {
+            break;
+        }
+        const char *close = memchr(pos + 1, *pos, tag.end - pos - 1);
+        if (!close) {
+            break;
+        }
+        if (size_Range(&attrName) == len && !memcmp(attrName.start, attrib, len)) {
+            return (iRangecc){ pos + 1, close };
+        }
+        pos = close + 1;
+    }
+    return iNullRange;
+}
+
+static iBool emitHeader_FeedParser_(iFeedParser *d) {
+    if (d->state == undetermined_FeedParserState) {
+        if (isEmpty_String(&d->title)) {
+            d->state = notFeed_FeedParserState;
+            return iFalse;
+        }
+        d->state = feed_FeedParserState;
+        if (d->headerFunc) {
+            d->headerFunc(d->context, &d->title, &d->subtitle);
+        }
+        if (d->gemini) {
+            appendFormat_String(d->gemini, "# %s\n\n", cstr_String(&d->title));
+            if (!isEmpty_String(&d->subtitle)) {
+                appendFormat_String(d->gemini, "## %s\n\n", cstr_String(&d->subtitle));
+            }
+            appendCStr_String(d->gemini, cstr_Lang("feeds.atom.translated"));
+            appendCStr_String(d->gemini, "\n\n");
+        }
+    }
+    return d->state == feed_FeedParserState;
+}
+
+static void emitEntry_FeedParser_(iFeedParser *d) {
+    iFeedParserEntry *entry = &d->entry;
+    if (isEmpty_String(&entry->title) || isEmpty_String(&entry->url)) {
+        return;
+    }
+    if (!normalizeDate_(&d->entryUpdated, &entry->date) &&
+        !normalizeDate_(&d->entryPublished, &entry->date)) {
+        return;
+    }
+    if (d->entryFunc) {
+        d->entryFunc(d->context, entry);
+    }
+    if (d->gemini) {
+        appendFormat_String(d->gemini, "=> %s %s - %s\n",
+                            cstr_String(&entry->url),
+                            cstr_String(&entry->date),
+                            cstr_String(&entry->title));
+    }
+}
+
+static void capture_FeedParser_(iFeedParser *d, enum iFeedField field) {
+    d->field        = field;
+    d->captureDepth = d->depth;
+    clear_String(&d->text);
+}
+
+static void characters_FeedParser_(iFeedParser *d, iRangecc text, iBool isRaw) {
+    if (!d->captureDepth || isEmpty_Range(&text) ||
+        size_String(&d->text) >= maxFieldSize_FeedParser_) {
+        return;
+    }
+    if (isRaw) {
+        appendCStrN_String(&d->text, text.start, size_Range(&text));
+    }
+    else {
+        appendDecoded_String_(&d->text, text);
+    }
+}
+
+static void link_FeedParser_(iFeedParser *d, iRangecc tag) {
+    /* Prefer Gemini links, then alternate links, then anything else. */
+    const iRangecc rel  = attribute_(tag, "rel");
+    const iRangecc href = attribute_(tag, "href");
+    if (isEmpty_Range(&href)) {
+        return;
+    }
+    const int rank = startsWithCase_Rangecc(href, "gemini:")                   ? 3
+                     : isEmpty_Range(&rel) || equal_Rangecc(rel, "alternate") ? 2
+                                                                                : 1;
+    if (rank > d->entryLinkRank) {
+        d->entryLinkRank = rank;
+        clear_String(&d->entry.url);
+        appendDecoded_String_(&d->entry.url, href);
+    }
+}
+
+static void startElement_FeedParser_(iFeedParser *d, iRangecc tag) {
+    const iRangecc name = localName_(tag);
+    d->depth++;
+    if (d->depth == 1) {
+        if (equal_Rangecc(name, "feed") &&
+            equal_Rangecc(attribute_(tag, "xmlns"), atomNamespace_FeedParser_)) {
+            d->format       = atom_FeedFormat;
+            d->channelDepth = 1;
+        }
+        else if (equal_Rangecc(name, "rss") || equal_Rangecc(name, "RDF")) {
+            d->format = rss_FeedFormat;
+        }
+        else {
+            d->state = notFeed_FeedParserState;
+        }
+        return;
+    }
+    const iBool isAtom = (d->format == atom_FeedFormat);
+    if (!d->entryDepth) {
+        if (equal_Rangecc(name, isAtom ? "entry" : "item")) {
+            if (emitHeader_FeedParser_(d)) {
+                d->entryDepth    = d->depth;
+                d->entryLinkRank = 0;
+                clear_String(&d->entry.title);
+                clear_String(&d->entry.url);
+                clear_String(&d->entryPublished);
+                clear_String(&d->entryUpdated);
+            }
+        }
+        else if (!isAtom && d->depth == 2 && equal_Rangecc(name, "channel")) {
+            d->channelDepth = d->depth;
+        }
+        else if (d->channelDepth && d->depth == d->channelDepth + 1) {
+            if (equal_Rangecc(name, "title")) {
+                capture_FeedParser_(d, title_FeedField);
+            }
+            else if (equal_Rangecc(name, isAtom ? "subtitle" : "description")) {
+                capture_FeedParser_(d, subtitle_FeedField);
+            }
+        }
+        return;
+    }
+    if (d->depth != d->entryDepth + 1 || d->captureDepth) {
+        return;
+    }
+    if (equal_Rangecc(name, "title")) {
+        capture_FeedParser_(d, entryTitle_FeedField);
+    }
+    else if (equal_Rangecc(name, "link")) {
+        if (isAtom) {
+            link_FeedParser_(d, tag);
+        }
+        else {
+            capture_FeedParser_(d, entryLink_FeedField);
+        }
+    }
+    else if (equal_Rangecc(name, "published") || equal_Rangecc(name, "pubDate")) {
+        capture_FeedParser_(d, entryPublished_FeedField);
+    }
+    else if (equal_Rangecc(name, "updated") || equal_Rangecc(name, "date") /* dc:date */) {
+        capture_FeedParser_(d, entryUpdated_FeedField);
+    }
+}
+
+static void endElement_FeedParser_(iFeedParser *d) {
+    if (d->captureDepth && d->captureDepth == d->depth) {
+        normalizeSpace_String_(&d->text);
+        iString *dst = NULL;
+        switch (d->field) {
+            case title_FeedField:          dst = &d->title;          break;
+            case subtitle_FeedField:       dst = &d->subtitle;       break;
+            case entryTitle_FeedField:     dst = &d->entry.title;    break;
+            case entryLink_FeedField:      dst = &d->entry.url;      break;
+            case entryPublished_FeedField: dst = &d->entryPublished; break;
+            case entryUpdated_FeedField:   dst = &d->entryUpdated;   break;
+            default:                                                 break;
+        }
+        if (dst && isEmpty_String(dst)) {
+            set_String(dst, &d->text);
+        }
+        d->captureDepth = 0;
+        d->field        = none_FeedField;
+    }
+    if (d->entryDepth && d->entryDepth == d->depth) {
+        emitEntry_FeedParser_(d);
+        d->entryDepth = 0;
+    }
+    if (d->depth == 1) {
+        emitHeader_FeedParser_(d); /* feed without entries */
+    }
+    d->depth = iMax(0, d->depth - 1);
+}
+
+static const char *find_(const char *pos, const char *end, const char *term) {
+    const size_t len = strlen(term);
+    while (end - pos >= (ptrdiff_t) len) {
+        const char *found = memchr(pos, term[0], end - pos - len + 1);
+        if (!found) {
+            break;
+        }
+        if (!memcmp(found, term, len)) {
+            return found;
+        }
+        pos = found + 1;
+    }
+    return NULL;
+}
+
+static const char *endOfTag_(const char *pos, const char *end) {
+    char quote = 0;
+    for (; pos < end; pos++) {
+        if (quote) {
+            if (*pos == quote) {
+                quote = 0;
+            }
+        }
+        else if (*pos == '"' || *pos == '\'') {
+            quote = *pos;
+        }
+        else if (*pos == '>') {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static void parse_FeedParser_(iFeedParser *d) {
+    /* Everything that forms complete tokens is consumed. The remainder is kept for the next
+       write. Text, comments, and CDATA sections are consumed even when incomplete, so the
+       amount of pending data stays small. */
+    const char *start = constData_Block(&d->pending);
+    const char *end   = start + size_Block(&d->pending);
+    const char *pos   = start;
+    while (pos < end && d->state != notFeed_FeedParserState) {
+        if (d->mode != markup_FeedParserMode) {
+            const iBool isCData = (d->mode == cdata_FeedParserMode);
+            const char *term = find_(pos, end, isCData ? "]]>" : "-->");
+            if (!term) {
+                /* The last characters may be the beginning of the terminator. */
+                const char *safe = iMax(pos, end - 2);
+                if (isCData) {
+                    characters_FeedParser_(d, (iRangecc){ pos, safe }, iTrue);
+                }
+                pos = safe;
+                break;
+            }
+            if (isCData) {
+                characters_FeedParser_(d, (iRangecc){ pos, term }, iTrue);
+            }
+            pos     = term + 3;
+            d->mode = markup_FeedParserMode;
+            continue;
+        }
+        if (*pos != '<') {
+            const char *lt = memchr(pos, '<', end - pos);
+            if (!lt) {
+                /* Keep an incomplete entity reference for later. */
+                const char *safe = end;
+                for (const char *ch = end - 1; ch >= pos && end - ch <= 10; ch--) {
+                    if (*ch == ';') break;
+                    if (*ch == '&') {
+                        safe = ch;
+                        break;
+                    }
+                }
+                characters_FeedParser_(d, (iRangecc){ pos, safe }, iFalse);
+                pos = safe;
+                break;
+            }
+            characters_FeedParser_(d, (iRangecc){ pos, lt }, iFalse);
+            pos = lt;
+            continue;
+        }
+        if (end - pos < 9 && pos + 1 < end && pos[1] == '!' &&
+            (!memcmp(pos, "<![CDATA[", end - pos) || !memcmp(pos, "<!--", iMin(4, end - pos)))) {
+            break; /* need more data to tell what this is */
+        }
+        if (end - pos >= 4 && !memcmp(pos, "<!--", 4)) {
+            d->mode = comment_FeedParserMode;
+            pos += 4;
+            continue;
+        }
+        if (end - pos >= 9 && !memcmp(pos, "<![CDATA[", 9)) {
+            d->mode = cdata_FeedParserMode;
+            pos += 9;
+            continue;
+        }
+        const char *gt = endOfTag_(pos + 1, end);
+        if (!gt) {
+            if ((size_t) (end - pos) > maxTagSize_FeedParser_) {
+                d->state = notFeed_FeedParserState;
+            }
+            break;
+        }
+        iRangecc tag = { pos + 1, gt };
+        pos = gt + 1;
+        if (isEmpty_Range(&tag) || *tag.start == '?' || *tag.start == '!') {
+            continue; /* processing instructions and declarations are ignored */
+        }
+        if (*tag.start == '/') {
+            endElement_FeedParser_(d);
+            continue;
+        }
+        const iBool isEmptyElement = (tag.end[-1] == '/');
+        if (isEmptyElement) {
+            tag.end--;
+        }
+        startElement_FeedParser_(d, tag);
+        if (isEmptyElement) {
+            endElement_FeedParser_(d);
+        }
+    }
+    remove_Block(&d->pending, 0, pos - start);
+}
+
+void write_FeedParser(iFeedParser *d, iRangecc data) {
+    if (d->state == notFeed_FeedParserState || isEmpty_Range(&data)) {
+        return;
+    }
+    appendData_Block(&d->pending, data.start, size_Range(&data));
+    parse_FeedParser_(d);
+}
+
+void finish_FeedParser(iFeedParser *d) {
+    if (d->state == undetermined_FeedParserState) {
+        d->state = notFeed_FeedParserState; /* root element was never closed */
+    }
+    clear_Block(&d->pending);
+}
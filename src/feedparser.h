@@ -0,0 +1,60 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/range.h>
+#include <the_Foundation/string.h>
+
+/* Streaming parser for Atom and RSS feeds. Data is written in arbitrarily sized chunks as it
+   arrives, and entries are reported as soon as they have been fully parsed. No document tree
+   is built: only the feed header and the current entry are kept in memory. */
+
+iDeclareType(FeedParser)
+iDeclareTypeConstruction(FeedParser)
+
+iDeclareType(FeedParserEntry)
+
+struct Impl_FeedParserEntry {
+    iString title;
+    iString url;
+    iString date; /* YYYY-MM-DD */
+};
+
+enum iFeedParserState {
+    undetermined_FeedParserState, /* root element not seen yet */
+    feed_FeedParserState,         /* header has been parsed */
+    notFeed_FeedParserState,      /* not a feed or the XML is malformed */
+};
+
+typedef void (*iFeedParserHeaderFunc)(iAny *, const iString *title, const iString *subtitle);
+typedef void (*iFeedParserEntryFunc) (iAny *, const iFeedParserEntry *);
+
+void    setHandlers_FeedParser      (iFeedParser *, iAny *context,
+                                     iFeedParserHeaderFunc header, iFeedParserEntryFunc entry);
+void    setGeminiOutput_FeedParser  (iFeedParser *, iString *out); /* appends translated gemtext */
+void    write_FeedParser            (iFeedParser *, iRangecc data);
+void    finish_FeedParser           (iFeedParser *); /* end of data */
+
+enum iFeedParserState state_FeedParser(const iFeedParser *);
+
+iBool   isFeedMime_FeedParser       (const iString *mime);
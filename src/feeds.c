@@ -24,10 +24,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "bookmarks.h"
 #include "gmrequest.h"
 #include "visited.h"
+#include "feedparser.h"
+#include "mimehooks.h"
 #include "lang.h"
 #include "app.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/intset.h>
 #include <the_Foundation/mutex.h>
@@ -80,10 +84,13 @@ iBool isUnread_FeedEntry(const iFeedEntry *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 static int requestTimeoutSeconds_FeedJob_ = 10.0f;
+static int maxRedirects_FeedJob_          = 5;
 
 struct Impl_FeedJob {
     iString     url;
+    iString     host; /* of the current request */
     uint32_t    bookmarkId;
+    int         numRedirects;
     iTime       startTime;
     iBool       isFirstUpdate; /* hasn't been checked ever before */
     iBool       checkHeadings;
@@ -94,7 +101,9 @@ struct Impl_FeedJob {
 
 static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     initCopy_String(&d->url, &bookmark->url);
+    init_String(&d->host);
     d->bookmarkId = id_Bookmark(bookmark);
+    d->numRedirects = 0;
     d->request = NULL;
     init_PtrArray(&d->results);
     iZap(d->startTime);
@@ -103,12 +112,23 @@ static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     d->ignoreWeb     = (bookmark->flags & ignoreWeb_BookmarkFlag) != 0;
 }
 
+static void requestFinished_FeedJob_(iFeedJob *, iGmRequest *);
+
+static void cancel_FeedJob_(iFeedJob *d) {
+    if (d->request) {
+        iDisconnect(GmRequest, d->request, finished, d, requestFinished_FeedJob_);
+        cancel_GmRequest(d->request);
+        iReleasePtr(&d->request);
+    }
+}
+
 static void deinit_FeedJob(iFeedJob *d) {
-    iRelease(d->request);
+    cancel_FeedJob_(d);
     iForEach(PtrArray, i, &d->results) {
         delete_FeedEntry(i.ptr);
     }
     deinit_PtrArray(&d->results);
+    deinit_String(&d->host);
     deinit_String(&d->url);
 }
 
@@ -120,9 +140,54 @@ iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
 
 /*----------------------------------------------------------------------------------------------*/
 
-static const char *feedsFilename_Feeds_         = "feeds.txt";
+static const char *feedsFilename_Feeds_         = "feeds.2.bin";
+static const char *tempFeedsFilename_Feeds_     = "feeds.2.bin.tmp";
+static const char *legacyFeedsFilename_Feeds_   = "feeds.txt";
+static const char *magic_Feeds_                 = "lgFd";
 static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
 
+static const int   maxRequestsPerHost_Feeds_    = 2;
+
+enum iFeedsFileVersion {
+    initial_FeedsFileVersion = 0,
+    /* meta */
+    latest_FeedsFileVersion = initial_FeedsFileVersion,
+};
+
+/* The feeds file is a header followed by a log of records. Each record has a type byte and
+   a payload size (u32), so truncated or unknown records can be skipped. Feed IDs refer to the
+   most recent preceding feed record with that ID. */
+enum iFeedsRecordType {
+    refreshTime_FeedsRecordType = 'T', /* u64 seconds */
+    feed_FeedsRecordType        = 'F', /* u32 feed ID, u32 body CRC, String URL */
+    entry_FeedsRecordType       = 'E', /* u32 feed ID, u32 URL hash, u64 posted, u64 discovered,
+                                          String URL, String title */
+    removal_FeedsRecordType     = 'R', /* u32 feed ID, u32 URL hash, String URL */
+};
+
+iDeclareType(FeedBodyHashNode)
+
+struct Impl_FeedBodyHashNode {
+    iHashNode   node; /* key is the bookmark ID */
+    uint32_t    crc;
+    iStringSet *entryUrls; /* entries of the last parsed body; NULL if not parsed since launch */
+};
+
+static iFeedBodyHashNode *new_FeedBodyHashNode_(uint32_t bookmarkId) {
+    iFeedBodyHashNode *d = iMalloc(FeedBodyHashNode);
+    d->node.key  = bookmarkId;
+    d->crc       = 0;
+    d->entryUrls = NULL;
+    return d;
+}
+
+static void delete_FeedBodyHashNode_(iFeedBodyHashNode *d) {
+    if (d) {
+        iRelease(d->entryUrls);
+        free(d);
+    }
+}
+
 struct Impl_Feeds {
     iMutex *  mtx;
     iString   saveDir;
@@ -131,21 +196,63 @@ struct Impl_Feeds {
     int       refreshTimer;
     iThread * worker;
     iBool     stopWorker;
+    iCondition wakeup; /* worker waits for requests to finish */
+    int       numFinished; /* requests finished since the worker last checked */
     iPtrArray jobs; /* pending */
+    iHash     bodyHashes; /* CRC-32 of the latest fetched body of each feed */
     iSortedArray entries; /* pointers to all discovered feed entries, sorted by entry ID (URL) */
+    iThread * loader;
+    iBool     isLoaded;
+    iBool     isRefreshPending; /* requested while loading */
+    iBuffer * log; /* records not yet appended to the file */
+    size_t    numRecords; /* in the file and `log` */
+    iIntSet   loggedFeeds; /* bookmark IDs that have a feed record in the file */
+    iBool     needsCompaction;
 };
 
 static iFeeds feeds_;
 
-#define maxConcurrentRequests_Feeds 4
+static void requestFinished_FeedJob_(iFeedJob *d, iGmRequest *req) {
+    /* Called in a request thread. */
+    iUnused(d, req);
+    iGuardMutex(feeds_.mtx, {
+        feeds_.numFinished++; /* in case the worker isn't waiting right now */
+        signal_Condition(&feeds_.wakeup);
+    });
+}
 
-static void submit_FeedJob_(iFeedJob *d) {
+static void submitUrl_FeedJob_(iFeedJob *d, const iString *url) {
+    cancel_FeedJob_(d);
+    setRange_String(&d->host, urlHost_String(url));
     d->request = new_GmRequest(certs_App());
-    setUrl_GmRequest(d->request, &d->url);
+    setUrl_GmRequest(d->request, url);
+    enableFilters_GmRequest(d->request, iFalse); /* applied in `parseResult_FeedJob_` */
+    iConnect(GmRequest, d->request, finished, d, requestFinished_FeedJob_);
     initCurrent_Time(&d->startTime);
     submit_GmRequest(d->request);
 }
 
+static iBool redirect_FeedJob_(iFeedJob *d) {
+    /* Redirects are followed within the same scheme. Returns True if a new request was made. */
+    const iGmResponse *resp = lockResponse_GmRequest(d->request);
+    iBool isRedirected = iFalse;
+    if (category_GmStatusCode(resp->statusCode) == categoryRedirect_GmStatusCode &&
+        !isEmpty_String(&resp->meta) && d->numRedirects < maxRedirects_FeedJob_) {
+        iString *dstUrl = copy_String(absoluteUrl_String(url_GmRequest(d->request), &resp->meta));
+        isRedirected = equalRangeCase_Rangecc(urlScheme_String(dstUrl),
+                                              urlScheme_String(url_GmRequest(d->request)));
+        unlockResponse_GmRequest(d->request);
+        if (isRedirected) {
+            d->numRedirects++;
+            submitUrl_FeedJob_(d, dstUrl);
+        }
+        delete_String(dstUrl);
+        return isRedirected;
+    }
+    unlockResponse_GmRequest(d->request);
+    return iFalse;
+}
+
 static iBool isSubscribed_(void *context, const iBookmark *bm) {
     iUnused(context);
     return (bm->flags & subscribed_BookmarkFlag) != 0;
@@ -155,14 +262,28 @@ static const iPtrArray *listSubscriptions_(void) {
     return list_Bookmarks(bookmarks_App(), NULL, isSubscribed_, NULL);
 }
 
-static iFeedJob *startNextJob_Feeds_(iFeeds *d) {
-    if (isEmpty_PtrArray(&d->jobs)) {
-        return NULL;
+static int numRequestsToHost_(const iPtrArray *ongoing, iRangecc host) {
+    int count = 0;
+    iConstForEach(PtrArray, i, ongoing) {
+        const iFeedJob *job = i.ptr;
+        if (equalRangeCase_Rangecc(range_String(&job->host), host)) {
+            count++;
+        }
     }
-    iFeedJob *job;
-    take_PtrArray(&d->jobs, 0, (void **) &job);
-    submit_FeedJob_(job);
-    return job;
+    return count;
+}
+
+static iFeedJob *startNextJob_Feeds_(iFeeds *d, const iPtrArray *ongoing) {
+    /* The next pending job whose host isn't already busy with our requests. */
+    iForEach(PtrArray, i, &d->jobs) {
+        iFeedJob *job = i.ptr;
+        if (numRequestsToHost_(ongoing, urlHost_String(&job->url)) < maxRequestsPerHost_Feeds_) {
+            remove_PtrArrayIterator(&i);
+            submitUrl_FeedJob_(job, &job->url);
+            return job;
+        }
+    }
+    return NULL;
 }
 
 static iBool isTrimmablePunctuation_(iChar c) {
@@ -194,121 +315,322 @@ static iBool isUrlIgnored_FeedJob_(const iFeedJob *d, iRangecc url) {
     return iFalse;
 }
 
-static void parseResult_FeedJob_(iFeedJob *d) {
-    /* TODO: Should tell the user if the request failed. */
-    if (isSuccess_GmStatusCode(status_GmRequest(d->request))) {
-        iBeginCollect();
-        iTime now;
-        iTime perEntryAdjust;
-        initSeconds_Time(&perEntryAdjust, 1.0);
-        initCurrent_Time(&now);
-        iRegExp *linkPattern =
-            new_RegExp("^=>\\s*([^\\s]+)\\s+"
-                       "([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])"
-                       "([^0-9].*)",
-                       0);
-        iString src;
-        initBlock_String(&src, &lockResponse_GmRequest(d->request)->body);
-        unlockResponse_GmRequest(d->request);
-        iRangecc srcLine = iNullRange;
-        while (nextSplit_Rangecc(range_String(&src), "\n", &srcLine)) {
-            iRangecc line = srcLine;
-            trimEnd_Rangecc(&line);
-            iRegExpMatch m;
+iDeclareType(FeedJobParse)
+
+struct Impl_FeedJobParse {
+    iFeedJob *d;
+    iTime     now;
+    iTime     perEntryAdjust;
+};
+
+static void addEntry_FeedJob_(iFeedJobParse *p, iRangecc url, iRangecc date, iRangecc title) {
+    iFeedJob *d = p->d;
+    if (isUrlIgnored_FeedJob_(d, url)) {
+        return;
+    }
+    iFeedEntry *entry = new_FeedEntry();
+    entry->discovered = p->now;
+    sub_Time(&p->now, &p->perEntryAdjust);
+    entry->bookmarkId = d->bookmarkId;
+    setRange_String(&entry->url, url);
+    set_String(&entry->url, canonicalUrl_String(absoluteUrl_String(url_GmRequest(d->request), &entry->url)));
+    setRange_String(&entry->title, title);
+    trimTitle_(&entry->title);
+    int year, month, day;
+    sscanf(date.start, "%04d-%02d-%02d", &year, &month, &day);
+    init_Time(
+        &entry->posted,
+        &(iDate){
+            .year = year, .month = month, .day = day, .hour = 12 /* noon UTC */ });
+    pushBack_PtrArray(&d->results, entry);
+}
+
+static void parsedFeedEntry_FeedJob_(iAny *context, const iFeedParserEntry *entry) {
+    addEntry_FeedJob_(context,
+                      range_String(&entry->url),
+                      range_String(&entry->date),
+                      range_String(&entry->title));
+}
+
+static void parseFeedXml_FeedJob_(iFeedJobParse *p, const iBlock *body) {
+    /* Atom and RSS entries are used directly without translating to Gemtext first. */
+    iFeedParser *parser = new_FeedParser();
+    setHandlers_FeedParser(parser, p, NULL, parsedFeedEntry_FeedJob_);
+    write_FeedParser(parser, range_Block(body));
+    finish_FeedParser(parser);
+    delete_FeedParser(parser);
+}
+
+static void parseGemtext_FeedJob_(iFeedJobParse *p, const iBlock *body) {
+    iFeedJob *d = p->d;
+    iRegExp *linkPattern =
+        new_RegExp("^=>\\s*([^\\s]+)\\s+"
+                   "([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])"
+                   "([^0-9].*)",
+                   0);
+    iString src;
+    initBlock_String(&src, body);
+    iRangecc srcLine = iNullRange;
+    while (nextSplit_Rangecc(range_String(&src), "\n", &srcLine)) {
+        iRangecc line = srcLine;
+        trimEnd_Rangecc(&line);
+        iRegExpMatch m;
+        init_RegExpMatch(&m);
+        if (matchRange_RegExp(linkPattern, line, &m)) {
+            addEntry_FeedJob_(p,
+                              capturedRange_RegExpMatch(&m, 1),
+                              capturedRange_RegExpMatch(&m, 2),
+                              capturedRange_RegExpMatch(&m, 3));
+        }
+        if (d->checkHeadings) {
             init_RegExpMatch(&m);
-            if (matchRange_RegExp(linkPattern, line, &m)) {
-                const iRangecc url   = capturedRange_RegExpMatch(&m, 1);
-                const iRangecc date  = capturedRange_RegExpMatch(&m, 2);
-                const iRangecc title = capturedRange_RegExpMatch(&m, 3);
-                if (isUrlIgnored_FeedJob_(d, url)) {
-                    continue;
+            if (startsWith_Rangecc(line, "#")) {
+                while (*line.start == '#' && line.start < line.end) {
+                    line.start++;
                 }
+                trimStart_Rangecc(&line);
                 iFeedEntry *entry = new_FeedEntry();
-                entry->discovered = now;
-                sub_Time(&now, &perEntryAdjust);
+                entry->isHeading = iTrue;
+                entry->posted = p->now;
+                if (!d->isFirstUpdate) {
+                    entry->discovered = p->now;
+                    sub_Time(&p->now, &p->perEntryAdjust);
+                }
                 entry->bookmarkId = d->bookmarkId;
-                setRange_String(&entry->url, url);
-                set_String(&entry->url, canonicalUrl_String(absoluteUrl_String(url_GmRequest(d->request), &entry->url)));
-                setRange_String(&entry->title, title);
-                trimTitle_(&entry->title);
-                int year, month, day;
-                sscanf(date.start, "%04d-%02d-%02d", &year, &month, &day);
-                init_Time(
-                    &entry->posted,
-                    &(iDate){
-                        .year = year, .month = month, .day = day, .hour = 12 /* noon UTC */ });
+                iString *title = newRange_String(line);
+                set_String(&entry->title, title);
+                set_String(&entry->url, &d->url);
+                appendChar_String(&entry->url, '#');
+                append_String(&entry->url, collect_String(urlEncode_String(title)));
+                set_String(&entry->url, canonicalUrl_String(&entry->url));
+                delete_String(title);
                 pushBack_PtrArray(&d->results, entry);
             }
-            if (d->checkHeadings) {
-                init_RegExpMatch(&m);
-                if (startsWith_Rangecc(line, "#")) {
-                    while (*line.start == '#' && line.start < line.end) {
-                        line.start++;
-                    }
-                    trimStart_Rangecc(&line);
-                    iFeedEntry *entry = new_FeedEntry();
-                    entry->isHeading = iTrue;
-                    entry->posted = now;
-                    if (!d->isFirstUpdate) {
-                        entry->discovered = now;
-                        sub_Time(&now, &perEntryAdjust);
-                    }
-                    entry->bookmarkId = d->bookmarkId;
-                    iString *title = newRange_String(line);
-                    set_String(&entry->title, title);
-                    set_String(&entry->url, &d->url);
-                    appendChar_String(&entry->url, '#');
-                    append_String(&entry->url, collect_String(urlEncode_String(title)));
-                    set_String(&entry->url, canonicalUrl_String(&entry->url));
-                    delete_String(title);
-                    pushBack_PtrArray(&d->results, entry);
-                }
+        }
+    }
+    deinit_String(&src);
+    iRelease(linkPattern);
+}
+
+static void parseResult_FeedJob_(iFeedJob *d) {
+    /* TODO: Should tell the user if the request failed. */
+    if (isSuccess_GmStatusCode(status_GmRequest(d->request))) {
+        iBeginCollect();
+        iFeedJobParse p = { .d = d };
+        initSeconds_Time(&p.perEntryAdjust, 1.0);
+        initCurrent_Time(&p.now);
+        iGmResponse *resp = lockResponse_GmRequest(d->request);
+        const iMimeHooks *hooks = mimeHooks_App();
+        if (willTranslateFeed_MimeHooks(hooks, &resp->meta)) {
+            parseFeedXml_FeedJob_(&p, &resp->body);
+        }
+        else {
+            iBlock *filtered = willTryFilter_MimeHooks(hooks, &resp->meta)
+                                   ? tryFilter_MimeHooks(hooks, &resp->meta, &resp->body, &d->url)
+                                   : NULL;
+            parseGemtext_FeedJob_(&p, filtered ? filtered : &resp->body);
+            if (filtered) {
+                delete_Block(filtered);
             }
         }
-        deinit_String(&src);
-        iRelease(linkPattern);
+        unlockResponse_GmRequest(d->request);
         iEndCollect();
     }
 }
 
-static void save_Feeds_(iFeeds *d) {
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
-    if (open_File(f, write_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iString *str = new_String();
-        format_String(str, "%llu\n# Feeds\n", (unsigned long long)
-                      integralSeconds_Time(&d->lastRefreshedAt));
-        write_File(f, utf8_String(str));
-        /* Index of feeds for IDs. */ {
-            iConstForEach(PtrArray, i, listSubscriptions_()) {
-                const iBookmark *bm = i.ptr;
-                format_String(str, "%08x %s\n", id_Bookmark(bm), cstr_String(&bm->url));
-                write_File(f, utf8_String(str));
-            }
+static uint32_t urlHash_FeedEntry_(const iFeedEntry *d) {
+    return iCrc32(cstr_String(&d->url), size_String(&d->url));
+}
+
+static void writeRecord_Feeds_(iStream *outs, char type, iBuffer *payload) {
+    const iBlock *data = data_Buffer(payload);
+    write8_Stream(outs, type);
+    writeU32_Stream(outs, (uint32_t) size_Block(data));
+    writeData_Stream(outs, constData_Block(data), size_Block(data));
+}
+
+static iBuffer *newPayload_Feeds_(void) {
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    return buf;
+}
+
+static void writeRefreshTime_Feeds_(const iFeeds *d, iStream *outs) {
+    iBuffer *rec = newPayload_Feeds_();
+    writeU64_Stream(stream_Buffer(rec), integralSeconds_Time(&d->lastRefreshedAt));
+    writeRecord_Feeds_(outs, refreshTime_FeedsRecordType, rec);
+    iRelease(rec);
+}
+
+static iBool writeFeed_Feeds_(const iFeeds *d, iStream *outs, uint32_t bookmarkId) {
+    const iBookmark *bm = get_Bookmarks(bookmarks_App(), bookmarkId);
+    if (!bm) {
+        return iFalse;
+    }
+    const iFeedBodyHashNode *hash =
+        (const iFeedBodyHashNode *) value_Hash(&d->bodyHashes, bookmarkId);
+    iBuffer *rec = newPayload_Feeds_();
+    writeU32_Stream(stream_Buffer(rec), bookmarkId);
+    writeU32_Stream(stream_Buffer(rec), hash ? hash->crc : 0);
+    serialize_String(&bm->url, stream_Buffer(rec));
+    writeRecord_Feeds_(outs, feed_FeedsRecordType, rec);
+    iRelease(rec);
+    return iTrue;
+}
+
+static void writeEntry_Feeds_(iStream *outs, const iFeedEntry *entry, iBool isRemoval) {
+    iBuffer *rec  = newPayload_Feeds_();
+    iStream *outp = stream_Buffer(rec);
+    writeU32_Stream(outp, entry->bookmarkId);
+    writeU32_Stream(outp, urlHash_FeedEntry_(entry));
+    if (!isRemoval) {
+        writeU64_Stream(outp, integralSeconds_Time(&entry->posted));
+        writeU64_Stream(outp, integralSeconds_Time(&entry->discovered));
+    }
+    serialize_String(&entry->url, outp);
+    if (!isRemoval) {
+        serialize_String(&entry->title, outp);
+    }
+    writeRecord_Feeds_(outs, isRemoval ? removal_FeedsRecordType : entry_FeedsRecordType, rec);
+    iRelease(rec);
+}
+
+static void logFeed_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    lock_Mutex(d->mtx);
+    if (writeFeed_Feeds_(d, stream_Buffer(d->log), bookmarkId)) {
+        insert_IntSet(&d->loggedFeeds, bookmarkId);
+        d->numRecords++;
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void logEntry_Feeds_(iFeeds *d, const iFeedEntry *entry, iBool isRemoval) {
+    lock_Mutex(d->mtx);
+    /* Entries refer to a feed record written during this session, since bookmark IDs
+       are not persistent. */
+    if (!contains_IntSet(&d->loggedFeeds, entry->bookmarkId)) {
+        logFeed_Feeds_(d, entry->bookmarkId);
+    }
+    if (contains_IntSet(&d->loggedFeeds, entry->bookmarkId)) {
+        writeEntry_Feeds_(stream_Buffer(d->log), entry, isRemoval);
+        d->numRecords++;
+    }
+    else {
+        d->needsCompaction = iTrue; /* the feed bookmark is gone */
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void resetLog_Feeds_(iFeeds *d) {
+    close_Buffer(d->log);
+    openEmpty_Buffer(d->log);
+}
+
+static iBool appendLog_Feeds_(iFeeds *d, const iString *path) {
+    /* Returns True if the entire log was appended. The log is kept otherwise. */
+    const iBlock *log = data_Buffer(d->log);
+    if (isEmpty_Block(log)) {
+        return iTrue;
+    }
+    iBool  ok = iFalse;
+    iFile *f  = new_File(path);
+    if (open_File(f, append_FileMode)) {
+        ok = (write_File(f, log) == size_Block(log));
+        close_File(f);
+    }
+    iRelease(f);
+    if (ok) {
+        resetLog_Feeds_(d);
+    }
+    return ok;
+}
+
+static void compact_Feeds_(iFeeds *d) {
+    /* Write a new file with just the current state. Entries discovered long ago are
+       forgotten. The new state is prepared in memory so nothing changes unless the file
+       is completely written. */
+    const iString *tempPath = collect_String(concatCStr_Path(&d->saveDir, tempFeedsFilename_Feeds_));
+    const iString *path     = collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_));
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    iIntSet  loggedFeeds;
+    init_IntSet(&loggedFeeds);
+    size_t numRecords = 1;
+    writeData_Stream(outs, magic_Feeds_, 4);
+    writeU32_Stream(outs, latest_FeedsFileVersion);
+    writeRefreshTime_Feeds_(d, outs);
+    iConstForEach(PtrArray, i, listSubscriptions_()) {
+        const uint32_t id = id_Bookmark(i.ptr);
+        if (writeFeed_Feeds_(d, outs, id)) {
+            insert_IntSet(&loggedFeeds, id);
+            numRecords++;
         }
-        writeData_File(f, "# Entries\n", 10);
-        iTime now;
-        initCurrent_Time(&now);
-        iConstForEach(Array, i, &d->entries.values) {
-            const iFeedEntry *entry = *(const iFeedEntry **) i.value;
-            /* Heading entries are kept as long as they are present in the source. */
-            if (!entry->isHeading && isValid_Time(&entry->discovered) &&
-                secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
-                continue; /* Forget entries discovered long ago. */
-            }
-            format_String(str, "%x\n%llu\n%llu\n%s\n%s\n",
-                          entry->bookmarkId,
-                          (unsigned long long) integralSeconds_Time(&entry->posted),
-                          (unsigned long long) integralSeconds_Time(&entry->discovered),
-                          cstr_String(&entry->url),
-                          cstr_String(&entry->title));
-            write_File(f, utf8_String(str));
-        }
-        delete_String(str);
+    }
+    iTime now;
+    initCurrent_Time(&now);
+    iConstForEach(Array, j, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) j.value;
+        if (!contains_IntSet(&loggedFeeds, entry->bookmarkId)) {
+            continue; /* no longer subscribed */
+        }
+        /* Heading entries are kept as long as they are present in the source. */
+        if (!entry->isHeading && isValid_Time(&entry->discovered) &&
+            secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
+            continue; /* Forget entries discovered long ago. */
+        }
+        writeEntry_Feeds_(outs, entry, iFalse);
+        numRecords++;
+    }
+    iBool  ok = iFalse;
+    iFile *f  = new_File(tempPath);
+    if (open_File(f, writeOnly_FileMode)) {
+        ok = (write_File(f, data_Buffer(buf)) == size_Block(data_Buffer(buf)));
         close_File(f);
-        unlock_Mutex(d->mtx);
     }
     iRelease(f);
+    iRelease(buf);
+    if (ok) {
+        commitFile_App(cstr_String(path), cstr_String(tempPath));
+        /* The new file includes everything that was logged. */
+        resetLog_Feeds_(d);
+        clear_IntSet(&d->loggedFeeds);
+        iConstForEach(IntSet, k, &loggedFeeds) {
+            insert_IntSet(&d->loggedFeeds, *k.value);
+        }
+        d->numRecords      = numRecords;
+        d->needsCompaction = iFalse;
+    }
+    else {
+        /* The old file and log are kept as they are. If there is a file, the log can still be
+           appended to it; compaction is tried again on the next save. */
+        remove(cstr_String(tempPath));
+        if (fileExists_FileInfo(path)) {
+            appendLog_Feeds_(d, path);
+        }
+        d->needsCompaction = iTrue;
+    }
+    deinit_IntSet(&loggedFeeds);
+}
+
+static void save_Feeds_(iFeeds *d) {
+    /* Changed entries are appended to the file. The file is rewritten when the log has grown
+       much larger than the number of entries. */
+    lock_Mutex(d->mtx);
+    iBeginCollect();
+    const iString *path = collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_));
+    if (!fileExists_FileInfo(path)) {
+        d->needsCompaction = iTrue;
+    }
+    if (d->needsCompaction || d->numRecords > 2 * size_SortedArray(&d->entries) + 1000) {
+        compact_Feeds_(d);
+    }
+    else if (!appendLog_Feeds_(d, path)) {
+        /* A partial record may have been appended, so rewrite the whole file next time. */
+        d->needsCompaction = iTrue;
+    }
+    iEndCollect();
+    unlock_Mutex(d->mtx);
 }
 
 static iBool isHeadingEntry_FeedEntry_(const iFeedEntry *d) {
@@ -349,6 +671,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (!contains_StringSet(known, &entry->url)) {
 //                printf("  {%s} is new\n", cstr_String(&entry->url));
                 insert_SortedArray(&d->entries, &entry);
+                logEntry_Feeds_(d, entry, iFalse);
                 gotNew = iTrue;
                 remove_PtrArrayIterator(&i);
             }
@@ -364,6 +687,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (entry->bookmarkId == sourceId &&
                 !contains_StringSet(presentInSource, &entry->url)) {
 //                printf("    {%s}\n", cstr_String(&entry->url));
+                logEntry_Feeds_(d, entry, iTrue);
                 delete_FeedEntry(entry);
                 remove_ArrayIterator(&e);
             }
@@ -402,6 +726,12 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
                 iAssert(!isHeadingEntry_FeedEntry_(entry));
                 /* Already known, but update it, maybe the time and label have changed. */
                 iBool changed = iFalse;
+                /* Unchanged entries are saved only when the saved discovery time is getting
+                   old enough for them to be discarded. */
+                const iBool isModified =
+                    !equal_String(&existing->title, &entry->title) ||
+                    cmp_Time(&existing->posted, &entry->posted) != 0 ||
+                    secondsSince_Time(&now, &existing->discovered) > maxAge_Visited / 2;
                 iDate newDate;
                 iDate oldDate;
                 init_Date(&newDate, &entry->posted);
@@ -415,6 +745,9 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
                 existing->posted     = entry->posted;
                 existing->discovered = entry->discovered; /* prevent discarding */
                 delete_FeedEntry(entry);
+                if (isModified) {
+                    logEntry_Feeds_(d, existing, iFalse);
+                }
                 if (changed) {
                     /* TODO: better to use a new flag for read feed entries? */
                     removeUrl_Visited(visited_App(), &existing->url);
@@ -423,6 +756,7 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             }
             else {
                 insert_SortedArray(&d->entries, &entry);
+                logEntry_Feeds_(d, entry, iFalse);
                 gotNew = iTrue;
             }
             remove_PtrArrayIterator(&i);
@@ -434,60 +768,165 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
     return gotNew;
 }
 
+static iBool isUnchanged_Feeds_(iFeeds *d, const iFeedJob *job) {
+    /* Compares the body with the one fetched in the previous refresh. The body must also
+       have been parsed since launch, so it's known which entries it contains. */
+    if (!isSuccess_GmStatusCode(status_GmRequest(job->request))) {
+        return iFalse;
+    }
+    const iBlock  *body = &lockResponse_GmRequest(job->request)->body;
+    const uint32_t crc  = iCrc32(constData_Block(body), size_Block(body));
+    unlockResponse_GmRequest(job->request);
+    iBool isUnchanged = iFalse;
+    lock_Mutex(d->mtx);
+    iFeedBodyHashNode *node = (iFeedBodyHashNode *) value_Hash(&d->bodyHashes, job->bookmarkId);
+    if (node) {
+        isUnchanged = (node->crc == crc && node->entryUrls);
+    }
+    else {
+        node = new_FeedBodyHashNode_(job->bookmarkId);
+        insert_Hash(&d->bodyHashes, &node->node);
+    }
+    if (!isUnchanged) {
+        node->crc = crc;
+        logFeed_Feeds_(d, job->bookmarkId);
+    }
+    unlock_Mutex(d->mtx);
+    return isUnchanged;
+}
+
+static void setEntryUrls_Feeds_(iFeeds *d, uint32_t sourceId, const iPtrArray *parsed) {
+    iStringSet *urls = new_StringSet();
+    iConstForEach(PtrArray, i, parsed) {
+        insert_StringSet(urls, &((const iFeedEntry *) i.ptr)->url);
+    }
+    lock_Mutex(d->mtx);
+    iFeedBodyHashNode *node = (iFeedBodyHashNode *) value_Hash(&d->bodyHashes, sourceId);
+    if (node) {
+        iRelease(node->entryUrls);
+        node->entryUrls = urls;
+        urls = NULL;
+    }
+    unlock_Mutex(d->mtx);
+    iRelease(urls);
+}
+
+static iBool isTouchable_Feeds_(const iStringSet *urls, uint32_t sourceId,
+                                const iFeedEntry *entry) {
+    return entry->bookmarkId == sourceId && !entry->isHeading &&
+           isValid_Time(&entry->discovered) && contains_StringSet(urls, &entry->url);
+}
+
+static void touchEntries_Feeds_(iFeeds *d, uint32_t sourceId) {
+    /* The source hasn't changed, so the entries it still contains are moved forward in time
+       as if they had just been discovered again. This keeps them from being discarded as old.
+       Entries from older versions of the source are left to expire. To avoid saving them on
+       every refresh, this is only done when they are halfway to being discarded. */
+    lock_Mutex(d->mtx);
+    const iFeedBodyHashNode *node =
+        (const iFeedBodyHashNode *) value_Hash(&d->bodyHashes, sourceId);
+    if (!node || !node->entryUrls) {
+        unlock_Mutex(d->mtx);
+        return;
+    }
+    const iStringSet *urls = node->entryUrls;
+    iTime now, latest, delta;
+    initCurrent_Time(&now);
+    iZap(latest);
+    iConstForEach(Array, i, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) i.value;
+        if (isTouchable_Feeds_(urls, sourceId, entry)) {
+            max_Time(&latest, &entry->discovered);
+        }
+    }
+    if (isValid_Time(&latest) && secondsSince_Time(&now, &latest) > maxAge_Visited / 2) {
+        delta = now;
+        sub_Time(&delta, &latest);
+        iForEach(Array, j, &d->entries.values) {
+            iFeedEntry *entry = *(iFeedEntry **) j.value;
+            if (isTouchable_Feeds_(urls, sourceId, entry)) {
+                add_Time(&entry->discovered, &delta);
+                logEntry_Feeds_(d, entry, iFalse);
+            }
+        }
+    }
+    unlock_Mutex(d->mtx);
+}
+
 static iThreadResult fetch_Feeds_(iThread *thread) {
     iFeeds *d = &feeds_;
     iUnused(thread);
-    iFeedJob *work[maxConcurrentRequests_Feeds]; /* We'll do a couple of concurrent requests. */
-    iZap(work);
+    iPtrArray ongoing; /* jobs with a submitted request */
+    init_PtrArray(&ongoing);
     iBool gotNew = iFalse;
     postCommand_App("feeds.update.started");
     const size_t totalJobs = size_PtrArray(&d->jobs);
     int numFinishedJobs = 0;
+    lock_Mutex(d->mtx);
+    d->numFinished = 0;
     while (!d->stopWorker) {
-        /* Start new jobs. */
-        iForIndices(i, work) {
-            if (!work[i]) {
-                work[i] = startNextJob_Feeds_(d);
-            }
+        /* Start new jobs, limiting the number of concurrent requests in total and per host. */
+        const size_t maxOngoing = iMax(1, prefs_App()->maxFeedRequests);
+        while (size_PtrArray(&ongoing) < maxOngoing) {
+            iFeedJob *job = startNextJob_Feeds_(d, &ongoing);
+            if (!job) break;
+            pushBack_PtrArray(&ongoing, job);
+        }
+        /* Stop if everything has finished. */
+        if (isEmpty_PtrArray(&ongoing) && isEmpty_PtrArray(&d->jobs)) {
+            break;
+        }
+        /* Requests signal when they finish. Timeouts are checked every second. */
+        if (!d->numFinished) {
+            iTime timeout;
+            initTimeout_Time(&timeout, 1.0);
+            waitTimeout_Condition(&d->wakeup, d->mtx, &timeout);
         }
-        sleep_Thread(0.5); /* TODO: wait on a Condition so we can exit quickly */
+        d->numFinished = 0;
         if (d->stopWorker) break;
-        size_t ongoing = 0;
+        unlock_Mutex(d->mtx);
         iBool doNotify = iFalse;
-        iForIndices(i, work) {
-            if (work[i]) {
-                if (isFinished_GmRequest(work[i]->request)) {
-                    /* TODO: Handle redirects. Need to resubmit the job with new URL. */
-                    parseResult_FeedJob_(work[i]);
-                    gotNew |= updateEntries_Feeds_(
-                        d, work[i]->checkHeadings, work[i]->bookmarkId, &work[i]->results);
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                    numFinishedJobs++;
-                    doNotify = iTrue;
+        iForEach(PtrArray, i, &ongoing) {
+            iFeedJob *job = i.ptr;
+            if (isFinished_GmRequest(job->request)) {
+                if (redirect_FeedJob_(job)) {
+                    continue; /* resubmitted */
                 }
-                else if (isTimedOut_FeedJob_(work[i])) {
-                    /* Maybe we'll get it next time! */
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                    numFinishedJobs++;
-                    doNotify = iTrue;
+                if (isUnchanged_Feeds_(d, job)) {
+                    touchEntries_Feeds_(d, job->bookmarkId);
                 }
                 else {
-                    ongoing++;
+                    parseResult_FeedJob_(job);
+                    setEntryUrls_Feeds_(d, job->bookmarkId, &job->results);
+                    gotNew |= updateEntries_Feeds_(
+                        d, job->checkHeadings, job->bookmarkId, &job->results);
                 }
-                /* TODO: abort job if it takes too long (> 15 seconds?) */
             }
+            else if (!isTimedOut_FeedJob_(job)) {
+                continue;
+            }
+            /* Finished or timed out. If the latter, maybe we'll get it next time! */
+            delete_FeedJob(job);
+            remove_PtrArrayIterator(&i);
+            numFinishedJobs++;
+            doNotify = iTrue;
         }
         if (doNotify) {
             postCommandf_App("feeds.update.progress arg:%d total:%zu", numFinishedJobs, totalJobs);
         }
-        /* Stop if everything has finished. */
-        if (ongoing == 0 && isEmpty_PtrArray(&d->jobs)) {
-            break;
-        }
+        lock_Mutex(d->mtx);
     }
-    initCurrent_Time(&d->lastRefreshedAt);
+    unlock_Mutex(d->mtx);
+    /* Abandon unfinished requests if stopped early. */
+    iForEach(PtrArray, i, &ongoing) {
+        delete_FeedJob(i.ptr);
+    }
+    deinit_PtrArray(&ongoing);
+    iGuardMutex(d->mtx, {
+        initCurrent_Time(&d->lastRefreshedAt);
+        writeRefreshTime_Feeds_(d, stream_Buffer(d->log));
+        d->numRecords++;
+    });
     save_Feeds_(d);
     /* Check if there are visited URLs marked as Kept that can be cleared because they are no
        longer present in the database. */ {
@@ -516,6 +955,16 @@ static iBool startWorker_Feeds_(iFeeds *d) {
     if (d->worker) {
         return iFalse; /* Refresh is already ongoing. */
     }
+    iBool isLoaded;
+    iGuardMutex(d->mtx, {
+        isLoaded = d->isLoaded;
+        if (!isLoaded) {
+            d->isRefreshPending = iTrue; /* started after loading */
+        }
+    });
+    if (!isLoaded) {
+        return iFalse;
+    }
     /* Queue up all the subscriptions for the worker. */
     iConstForEach(PtrArray, i, listSubscriptions_()) {
         const iBookmark *bm = i.ptr;
@@ -545,7 +994,10 @@ static uint32_t refresh_Feeds_(uint32_t interval, void *data) {
 
 static void stopWorker_Feeds_(iFeeds *d) {
     if (d->worker) {
-        d->stopWorker = iTrue;
+        iGuardMutex(d->mtx, {
+            d->stopWorker = iTrue;
+            signal_Condition(&d->wakeup);
+        });
         join_Thread(d->worker);
         iReleasePtr(&d->worker);
     }
@@ -573,9 +1025,9 @@ struct Impl_FeedHashNode {
     uint32_t  bookmarkId;
 };
 
-static void load_Feeds_(iFeeds *d) {
-    /* TODO: If there are lots of entries, it would make sense to load async. */
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
+static void loadLegacy_Feeds_(iFeeds *d) {
+    /* Older versions saved a text file. */
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, legacyFeedsFilename_Feeds_)));
     if (open_File(f, read_FileMode | text_FileMode)) {
         iBlock * src     = readAll_File(f);
         iRangecc line    = iNullRange;
@@ -679,6 +1131,215 @@ static void load_Feeds_(iFeeds *d) {
     iRelease(f);
 }
 
+iDeclareType(FeedEntryNode)
+
+struct Impl_FeedEntryNode {
+    iHashNode       node; /* key combines the bookmark ID and the URL hash */
+    iFeedEntry *    entry;
+    iFeedEntryNode *next; /* another entry with the same key */
+};
+
+static uint32_t entryKey_Feeds_(uint32_t bookmarkId, uint32_t urlHash) {
+    return urlHash ^ (bookmarkId * 0x9e3779b1u);
+}
+
+static iFeedEntry *takeEntry_Feeds_(iHash *entries, uint32_t key, const iFeedEntry *match) {
+    iFeedEntryNode *prev = NULL;
+    for (iFeedEntryNode *n = (iFeedEntryNode *) value_Hash(entries, key); n; prev = n, n = n->next) {
+        if (n->entry->bookmarkId == match->bookmarkId && equal_String(&n->entry->url, &match->url)) {
+            iFeedEntry *entry = n->entry;
+            if (prev) {
+                prev->next = n->next;
+            }
+            else {
+                remove_Hash(entries, key);
+                if (n->next) {
+                    insert_Hash(entries, &n->next->node);
+                }
+            }
+            free(n);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void insertEntry_Feeds_(iHash *entries, uint32_t key, iFeedEntry *entry) {
+    iFeedEntryNode *n = iMalloc(FeedEntryNode);
+    n->node.key = key;
+    n->entry    = entry;
+    n->next     = (iFeedEntryNode *) remove_Hash(entries, key);
+    insert_Hash(entries, &n->node);
+}
+
+static iBool read_Feeds_(iFeeds *d, const iBlock *src) {
+    /* Replays the records in the file. Entries are collected in a hash keyed by feed and URL
+       hash, and sorted into the entries array once at the end. */
+    iBuffer *buf = new_Buffer();
+    open_Buffer(buf, src);
+    iStream *ins = stream_Buffer(buf);
+    char magic[4];
+    readData_Stream(ins, sizeof(magic), magic);
+    if (size_Block(src) < 8 || memcmp(magic, magic_Feeds_, sizeof(magic)) ||
+        readU32_Stream(ins) > latest_FeedsFileVersion) {
+        iRelease(buf);
+        return iFalse;
+    }
+    iHash feeds; /* file's feed IDs to bookmark IDs */
+    iHash entries;
+    iHash bodyHashes;
+    iIntSet checked;
+    init_Hash(&feeds);
+    init_Hash(&entries);
+    init_Hash(&bodyHashes);
+    init_IntSet(&checked);
+    iTime lastRefreshedAt;
+    iZap(lastRefreshedAt);
+    size_t numRecords = 0;
+    iString *url = new_String();
+    iFeedEntry *entry = new_FeedEntry();
+    while (pos_Stream(ins) + 5 <= size_Block(src)) {
+        const char   type  = read8_Stream(ins);
+        const size_t size  = readU32_Stream(ins);
+        const size_t start = pos_Stream(ins);
+        if (start + size > size_Block(src)) {
+            break; /* truncated */
+        }
+        switch (type) {
+            case refreshTime_FeedsRecordType:
+                lastRefreshedAt.ts.tv_sec = readU64_Stream(ins);
+                break;
+            case feed_FeedsRecordType: {
+                const uint32_t feedId = readU32_Stream(ins);
+                const uint32_t crc    = readU32_Stream(ins);
+                deserialize_String(url, ins);
+                const uint32_t bookmarkId = findUrl_Bookmarks(bookmarks_App(), url);
+                iFeedHashNode *node = (iFeedHashNode *) value_Hash(&feeds, feedId);
+                if (!node) {
+                    node = iMalloc(FeedHashNode);
+                    node->node.key = feedId;
+                    insert_Hash(&feeds, &node->node);
+                }
+                node->bookmarkId = bookmarkId;
+                if (bookmarkId) {
+                    insert_IntSet(&checked, bookmarkId);
+                    iFeedBodyHashNode *hash =
+                        (iFeedBodyHashNode *) value_Hash(&bodyHashes, bookmarkId);
+                    if (!hash) {
+                        hash = new_FeedBodyHashNode_(bookmarkId);
+                        insert_Hash(&bodyHashes, &hash->node);
+                    }
+                    hash->crc = crc;
+                }
+                break;
+            }
+            case entry_FeedsRecordType:
+            case removal_FeedsRecordType: {
+                const iFeedHashNode *node =
+                    (const iFeedHashNode *) value_Hash(&feeds, readU32_Stream(ins));
+                const uint32_t urlHash = readU32_Stream(ins);
+                if (type == entry_FeedsRecordType) {
+                    entry->posted.ts.tv_sec     = readU64_Stream(ins);
+                    entry->discovered.ts.tv_sec = readU64_Stream(ins);
+                }
+                deserialize_String(&entry->url, ins);
+                if (!node || !node->bookmarkId) {
+                    break;
+                }
+                entry->bookmarkId = node->bookmarkId;
+                const uint32_t key = entryKey_Feeds_(entry->bookmarkId, urlHash);
+                iFeedEntry *old = takeEntry_Feeds_(&entries, key, entry);
+                if (old) {
+                    delete_FeedEntry(old);
+                }
+                if (type == entry_FeedsRecordType) {
+                    deserialize_String(&entry->title, ins);
+                    entry->isHeading = isHeadingEntry_FeedEntry_(entry);
+                    insertEntry_Feeds_(&entries, key, entry);
+                    entry = new_FeedEntry();
+                }
+                break;
+            }
+            default:
+                break; /* unknown record */
+        }
+        seek_Stream(ins, start + size);
+        numRecords++;
+    }
+    delete_FeedEntry(entry);
+    delete_String(url);
+    iRelease(buf);
+    /* Take the loaded entries into use. */
+    lock_Mutex(d->mtx);
+    d->lastRefreshedAt = lastRefreshedAt;
+    d->numRecords = numRecords;
+    iForEach(Hash, i, &entries) {
+        for (iFeedEntryNode *n = (iFeedEntryNode *) i.value; n; ) {
+            iFeedEntryNode *next = n->next;
+            pushBack_Array(&d->entries.values, &n->entry);
+            free(n);
+            n = next;
+        }
+    }
+    sort_Array(&d->entries.values, cmp_FeedEntryPtr_);
+    iForEach(Hash, j, &bodyHashes) {
+        iFeedBodyHashNode *hash = remove_HashIterator(&j);
+        delete_FeedBodyHashNode_((iFeedBodyHashNode *) insert_Hash(&d->bodyHashes, &hash->node));
+    }
+    iConstForEach(IntSet, k, &checked) {
+        insert_IntSet(&d->previouslyCheckedFeeds, *k.value);
+    }
+    unlock_Mutex(d->mtx);
+    iForEach(Hash, m, &feeds) {
+        free(m.value);
+    }
+    deinit_Hash(&feeds);
+    deinit_Hash(&entries);
+    deinit_Hash(&bodyHashes);
+    deinit_IntSet(&checked);
+    return iTrue;
+}
+
+static iThreadResult load_Feeds_(iThread *thread) {
+    iFeeds *d = &feeds_;
+    iUnused(thread);
+    iBeginCollect();
+    iBool isLoaded = iFalse;
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
+    if (open_File(f, readOnly_FileMode)) {
+        iBlock *src = readAll_File(f);
+        isLoaded = read_Feeds_(d, src);
+        delete_Block(src);
+    }
+    iRelease(f);
+    if (!isLoaded) {
+        iGuardMutex(d->mtx, {
+            loadLegacy_Feeds_(d);
+            d->needsCompaction = iTrue;
+        });
+    }
+    iEndCollect();
+    /* Update feeds if it has been a while. */
+    int intervalSec = updateIntervalSeconds_Feeds_;
+    iBool isRefreshPending;
+    iGuardMutex(d->mtx, {
+        d->isLoaded = iTrue;
+        isRefreshPending = d->isRefreshPending;
+        if (isValid_Time(&d->lastRefreshedAt)) {
+            const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
+            intervalSec = iMax(1, updateIntervalSeconds_Feeds_ - elapsed);
+        }
+    });
+    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    iBeginCollect();
+    postCommandf_App("feeds.update.loaded unread:%zu", numUnread_Feeds());
+    iEndCollect();
+    if (isRefreshPending) {
+        postCommand_App("feeds.refresh");
+    }
+    return 0;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 void init_Feeds(const char *saveDir) {
@@ -688,24 +1349,41 @@ void init_Feeds(const char *saveDir) {
     init_IntSet(&d->previouslyCheckedFeeds);
     iZap(d->lastRefreshedAt);
     d->worker = NULL;
+    d->stopWorker = iFalse;
+    init_Condition(&d->wakeup);
+    d->numFinished = 0;
     init_PtrArray(&d->jobs);
+    init_Hash(&d->bodyHashes);
     init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
-    load_Feeds_(d);
-    /* Update feeds if it has been a while. */
-    int intervalSec = updateIntervalSeconds_Feeds_;
-    if (isValid_Time(&d->lastRefreshedAt)) {
-        const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
-        intervalSec = iMax(1, updateIntervalSeconds_Feeds_ - elapsed);
-    }
-    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    d->isLoaded = iFalse;
+    d->isRefreshPending = iFalse;
+    d->log = new_Buffer();
+    openEmpty_Buffer(d->log);
+    d->numRecords = 0;
+    init_IntSet(&d->loggedFeeds);
+    d->needsCompaction = iFalse;
+    d->refreshTimer = 0;
+    /* Loading is done in the background; the refresh timer is started afterwards. */
+    d->loader = new_Thread(load_Feeds_);
+    start_Thread(d->loader);
 }
 
 void deinit_Feeds(void) {
     iFeeds *d = &feeds_;
+    join_Thread(d->loader);
+    iRelease(d->loader);
     SDL_RemoveTimer(d->refreshTimer);
     stopWorker_Feeds_(d);
+    save_Feeds_(d); /* changes made since the last refresh */
+    iRelease(d->log);
+    deinit_IntSet(&d->loggedFeeds);
     iAssert(isEmpty_PtrArray(&d->jobs));
     deinit_PtrArray(&d->jobs);
+    iForEach(Hash, h, &d->bodyHashes) {
+        delete_FeedBodyHashNode_((iFeedBodyHashNode *) h.value);
+    }
+    deinit_Hash(&d->bodyHashes);
+    deinit_Condition(&d->wakeup);
     deinit_String(&d->saveDir);
     delete_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
@@ -726,13 +1404,16 @@ void refreshFinished_Feeds(void) {
 
 void removeEntries_Feeds(uint32_t feedBookmarkId) {
     iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         if ((*entry)->bookmarkId == feedBookmarkId) {
+            logEntry_Feeds_(d, *entry, iTrue);
             delete_FeedEntry(*entry);
             remove_ArrayIterator(&i);
         }
     }
+    unlock_Mutex(d->mtx);
 }
 
 void markEntryAsRead_Feeds(uint32_t feedBookmarkId, const iString *entryUrl, iBool isRead) {
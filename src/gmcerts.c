@@ -33,10 +33,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/stringarray.h>
 #include <the_Foundation/stringhash.h>
 #include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/time.h>
 #include <ctype.h>
 
 static const char *trustedFilename_GmCerts_   = "trusted.2.txt";
+static const char *tempTrustedFilename_GmCerts_ = "trusted.2.txt.tmp";
+static const char *trustedJournalFilename_GmCerts_ = "trusted.2.journal.txt";
+static const double journalFlushDelay_GmCerts_ = 2.0; /* seconds */
 static const char *identsDir_GmCerts_         = "idents";
 static const char *oldIdentsFilename_GmCerts_ = "idents.binary";
 static const char *identsFilename_GmCerts_    = "idents.lgr";
@@ -70,6 +74,10 @@ static int cmpUrl_GmIdentity_(const iString *a, const iString *b) {
     return cmpStringCase_String(a, b);
 }
 
+/* Incremented whenever any identity's use-URLs change, so GmCerts knows to rebuild its
+   URL prefix trie. */
+static unsigned useGeneration_GmIdentity_ = 1;
+
 void init_GmIdentity(iGmIdentity *d) {
     d->icon  = 0x1f511; /* key */
     d->flags = 0;
@@ -80,6 +88,9 @@ void init_GmIdentity(iGmIdentity *d) {
 }
 
 void deinit_GmIdentity(iGmIdentity *d) {
+    if (!isEmpty_StringSet(d->useUrls)) {
+        useGeneration_GmIdentity_++;
+    }
     iRelease(d->useUrls);
     deinit_String(&d->notes);
     delete_TlsCertificate(d->cert);
@@ -147,7 +158,9 @@ iBool isUsed_GmIdentity(const iGmIdentity *d) {
 }
 
 iBool isUsedOn_GmIdentity(const iGmIdentity *d, const iString *url) {
-#if 0
+    /* setUse_GmIdentity() keeps the set free of redundant URLs, so no use-URL is a prefix
+       of another one. The only candidate prefix of `url` is then the one sorted at or
+       right before it. */
     size_t pos = iInvalidPos;
     locate_StringSet(d->useUrls, url, &pos);
     if (pos < size_StringSet(d->useUrls)) {
@@ -161,12 +174,6 @@ iBool isUsedOn_GmIdentity(const iGmIdentity *d, const iString *url) {
             return iTrue;
         }
     }
-#endif
-    iConstForEach(StringSet, i, d->useUrls) {
-        if (startsWithCase_String(url, cstr_String(i.value))) {
-            return iTrue;
-        }
-    }
     return iFalse;
 }
 
@@ -199,6 +206,7 @@ void setUse_GmIdentity(iGmIdentity *d, const iString *url, iBool use) {
 #endif
         insert_StringSet(d->useUrls, url);
         iAssert(wasInserted);
+        useGeneration_GmIdentity_++;
     }
     else {
         iForEach(Array, i, &d->useUrls->strings.values) {
@@ -206,13 +214,17 @@ void setUse_GmIdentity(iGmIdentity *d, const iString *url, iBool use) {
             if (startsWithCase_String(url, cstr_String(used))) {
                 deinit_String(used);
                 remove_ArrayIterator(&i);
+                useGeneration_GmIdentity_++;
             }
         }        
     }
 }
 
 void clearUse_GmIdentity(iGmIdentity *d) {
-    clear_StringSet(d->useUrls);
+    if (!isEmpty_StringSet(d->useUrls)) {
+        clear_StringSet(d->useUrls);
+        useGeneration_GmIdentity_++;
+    }
 }
 
 const iString *findUse_GmIdentity(const iGmIdentity *d, const iString *url) {
@@ -242,24 +254,113 @@ struct Impl_GmCerts {
     iString saveDir;
     iStringHash *trusted;
     iPtrArray idents;
+    /* Trust changes are appended to a journal file by a background thread, and the
+       journal is compacted into the trusted file on exit. */
+    iBool isTrustDirty;
+    iString journal; /* lines not yet written to the journal file */
+    iCondition journalChanged;
+    iThread *journalWriter;
+    iBool isQuitting;
+    /* Case-insensitive prefix trie of all use-URLs, for finding the identity to use
+       with a URL. Rebuilt lazily when identities' use-URLs have changed. */
+    iArray useTrie; /* iUseUrlNode, root at index 0 */
+    unsigned useTrieGeneration;
 };
 
+iDeclareType(UseUrlNode)
+
+struct Impl_UseUrlNode {
+    uint32_t child;   /* first child, or 0 */
+    uint32_t sibling; /* next sibling, or 0 */
+    char     ch;      /* lowercase */
+    const iGmIdentity *ident; /* identity used on the URL ending at this node */
+};
+
+static void insertUseUrl_GmCerts_(iGmCerts *d, const iString *url, const iGmIdentity *ident) {
+    uint32_t node = 0;
+    /* Bytes are folded like startsWithCase_String() does for the ASCII range. */
+    for (const char *ch = constBegin_String(url); ch != constEnd_String(url); ch++) {
+        const char   lc   = tolower((unsigned char) *ch);
+        uint32_t     next = ((const iUseUrlNode *) constAt_Array(&d->useTrie, node))->child;
+        while (next && ((const iUseUrlNode *) constAt_Array(&d->useTrie, next))->ch != lc) {
+            next = ((const iUseUrlNode *) constAt_Array(&d->useTrie, next))->sibling;
+        }
+        if (!next) {
+            iUseUrlNode *parent = at_Array(&d->useTrie, node);
+            next = (uint32_t) size_Array(&d->useTrie);
+            const iUseUrlNode added = { .ch = lc, .sibling = parent->child };
+            parent->child = next;
+            pushBack_Array(&d->useTrie, &added);
+        }
+        node = next;
+    }
+    iUseUrlNode *end = at_Array(&d->useTrie, node);
+    if (!end->ident) {
+        end->ident = ident; /* the first identity in the list wins */
+    }
+}
+
+static void updateUseTrie_GmCerts_(iGmCerts *d) {
+    if (d->useTrieGeneration == useGeneration_GmIdentity_) {
+        return;
+    }
+    clear_Array(&d->useTrie);
+    const iUseUrlNode root = { 0 };
+    pushBack_Array(&d->useTrie, &root);
+    iConstForEach(PtrArray, i, &d->idents) {
+        const iGmIdentity *ident = i.ptr;
+        iConstForEach(StringSet, j, ident->useUrls) {
+            if (!isEmpty_String(j.value)) {
+                insertUseUrl_GmCerts_(d, j.value, ident);
+            }
+        }
+    }
+    d->useTrieGeneration = useGeneration_GmIdentity_;
+}
+
+static const iGmIdentity *findUseUrl_GmCerts_(const iGmCerts *d, const iString *url) {
+    /* Walk down the trie, remembering the identity of the longest matching prefix. */
+    const iGmIdentity *found = NULL;
+    uint32_t node = 0;
+    for (const char *ch = constBegin_String(url); ch != constEnd_String(url); ch++) {
+        const char lc = tolower((unsigned char) *ch);
+        node = ((const iUseUrlNode *) constAt_Array(&d->useTrie, node))->child;
+        while (node && ((const iUseUrlNode *) constAt_Array(&d->useTrie, node))->ch != lc) {
+            node = ((const iUseUrlNode *) constAt_Array(&d->useTrie, node))->sibling;
+        }
+        if (!node) {
+            break;
+        }
+        const iUseUrlNode *match = constAt_Array(&d->useTrie, node);
+        if (match->ident) {
+            found = match->ident;
+        }
+    }
+    return found;
+}
+
 static const char *magicIdMeta_GmCerts_   = "lgL2";
 static const char *magicIdentity_GmCerts_ = "iden";
 
 iDefineTypeConstructionArgs(GmCerts, (const char *saveDir), saveDir)
 
+static void appendTrustLine_(iString *out, const iString *key, const iTrustEntry *trust) {
+    iString *fp = hexEncode_Block(&trust->fingerprint);
+    appendFormat_String(out,
+                        "%s %llu %s\n",
+                        cstr_String(key),
+                        (unsigned long long) integralSeconds_Time(&trust->validUntil),
+                        cstr_String(fp));
+    delete_String(fp);
+}
+
 void serialize_GmCerts(const iGmCerts *d, iStream *trusted, iStream *identsMeta) {
     if (trusted) {
         iString line;
         init_String(&line);
         iConstForEach(StringHash, i, d->trusted) {
-            const iTrustEntry *trust = value_StringHashNode(i.value);
-            format_String(&line,
-                          "%s %llu %s\n",
-                          cstr_String(key_StringHashConstIterator(&i)),
-                          (unsigned long long) integralSeconds_Time(&trust->validUntil),
-                          cstrCollect_String(hexEncode_Block(&trust->fingerprint)));
+            clear_String(&line);
+            appendTrustLine_(&line, key_StringHashConstIterator(&i), value_StringHashNode(i.value));
             write_Stream(trusted, &line.chars);
         }
         deinit_String(&line);        
@@ -289,16 +390,70 @@ void saveIdentities_GmCerts(const iGmCerts *d) {
                    cstr_String(tempPath));
 }
 
-static void save_GmCerts_(const iGmCerts *d) {
+static void compactTrusted_GmCerts_(iGmCerts *d) {
+    /* Rewrite the trusted file with all entries, replacing the journal. */
     iBeginCollect();
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, trustedFilename_GmCerts_)));
+    const iString *tempPath =
+        collect_String(concatCStr_Path(&d->saveDir, tempTrustedFilename_GmCerts_));
+    iFile *f = new_File(tempPath);
     if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        serialize_GmCerts(d, stream_File(f), NULL);        
+        serialize_GmCerts(d, stream_File(f), NULL);
+        close_File(f);
+        commitFile_App(cstrCollect_String(concatCStr_Path(&d->saveDir, trustedFilename_GmCerts_)),
+                       cstr_String(tempPath));
+        remove(cstrCollect_String(concatCStr_Path(&d->saveDir, trustedJournalFilename_GmCerts_)));
+        d->isTrustDirty = iFalse;
     }
     iRelease(f);
     iEndCollect();
 }
 
+static void journalTrust_GmCerts_(iGmCerts *d, const iString *key, const iTrustEntry *trust) {
+    /* No file I/O here; called with `mtx` locked while verifying certificates. */
+    const iBool wasEmpty = isEmpty_String(&d->journal);
+    appendTrustLine_(&d->journal, key, trust);
+    d->isTrustDirty = iTrue;
+    if (wasEmpty) {
+        signal_Condition(&d->journalChanged);
+    }
+}
+
+static iThreadResult writeJournal_GmCerts_(iThread *thread) {
+    iGmCerts *d = userData_Thread(thread);
+    iString pending;
+    init_String(&pending);
+    lock_Mutex(d->mtx);
+    while (!d->isQuitting) {
+        if (isEmpty_String(&d->journal)) {
+            wait_Condition(&d->journalChanged, d->mtx);
+            continue;
+        }
+        /* Wait a moment to collect more changes into a single write. */
+        iTime until;
+        initTimeout_Time(&until, journalFlushDelay_GmCerts_);
+        while (!d->isQuitting && elapsedSeconds_Time(&until) < 0) {
+            waitTimeout_Condition(&d->journalChanged, d->mtx, &until);
+        }
+        if (d->isQuitting) {
+            break; /* everything gets compacted */
+        }
+        set_String(&pending, &d->journal);
+        clear_String(&d->journal);
+        unlock_Mutex(d->mtx);
+        iString *path = concatCStr_Path(&d->saveDir, trustedJournalFilename_GmCerts_);
+        iFile *f = new_File(path);
+        if (open_File(f, append_FileMode | text_FileMode)) {
+            write_File(f, &pending.chars);
+        }
+        iRelease(f);
+        delete_String(path);
+        lock_Mutex(d->mtx);
+    }
+    unlock_Mutex(d->mtx);
+    deinit_String(&pending);
+    return 0;
+}
+
 static void loadIdentityFromCertificate_GmCerts_(iGmCerts *d, const iString *crtPath) {
     iAssert(fileExists_FileInfo(crtPath));
     iString *keyPath = collect_String(copy_String(crtPath));
@@ -460,6 +615,7 @@ void deserializeTrusted_GmCerts(iGmCerts *d, iStream *ins, enum iImportMethod me
             iEndCollect();
         }
     }
+    d->isTrustDirty = iTrue;
     unlock_Mutex(d->mtx);
     iRelease(pattern);
 }
@@ -470,6 +626,12 @@ static void load_GmCerts_(iGmCerts *d) {
         deserializeTrusted_GmCerts(d, stream_File(f), all_ImportMethod);
     }
     iRelease(f);
+    /* Changes made after the last compaction. */
+    f = new_File(collect_String(concatCStr_Path(&d->saveDir, trustedJournalFilename_GmCerts_)));
+    if (open_File(f, readOnly_FileMode | text_FileMode)) {
+        deserializeTrusted_GmCerts(d, stream_File(f), all_ImportMethod);
+    }
+    iRelease(f);
     loadIdentities_GmCerts_(d);
 }
 
@@ -496,21 +658,46 @@ void init_GmCerts(iGmCerts *d, const char *saveDir) {
     initCStr_String(&d->saveDir, saveDir);
     d->trusted = new_StringHash();
     init_PtrArray(&d->idents);
+    init_Array(&d->useTrie, sizeof(iUseUrlNode));
+    d->useTrieGeneration = 0;
+    init_String(&d->journal);
+    init_Condition(&d->journalChanged);
+    d->isQuitting = iFalse;
     load_GmCerts_(d);
+    d->isTrustDirty = iFalse;
+    if (fileExistsCStr_FileInfo(
+            cstrCollect_String(concatCStr_Path(&d->saveDir, trustedJournalFilename_GmCerts_)))) {
+        d->isTrustDirty = iTrue; /* compact on exit */
+    }
+    d->journalWriter = new_Thread(writeJournal_GmCerts_);
+    setUserData_Thread(d->journalWriter, d);
+    start_Thread(d->journalWriter);
     setVerifyFunc_TlsRequest(verify_GmCerts_);
 }
 
 void deinit_GmCerts(iGmCerts *d) {
     setVerifyFunc_TlsRequest(NULL);
     iGuardMutex(d->mtx, {
+        d->isQuitting = iTrue;
+        signal_Condition(&d->journalChanged);
+    });
+    join_Thread(d->journalWriter);
+    iRelease(d->journalWriter);
+    iGuardMutex(d->mtx, {
+        if (d->isTrustDirty) {
+            compactTrusted_GmCerts_(d);
+        }
         saveIdentities_GmCerts(d);
         iForEach(PtrArray, i, &d->idents) {
             delete_GmIdentity(i.ptr);
         }
         deinit_PtrArray(&d->idents);
+        deinit_Array(&d->useTrie);
         iRelease(d->trusted);
+        deinit_String(&d->journal);
         deinit_String(&d->saveDir);
     });
+    deinit_Condition(&d->journalChanged);
     delete_Mutex(d->mtx);
 }
 
@@ -589,11 +776,11 @@ iBool checkTrust_GmCerts(iGmCerts *d, iRangecc domain, uint16_t port, const iTls
     }
     else {
         if (ok) {
-            insert_StringHash(d->trusted, &key, iClob(new_TrustEntry(fingerprint, &until)));
+            insert_StringHash(d->trusted, &key, iClob(trust = new_TrustEntry(fingerprint, &until)));
         }
     }
     if (ok) {
-        save_GmCerts_(d);
+        journalTrust_GmCerts_(d, &key, trust);
     }
     unlock_Mutex(d->mtx);
     delete_Block(fingerprint);
@@ -615,7 +802,7 @@ void setTrusted_GmCerts(iGmCerts *d, iRangecc domain, uint16_t port, const iBloc
     else {
         insert_StringHash(d->trusted, &key, iClob(trust = new_TrustEntry(fingerprint, validUntil)));
     }
-    save_GmCerts_(d);
+    journalTrust_GmCerts_(d, &key, trust);
     unlock_Mutex(d->mtx);
     deinit_String(&key);
 }
@@ -649,18 +836,8 @@ const iGmIdentity *identityForUrl_GmCerts(const iGmCerts *d, const iString *url)
         return NULL;
     }
     lock_Mutex(d->mtx);
-    const iGmIdentity *found = NULL;
-    iConstForEach(PtrArray, i, &d->idents) {
-        const iGmIdentity *ident = i.ptr;
-        iConstForEach(StringSet, j, ident->useUrls) {
-            const iString *used = j.value;
-            if (startsWithCase_String(url, cstr_String(used))) {
-                found = ident;
-                goto done;
-            }
-        }
-    }
-done:
+    updateUseTrie_GmCerts_(iConstCast(iGmCerts *, d));
+    const iGmIdentity *found = findUseUrl_GmCerts_(d, url);
     unlock_Mutex(d->mtx);
     /* Fallback: Titan URLs use the Gemini identities, if not otherwise specified. */
     if (!found && startsWithCase_String(url, "titan://")) {
@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/stringarray.h>
 #include <the_Foundation/stringset.h>
+#include <SDL_timer.h>
 
 #include <ctype.h>
 
@@ -152,13 +153,126 @@ static uint32_t themeHash_(const iBlock *data) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(GmRunIndex)
+iDeclareType(GmRunLoc)
+
+struct Impl_GmRunLoc {
+    size_t offset; /* in source */
+    size_t run;
+};
+
+/* Lookup tables for finding runs by vertical position or by source location without having
+   to scan the layout from the beginning. The index is extended as runs are appended. */
+struct Impl_GmRunIndex {
+    size_t numRuns;   /* how many runs have been indexed */
+    int    maxBottom; /* lowest bottom edge of the indexed runs */
+    iArray blocks;    /* first run that may extend below the top of each block */
+    iArray locs;      /* sampled GmRunLocs, ordered by offset */
+};
+
+static const int    runIndexBlockHeight_ = 256; /* pixels */
+static const size_t runIndexLocStep_     = 16;  /* every Nth source run gets a GmRunLoc */
+
+static void init_GmRunIndex_(iGmRunIndex *d) {
+    d->numRuns   = 0;
+    d->maxBottom = 0;
+    init_Array(&d->blocks, sizeof(size_t));
+    init_Array(&d->locs, sizeof(iGmRunLoc));
+}
+
+static void deinit_GmRunIndex_(iGmRunIndex *d) {
+    deinit_Array(&d->locs);
+    deinit_Array(&d->blocks);
+}
+
+static void clear_GmRunIndex_(iGmRunIndex *d) {
+    d->numRuns   = 0;
+    d->maxBottom = 0;
+    clear_Array(&d->blocks);
+    clear_Array(&d->locs);
+}
+
+static void update_GmRunIndex_(iGmRunIndex *d, const iArray *layout, iRangecc source) {
+    const iGmRun *runs = constData_Array(layout);
+    for (size_t i = d->numRuns; i < size_Array(layout); i++) {
+        const iGmRun *run = &runs[i];
+        /* Both bounds are considered so the index works for drawing and for hit testing. */
+        d->maxBottom = iMax(d->maxBottom, iMax(bottom_Rect(run->bounds),
+                                               bottom_Rect(run->visBounds)));
+        while ((int) size_Array(&d->blocks) * runIndexBlockHeight_ <= d->maxBottom) {
+            pushBack_Array(&d->blocks, &i);
+        }
+        if (~run->flags & decoration_GmRunFlag && i % runIndexLocStep_ == 0 &&
+            contains_Range(&source, run->text.start)) {
+            const iGmRunLoc loc = { run->text.start - source.start, i };
+            if (isEmpty_Array(&d->locs) ||
+                ((const iGmRunLoc *) constBack_Array(&d->locs))->offset < loc.offset) {
+                pushBack_Array(&d->locs, &loc);
+            }
+        }
+    }
+    d->numRuns = size_Array(layout);
+}
+
+static size_t firstRunBelow_GmRunIndex_(const iGmRunIndex *d, int y) {
+    /* Returns the index of a run such that all preceding runs are entirely above `y`. */
+    if (y <= 0 || isEmpty_Array(&d->blocks)) {
+        return 0;
+    }
+    const size_t block = y / runIndexBlockHeight_;
+    if (block >= size_Array(&d->blocks)) {
+        return d->numRuns; /* everything is above */
+    }
+    return constValue_Array(&d->blocks, block, size_t);
+}
+
+static size_t runBeforeLoc_GmRunIndex_(const iGmRunIndex *d, size_t offset) {
+    /* Returns the index of a run that comes before the source `offset`. */
+    size_t lo = 0, hi = size_Array(&d->locs);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (((const iGmRunLoc *) constAt_Array(&d->locs, mid))->offset <= offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    /* `lo` is the first one after `offset`; back up one more to be on the safe side. */
+    return lo >= 2 ? ((const iGmRunLoc *) constAt_Array(&d->locs, lo - 2))->run : 0;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmLayoutState)
+
+/* Layout progress is remembered so that lines appended to the source can be laid out
+   without redoing the preceding ones. */
+struct Impl_GmLayoutState {
+    size_t           sourcePos; /* `source` has been laid out up to here */
+    iInt2            pos;
+    iBool            isFirstText;
+    iBool            addQuoteIcon;
+    iBool            isPreformat;
+    int              preFont;
+    uint16_t         preId;
+    iBool            enableIndents;
+    enum iGmLineType prevType;
+    enum iGmLineType prevNonBlankType;
+    iBool            followsBlank;
+};
+
 struct Impl_GmDocument {
     iObject object;
     enum iSourceFormat origFormat;
     enum iSourceFormat viewFormat; /* what the user prefers to see */
     enum iSourceFormat format;
     iString   origSource; /* original (unnormalized) source */
+    uint32_t  sourceStream; /* identifies the response `origSource` came from; 0 if none */
     iString   source;     /* normalized (possibly converted) source */
+    iGmTypesetter *typesetter; /* converts `origSource` to `source` as it arrives */
+    iGmLayoutState layoutState;
+    uint32_t  layoutSlice; /* max duration of a full layout before it continues in steps (ms) */
     iString   url;        /* for resolving relative links */
     iString   localHost;
     iInt2     size;
@@ -167,11 +281,13 @@ struct Impl_GmDocument {
     iBool     isSpartan;
     iBool     isLayoutInvalidated;
     iArray    layout; /* contents of source, laid out in document space */
+    iGmRunIndex runIndex;
     iStringArray auxText; /* generated text that appears on the page but is not part of the source */
     iPtrArray links;
     iString   title; /* the first top-level title */
     iArray    headings;
     iArray    preMeta; /* metadata about preformatted blocks */
+    iArray    oldPreMeta; /* fold states of the previous complete layout */
     iGmTheme  theme;
     uint32_t  themeSeed;
     iChar     siteIcon;
@@ -184,7 +300,7 @@ struct Impl_GmDocument {
 
 iDefineObjectConstruction(GmDocument)
     
-static void import_GmDocument_(iGmDocument *);
+static void import_GmDocument_(iGmDocument *, iBool isFinal);
 
 static iBool isForcedMonospace_GmDocument_(const iGmDocument *d) {
     const iRangecc scheme = urlScheme_String(&d->url);
@@ -443,7 +559,7 @@ static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *li
     if (link) {
         /* Check if visited. */
         if (cmpString_String(&link->url, &d->url)) {
-            link->when = urlVisitTime_Visited(visited_App(), &link->url);
+            link->when = urlVisitTimeRange_Visited(visited_App(), range_String(&link->url));
             if (isValid_Time(&link->when)) {
                 link->flags |= visited_GmLinkFlag;
             }
@@ -676,11 +792,38 @@ static iBool isHRule_(iRangecc line) {
     return n >= 3;
 }
 
-static void doLayout_GmDocument_(iGmDocument *d) {
+static void resetLayoutState_GmDocument_(iGmDocument *d) {
+    const iPrefs   *prefs = prefs_App();
+    iGmLayoutState *ls    = &d->layoutState;
+    iZap(*ls);
+    ls->isFirstText      = prefs->bigFirstParagraph && !isTerminal_Platform();
+    ls->addQuoteIcon     = prefs->quoteIcon;
+    ls->preFont          = preformatted_FontId;
+    ls->prevType         = text_GmLineType;
+    ls->prevNonBlankType = text_GmLineType;
+    if (isGopher_GmDocument_(d) && !prefs->geminiStyledGopher) {
+        ls->isFirstText = iFalse;
+    }
+    if (d->format == plainText_SourceFormat) {
+        ls->isPreformat = iTrue;
+        ls->isFirstText = iFalse;
+    }
+}
+
+static void layoutLines_GmDocument_(iGmDocument *d, size_t endPos, const char *untilLoc,
+                                    uint32_t deadline) {
+    /* Lays out the source lines from the saved layout position up to `endPos`, appending
+       to the existing runs. If a `deadline` is given, layout may stop at any line after
+       `untilLoc` once the deadline has passed; the rest is done by `continueLayout`. */
     static iRegExp *ansiPattern_;
     if (!ansiPattern_) {
         ansiPattern_ = makeAnsiEscapePattern_Text(iTrue /* with ESC */);
     }
+    iGmLayoutState *ls = &d->layoutState;
+    if (d->size.x <= 0 || endPos <= ls->sourcePos) {
+        return;
+    }
+    pinFontRuns_Text(d); /* keep the shaped lines around for drawing */
     const iPrefs *prefs             = prefs_App();
     const iBool   isMono            = isForcedMonospace_GmDocument_(d);
     const iBool   isGopher          = isGopher_GmDocument_(d);
@@ -688,9 +831,6 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     const iBool   isVeryNarrow      = d->size.x <= 70 * gap_Text * aspect_UI;
     const iBool   isExtremelyNarrow = d->size.x <= 60 * gap_Text * aspect_UI;
     const iBool   isFullWidthImages = (d->outsideMargin < 5 * gap_UI * aspect_UI);
-    
-    initTheme_GmDocument_(d);
-    d->isLayoutInvalidated = iFalse;
     /* TODO: Collect these parameters into a GmTheme. */
     float indents[max_GmLineType] = { 5, 10, 5, isNarrow ? 5 : 10, 0, 0, 5, 5 };
     if (isExtremelyNarrow) {
@@ -719,42 +859,41 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     static const char *pointingFinger  = "\U0001f449";
     static const char *uploadArrow     = upload_Icon;
     static const char *image           = photo_Icon;
-    clear_Array(&d->layout);
-    clear_StringArray(&d->auxText);
-    clearLinks_GmDocument_(d);
-    clear_Array(&d->headings);
-    const iArray *oldPreMeta = collect_Array(copy_Array(&d->preMeta)); /* remember fold states */
-    clear_Array(&d->preMeta);
-    clear_String(&d->title);
-    if (d->size.x <= 0 || isEmpty_String(&d->source)) {
-        return;
+    if (!d->openURLs) {
+        updateOpenURLs_GmDocument_(d);
     }
-    updateOpenURLs_GmDocument_(d);
-    const iRangecc   content       = range_String(&d->source);
+    const char      *docStart      = constBegin_String(&d->source);
+    const iRangecc   content       = { docStart + ls->sourcePos, docStart + endPos };
     iRangecc         contentLine   = iNullRange;
-    iInt2            pos           = zero_I2();
-    iBool            isFirstText   = prefs->bigFirstParagraph && !isTerminal_Platform();
-    iBool            addQuoteIcon  = prefs->quoteIcon;
-    iBool            isPreformat   = iFalse;
-    int              preFont       = preformatted_FontId;
-    uint16_t         preId         = 0;
-    iBool            enableIndents = iFalse;
+    iInt2            pos           = ls->pos;
+    iBool            isFirstText   = ls->isFirstText;
+    iBool            addQuoteIcon  = ls->addQuoteIcon;
+    iBool            isPreformat   = ls->isPreformat;
+    int              preFont       = ls->preFont;
+    uint16_t         preId         = ls->preId;
+    iBool            enableIndents = ls->enableIndents;
     const iBool      isNormalized  = shouldBeNormalized_GmDocument_(d);
     const iBool      isJustified   = prefs->justifyParagraph;
-    enum iGmLineType prevType      = text_GmLineType;
-    enum iGmLineType prevNonBlankType = text_GmLineType;
-    iBool            followsBlank  = iFalse;
-    if (isGopher && !prefs->geminiStyledGopher) {
-        isFirstText = iFalse;
-    }
-    if (d->format == plainText_SourceFormat) {
-        isPreformat = iTrue;
-        isFirstText = iFalse;
-    }
-    d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    enum iGmLineType prevType      = ls->prevType;
+    enum iGmLineType prevNonBlankType = ls->prevNonBlankType;
+    iBool            followsBlank  = ls->followsBlank;
+    const iArray    *oldPreMeta    = &d->oldPreMeta;
+    const size_t     firstNewRun   = size_Array(&d->layout);
+    /* A terminating newline begins another (empty) line only at the end of the source. */
+    const iBool      isSourceEnd   = isFinished_GmTypesetter(d->typesetter) &&
+                                     endPos == size_String(&d->source);
+    const iBool      isTerminated  = !isSourceEnd && content.end[-1] == '\n';
     checkMissing_Text(); /* clear the flag */
     setAnsiFlags_Text(d->theme.ansiEscapes);
     while (nextSplit_Rangecc(content, "\n", &contentLine)) {
+        if (isTerminated && contentLine.start == content.end) {
+            break; /* the rest will be laid out when more lines arrive */
+        }
+        if (deadline && contentLine.start > content.start &&
+            (!untilLoc || contentLine.start > untilLoc) && SDL_GetTicks() >= deadline) {
+            endPos = contentLine.start - docStart; /* out of time, continue from here later */
+            break;
+        }
         iRangecc line = contentLine; /* `line` will be trimmed; modifying would confuse `nextSplit_Rangecc` */
         if (*line.end == '\r') {
             line.end--; /* trim CR always */
@@ -780,7 +919,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                     continue;
                 }
             }
-            if (contentLine.start == content.start) {
+            if (contentLine.start == docStart) {
                 prevType = type;
             }
             indent = indents[type];
@@ -835,7 +974,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         else {
             /* Preformatted line. */
             type = preformatted_GmLineType;
-            if (contentLine.start == content.start) {
+            if (contentLine.start == docStart) {
                 prevType = type;
             }
             if (d->format == gemini_SourceFormat &&
@@ -1247,31 +1386,88 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     if (checkMissing_Text()) {
         d->warnings |= missingGlyphs_GmDocumentWarning;
     }
-    /* Go over the preformatted blocks and mark them wide if at least one run is wide. */ {
+    /* Go over the new preformatted blocks and mark them wide if at least one run is wide. */ {
         /* TODO: Store the dimensions and ranges for later access. */
-        iForEach(Array, i, &d->layout) {
-            iGmRun *run = i.value;
+        size_t i = firstNewRun;
+        if (i > 0 && preId_GmRun(constAt_Array(&d->layout, i - 1))) {
+            /* The last block may have been started by a previous batch of lines. */
+            i = findPreformattedRange_GmDocument(d, constAt_Array(&d->layout, i - 1)).start -
+                (const iGmRun *) constData_Array(&d->layout);
+        }
+        for (; i < size_Array(&d->layout); i++) {
+            const iGmRun *run = constAt_Array(&d->layout, i);
             if (preId_GmRun(run) && run->flags & wide_GmRunFlag) {
                 iGmRunRange block = findPreformattedRange_GmDocument(d, run);
                 for (const iGmRun *j = block.start; j != block.end; j++) {
                     iConstCast(iGmRun *, j)->flags |= wide_GmRunFlag;
                 }
                 /* Skip to the end of the block. */
-                i.pos = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
+                i = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
             }
         }
     }
     setAnsiFlags_Text(allowAll_AnsiFlag);
+    pinFontRuns_Text(NULL);
+    update_GmRunIndex_(&d->runIndex, &d->layout, range_String(&d->source));
+    /* Continue from here when more source is available. */
+    ls->sourcePos        = endPos;
+    ls->pos              = pos;
+    ls->isFirstText      = isFirstText;
+    ls->addQuoteIcon     = addQuoteIcon;
+    ls->isPreformat      = isPreformat;
+    ls->preFont          = preFont;
+    ls->preId            = preId;
+    ls->enableIndents    = enableIndents;
+    ls->prevType         = prevType;
+    ls->prevNonBlankType = prevNonBlankType;
+    ls->followsBlank     = followsBlank;
 //    printf("[GmDocument] layout size: %zu runs (%zu bytes)\n",
 //           size_Array(&d->layout), size_Array(&d->layout) * sizeof(iGmRun));        
 }
 
+static size_t layoutEnd_GmDocument_(const iGmDocument *d) {
+    return readySize_GmTypesetter(d->typesetter, &d->source);
+}
+
+static uint32_t layoutDeadline_GmDocument_(const iGmDocument *d) {
+    return d->layoutSlice ? SDL_GetTicks() + d->layoutSlice : 0;
+}
+
+static void doLayout_GmDocument_(iGmDocument *d, const char *untilLoc, uint32_t deadline) {
+    initTheme_GmDocument_(d);
+    if (!isLayoutPending_GmDocument(d)) {
+        /* Remember fold states. An unfinished layout only has a subset of them. */
+        clear_Array(&d->oldPreMeta);
+        pushBackN_Array(&d->oldPreMeta, constData_Array(&d->preMeta), size_Array(&d->preMeta));
+    }
+    d->isLayoutInvalidated = iFalse;
+    releaseFontRuns_Text(d);
+    clear_Array(&d->layout);
+    clear_GmRunIndex_(&d->runIndex);
+    clear_StringArray(&d->auxText);
+    clearLinks_GmDocument_(d);
+    clear_Array(&d->headings);
+    clear_Array(&d->preMeta);
+    clear_String(&d->title);
+    d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    resetLayoutState_GmDocument_(d);
+    if (d->size.x <= 0 || isEmpty_String(&d->source)) {
+        return;
+    }
+    updateOpenURLs_GmDocument_(d);
+    layoutLines_GmDocument_(d, layoutEnd_GmDocument_(d), untilLoc, deadline);
+}
+
 void init_GmDocument(iGmDocument *d) {
     d->origFormat = gemini_SourceFormat; /* format of `origSource` */
     d->format     = gemini_SourceFormat; /* format of `source` */
     d->viewFormat = gemini_SourceFormat; /* user's preference */
     init_String(&d->origSource);
+    d->sourceStream = 0;
     init_String(&d->source);
+    d->typesetter = new_GmTypesetter();
+    iZap(d->layoutState);
+    d->layoutSlice = 0;
     init_String(&d->url);
     init_String(&d->localHost);
     d->outsideMargin = 0;
@@ -1280,11 +1476,13 @@ void init_GmDocument(iGmDocument *d) {
     d->isSpartan = iFalse;
     d->isLayoutInvalidated = iFalse;
     init_Array(&d->layout, sizeof(iGmRun));
+    init_GmRunIndex_(&d->runIndex);
     init_StringArray(&d->auxText);
     init_PtrArray(&d->links);
     init_String(&d->title);
     init_Array(&d->headings, sizeof(iGmHeading));
     init_Array(&d->preMeta, sizeof(iGmPreMeta));
+    init_Array(&d->oldPreMeta, sizeof(iGmPreMeta));
     d->themeSeed = 0;
     d->siteIcon = 0;
     d->media = new_Media();
@@ -1295,17 +1493,21 @@ void init_GmDocument(iGmDocument *d) {
 }
 
 void deinit_GmDocument(iGmDocument *d) {
+    releaseFontRuns_Text(d);
     iReleasePtr(&d->openURLs);
     delete_Media(d->media);
     deinit_String(&d->title);
     clearLinks_GmDocument_(d);
     deinit_PtrArray(&d->links);
+    deinit_Array(&d->oldPreMeta);
     deinit_Array(&d->preMeta);
     deinit_Array(&d->headings);
     deinit_StringArray(&d->auxText);
+    deinit_GmRunIndex_(&d->runIndex);
     deinit_Array(&d->layout);
     deinit_String(&d->localHost);
     deinit_String(&d->url);
+    delete_GmTypesetter(d->typesetter);
     deinit_String(&d->source);
     deinit_String(&d->origSource);
 }
@@ -1954,7 +2156,7 @@ void setFormat_GmDocument(iGmDocument *d, enum iSourceFormat format) {
 iBool setViewFormat_GmDocument(iGmDocument *d, enum iSourceFormat viewFormat) {
     if (d->viewFormat != viewFormat) {
         d->viewFormat = viewFormat;
-        import_GmDocument_(d);        
+        import_GmDocument_(d, isFinished_GmTypesetter(d->typesetter));
         return iTrue;
     }
     return iFalse;
@@ -1963,7 +2165,42 @@ iBool setViewFormat_GmDocument(iGmDocument *d, enum iSourceFormat viewFormat) {
 void setWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
     d->size.x        = width;
     d->outsideMargin = iMax(0, (canvasWidth - width) / 2); /* distance to edge of the canvas */
-    doLayout_GmDocument_(d); /* TODO: just flag need-layout and do it later */
+    doLayout_GmDocument_(d, NULL, layoutDeadline_GmDocument_(d));
+}
+
+void setLayoutSlice_GmDocument(iGmDocument *d, uint32_t maxDuration) {
+    d->layoutSlice = maxDuration;
+}
+
+void beginLayout_GmDocument(iGmDocument *d, int width, int canvasWidth, const char *untilLoc,
+                            uint32_t maxDuration) {
+    d->size.x        = width;
+    d->outsideMargin = iMax(0, (canvasWidth - width) / 2);
+    const iRangecc src = range_String(&d->source);
+    if (untilLoc && !contains_Range(&src, untilLoc)) {
+        setWidth_GmDocument(d, width, canvasWidth); /* not a source location; start from the top */
+        return;
+    }
+    doLayout_GmDocument_(d, untilLoc, SDL_GetTicks() + maxDuration);
+}
+
+iBool continueLayout_GmDocument(iGmDocument *d, uint32_t maxDuration) {
+    if (isLayoutPending_GmDocument(d)) {
+        layoutLines_GmDocument_(d, layoutEnd_GmDocument_(d), NULL, SDL_GetTicks() + maxDuration);
+    }
+    return isLayoutPending_GmDocument(d);
+}
+
+void finishLayout_GmDocument(iGmDocument *d) {
+    if (isLayoutPending_GmDocument(d)) {
+        layoutLines_GmDocument_(d, layoutEnd_GmDocument_(d), NULL, 0);
+    }
+}
+
+iBool isLayoutPending_GmDocument(const iGmDocument *d) {
+    /* Source that is still incomplete (streaming) does not count as pending. */
+    return d->size.x > 0 && !d->isLayoutInvalidated &&
+           d->layoutState.sourcePos < layoutEnd_GmDocument_(d);
 }
 
 iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
@@ -1975,7 +2212,7 @@ iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
 }
 
 void redoLayout_GmDocument(iGmDocument *d) {
-    doLayout_GmDocument_(d);
+    doLayout_GmDocument_(d, NULL, layoutDeadline_GmDocument_(d));
 }
 
 void invalidateLayout_GmDocument(iGmDocument *d) {
@@ -2021,90 +2258,6 @@ iBool updateOpenURLs_GmDocument(iGmDocument *d) {
     return wasChanged;
 }
 
-iLocalDef iBool isNormalizableSpace_(char ch) {
-    return ch == ' ' || ch == '\t';
-}
-
-static void normalize_GmDocument(iGmDocument *d) {
-    iString *normalized = new_String();
-    iRangecc src = range_String(&d->source);
-    /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */ {
-        iChar ch = 0;
-        decodeBytes_MultibyteChar(src.start, src.end, &ch);
-        if (ch == 0xfeff) /* zero-width non-breaking space */ {
-            src.start += 3;
-        }
-    }
-    iRangecc line = iNullRange;
-    iBool isPreformat = iFalse;
-    if (d->format == plainText_SourceFormat) {
-        isPreformat = iTrue; /* Cannot be turned off. */
-    }
-    iBool wasNormalized = iFalse;
-    while (nextSplit_Rangecc(src, "\n", &line)) {
-        if (isPreformat) {
-            for (const char *ch = line.start; ch != line.end; ch++) {
-                if (*ch != '\v') {
-                    appendCStrN_String(normalized, ch, 1);
-                }
-                else {
-                    wasNormalized = iTrue;
-                }
-            }
-            appendCStr_String(normalized, "\n");
-            if (d->format == gemini_SourceFormat &&
-                lineType_GmDocument_(d, line) == preformatted_GmLineType) {
-                isPreformat = iFalse;
-            }
-            continue;
-        }
-        if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
-            isPreformat = iTrue;
-            appendRange_String(normalized, line);
-            appendCStr_String(normalized, "\n");
-            continue;
-        }
-        iBool isPrevSpace = iFalse;
-        int spaceCount = 0;
-        for (const char *ch = line.start; ch != line.end; ch++) {
-            char c = *ch;
-            if (c == '\v') {
-                wasNormalized = iTrue;
-                continue;
-            }
-            if (isNormalizableSpace_(c)) {
-                if (isPrevSpace) {
-                    if (++spaceCount == 8) {
-                        /* There are several consecutive space characters. The author likely
-                           really wants to have some space here, so normalize to a tab stop. */
-                        popBack_Block(&normalized->chars);
-                        pushBack_Block(&normalized->chars, '\t');
-                    }
-                    wasNormalized = iTrue;
-                    continue; /* skip repeated spaces */
-                }
-                if (c != ' ') {
-                    c = ' ';
-                    wasNormalized = iTrue;
-                }
-                isPrevSpace = iTrue;
-            }
-            else {
-                isPrevSpace = iFalse;
-                spaceCount = 0;
-            }
-            appendCStrN_String(normalized, &c, 1);
-        }
-        appendCStr_String(normalized, "\n");
-    }
-    iUnused(wasNormalized);
-//    printf("wasNormalized: %d\n", wasNormalized);
-//    fflush(stdout);
-    set_String(&d->source, collect_String(normalized));
-    //normalize_String(&d->source); /* NFC */
-//    printf("orig:%zu norm:%zu\n", size_String(&d->origSource), size_String(&d->source));
-}
-
 void setUrl_GmDocument(iGmDocument *d, const iString *url) {
     url = canonicalUrl_String(url);
     set_String(&d->url, url);
@@ -2276,21 +2429,75 @@ static void convertMarkdownToGemtext_GmDocument_(iGmDocument *d) {
     d->format = gemini_SourceFormat;
 }
 
-static void import_GmDocument_(iGmDocument *d) {
-    d->format = d->origFormat;
-    set_String(&d->source, &d->origSource);
-    replace_String(&d->source, "\r\n", "\n");
-    /* Detect use of ANSI escapes. */ {
-        iRegExp *ansiEsc = new_RegExp("\x1b[[()]([0-9;AB]*?)[ABCDEFGHJKSTfimn]", 0);
-        iRegExpMatch m;
-        init_RegExpMatch(&m);
-        const iBool found = matchString_RegExp(ansiEsc, &d->origSource, &m);
-        iChangeFlags(d->warnings, ansiEscapes_GmDocumentWarning, found);
-        iRelease(ansiEsc);
+static void detectAnsiEscapes_GmDocument_(iGmDocument *d, iRangecc range) {
+    static iRegExp *ansiEsc_;
+    if (!ansiEsc_) {
+        ansiEsc_ = new_RegExp("\x1b[[()]([0-9;AB]*?)[ABCDEFGHJKSTfimn]", 0);
     }
+    iRegExpMatch m;
+    init_RegExpMatch(&m);
+    if (matchRange_RegExp(ansiEsc_, range, &m)) {
+        d->warnings |= ansiEscapes_GmDocumentWarning;
+    }
+}
+
+static void rebaseRange_(iRangecc *range, iRangecc oldSource, const char *newStart) {
+    if (range->start >= oldSource.start && range->start <= oldSource.end) {
+        range->end   = newStart + (range->end - oldSource.start);
+        range->start = newStart + (range->start - oldSource.start);
+    }
+}
+
+static void rebaseSourceRanges_GmDocument_(iGmDocument *d, iRangecc oldSource) {
+    /* The source buffer was reallocated, so everything that points to it needs updating.
+       Other text (icons, captions) is located elsewhere and remains unaffected. */
+    const char *newStart = constBegin_String(&d->source);
+    iForEach(Array, i, &d->layout) {
+        iGmRun *run = i.value;
+        rebaseRange_(&run->text, oldSource, newStart);
+    }
+    iForEach(Array, h, &d->headings) {
+        iGmHeading *heading = h.value;
+        rebaseRange_(&heading->text, oldSource, newStart);
+    }
+    iForEach(Array, p, &d->preMeta) {
+        iGmPreMeta *meta = p.value;
+        rebaseRange_(&meta->bounds, oldSource, newStart);
+        rebaseRange_(&meta->altText, oldSource, newStart);
+        rebaseRange_(&meta->contents, oldSource, newStart);
+    }
+    iForEach(PtrArray, k, &d->links) {
+        iGmLink *link = k.ptr;
+        rebaseRange_(&link->urlRange, oldSource, newStart);
+        rebaseRange_(&link->labelRange, oldSource, newStart);
+        rebaseRange_(&link->labelIcon, oldSource, newStart);
+    }
+}
+
+static void appendInput_GmDocument_(iGmDocument *d, iBool isFinal) {
+    /* New complete lines of `origSource` are appended to `source`. */
+    const iRangecc oldSource = range_String(&d->source);
+    const size_t   oldInput  = inputSize_GmTypesetter(d->typesetter);
+    addInput_GmTypesetter(d->typesetter, &d->origSource, isFinal, &d->source);
+    detectAnsiEscapes_GmDocument_(
+        d,
+        (iRangecc){ constBegin_String(&d->origSource) + oldInput,
+                    constBegin_String(&d->origSource) + inputSize_GmTypesetter(d->typesetter) });
+    if (constBegin_String(&d->source) != oldSource.start) {
+        rebaseSourceRanges_GmDocument_(d, oldSource);
+    }
+}
+
+static void import_GmDocument_(iGmDocument *d, iBool isFinal) {
+    d->format = d->origFormat;
+    d->isLayoutInvalidated = iTrue; /* source is replaced */
+    d->warnings &= ~ansiEscapes_GmDocumentWarning;
+    clear_String(&d->source);
     if (d->viewFormat == plainText_SourceFormat) {
         d->format = plainText_SourceFormat;
         d->theme.ansiEscapes = allowAll_AnsiFlag;
+        reset_GmTypesetter(d->typesetter, plainText_SourceFormat, iFalse);
+        appendInput_GmDocument_(d, isFinal);
         return;
     }
     /* Do an internal format conversion to Gemtext. */
@@ -2298,33 +2505,77 @@ static void import_GmDocument_(iGmDocument *d) {
     if (d->format == gemini_SourceFormat) {
         d->theme.ansiEscapes = prefs_App()->gemtextAnsiEscapes;
     }
-    else if (d->format == markdown_SourceFormat) {
-        convertMarkdownToGemtext_GmDocument_(d);
-        d->theme.ansiEscapes = allowAll_AnsiFlag; /* escapes are used for styling */
-    }
     else {
-        d->theme.ansiEscapes = allowAll_AnsiFlag;
+        d->theme.ansiEscapes = allowAll_AnsiFlag; /* escapes are used for styling */
     }
-    if (shouldBeNormalized_GmDocument_(d)) {
-        normalize_GmDocument(d);
+    if (d->format == markdown_SourceFormat) {
+        /* The conversion needs the entire source, so it can't be done progressively. */
+        detectAnsiEscapes_GmDocument_(d, range_String(&d->origSource));
+        set_String(&d->source, &d->origSource);
+        replace_String(&d->source, "\r\n", "\n");
+        convertMarkdownToGemtext_GmDocument_(d);
+        iString *converted = collect_String(copy_String(&d->source));
+        clear_String(&d->source);
+        reset_GmTypesetter(d->typesetter, gemini_SourceFormat, shouldBeNormalized_GmDocument_(d));
+        addInput_GmTypesetter(d->typesetter, converted, iTrue, &d->source);
+        return;
     }
+    reset_GmTypesetter(d->typesetter, d->format, shouldBeNormalized_GmDocument_(d));
+    appendInput_GmDocument_(d, isFinal);
+}
+
+static iBool canAppendSource_GmDocument_(const iGmDocument *d, const iString *source,
+                                         uint32_t stream, int width, int canvasWidth) {
+    /* Checks if the new source just continues the previous one and the existing layout is
+       still valid, so only the new lines need to be laid out. A streamed response only
+       grows, so the new source continues the previous one if it comes from the same
+       response. Any other source is considered a replacement. */
+    const enum iSourceFormat format =
+        (d->viewFormat == plainText_SourceFormat ? plainText_SourceFormat : d->origFormat);
+    return stream && stream == d->sourceStream &&
+           !isFinished_GmTypesetter(d->typesetter) && !d->isLayoutInvalidated &&
+           format == d->format && d->format != markdown_SourceFormat &&
+           d->size.x == width && d->outsideMargin == iMax(0, (canvasWidth - width) / 2) &&
+           size_String(source) >= size_String(&d->origSource);
 }
 
-void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int canvasWidth,
-                          enum iGmDocumentUpdate updateType) {
-    /* TODO: This API has been set up to allow partial/progressive updating of the content.
-       Currently the entire source is replaced every time, though. */
+void setSource_GmDocument(iGmDocument *d, const iString *source, uint32_t stream, int width,
+                          int canvasWidth, enum iGmDocumentUpdate updateType) {
 //    printf("[GmDocument] source update (%zu bytes), width:%d, final:%d\n",
 //           size_String(source), width, updateType == final_GmDocumentUpdate);
-    if (size_String(source) == size_String(&d->origSource)) {
+    const iBool isFinal = (updateType == final_GmDocumentUpdate);
+    if (canAppendSource_GmDocument_(d, source, stream, width, canvasWidth)) {
+        /* Progressive update: only lay out the newly completed lines. When the source is
+           final, the last unterminated line and any unclosed preformatted block are
+           processed, too. */
+        if (size_String(source) > size_String(&d->origSource) || isFinal) {
+            const iBool wasPending = isLayoutPending_GmDocument(d);
+            appendRange_String(&d->origSource,
+                               (iRangecc){ constBegin_String(source) + size_String(&d->origSource),
+                                           constEnd_String(source) });
+            appendInput_GmDocument_(d, isFinal);
+            if (!wasPending) {
+                /* Otherwise, the new lines are laid out when the pending layout continues. */
+                layoutLines_GmDocument_(d, layoutEnd_GmDocument_(d), NULL, 0);
+            }
+        }
+        return;
+    }
+    if (size_String(source) == size_String(&d->origSource) &&
+        ((stream && stream == d->sourceStream) || equal_String(source, &d->origSource))) {
         iAssert(equal_String(source, &d->origSource));
 //        printf("[GmDocument] source is unchanged!\n");
+        if (isFinal && !isFinished_GmTypesetter(d->typesetter)) {
+            appendInput_GmDocument_(d, iTrue);
+            invalidateLayout_GmDocument(d);
+        }
         updateWidth_GmDocument(d, width, canvasWidth);
         return; /* Nothing to do. */
     }
     /* Normalize and convert to Gemtext if needed. */
     set_String(&d->origSource, source);
-    import_GmDocument_(d);
+    d->sourceStream = stream;
+    import_GmDocument_(d, isFinal);
     setWidth_GmDocument(d, width, canvasWidth); /* re-do layout */    
 }
 
@@ -2341,7 +2592,7 @@ void updateVisitedLinks_GmDocument(iGmDocument *d) {
     iForEach(PtrArray, i, &d->links) {
         iGmLink *link = i.ptr;
         if (~link->flags & visited_GmLinkFlag) {
-            iTime visitTime = urlVisitTime_Visited(visited_App(), &link->url);
+            iTime visitTime = urlVisitTimeRange_Visited(visited_App(), range_String(&link->url));
             if (isValid_Time(&visitTime)) {
                 link->flags |= visited_GmLinkFlag;
                 insert_IntSet(&linkIds, index_PtrArrayIterator(&i) + 1);
@@ -2363,9 +2614,11 @@ void render_GmDocument(const iGmDocument *d, iRangei visRangeY, iGmDocumentRende
                        void *context) {
     iBool isInside = iFalse;
     setAnsiFlags_Text(d->theme.ansiEscapes);
-    /* TODO: Check lookup table for quick starting position. */
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const iGmRun *runs = constData_Array(&d->layout);
+    for (size_t i = firstRunBelow_GmRunIndex_(&d->runIndex, visRangeY.start);
+         i < size_Array(&d->layout);
+         i++) {
+        const iGmRun *run = &runs[i];
         if (isInside) {
             if (top_Rect(run->visBounds) > visRangeY.end) {
                 break;
@@ -2508,11 +2761,20 @@ iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun
 }
 
 const iGmRun *findRun_GmDocument(const iGmDocument *d, iInt2 pos) {
-    /* TODO: Perf optimization likely needed; use a block map? */
-    const iGmRun *last = NULL;
-    iBool isFirstNonDecoration = iTrue;
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const iGmRun *runs  = constData_Array(&d->layout);
+    const size_t  first = firstRunBelow_GmRunIndex_(&d->runIndex, pos.y);
+    const iGmRun *last  = NULL;
+    /* The runs skipped by the index are all above the point, so the closest one is the
+       last of them. */
+    for (size_t i = first; i-- > 0; ) {
+        if (~runs[i].flags & decoration_GmRunFlag) {
+            last = &runs[i];
+            break;
+        }
+    }
+    iBool isFirstNonDecoration = (last == NULL);
+    for (size_t i = first; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = &runs[i];
         if (run->flags & decoration_GmRunFlag) continue;
         const iRangei span = ySpan_Rect(run->bounds);
         if (contains_Range(&span, pos.y)) {
@@ -2543,8 +2805,13 @@ iRangecc findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
 }
 
 const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const iRangecc source = range_String(&d->source);
+    const iGmRun  *runs   = constData_Array(&d->layout);
+    const size_t   first  = contains_Range(&source, textCStr)
+                                ? runBeforeLoc_GmRunIndex_(&d->runIndex, textCStr - source.start)
+                                : 0;
+    for (size_t i = first; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = &runs[i];
         if (run->flags & decoration_GmRunFlag) {
             continue;
         }
@@ -2569,11 +2836,14 @@ const iString *linkUrl_GmDocument(const iGmDocument *d, iGmLinkId linkId) {
 
 iRangecc linkUrlRange_GmDocument(const iGmDocument *d, iGmLinkId linkId) {
     const iGmLink *link = link_GmDocument_(d, linkId);
-    return link->urlRange;
+    return link ? link->urlRange : iNullRange; /* not laid out yet? */
 }
 
 iRangecc linkLabel_GmDocument(const iGmDocument *d, iGmLinkId linkId) {
     const iGmLink *link = link_GmDocument_(d, linkId);
+    if (!link) {
+        return iNullRange;
+    }
     if (isEmpty_Range(&link->labelRange)) {
         return link->urlRange;
     }
@@ -192,13 +192,20 @@ void    setThemeSeed_GmDocument (iGmDocument *,
 void    setFormat_GmDocument    (iGmDocument *, enum iSourceFormat sourceFormat);
 iBool   setViewFormat_GmDocument(iGmDocument *, enum iSourceFormat viewFormat); /* returns True if changed */
 void    setWidth_GmDocument     (iGmDocument *, int width, int canvasWidth);
+void    setLayoutSlice_GmDocument(iGmDocument *, uint32_t maxDuration); /* full layouts continue in steps */
+void    beginLayout_GmDocument  (iGmDocument *, int width, int canvasWidth, const char *untilLoc,
+                                 uint32_t maxDuration); /* lays out at least up to `untilLoc` */
+iBool   continueLayout_GmDocument(iGmDocument *, uint32_t maxDuration); /* returns True if unfinished */
+void    finishLayout_GmDocument (iGmDocument *);
+iBool   isLayoutPending_GmDocument(const iGmDocument *);
 iBool   updateWidth_GmDocument  (iGmDocument *, int width, int canvasWidth);
 void    redoLayout_GmDocument   (iGmDocument *);
 void    invalidateLayout_GmDocument(iGmDocument *); /* will have to be redone later */
 iBool   updateOpenURLs_GmDocument(iGmDocument *);
 void    setUrl_GmDocument       (iGmDocument *, const iString *url);
-void    setSource_GmDocument    (iGmDocument *, const iString *source, int width, int canvasWidth,
-                                 enum iGmDocumentUpdate updateType);
+void    setSource_GmDocument    (iGmDocument *, const iString *source,
+                                 uint32_t stream, /* same for all updates of a response; or 0 */
+                                 int width, int canvasWidth, enum iGmDocumentUpdate updateType);
 void    foldPre_GmDocument      (iGmDocument *, uint16_t preId);
 
 void    updateVisitedLinks_GmDocument   (iGmDocument *); /* check all links for visited status */
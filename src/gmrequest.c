@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "gopher.h"
 #include "app.h" /* dataDir_App() */
 #include "mimehooks.h"
+#include "feedparser.h"
 #include "feeds.h"
 #include "bookmarks.h"
 #include "ui/text.h"
@@ -179,10 +180,15 @@ struct Impl_GmRequest {
     iBool                isFilterEnabled;
     iBool                isRespLocked;
     iBool                isRespFiltered;
+    iFeedParser *        feedParser; /* built-in feed translation as the response arrives */
+    iString *            feedGemini;
     iAtomicInt           allowUpdate;
     iAudience *          updated;
     iAudience *          finished;
     iGmRequestProgressFunc sendProgress;
+    iGmRequestSinkFunc   sink;
+    iAny *               sinkContext;
+    size_t               sinkSize; /* number of body bytes passed to the sink */
 };
 
 iDefineObjectConstructionArgs(GmRequest, (iGmCerts *certs), certs)
@@ -220,6 +226,53 @@ static void checkServerCertificate_GmRequest_(iGmRequest *d) {
     }
 }
 
+static void flushBodyToSink_GmRequest_(iGmRequest *d) {
+    /* In sink mode, the body is handed over as it arrives and is not kept in memory. */
+    iGmResponse *resp = d->resp;
+    if (d->sink && isSuccess_GmStatusCode(resp->statusCode) && !isEmpty_Block(&resp->body)) {
+        d->sink(d->sinkContext, resp, &resp->body);
+        d->sinkSize += size_Block(&resp->body);
+        clear_Block(&resp->body);
+    }
+}
+
+static void deleteFeedParser_GmRequest_(iGmRequest *d) {
+    if (d->feedParser) {
+        delete_FeedParser(d->feedParser);
+        delete_String(d->feedGemini);
+        d->feedParser = NULL;
+        d->feedGemini = NULL;
+    }
+}
+
+static iBool isTranslatingFeed_GmRequest_(const iGmRequest *d) {
+    return d->feedParser && !d->isRespFiltered;
+}
+
+static void translateFeed_GmRequest_(iGmRequest *d, iRangecc data) {
+    /* Feeds are translated to Gemtext while they are being received, so the page can be shown
+       progressively. The original body is kept until it is known to be a feed. */
+    if (!d->feedParser) {
+        return;
+    }
+    iGmResponse *resp = d->resp;
+    write_FeedParser(d->feedParser, data);
+    const enum iFeedParserState state = state_FeedParser(d->feedParser);
+    if (state == notFeed_FeedParserState) {
+        deleteFeedParser_GmRequest_(d); /* shown as is */
+        return;
+    }
+    if (state == feed_FeedParserState) {
+        if (d->isRespFiltered) {
+            d->isRespFiltered = iFalse;
+            setCStr_String(&resp->meta, "text/gemini");
+            clear_Block(&resp->body);
+        }
+        append_Block(&resp->body, utf8_String(d->feedGemini));
+        clear_String(d->feedGemini);
+    }
+}
+
 static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
     iBool        notifyUpdate = iFalse;
     iBool        notifyDone   = iFalse;
@@ -263,14 +316,26 @@ static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
                 notifyUpdate     = iTrue;
                 if (d->isFilterEnabled && willTryFilter_MimeHooks(mimeHooks_App(), &resp->meta)) {
                     d->isRespFiltered = iTrue;
+                    if (!d->feedParser &&
+                        willTranslateFeed_MimeHooks(mimeHooks_App(), &resp->meta)) {
+                        d->feedParser = new_FeedParser();
+                        d->feedGemini = new_String();
+                        setGeminiOutput_FeedParser(d->feedParser, d->feedGemini);
+                    }
                 }
             }
             checkServerCertificate_GmRequest_(d);
             iRelease(metaPattern);
+            translateFeed_GmRequest_(d, range_Block(&resp->body));
+            flushBodyToSink_GmRequest_(d);
         }
     }
     else if (d->state == receivingBody_GmRequestState) {
-        append_Block(&resp->body, data);
+        if (!isTranslatingFeed_GmRequest_(d)) {
+            append_Block(&resp->body, data);
+        }
+        translateFeed_GmRequest_(d, range_Block(data));
+        flushBodyToSink_GmRequest_(d);
         notifyUpdate = iTrue;
     }
     return (notifyUpdate ? 1 : 0) | (notifyDone ? 2 : 0);
@@ -355,6 +420,10 @@ static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
         }
     }
     checkServerCertificate_GmRequest_(d);
+    if (d->feedParser) {
+        finish_FeedParser(d->feedParser);
+        deleteFeedParser_GmRequest_(d);
+    }
     unlock_Mutex(d->mtx);
     /* Check for mimehooks. */
     if (d->isRespFiltered && d->state == finished_GmRequestState) {
@@ -460,6 +529,7 @@ static void gopherRead_GmRequest_(iGmRequest *d, iSocket *socket) {
     iBlock *data = readAll_Socket(socket);
     if (!isEmpty_Block(data)) {
         processResponse_Gopher(&d->gopher, data);
+        flushBodyToSink_GmRequest_(d);
     }
     delete_Block(data);
     unlock_Mutex(d->mtx);
@@ -569,10 +639,12 @@ static void spartanRead_GmRequest_(iGmRequest *d, iSocket *socket) {
                     notifyDone          = iTrue;
                 }
                 iRelease(metaPattern);
+                flushBodyToSink_GmRequest_(d);
             }
         }
         else if (d->state == receivingBody_GmRequestState) {
             append_Block(&d->resp->body, data);
+            flushBodyToSink_GmRequest_(d);
             notifyUpdate = iTrue;
         }
     }
@@ -652,6 +724,8 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     d->isFilterEnabled = iTrue;
     d->isRespLocked    = iFalse;
     d->isRespFiltered  = iFalse;
+    d->feedParser      = NULL;
+    d->feedGemini      = NULL;
     set_Atomic(&d->allowUpdate, iTrue);
     init_String(&d->url);
     init_Gopher(&d->gopher);
@@ -662,6 +736,9 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     d->updated      = NULL;
     d->finished     = NULL;
     d->sendProgress = NULL;
+    d->sink         = NULL;
+    d->sinkContext  = NULL;
+    d->sinkSize     = 0;
     d->state        = initialized_GmRequestState;
 }
 
@@ -681,6 +758,7 @@ void deinit_GmRequest(iGmRequest *d) {
         unlock_Mutex(d->mtx);
     }
     iReleasePtr(&d->req);
+    deleteFeedParser_GmRequest_(d);
     delete_UploadData(d->upload);
     deinit_Gopher(&d->gopher);
     iRelease(d->spartan);
@@ -741,6 +819,22 @@ void setSendProgressFunc_GmRequest(iGmRequest *d, iGmRequestProgressFunc func) {
     d->sendProgress = func;
 }
 
+void setBodySink_GmRequest(iGmRequest *d, iGmRequestSinkFunc func, iAny *context) {
+    /* The sink is called in the request's background thread. Body data received before this
+       is passed to the sink right away. MIME hooks can't be applied since the full body is not
+       available. */
+    iGuardMutex(d->mtx, {
+        d->sink        = func;
+        d->sinkContext = context;
+        if (func) {
+            d->isFilterEnabled = iFalse;
+            d->isRespFiltered  = iFalse;
+            deleteFeedParser_GmRequest_(d);
+            flushBodyToSink_GmRequest_(d);
+        }
+    });
+}
+
 static void bytesSent_GmRequest_(iGmRequest *d, iTlsRequest *req, size_t sent, size_t toSend) {
     iUnused(req);
     if (d->sendProgress) {
@@ -781,6 +875,7 @@ void submit_GmRequest(iGmRequest *d) {
     set_Atomic(&d->allowUpdate, iTrue);
     iGmResponse *resp = d->resp;
     clear_GmResponse(resp);
+    d->sinkSize = 0;
 #if !defined (NDEBUG) && !defined (iPlatformTerminal)
     fprintf(stderr, "[GmRequest] URL: %s\n", cstr_String(&d->url)); fflush(stderr);
 #endif
@@ -1163,7 +1258,7 @@ const iBlock *body_GmRequest(const iGmRequest *d) {
 
 size_t bodySize_GmRequest(const iGmRequest *d) {
     size_t size;
-    iGuardMutex(d->mtx, size = size_Block(&d->resp->body));
+    iGuardMutex(d->mtx, size = d->sinkSize + size_Block(&d->resp->body));
     return size;
 }
 
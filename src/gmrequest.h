@@ -68,6 +68,7 @@ iDeclareAudienceGetter(GmRequest, updated)
 iDeclareAudienceGetter(GmRequest, finished)
     
 typedef void (*iGmRequestProgressFunc)(iGmRequest *, size_t current, size_t total);
+typedef void (*iGmRequestSinkFunc)    (iAny *, const iGmResponse *, const iBlock *data);
 
 void                enableFilters_GmRequest     (iGmRequest *, iBool enable);
 void                setUrl_GmRequest            (iGmRequest *, const iString *url);
@@ -75,6 +76,7 @@ void                setIdentity_GmRequest       (iGmRequest *, const iGmIdentity
 void                setUploadData_GmRequest     (iGmRequest *, const iString *mime,
                                                  const iBlock *payload, const iString *token);
 void                setSendProgressFunc_GmRequest(iGmRequest *, iGmRequestProgressFunc func);
+void                setBodySink_GmRequest       (iGmRequest *, iGmRequestSinkFunc func, iAny *context);
 void                submit_GmRequest            (iGmRequest *);
 void                cancel_GmRequest            (iGmRequest *);
 
@@ -86,7 +88,7 @@ iBool               isFinished_GmRequest        (const iGmRequest *);
 enum iGmStatusCode  status_GmRequest            (const iGmRequest *);
 const iString *     meta_GmRequest              (const iGmRequest *);
 const iBlock  *     body_GmRequest              (const iGmRequest *);
-size_t              bodySize_GmRequest          (const iGmRequest *);
+size_t              bodySize_GmRequest          (const iGmRequest *); /* includes sunk bytes */
 const iString *     url_GmRequest               (const iGmRequest *);
 iBool               isProxy_GmRequest           (const iGmRequest *); /* was sent to a proxy */
 const iAddress *    address_GmRequest           (const iGmRequest *);
@@ -21,5 +21,153 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "gmtypesetter.h"
-#include "gmdocument.h"
 
+#include <string.h>
+
+struct Impl_GmTypesetter {
+    enum iSourceFormat format;
+    iBool  isNormalized; /* collapse whitespace outside preformatted blocks */
+    iBool  isFinished;   /* all of the source has been received */
+    size_t inputPos;     /* source bytes already consumed (complete lines only) */
+    iBool  isPreformat;  /* inside a preformatted block */
+    size_t preStart;     /* output position of the opening line of the current block */
+};
+
+void init_GmTypesetter(iGmTypesetter *d) {
+    reset_GmTypesetter(d, gemini_SourceFormat, iFalse);
+}
+
+void deinit_GmTypesetter(iGmTypesetter *d) {
+    iUnused(d);
+}
+
+iDefineTypeConstruction(GmTypesetter)
+
+void reset_GmTypesetter(iGmTypesetter *d, enum iSourceFormat format, iBool isNormalized) {
+    d->format       = format;
+    d->isNormalized = isNormalized;
+    d->isFinished   = iFalse;
+    d->inputPos     = 0;
+    d->isPreformat  = iFalse;
+    d->preStart     = 0;
+}
+
+iLocalDef iBool isNormalizableSpace_(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+static void appendNormalized_(iRangecc line, iString *out) {
+    iBool isPrevSpace = iFalse;
+    int   spaceCount  = 0;
+    for (const char *ch = line.start; ch != line.end; ch++) {
+        char c = *ch;
+        if (c == '\v') {
+            continue;
+        }
+        if (isNormalizableSpace_(c)) {
+            if (isPrevSpace) {
+                if (++spaceCount == 8) {
+                    /* There are several consecutive space characters. The author likely
+                       really wants to have some space here, so normalize to a tab stop. */
+                    popBack_Block(&out->chars);
+                    pushBack_Block(&out->chars, '\t');
+                }
+                continue; /* skip repeated spaces */
+            }
+            c = ' ';
+            isPrevSpace = iTrue;
+        }
+        else {
+            isPrevSpace = iFalse;
+            spaceCount = 0;
+        }
+        pushBack_Block(&out->chars, c);
+    }
+}
+
+static void appendLine_GmTypesetter_(iGmTypesetter *d, iRangecc line, iBool isTerminated,
+                                     iString *out) {
+    const iBool isGemini = (d->format == gemini_SourceFormat);
+    const iBool isToggle = isGemini && startsWith_Rangecc(line, "```");
+    if (isToggle && !d->isPreformat) {
+        /* The block can't be laid out until its end is known. */
+        d->isPreformat = iTrue;
+        d->preStart    = size_String(out);
+        appendRange_String(out, line);
+    }
+    else if (!d->isNormalized) {
+        appendRange_String(out, line);
+        if (isToggle) {
+            d->isPreformat = iFalse;
+        }
+    }
+    else if (d->isPreformat || !isGemini) {
+        /* Preformatted text is kept as-is, except for vertical tabs. */
+        for (const char *ch = line.start; ch != line.end; ch++) {
+            if (*ch != '\v') {
+                pushBack_Block(&out->chars, *ch);
+            }
+        }
+        if (isToggle) {
+            d->isPreformat = iFalse;
+        }
+    }
+    else {
+        appendNormalized_(line, out);
+    }
+    if (isTerminated || d->isNormalized) {
+        appendCStr_String(out, "\n");
+    }
+}
+
+size_t addInput_GmTypesetter(iGmTypesetter *d, const iString *source, iBool isFinal,
+                             iString *output) {
+    const size_t startPos = d->inputPos;
+    iRangecc     input    = { constBegin_String(source) + d->inputPos, constEnd_String(source) };
+    iAssert(input.start <= input.end);
+    if (startPos == 0 && d->isNormalized) {
+        /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */
+        iChar ch = 0;
+        decodeBytes_MultibyteChar(input.start, input.end, &ch);
+        if (ch == 0xfeff) /* zero-width non-breaking space */ {
+            input.start += 3;
+        }
+    }
+    while (input.start < input.end) {
+        const char *eol = memchr(input.start, '\n', size_Range(&input));
+        if (!eol) {
+            /* The last line is incomplete until the source has been fully received. */
+            if (isFinal) {
+                appendLine_GmTypesetter_(d, input, iFalse, output);
+                input.start = input.end;
+            }
+            break;
+        }
+        iRangecc line = { input.start, eol };
+        if (line.end > line.start && line.end[-1] == '\r') {
+            line.end--;
+        }
+        appendLine_GmTypesetter_(d, line, iTrue, output);
+        input.start = eol + 1;
+    }
+    d->inputPos = input.start - constBegin_String(source);
+    if (isFinal) {
+        d->isFinished = iTrue;
+    }
+    return d->inputPos - startPos;
+}
+
+iBool isFinished_GmTypesetter(const iGmTypesetter *d) {
+    return d->isFinished;
+}
+
+size_t inputSize_GmTypesetter(const iGmTypesetter *d) {
+    return d->inputPos;
+}
+
+size_t readySize_GmTypesetter(const iGmTypesetter *d, const iString *output) {
+    if (d->isPreformat && !d->isFinished) {
+        return d->preStart;
+    }
+    return size_String(output);
+}
@@ -24,18 +24,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "defs.h"
 
-#include <the_Foundation/array.h>
 #include <the_Foundation/string.h>
-#include <the_Foundation/vec2.h>
 
-/* GmTypesetter has two jobs: it normalizes incoming source text, and typesets it as a
-   sequence of GmRuns. New data can be appended progressively. */
+/* GmTypesetter prepares incoming source text for layout. New data can be appended
+   progressively: only complete lines are accepted, and the normalizer and preformatted
+   block state carries over from one chunk to the next. The output is appended to a
+   caller-owned string, so previously produced text is never modified. */
 
 iDeclareType(GmTypesetter)
 iDeclareTypeConstruction(GmTypesetter)
-        
-void    reset_GmTypesetter      (iGmTypesetter *, enum iSourceFormat format);
-void    setWidth_GmTypesetter   (iGmTypesetter *, int width);
-void    addInput_GmTypesetter   (iGmTypesetter *, const iString *source);
-iBool   getRuns_GmTypesetter    (iGmTypesetter *, iArray *runs_out); /* returns false when no output generated */
-void    skip_GmTypesetter       (iGmTypesetter *, int ySkip);
+
+void    reset_GmTypesetter      (iGmTypesetter *, enum iSourceFormat format, iBool isNormalized);
+size_t  addInput_GmTypesetter   (iGmTypesetter *, const iString *source, iBool isFinal,
+                                 iString *output); /* returns number of source bytes consumed */
+
+iBool   isFinished_GmTypesetter (const iGmTypesetter *);
+size_t  inputSize_GmTypesetter  (const iGmTypesetter *); /* bytes of source consumed so far */
+size_t  readySize_GmTypesetter  (const iGmTypesetter *, const iString *output); /* output that can be laid out */
@@ -21,13 +21,20 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "history.h"
+#include "contentcache.h"
 #include "ui/root.h"
 #include "app.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/file.h>
+#include <the_Foundation/hash.h>
+#include <the_Foundation/intset.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
+#include <the_Foundation/ptrarray.h>
 #include <the_Foundation/stringset.h>
+#include <the_Foundation/thread.h>
+#include <ctype.h>
 #include <math.h>
 
 static const size_t maxStack_History_ = 50; /* back/forward navigable items */
@@ -36,15 +43,19 @@ void init_RecentUrl(iRecentUrl *d) {
     init_String(&d->url);
     d->normScrollY    = 0;
     d->cachedResponse = NULL;
+    init_String(&d->cacheKey);
+    d->indexId        = 0;
     d->cachedDoc      = NULL;
     d->flags          = 0;
     init_Block(&d->setIdentity, 0);
+    iZap(d->counted);
 }
 
 void deinit_RecentUrl(iRecentUrl *d) {
     iRelease(d->cachedDoc);
     deinit_String(&d->url);
     delete_GmResponse(d->cachedResponse);
+    deinit_String(&d->cacheKey);
     deinit_Block(&d->setIdentity);
 }
 
@@ -55,6 +66,7 @@ iRecentUrl *copy_RecentUrl(const iRecentUrl *d) {
     set_String(&copy->url, &d->url);
     copy->normScrollY    = d->normScrollY;
     copy->cachedResponse = d->cachedResponse ? copy_GmResponse(d->cachedResponse) : NULL;
+    set_String(&copy->cacheKey, &d->cacheKey);
     copy->cachedDoc      = ref_Object(d->cachedDoc);
     copy->flags          = d->flags;
     set_Block(&copy->setIdentity, &d->setIdentity);
@@ -67,49 +79,347 @@ size_t cacheSize_RecentUrl(const iRecentUrl *d) {
         size += size_String(&d->cachedResponse->meta);
         size += size_Block(&d->cachedResponse->body);
     }
+    else if (!isEmpty_String(&d->cacheKey)) {
+        size += size_ContentCache(&d->cacheKey);
+    }
     return size;    
 }
 
 size_t memorySize_RecentUrl(const iRecentUrl *d) {
-    size_t size = cacheSize_RecentUrl(d);
+    size_t size = 0;
+    if (d->cachedResponse) {
+        size += size_String(&d->cachedResponse->meta);
+        size += size_Block(&d->cachedResponse->body);
+    }
     if (d->cachedDoc) {
         size += memorySize_GmDocument(d->cachedDoc);
     }
     return size;
 }
 
+iBool hasCachedResponse_RecentUrl(const iRecentUrl *d) {
+    return d->cachedResponse || !isEmpty_String(&d->cacheKey);
+}
+
+static const iGmResponse *loadCachedResponse_RecentUrl_(iRecentUrl *d) {
+    if (!d->cachedResponse && !isEmpty_String(&d->cacheKey)) {
+        d->cachedResponse = load_ContentCache(&d->cacheKey);
+        if (!d->cachedResponse) {
+            clear_String(&d->cacheKey); /* missing from the cache */
+        }
+    }
+    return d->cachedResponse;
+}
+
+static iTime cachedTime_RecentUrl_(const iRecentUrl *d) {
+    if (d->cachedResponse) {
+        return d->cachedResponse->when;
+    }
+    return time_ContentCache(&d->cacheKey);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Trigram index of cached text responses, for searching history contents without scanning
+   every response body. A candidate must contain all the trigrams of the search words;
+   candidates are then verified with the actual search pattern, so a match may begin
+   anywhere in a word. Trigrams are lowercase and ASCII only: the pattern is matched
+   case-insensitively, and non-ASCII letters can't be lowercased byte by byte. */
+
+iDeclareType(ContentIndex)
+iDeclareType(ContentGram)
+iDeclareType(ContentItem)
+
+struct Impl_ContentGram {
+    iHashNode node; /* key is three lowercase bytes */
+    iIntSet   ids;
+};
+
+struct Impl_ContentItem {
+    iHashNode node; /* key is the item ID */
+    iBool     isText;
+    iBool     isIndexed; /* if not, the item is always a candidate */
+    iArray    grams;     /* uint32_t, unique */
+};
+
+struct Impl_ContentIndex {
+    iHash    grams; /* ContentGram */
+    iHash    items; /* ContentItem */
+    uint32_t nextItemId;
+};
+
+/* Every tab has its own index, so the number of indexed trigrams is limited globally.
+   Responses that don't fit are scanned in full when searching. */
+static iAtomicInt   numGrams_ContentIndex_;
+static const int    maxGrams_ContentIndex_ = 2000000;
+
+static uint32_t gram_ContentIndex_(const char *chars) {
+    return ((uint32_t) (uint8_t) chars[0] << 16) | ((uint32_t) (uint8_t) chars[1] << 8) |
+           (uint8_t) chars[2];
+}
+
+static iBool isAscii_ContentIndex_(const char *chars) {
+    return ((uint8_t) chars[0] | (uint8_t) chars[1] | (uint8_t) chars[2]) < 0x80;
+}
+
+static int cmpGram_ContentIndex_(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static iBool isText_ContentIndex_(const iGmResponse *resp) {
+    return category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode &&
+           indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) != iInvalidPos;
+}
+
+static iContentItem *new_ContentItem_(const iGmResponse *resp) {
+    /* Note: Called without holding the History lock. */
+    iContentItem *d = iMalloc(ContentItem);
+    d->isText = isText_ContentIndex_(resp);
+    d->isIndexed = d->isText;
+    init_Array(&d->grams, sizeof(uint32_t));
+    if (d->isText) {
+        const size_t len = size_Block(&resp->body);
+        char *text = malloc(len + 1);
+        const char *src = constData_Block(&resp->body);
+        for (size_t i = 0; i < len; i++) {
+            text[i] = tolower((unsigned char) src[i]);
+        }
+        for (size_t i = 0; i + 3 <= len; i++) {
+            if (isAscii_ContentIndex_(text + i)) {
+                const uint32_t gram = gram_ContentIndex_(text + i);
+                pushBack_Array(&d->grams, &gram);
+            }
+        }
+        free(text);
+        sort_Array(&d->grams, cmpGram_ContentIndex_);
+        size_t dst = 0;
+        for (size_t i = 0; i < size_Array(&d->grams); i++) {
+            const uint32_t gram = value_Array(&d->grams, i, uint32_t);
+            if (dst == 0 || value_Array(&d->grams, dst - 1, uint32_t) != gram) {
+                value_Array(&d->grams, dst++, uint32_t) = gram;
+            }
+        }
+        resize_Array(&d->grams, dst);
+    }
+    return d;
+}
+
+static void delete_ContentItem_(iContentItem *d) {
+    if (d) {
+        deinit_Array(&d->grams);
+        free(d);
+    }
+}
+
+static void init_ContentIndex(iContentIndex *d) {
+    init_Hash(&d->grams);
+    init_Hash(&d->items);
+    d->nextItemId = 1;
+}
+
+static void clear_ContentIndex(iContentIndex *d) {
+    iForEach(Hash, i, &d->items) {
+        iContentItem *item = (iContentItem *) i.value;
+        if (item->isIndexed) {
+            add_Atomic(&numGrams_ContentIndex_, -(int) size_Array(&item->grams));
+        }
+        delete_ContentItem_(item);
+    }
+    iForEach(Hash, j, &d->grams) {
+        iContentGram *gram = (iContentGram *) j.value;
+        deinit_IntSet(&gram->ids);
+        free(gram);
+    }
+    deinit_Hash(&d->items);
+    deinit_Hash(&d->grams);
+    init_Hash(&d->grams);
+    init_Hash(&d->items);
+}
+
+static void deinit_ContentIndex(iContentIndex *d) {
+    clear_ContentIndex(d);
+    deinit_Hash(&d->items);
+    deinit_Hash(&d->grams);
+}
+
+static void add_ContentIndex(iContentIndex *d, uint32_t itemId, iContentItem *item) {
+    /* The index takes ownership of `item`. Only the item's own trigrams are touched. */
+    const int numGrams = (int) size_Array(&item->grams);
+    if (item->isIndexed &&
+        add_Atomic(&numGrams_ContentIndex_, numGrams) + numGrams > maxGrams_ContentIndex_) {
+        add_Atomic(&numGrams_ContentIndex_, -numGrams);
+        item->isIndexed = iFalse;
+    }
+    if (!item->isIndexed) {
+        clear_Array(&item->grams);
+    }
+    iConstForEach(Array, i, &item->grams) {
+        const uint32_t key  = *(const uint32_t *) i.value;
+        iContentGram  *gram = (iContentGram *) value_Hash(&d->grams, key);
+        if (!gram) {
+            gram = iMalloc(ContentGram);
+            gram->node.key = key;
+            init_IntSet(&gram->ids);
+            insert_Hash(&d->grams, &gram->node);
+        }
+        insert_IntSet(&gram->ids, itemId);
+    }
+    item->node.key = itemId;
+    insert_Hash(&d->items, &item->node);
+}
+
+static void remove_ContentIndex(iContentIndex *d, uint32_t itemId) {
+    iContentItem *item = (iContentItem *) remove_Hash(&d->items, itemId);
+    if (!item) {
+        return; /* possibly still being tokenized */
+    }
+    iConstForEach(Array, i, &item->grams) {
+        const uint32_t key  = *(const uint32_t *) i.value;
+        iContentGram  *gram = (iContentGram *) value_Hash(&d->grams, key);
+        if (gram) {
+            remove_IntSet(&gram->ids, itemId);
+            if (isEmpty_IntSet(&gram->ids)) {
+                remove_Hash(&d->grams, key);
+                deinit_IntSet(&gram->ids);
+                free(gram);
+            }
+        }
+    }
+    if (item->isIndexed) {
+        add_Atomic(&numGrams_ContentIndex_, -(int) size_Array(&item->grams));
+    }
+    delete_ContentItem_(item);
+}
+
+static void queryGrams_ContentIndex_(const iContentIndex *d, const iStringArray *terms,
+                                     iPtrArray *ids_out) {
+    /* Collects the item ID sets of the search terms' trigrams. A NULL entry means that some
+       trigram isn't found in any indexed item. */
+    clear_PtrArray(ids_out);
+    iConstForEach(StringArray, i, terms) {
+        const size_t len  = size_String(i.value);
+        char        *term = malloc(len + 1);
+        for (size_t j = 0; j < len; j++) {
+            term[j] = tolower((unsigned char) cstr_String(i.value)[j]);
+        }
+        for (size_t pos = 0; pos + 3 <= len; pos++) {
+            if (isAscii_ContentIndex_(term + pos)) {
+                const iContentGram *gram =
+                    (const iContentGram *) value_Hash(&d->grams, gram_ContentIndex_(term + pos));
+                pushBack_PtrArray(ids_out, gram ? &gram->ids : NULL);
+            }
+        }
+        free(term);
+    }
+}
+
+static iBool isCandidate_ContentIndex_(const iContentIndex *d, uint32_t itemId,
+                                       const iPtrArray *gramIds) {
+    /* Items that haven't been indexed yet are always candidates. */
+    const iContentItem *item = itemId ? (const iContentItem *) value_Hash(&d->items, itemId)
+                                      : NULL;
+    if (!item) {
+        return iTrue;
+    }
+    if (!item->isText) {
+        return iFalse;
+    }
+    if (!item->isIndexed) {
+        return iTrue;
+    }
+    iConstForEach(PtrArray, g, gramIds) {
+        if (!g.ptr || !contains_IntSet(g.ptr, itemId)) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 struct Impl_History {
     iMutex *mtx;
     iArray recent;    /* TODO: should be specific to a DocumentWidget */
     size_t recentPos; /* zero at the latest item */
+    iContentIndex index;
+    iThread *indexer; /* tokenizes cached responses in the background */
+    iBool    isIndexing;
+    iBool    isQuitting;
+    iMemInfo totals;  /* sum of the items' counted sizes */
 };
 
 iDefineTypeConstruction(History)
 
+static void startIndexing_History_(iHistory *d);
+
 void init_History(iHistory *d) {
     d->mtx = new_Mutex();
     init_Array(&d->recent, sizeof(iRecentUrl));
     d->recentPos = 0;
+    init_ContentIndex(&d->index);
+    d->indexer    = NULL;
+    d->isIndexing = iFalse;
+    d->isQuitting = iFalse;
+    iZap(d->totals);
 }
 
 void deinit_History(iHistory *d) {
+    iGuardMutex(d->mtx, d->isQuitting = iTrue);
+    if (d->indexer) {
+        join_Thread(d->indexer);
+        iReleasePtr(&d->indexer);
+    }
     iGuardMutex(d->mtx, {
         clear_History(d);
         deinit_Array(&d->recent);
+        deinit_ContentIndex(&d->index);
     });
     delete_Mutex(d->mtx);
 }
 
+static void unindex_History_(iHistory *d, iRecentUrl *item) {
+    if (item->indexId) {
+        remove_ContentIndex(&d->index, item->indexId);
+        item->indexId = 0;
+    }
+}
+
+static void unaccount_History_(iHistory *d, iRecentUrl *item) {
+    d->totals.cacheSize  -= item->counted.cacheSize;
+    d->totals.memorySize -= item->counted.memorySize;
+    iZap(item->counted);
+}
+
+static void account_History_(iHistory *d, iRecentUrl *item) {
+    /* Called whenever the cached contents of an item change. A document's memory use also
+       changes when its images are decoded, so it is sampled again before pruning. */
+    unaccount_History_(d, item);
+    item->counted.cacheSize  = cacheSize_RecentUrl(item);
+    item->counted.memorySize = memorySize_RecentUrl(item);
+    d->totals.cacheSize  += item->counted.cacheSize;
+    d->totals.memorySize += item->counted.memorySize;
+}
+
+static void clearCachedResponse_History_(iHistory *d, iRecentUrl *item) {
+    unindex_History_(d, item);
+    delete_GmResponse(item->cachedResponse);
+    item->cachedResponse = NULL;
+    clear_String(&item->cacheKey);
+}
+
 iHistory *copy_History(const iHistory *d) {
     lock_Mutex(d->mtx);
     iHistory *copy = new_History();
     iConstForEach(Array, i, &d->recent) {
         pushBack_Array(&copy->recent, copy_RecentUrl(i.value));
     }
+    iForEach(Array, j, &copy->recent) {
+        account_History_(copy, j.value);
+    }
     copy->recentPos = d->recentPos;
     unlock_Mutex(d->mtx);
+    iGuardMutex(copy->mtx, startIndexing_History_(copy));
     return copy;
 }
 
@@ -185,9 +495,11 @@ void serialize_History(const iHistory *d, iStream *outs) {
         serialize_String(&item->url, outs);
         write32_Stream(outs, item->normScrollY * 1.0e6f);
         writeU16_Stream(outs, item->flags);
-        if (item->cachedResponse) {
-            write8_Stream(outs, 1);
-            serialize_GmResponse(item->cachedResponse, outs);
+        /* Response contents are already in the content cache, only the key is written here. */
+        if (!isEmpty_String(&item->cacheKey)) {
+            mark_ContentCache(&item->cacheKey);
+            write8_Stream(outs, 2);
+            serialize_String(&item->cacheKey, outs);
         }
         else {
             write8_Stream(outs, 0);
@@ -211,15 +523,22 @@ void deserialize_History(iHistory *d, iStream *ins) {
         if (version_Stream(ins) >= addedRecentUrlFlags_FileVersion) {
             item.flags = readU16_Stream(ins);
         }
-        if (read8_Stream(ins)) {
+        const uint8_t cached = read8_Stream(ins);
+        if (cached == 1) {
+            /* Older versions wrote the response inline. */
             item.cachedResponse = new_GmResponse();
             deserialize_GmResponse(item.cachedResponse, ins);
         }
+        else if (cached == 2) {
+            deserialize_String(&item.cacheKey, ins);
+        }
         if (version_Stream(ins) >= recentUrlSetIdentity_FileVersion) {
             deserialize_Block(&item.setIdentity, ins);
         }
         pushBack_Array(&d->recent, &item);
+        account_History_(d, back_Array(&d->recent));
     }
+    startIndexing_History_(d);
     unlock_Mutex(d->mtx);
 }
 
@@ -229,6 +548,8 @@ void clear_History(iHistory *d) {
         deinit_RecentUrl(s.value);
     }
     clear_Array(&d->recent);
+    clear_ContentIndex(&d->index);
+    iZap(d->totals);
     unlock_Mutex(d->mtx);
 }
 
@@ -295,7 +616,9 @@ void add_History(iHistory *d, const iString *url) {
     lock_Mutex(d->mtx);
     /* Cut the trailing history items. */
     if (d->recentPos > 0) {
-        for (size_t i = 0; i < d->recentPos - 1; i++) {
+        for (size_t i = 0; i < d->recentPos; i++) {
+            unindex_History_(d, recentUrl_History(d, i));
+            unaccount_History_(d, recentUrl_History(d, i));
             deinit_RecentUrl(recentUrl_History(d, i));
         }
         removeN_Array(&d->recent, size_Array(&d->recent) - d->recentPos, iInvalidSize);
@@ -310,6 +633,8 @@ void add_History(iHistory *d, const iString *url) {
         pushBack_Array(&d->recent, &item);
         /* Limit the number of items. */
         if (size_Array(&d->recent) > maxStack_History_) {
+            unindex_History_(d, front_Array(&d->recent));
+            unaccount_History_(d, front_Array(&d->recent));
             deinit_RecentUrl(front_Array(&d->recent));
             remove_Array(&d->recent, 0);
         }
@@ -320,6 +645,8 @@ void add_History(iHistory *d, const iString *url) {
 void undo_History(iHistory *d) {
     lock_Mutex(d->mtx);
     if (!isEmpty_Array(&d->recent) || d->recentPos != 0) {
+        unindex_History_(d, back_Array(&d->recent));
+        unaccount_History_(d, back_Array(&d->recent));
         deinit_RecentUrl(back_Array(&d->recent));
         popBack_Array(&d->recent);
     }
@@ -405,9 +732,29 @@ iBool atOldest_History(const iHistory *d) {
     return isOldest;
 }
 
-const iGmResponse *cachedResponse_History(const iHistory *d) {
-    const iRecentUrl *item = constMostRecentUrl_History(d);
-    return item ? item->cachedResponse : NULL;
+const iGmResponse *cachedResponse_History(iHistory *d) {
+    const iGmResponse *resp = NULL;
+    lock_Mutex(d->mtx);
+    iRecentUrl *item = mostRecentUrl_History(d);
+    if (item) {
+        resp = loadCachedResponse_History(d, item);
+    }
+    unlock_Mutex(d->mtx);
+    return resp;
+}
+
+const iGmResponse *loadCachedResponse_History(iHistory *d, iRecentUrl *item) {
+    const iGmResponse *resp = NULL;
+    lock_Mutex(d->mtx);
+    if (item) {
+        const iBool wasLoaded = (item->cachedResponse != NULL);
+        resp = loadCachedResponse_RecentUrl_(item);
+        if (!wasLoaded) {
+            account_History_(d, item);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return resp;
 }
 
 void setIdentity_History(iHistory *d, const iBlock *identityFingerprint) {
@@ -425,16 +772,31 @@ void setIdentity_History(iHistory *d, const iBlock *identityFingerprint) {
 }
 
 void setCachedResponse_History(iHistory *d, const iGmResponse *response) {
+    /* The response is stored in the content cache once, here, so saving the history only
+       needs to write the key. */
+    iGmResponse *cached = NULL;
+    iString     *key    = NULL;
+    if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
+        cached = copy_GmResponse(response);
+        key    = store_ContentCache(cached);
+    }
     lock_Mutex(d->mtx);
     iRecentUrl *item = mostRecentUrl_History(d);
     if (item) {
-        delete_GmResponse(item->cachedResponse);
-        item->cachedResponse = NULL;
-        if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
-            item->cachedResponse = copy_GmResponse(response);
+        clearCachedResponse_History_(d, item);
+        item->cachedResponse = cached;
+        cached = NULL;
+        if (key) {
+            set_String(&item->cacheKey, key);
+        }
+        account_History_(d, item);
+        if (hasCachedResponse_RecentUrl(item)) {
+            startIndexing_History_(d);
         }
     }
     unlock_Mutex(d->mtx);
+    delete_GmResponse(cached);
+    delete_String(key);
 }
 
 void setCachedDocument_History(iHistory *d, iGmDocument *doc) {
@@ -453,29 +815,20 @@ void setCachedDocument_History(iHistory *d, iGmDocument *doc) {
             iRelease(item->cachedDoc);
             item->cachedDoc = ref_Object(doc);
         }
+        account_History_(d, item);
     }
     unlock_Mutex(d->mtx);
 }
 
 size_t cacheSize_History(const iHistory *d) {
-    size_t cached = 0;
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        cached += cacheSize_RecentUrl(url);
-    }
-    unlock_Mutex(d->mtx);
+    size_t cached;
+    iGuardMutex(d->mtx, cached = d->totals.cacheSize);
     return cached;
 }
 
 size_t memorySize_History(const iHistory *d) {
-    size_t bytes = 0;
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        bytes += memorySize_RecentUrl(url);
-    }
-    unlock_Mutex(d->mtx);
+    size_t bytes;
+    iGuardMutex(d->mtx, bytes = d->totals.memorySize);
     return bytes;
 }
 
@@ -483,11 +836,9 @@ void clearCache_History(iHistory *d) {
     lock_Mutex(d->mtx);
     iForEach(Array, i, &d->recent) {
         iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
-            delete_GmResponse(url->cachedResponse);
-            url->cachedResponse = NULL;
-        }
+        clearCachedResponse_History_(d, url);
         iReleasePtr(&url->cachedDoc); /* release all cached documents and media as well */
+        account_History_(d, url);
     }
     unlock_Mutex(d->mtx);
 }
@@ -503,68 +854,153 @@ void invalidateCachedLayout_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-size_t pruneLeastImportant_History(iHistory *d) {
-    size_t delta  = 0;
-    size_t chosen = iInvalidPos;
-    double score  = 0.0f;
-    iTime now;
+/* Pruning considers the items of all the given histories at once. The scores depend on the
+   current time, so the heap of candidates is built when pruning starts; after that, each
+   pruned item costs O(log n). */
+
+iDeclareType(PruneCandidate)
+
+struct Impl_PruneCandidate {
+    iHistory *history;
+    size_t    index;
+    double    score;
+};
+
+static void siftDown_PruneCandidates_(iArray *heap, size_t pos) {
+    const size_t n = size_Array(heap);
+    for (;;) {
+        size_t largest = pos;
+        const size_t left = 2 * pos + 1, right = left + 1;
+        if (left < n && ((const iPruneCandidate *) constAt_Array(heap, left))->score >
+                            ((const iPruneCandidate *) constAt_Array(heap, largest))->score) {
+            largest = left;
+        }
+        if (right < n && ((const iPruneCandidate *) constAt_Array(heap, right))->score >
+                             ((const iPruneCandidate *) constAt_Array(heap, largest))->score) {
+            largest = right;
+        }
+        if (largest == pos) {
+            break;
+        }
+        iPruneCandidate tmp = *(iPruneCandidate *) at_Array(heap, pos);
+        *(iPruneCandidate *) at_Array(heap, pos)     = *(iPruneCandidate *) at_Array(heap, largest);
+        *(iPruneCandidate *) at_Array(heap, largest) = tmp;
+        pos = largest;
+    }
+}
+
+static void makeHeap_PruneCandidates_(iArray *heap) {
+    for (size_t i = size_Array(heap) / 2; i-- > 0; ) {
+        siftDown_PruneCandidates_(heap, i);
+    }
+}
+
+static iPruneCandidate popHeap_PruneCandidates_(iArray *heap) {
+    iPruneCandidate top = *(iPruneCandidate *) front_Array(heap);
+    *(iPruneCandidate *) front_Array(heap) = *(iPruneCandidate *) back_Array(heap);
+    popBack_Array(heap);
+    siftDown_PruneCandidates_(heap, 0);
+    return top;
+}
+
+static double ageFactor_History_(const iTime *now, iTime when) {
+    return pow(secondsSince_Time(now, &when) / 60.0, 1.25);
+}
+
+size_t pruneCache_History(const iPtrArray *histories, size_t maxSize) {
+    /* Returns the total size of the cache after pruning. */
+    size_t total = 0;
+    iTime  now;
     initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
-            const double urlScore =
-                cacheSize_RecentUrl(url) *
-                pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25);
-            if (urlScore > score) {
-                chosen = index_ArrayConstIterator(&i);
-                score  = urlScore;
+    iArray heap;
+    init_Array(&heap, sizeof(iPruneCandidate));
+    iConstForEach(PtrArray, h, histories) {
+        iHistory *d = h.ptr;
+        lock_Mutex(d->mtx);
+        total += d->totals.cacheSize;
+        iConstForEach(Array, i, &d->recent) {
+            const iRecentUrl *url = i.value;
+            if (hasCachedResponse_RecentUrl(url)) {
+                const iPruneCandidate cand = {
+                    d,
+                    index_ArrayConstIterator(&i),
+                    url->counted.cacheSize * ageFactor_History_(&now, cachedTime_RecentUrl_(url))
+                };
+                pushBack_Array(&heap, &cand);
             }
         }
+        unlock_Mutex(d->mtx);
     }
-    if (chosen != iInvalidPos) {
-        iRecentUrl *url = at_Array(&d->recent, chosen);
-        delta = cacheSize_RecentUrl(url);
-        delete_GmResponse(url->cachedResponse);
-        url->cachedResponse = NULL;
-        iReleasePtr(&url->cachedDoc);
+    makeHeap_PruneCandidates_(&heap);
+    while (total > maxSize && !isEmpty_Array(&heap)) {
+        const iPruneCandidate cand = popHeap_PruneCandidates_(&heap);
+        iHistory *d = cand.history;
+        lock_Mutex(d->mtx);
+        if (cand.index < size_Array(&d->recent)) {
+            iRecentUrl *url = at_Array(&d->recent, cand.index);
+            const size_t before = d->totals.cacheSize;
+            clearCachedResponse_History_(d, url);
+            iReleasePtr(&url->cachedDoc);
+            account_History_(d, url);
+            total -= iMin(total, before - d->totals.cacheSize);
+        }
+        unlock_Mutex(d->mtx);
     }
-    unlock_Mutex(d->mtx);
-    return delta;
+    deinit_Array(&heap);
+    return total;
 }
 
-size_t pruneLeastImportantMemory_History(iHistory *d) {
-    size_t delta  = 0;
-    size_t chosen = iInvalidPos;
-    double score  = 0.0f;
-    iTime now;
+size_t pruneMemory_History(const iPtrArray *histories, size_t maxSize) {
+    /* Returns the total memory usage after pruning. */
+    size_t total = 0;
+    iTime  now;
     initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        if (d->recentPos == size_Array(&d->recent) - index_ArrayConstIterator(&i) - 1) {
-            continue; /* Not the current navigation position. */
+    iArray heap;
+    init_Array(&heap, sizeof(iPruneCandidate));
+    iConstForEach(PtrArray, h, histories) {
+        iHistory *d = h.ptr;
+        lock_Mutex(d->mtx);
+        iForEach(Array, j, &d->recent) {
+            iRecentUrl *url = j.value;
+            if (url->cachedDoc) {
+                account_History_(d, url);
+            }
         }
-        if (url->cachedDoc) {
-            const double urlScore =
-                memorySize_RecentUrl(url) *
-                (url->cachedResponse
-                     ? pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25)
-                     : 1.0);
-            if (urlScore > score) {
-                chosen = index_ArrayConstIterator(&i);
-                score  = urlScore;
+        total += d->totals.memorySize;
+        iConstForEach(Array, i, &d->recent) {
+            const iRecentUrl *url = i.value;
+            if (d->recentPos == size_Array(&d->recent) - index_ArrayConstIterator(&i) - 1) {
+                continue; /* Not the current navigation position. */
+            }
+            if (url->cachedDoc) {
+                const iPruneCandidate cand = {
+                    d,
+                    index_ArrayConstIterator(&i),
+                    url->counted.memorySize *
+                        (url->cachedResponse ? ageFactor_History_(&now, url->cachedResponse->when)
+                                             : 1.0)
+                };
+                pushBack_Array(&heap, &cand);
             }
         }
+        unlock_Mutex(d->mtx);
     }
-    if (chosen != iInvalidPos) {
-        iRecentUrl *url = at_Array(&d->recent, chosen);
-        const size_t before = memorySize_RecentUrl(url);
-        iReleasePtr(&url->cachedDoc);
-        delta = before - memorySize_RecentUrl(url);
+    makeHeap_PruneCandidates_(&heap);
+    while (total > maxSize && !isEmpty_Array(&heap)) {
+        const iPruneCandidate cand = popHeap_PruneCandidates_(&heap);
+        iHistory *d = cand.history;
+        lock_Mutex(d->mtx);
+        if (cand.index < size_Array(&d->recent)) {
+            iRecentUrl *url = at_Array(&d->recent, cand.index);
+            const size_t before = d->totals.memorySize;
+            iReleasePtr(&url->cachedDoc);
+            account_History_(d, url);
+            total -= iMin(total, before - d->totals.memorySize);
+        }
+        unlock_Mutex(d->mtx);
     }
-    unlock_Mutex(d->mtx);
-    return delta;
+    deinit_Array(&heap);
+    return total;
 }
 
 void invalidateTheme_History(iHistory *d) {
@@ -578,53 +1014,176 @@ void invalidateTheme_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern) {
+iDeclareType(ContentJob)
+
+struct Impl_ContentJob {
+    uint32_t     itemId;
+    iString      url;
+    iString      cacheKey;
+    iGmResponse *resp; /* copy of the item's response, or loaded from the content cache */
+};
+
+static iContentJob *new_ContentJob_(const iRecentUrl *item) {
+    iContentJob *d = iMalloc(ContentJob);
+    d->itemId = item->indexId;
+    initCopy_String(&d->url, &item->url);
+    initCopy_String(&d->cacheKey, &item->cacheKey);
+    d->resp = item->cachedResponse ? copy_GmResponse(item->cachedResponse) : NULL;
+    return d;
+}
+
+static void delete_ContentJob_(iContentJob *d) {
+    deinit_String(&d->cacheKey);
+    deinit_String(&d->url);
+    delete_GmResponse(d->resp);
+    free(d);
+}
+
+static const iGmResponse *response_ContentJob_(iContentJob *d) {
+    if (!d->resp && !isEmpty_String(&d->cacheKey)) {
+        d->resp = load_ContentCache(&d->cacheKey);
+    }
+    return d->resp;
+}
+
+static iBool hasIndexId_History_(const iHistory *d, uint32_t itemId) {
+    iConstForEach(Array, i, &d->recent) {
+        if (((const iRecentUrl *) i.value)->indexId == itemId) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static iThreadResult index_History_(iThread *thread) {
+    /* Responses are loaded and tokenized without holding the lock, one item at a time. IDs
+       are assigned beforehand so that items removed in the meantime can be recognized.
+       Responses cached while indexing are picked up on the next round. */
+    iHistory *d = userData_Thread(thread);
+    iPtrArray jobs;
+    init_PtrArray(&jobs);
+    for (;;) {
+        lock_Mutex(d->mtx);
+        if (!d->isQuitting) {
+            iForEach(Array, i, &d->recent) {
+                iRecentUrl *item = i.value;
+                if (!item->indexId && hasCachedResponse_RecentUrl(item)) {
+                    item->indexId = d->index.nextItemId++;
+                    pushBack_PtrArray(&jobs, new_ContentJob_(item));
+                }
+            }
+        }
+        if (isEmpty_PtrArray(&jobs)) {
+            d->isIndexing = iFalse;
+            unlock_Mutex(d->mtx);
+            break;
+        }
+        unlock_Mutex(d->mtx);
+        iForEach(PtrArray, j, &jobs) {
+            iContentJob  *job     = j.ptr;
+            iContentItem *indexed = NULL;
+            if (!d->isQuitting) {
+                const iGmResponse *resp = response_ContentJob_(job);
+                indexed = resp ? new_ContentItem_(resp) : NULL;
+            }
+            lock_Mutex(d->mtx);
+            if (indexed && hasIndexId_History_(d, job->itemId)) {
+                add_ContentIndex(&d->index, job->itemId, indexed);
+                indexed = NULL;
+            }
+            unlock_Mutex(d->mtx);
+            delete_ContentItem_(indexed);
+            delete_ContentJob_(job);
+        }
+        clear_PtrArray(&jobs);
+    }
+    deinit_PtrArray(&jobs);
+    return 0;
+}
+
+static void startIndexing_History_(iHistory *d) {
+    /* Note: Called while holding the lock. */
+    if (d->isIndexing || d->isQuitting) {
+        return; /* the running indexer will see the new responses */
+    }
+    if (d->indexer) {
+        /* The previous indexer has already finished. */
+        join_Thread(d->indexer);
+        iRelease(d->indexer);
+    }
+    d->isIndexing = iTrue;
+    d->indexer    = new_Thread(index_History_);
+    setUserData_Thread(d->indexer, d);
+    start_Thread(d->indexer);
+}
+
+const iStringArray *searchContents_History(iHistory *d, const iRegExp *pattern,
+                                           const iStringArray *terms) {
+    /* Note: Called in a background thread. */
     iStringArray *urls = iClob(new_StringArray());
+    /* The lock is only held while looking up the candidates. Responses that are still
+       waiting to be indexed are scanned in full. */
+    iPtrArray candidates;
+    iPtrArray gramIds;
+    init_PtrArray(&candidates);
+    init_PtrArray(&gramIds);
     lock_Mutex(d->mtx);
+    queryGrams_ContentIndex_(&d->index, terms, &gramIds);
+    iConstForEach(Array, i, &d->recent) {
+        const iRecentUrl *item = i.value;
+        if (hasCachedResponse_RecentUrl(item) &&
+            isCandidate_ContentIndex_(&d->index, item->indexId, &gramIds)) {
+            pushBack_PtrArray(&candidates, new_ContentJob_(item));
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_PtrArray(&gramIds);
     iStringSet inserted;
     init_StringSet(&inserted);
-    iReverseConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        const iGmResponse *resp = url->cachedResponse;
-        if (resp && category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode) {
-            if (indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) == iInvalidPos) {
-                continue;
+    for (size_t n = size_PtrArray(&candidates); n-- > 0; ) {
+        iContentJob       *job  = at_PtrArray(&candidates, n);
+        const iGmResponse *resp = response_ContentJob_(job);
+        if (!resp || !isText_ContentIndex_(resp)) {
+            continue;
+        }
+        /* Verify the candidate with the actual pattern. */
+        iRegExpMatch m;
+        init_RegExpMatch(&m);
+        if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
+            iString entry;
+            init_String(&entry);
+            iRangei cap = m.range;
+            const int prefix = iMin(10, cap.start);
+            cap.start   = cap.start - prefix;
+            cap.end     = iMin(cap.end + 30, (int) size_Block(&resp->body));
+            const size_t maxLen = 60;
+            if (size_Range(&cap) > maxLen) {
+                cap.end = cap.start + maxLen;
             }
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
-                iString entry;
-                init_String(&entry);
-                iRangei cap = m.range;
-                const int prefix = iMin(10, cap.start);
-                cap.start   = cap.start - prefix;
-                cap.end     = iMin(cap.end + 30, (int) size_Block(&resp->body));
-                const size_t maxLen = 60;
-                if (size_Range(&cap) > maxLen) {
-                    cap.end = cap.start + maxLen;
-                }
-                iString content;
-                initRange_String(&content, (iRangecc){ m.subject + cap.start, m.subject + cap.end });
-                /* This needs cleaning up; highlight the matched word. */
-                replace_Block(&content.chars, '\n', ' ');
-                replace_Block(&content.chars, '\r', ' ');
-                if (prefix + size_Range(&m.range) < size_String(&content)) {
-                    insertData_Block(&content.chars, prefix + size_Range(&m.range), uiText_ColorEscape, 2);
-                }
-                insertData_Block(&content.chars, prefix, uiTextStrong_ColorEscape, 2);
-                format_String(
-                    &entry, "match len:%zu str:%s", size_String(&content), cstr_String(&content));
-                deinit_String(&content);
-                appendFormat_String(&entry, " url:%s", cstr_String(&url->url));
-                if (!contains_StringSet(&inserted, &url->url)) {
-                    pushFront_StringArray(urls, &entry);
-                    insert_StringSet(&inserted, &url->url);
-                }
-                deinit_String(&entry);
+            iString content;
+            initRange_String(&content, (iRangecc){ m.subject + cap.start, m.subject + cap.end });
+            /* This needs cleaning up; highlight the matched word. */
+            replace_Block(&content.chars, '\n', ' ');
+            replace_Block(&content.chars, '\r', ' ');
+            if (prefix + size_Range(&m.range) < size_String(&content)) {
+                insertData_Block(&content.chars, prefix + size_Range(&m.range), uiText_ColorEscape, 2);
             }
+            insertData_Block(&content.chars, prefix, uiTextStrong_ColorEscape, 2);
+            format_String(
+                &entry, "match len:%zu str:%s", size_String(&content), cstr_String(&content));
+            deinit_String(&content);
+            appendFormat_String(&entry, " url:%s", cstr_String(&job->url));
+            if (!contains_StringSet(&inserted, &job->url)) {
+                pushFront_StringArray(urls, &entry);
+                insert_StringSet(&inserted, &job->url);
+            }
+            deinit_String(&entry);
         }
     }
     deinit_StringSet(&inserted);
-    unlock_Mutex(d->mtx);
+    iForEach(PtrArray, j, &candidates) {
+        delete_ContentJob_(j.ptr);
+    }
+    deinit_PtrArray(&candidates);
     return urls;
 }
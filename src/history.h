@@ -31,6 +31,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/stringarray.h>
 #include <the_Foundation/time.h>
 
+iDeclareType(MemInfo)
+
+struct Impl_MemInfo {
+    size_t cacheSize;   /* number of bytes stored persistently */
+    size_t memorySize;  /* number of bytes stored in RAM */
+};
+
 iDeclareType(RecentUrl)
 iDeclareTypeConstruction(RecentUrl)
     
@@ -38,17 +45,15 @@ struct Impl_RecentUrl {
     iString      url;
     float        normScrollY;    /* normalized to document height */
     iGmResponse *cachedResponse; /* kept in memory for quicker back navigation */
+    iString      cacheKey;       /* cachedResponse stored in ContentCache (loaded on demand) */
+    uint32_t     indexId;        /* item in the History's content index (not serialized) */
     iGmDocument *cachedDoc;      /* cached copy of the presentation: layout and media (not serialized) */
     iBlock       setIdentity;    /* fingerprint of identity that was pinned*/
     uint16_t     flags;
+    iMemInfo     counted;        /* sizes included in the History's running totals */
 };
 
-iDeclareType(MemInfo)
-
-struct Impl_MemInfo {
-    size_t cacheSize;   /* number of bytes stored persistently */
-    size_t memorySize;  /* number of bytes stored in RAM */
-};
+iBool               hasCachedResponse_RecentUrl (const iRecentUrl *);
 
 /*----------------------------------------------------------------------------------------------*/
 
@@ -67,6 +72,8 @@ void        replace_History             (iHistory *, const iString *url);
 void        setIdentity_History         (iHistory *, const iBlock *identityFingerprint);
 void        setCachedResponse_History   (iHistory *, const iGmResponse *response);
 void        setCachedDocument_History   (iHistory *, iGmDocument *doc);
+const iGmResponse *
+            loadCachedResponse_History  (iHistory *, iRecentUrl *item); /* from ContentCache if needed */
 iBool       goBack_History              (iHistory *);
 iBool       goForward_History           (iHistory *);
 iRecentUrl *precedingLocked_History     (iHistory *); /* requires manual lock/unlock! */
@@ -75,15 +82,16 @@ iRecentUrl *mostRecentUrl_History       (iHistory *);
 //iRecentUrl *findUrl_History             (iHistory *, const iString *url, int timeDir);
 
 void        clearCache_History                  (iHistory *);
-size_t      pruneLeastImportant_History         (iHistory *);
-size_t      pruneLeastImportantMemory_History   (iHistory *);
+size_t      pruneCache_History                  (const iPtrArray *histories, size_t maxSize);
+size_t      pruneMemory_History                 (const iPtrArray *histories, size_t maxSize);
 void        invalidateTheme_History             (iHistory *); /* theme has changed, cached contents need updating */
 void        invalidateCachedLayout_History      (iHistory *);
 
 iBool       atNewest_History            (const iHistory *);
 iBool       atOldest_History            (const iHistory *);
 
-const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern); /* chronologically ascending */
+const iStringArray *   searchContents_History   (iHistory *, const iRegExp *pattern,
+                                                 const iStringArray *terms); /* chronologically ascending */
 
 const iString *
             url_History                 (const iHistory *, size_t pos);
@@ -92,7 +100,7 @@ const iRecentUrl *
 const iRecentUrl *
             constMostRecentUrl_History  (const iHistory *);
 const iGmResponse *
-            cachedResponse_History      (const iHistory *);
+            cachedResponse_History      (iHistory *);
 size_t      cacheSize_History           (const iHistory *);
 size_t      memorySize_History          (const iHistory *);
 
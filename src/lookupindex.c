@@ -0,0 +1,534 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "lookupindex.h"
+#include "app.h"
+#include "bookmarks.h"
+#include "feeds.h"
+#include "gmutil.h"
+#include "visited.h"
+
+#include <the_Foundation/array.h>
+#include <the_Foundation/hash.h>
+#include <the_Foundation/intset.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/thread.h>
+
+static void init_LookupIndexEntry_(iLookupIndexEntry *d) {
+    d->type = none_LookupResultType;
+    d->icon = 0;
+    init_String(&d->url);
+    init_String(&d->label);
+    init_String(&d->meta);
+    init_String(&d->tags);
+    d->host = iNullRange;
+    d->path = iNullRange;
+    iZap(d->when);
+}
+
+static void deinit_LookupIndexEntry_(iLookupIndexEntry *d) {
+    deinit_String(&d->tags);
+    deinit_String(&d->meta);
+    deinit_String(&d->label);
+    deinit_String(&d->url);
+}
+
+static iBool isEqual_LookupIndexEntry_(const iLookupIndexEntry *d, const iLookupIndexEntry *other) {
+    return d->type == other->type && d->icon == other->icon &&
+           integralSeconds_Time(&d->when) == integralSeconds_Time(&other->when) &&
+           equal_String(&d->url, &other->url) && equal_String(&d->label, &other->label) &&
+           equal_String(&d->meta, &other->meta) && equal_String(&d->tags, &other->tags);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(IndexedEntry)
+
+struct Impl_IndexedEntry {
+    iHashNode         node; /* key is a hash of `key` */
+    iIndexedEntry *   next; /* another entry with the same key hash */
+    uint32_t          id;
+    uint32_t          generation; /* source update when last seen */
+    iString           key;
+    iString           text; /* searchable fields in lower case */
+    iLookupIndexEntry entry;
+};
+
+static void init_IndexedEntry(iIndexedEntry *d) {
+    d->next       = NULL;
+    d->id         = 0;
+    d->generation = 0;
+    init_String(&d->key);
+    init_String(&d->text);
+    init_LookupIndexEntry_(&d->entry);
+}
+
+static void deinit_IndexedEntry(iIndexedEntry *d) {
+    deinit_LookupIndexEntry_(&d->entry);
+    deinit_String(&d->text);
+    deinit_String(&d->key);
+}
+
+iDefineTypeConstruction(IndexedEntry)
+
+static void set_IndexedEntry_(iIndexedEntry *d, const iLookupIndexEntry *src) {
+    iLookupIndexEntry *entry = &d->entry;
+    entry->type = src->type;
+    entry->icon = src->icon;
+    entry->when = src->when;
+    set_String(&entry->url, &src->url);
+    set_String(&entry->label, &src->label);
+    set_String(&entry->meta, &src->meta);
+    set_String(&entry->tags, &src->tags);
+    /* URL parts are split once here instead of every time a search is made. */
+    iUrl parts;
+    init_Url(&parts, &entry->url);
+    entry->host = parts.host;
+    entry->path = parts.path;
+    iString *text = new_String();
+    append_String(text, &entry->label);
+    appendCStr_String(text, "\n");
+    appendRange_String(text, entry->host);
+    appendCStr_String(text, "\n");
+    appendRange_String(text, entry->path);
+    appendCStr_String(text, "\n");
+    append_String(text, &entry->tags);
+    iString *lower = lower_String(text);
+    set_String(&d->text, lower);
+    delete_String(lower);
+    delete_String(text);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(IndexGram)
+
+struct Impl_IndexGram {
+    iHashNode node; /* key is three lower case bytes */
+    iIntSet   ids;
+};
+
+iDeclareType(VisitedCopy)
+
+struct Impl_VisitedCopy {
+    iString url;
+    iTime   when;
+};
+
+struct Impl_LookupIndex {
+    iMutex *  mtx;
+    iPtrArray entries; /* IndexedEntry by ID; NULL if unused */
+    iArray    freeIds;
+    iHash     keys;    /* IndexedEntry */
+    iHash     grams;   /* IndexGram */
+    uint32_t  generation;
+    int       invalidSources;
+    uint32_t  visitedSerial;
+    iThread * builder;  /* indexes all visited URLs in the background */
+    iBool     isBuilding;
+    iArray    visitedCopies; /* VisitedCopy; input for `builder` */
+};
+
+iDefineTypeConstruction(LookupIndex)
+
+void init_LookupIndex(iLookupIndex *d) {
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->entries);
+    init_Array(&d->freeIds, sizeof(uint32_t));
+    init_Hash(&d->keys);
+    init_Hash(&d->grams);
+    d->generation     = 0;
+    d->invalidSources = bookmarks_LookupIndexSource | feeds_LookupIndexSource |
+                        visited_LookupIndexSource;
+    d->visitedSerial  = 0;
+    d->builder        = NULL;
+    d->isBuilding     = iFalse;
+    init_Array(&d->visitedCopies, sizeof(iVisitedCopy));
+}
+
+static void clearVisitedCopies_LookupIndex_(iLookupIndex *d) {
+    iForEach(Array, i, &d->visitedCopies) {
+        deinit_String(&((iVisitedCopy *) i.value)->url);
+    }
+    clear_Array(&d->visitedCopies);
+}
+
+static void joinBuilder_LookupIndex_(iLookupIndex *d) {
+    if (d->builder) {
+        join_Thread(d->builder);
+        iReleasePtr(&d->builder);
+        clearVisitedCopies_LookupIndex_(d);
+    }
+}
+
+void deinit_LookupIndex(iLookupIndex *d) {
+    joinBuilder_LookupIndex_(d);
+    deinit_Array(&d->visitedCopies);
+    iForEach(PtrArray, i, &d->entries) {
+        if (i.ptr) {
+            delete_IndexedEntry(i.ptr);
+        }
+    }
+    iForEach(Hash, j, &d->grams) {
+        iIndexGram *gram = (iIndexGram *) j.value;
+        deinit_IntSet(&gram->ids);
+        free(gram);
+    }
+    deinit_Hash(&d->grams);
+    deinit_Hash(&d->keys);
+    deinit_Array(&d->freeIds);
+    deinit_PtrArray(&d->entries);
+    delete_Mutex(d->mtx);
+}
+
+static uint32_t gram_(const char *chars) {
+    return ((uint32_t) (uint8_t) chars[0] << 16) | ((uint32_t) (uint8_t) chars[1] << 8) |
+           (uint8_t) chars[2];
+}
+
+static void addGrams_LookupIndex_(iLookupIndex *d, const iIndexedEntry *entry) {
+    const char  *text = cstr_String(&entry->text);
+    const size_t len  = size_String(&entry->text);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const uint32_t key  = gram_(text + i);
+        iIndexGram *   gram = (iIndexGram *) value_Hash(&d->grams, key);
+        if (!gram) {
+            gram = iMalloc(IndexGram);
+            gram->node.key = key;
+            init_IntSet(&gram->ids);
+            insert_Hash(&d->grams, &gram->node);
+        }
+        insert_IntSet(&gram->ids, entry->id);
+    }
+}
+
+static void removeGrams_LookupIndex_(iLookupIndex *d, const iIndexedEntry *entry) {
+    const char  *text = cstr_String(&entry->text);
+    const size_t len  = size_String(&entry->text);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const uint32_t key  = gram_(text + i);
+        iIndexGram *   gram = (iIndexGram *) value_Hash(&d->grams, key);
+        if (gram) {
+            remove_IntSet(&gram->ids, entry->id);
+            if (isEmpty_IntSet(&gram->ids)) {
+                remove_Hash(&d->grams, key);
+                deinit_IntSet(&gram->ids);
+                free(gram);
+            }
+        }
+    }
+}
+
+static iIndexedEntry *find_LookupIndex_(const iLookupIndex *d, const iString *key) {
+    const uint32_t hash = iCrc32(cstr_String(key), size_String(key));
+    for (iIndexedEntry *e = (iIndexedEntry *) value_Hash(&d->keys, hash); e; e = e->next) {
+        if (equal_String(&e->key, key)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void remove_LookupIndex_(iLookupIndex *d, iIndexedEntry *entry) {
+    removeGrams_LookupIndex_(d, entry);
+    iIndexedEntry *head = (iIndexedEntry *) value_Hash(&d->keys, entry->node.key);
+    if (head == entry) {
+        remove_Hash(&d->keys, entry->node.key);
+        if (entry->next) {
+            insert_Hash(&d->keys, &entry->next->node);
+        }
+    }
+    else {
+        while (head->next != entry) {
+            head = head->next;
+        }
+        head->next = entry->next;
+    }
+    set_Array(&d->entries, entry->id, &(void *){ NULL });
+    pushBack_Array(&d->freeIds, &entry->id);
+    delete_IndexedEntry(entry);
+}
+
+static void set_LookupIndex_(iLookupIndex *d, uint32_t generation, const iString *key,
+                             const iLookupIndexEntry *src) {
+    iIndexedEntry *entry = find_LookupIndex_(d, key);
+    if (entry && isEqual_LookupIndexEntry_(&entry->entry, src)) {
+        entry->generation = generation; /* unchanged */
+        return;
+    }
+    if (entry) {
+        remove_LookupIndex_(d, entry);
+    }
+    entry = new_IndexedEntry();
+    entry->generation = generation;
+    set_String(&entry->key, key);
+    set_IndexedEntry_(entry, src);
+    if (!isEmpty_Array(&d->freeIds)) {
+        entry->id = *(const uint32_t *) constAt_Array(&d->freeIds, size_Array(&d->freeIds) - 1);
+        popBack_Array(&d->freeIds);
+        set_Array(&d->entries, entry->id, &entry);
+    }
+    else {
+        entry->id = size_PtrArray(&d->entries);
+        pushBack_PtrArray(&d->entries, entry);
+    }
+    entry->node.key = iCrc32(cstr_String(key), size_String(key));
+    entry->next = (iIndexedEntry *) remove_Hash(&d->keys, entry->node.key);
+    insert_Hash(&d->keys, &entry->node);
+    addGrams_LookupIndex_(d, entry);
+}
+
+static void removeStale_LookupIndex_(iLookupIndex *d, uint32_t generation,
+                                     enum iLookupResultType type) {
+    /* Entries that were not seen during the latest update of their source. */
+    iForEach(PtrArray, i, &d->entries) {
+        iIndexedEntry *entry = i.ptr;
+        if (entry && entry->entry.type == type && entry->generation != generation) {
+            remove_LookupIndex_(d, entry);
+        }
+    }
+}
+
+static void updateBookmarks_LookupIndex_(iLookupIndex *d, iString *key, iLookupIndexEntry *src) {
+    const uint32_t gen = ++d->generation;
+    src->type = bookmark_LookupResultType;
+    clear_String(&src->tags);
+    iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, NULL, NULL)) {
+        const iBookmark *bm = i.ptr;
+        if (isFolder_Bookmark(bm)) {
+            continue;
+        }
+        format_String(key, "b%u", id_Bookmark(bm));
+        src->icon = bm->icon;
+        src->when = bm->when;
+        set_String(&src->url, &bm->url);
+        set_String(&src->label, &bm->title);
+        set_String(&src->meta, &bm->identity);
+        set_String(&src->tags, &bm->tags);
+        set_LookupIndex_(d, gen, key, src);
+    }
+    removeStale_LookupIndex_(d, gen, bookmark_LookupResultType);
+}
+
+static void updateFeeds_LookupIndex_(iLookupIndex *d, iString *key, iLookupIndexEntry *src) {
+    const uint32_t gen = ++d->generation;
+    src->type = feedEntry_LookupResultType;
+    clear_String(&src->tags);
+    iConstForEach(PtrArray, i, listEntries_Feeds()) {
+        const iFeedEntry *entry = i.ptr;
+        const iBookmark  *bm    = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
+        if (!bm) {
+            continue;
+        }
+        format_String(key, "f%u %s", entry->bookmarkId, cstr_String(&entry->url));
+        src->icon = bm->icon;
+        src->when = entry->posted;
+        set_String(&src->url, &entry->url);
+        set_String(&src->label, &entry->title);
+        set_String(&src->meta, &bm->title);
+        set_LookupIndex_(d, gen, key, src);
+    }
+    removeStale_LookupIndex_(d, gen, feedEntry_LookupResultType);
+}
+
+static void setVisited_LookupIndex_(iLookupIndex *d, uint32_t generation, iString *key,
+                                    iLookupIndexEntry *src, const iString *url, iTime when) {
+    format_String(key, "v%s", cstr_String(url));
+    src->when = when;
+    set_String(&src->url, url);
+    set_String(&src->label, url);
+    set_LookupIndex_(d, generation, key, src);
+}
+
+static void initVisitedSource_(iLookupIndexEntry *src) {
+    src->type = history_LookupResultType;
+    src->icon = 0;
+    clear_String(&src->meta);
+    clear_String(&src->tags);
+}
+
+static iThreadResult build_LookupIndex_(iThread *thread) {
+    /* Indexing the entire history takes a while, so it is done in small batches that
+       don't keep searches waiting. Searches made in the meantime see a partial index. */
+    iLookupIndex *d = userData_Thread(thread);
+    const size_t  batchSize = 500;
+    iString *     key       = new_String();
+    iLookupIndexEntry src;
+    init_LookupIndexEntry_(&src);
+    initVisitedSource_(&src);
+    uint32_t gen;
+    iGuardMutex(d->mtx, gen = ++d->generation);
+    const size_t count = size_Array(&d->visitedCopies); /* not modified while building */
+    for (size_t pos = 0; pos < count; pos += batchSize) {
+        lock_Mutex(d->mtx);
+        for (size_t i = pos; i < iMin(count, pos + batchSize); i++) {
+            const iVisitedCopy *vis = constAt_Array(&d->visitedCopies, i);
+            setVisited_LookupIndex_(d, gen, key, &src, &vis->url, vis->when);
+        }
+        unlock_Mutex(d->mtx);
+    }
+    lock_Mutex(d->mtx);
+    removeStale_LookupIndex_(d, gen, history_LookupResultType);
+    d->isBuilding = iFalse;
+    unlock_Mutex(d->mtx);
+    deinit_LookupIndexEntry_(&src);
+    delete_String(key);
+    return 0;
+}
+
+static iBool updateVisited_LookupIndex_(iLookupIndex *d, iString *key, iLookupIndexEntry *src) {
+    /* Returns False if the update has to be done later. */
+    if (d->isBuilding) {
+        return iFalse; /* changes are picked up after the build has finished */
+    }
+    joinBuilder_LookupIndex_(d);
+    const iVisited *visited = visited_App();
+    const uint32_t  serial  = serial_Visited(visited);
+    const iBool     isFull  = (d->invalidSources & visited_LookupIndexSource) != 0;
+    if (!isFull && serial == d->visitedSerial) {
+        return iTrue;
+    }
+    /* Recently visited URLs can be updated without going through the entire history. */
+    const iPtrArray *newest = isFull ? NULL : listNewestSince_Visited(visited, d->visitedSerial);
+    if (newest) {
+        initVisitedSource_(src);
+        iConstForEach(PtrArray, i, newest) {
+            const iVisitedUrl *vis = i.ptr;
+            if (~vis->flags & transient_VisitedUrlFlag) {
+                setVisited_LookupIndex_(d, d->generation, key, src, &vis->url, vis->when);
+            }
+        }
+    }
+    else {
+        /* Copying the strings is cheap since they share their data. */
+        iConstForEach(PtrArray, i, list_Visited(visited, 0)) {
+            const iVisitedUrl *vis = i.ptr;
+            iVisitedCopy copy;
+            initCopy_String(&copy.url, &vis->url);
+            copy.when = vis->when;
+            pushBack_Array(&d->visitedCopies, &copy);
+        }
+        d->isBuilding = iTrue;
+        d->builder    = new_Thread(build_LookupIndex_);
+        setUserData_Thread(d->builder, d);
+        start_Thread(d->builder);
+    }
+    d->visitedSerial = serial;
+    return iTrue;
+}
+
+void invalidate_LookupIndex(iLookupIndex *d, int sources) {
+    iGuardMutex(d->mtx, d->invalidSources |= sources);
+}
+
+void update_LookupIndex(iLookupIndex *d) {
+    iString *         key = new_String();
+    iLookupIndexEntry src;
+    init_LookupIndexEntry_(&src);
+    iBeginCollect();
+    lock_Mutex(d->mtx);
+    if (d->invalidSources & bookmarks_LookupIndexSource) {
+        updateBookmarks_LookupIndex_(d, key, &src);
+    }
+    if (d->invalidSources & feeds_LookupIndexSource) {
+        updateFeeds_LookupIndex_(d, key, &src);
+    }
+    d->invalidSources &= ~(bookmarks_LookupIndexSource | feeds_LookupIndexSource);
+    if (updateVisited_LookupIndex_(d, key, &src)) {
+        d->invalidSources &= ~visited_LookupIndexSource;
+    }
+    unlock_Mutex(d->mtx);
+    iEndCollect();
+    deinit_LookupIndexEntry_(&src);
+    delete_String(key);
+}
+
+static iBool containsWords_IndexedEntry_(const iIndexedEntry *d, const iStringArray *words) {
+    iConstForEach(StringArray, i, words) {
+        if (!strstr(cstr_String(&d->text), cstr_String(i.value))) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+iBool search_LookupIndex(const iLookupIndex *d, const iStringArray *words,
+                         iLookupIndexMatchFunc func, iAny *context) {
+    /* Candidates must contain every trigram of the search words. The shortest list of
+       entries with one of these trigrams is checked against all the others. Searching only
+       for words shorter than three characters requires checking all entries. */
+    iBool         isComplete = iTrue;
+    iStringArray *lowerWords = new_StringArray();
+    iConstForEach(StringArray, w, words) {
+        iString *lower = lower_String(w.value);
+        pushBack_StringArray(lowerWords, lower);
+        delete_String(lower);
+    }
+    iPtrArray gramIds;
+    init_PtrArray(&gramIds);
+    const iIntSet *shortest   = NULL;
+    iBool          isPossible = iTrue;
+    lock_Mutex(d->mtx);
+    iConstForEach(StringArray, i, lowerWords) {
+        const char  *word = cstr_String(i.value);
+        const size_t len  = size_String(i.value);
+        for (size_t pos = 0; isPossible && pos + 3 <= len; pos++) {
+            const iIndexGram *gram = (const iIndexGram *) value_Hash(&d->grams, gram_(word + pos));
+            if (!gram) {
+                isPossible = iFalse; /* nothing matches */
+                break;
+            }
+            pushBack_PtrArray(&gramIds, &gram->ids);
+            if (!shortest || size_IntSet(&gram->ids) < size_IntSet(shortest)) {
+                shortest = &gram->ids;
+            }
+        }
+    }
+    const size_t count = !isPossible ? 0
+                         : shortest  ? size_IntSet(shortest)
+                                     : size_PtrArray(&d->entries);
+    for (size_t i = 0; i < count; i++) {
+        const iIndexedEntry *entry =
+            constAt_PtrArray(&d->entries, shortest ? (size_t) at_IntSet(shortest, i) : i);
+        if (!entry) {
+            continue;
+        }
+        iBool isCandidate = iTrue;
+        iConstForEach(PtrArray, g, &gramIds) {
+            if (g.ptr != shortest && !contains_IntSet(g.ptr, entry->id)) {
+                isCandidate = iFalse;
+                break;
+            }
+        }
+        if (isCandidate && containsWords_IndexedEntry_(entry, lowerWords)) {
+            if (!func(context, &entry->entry)) {
+                isComplete = iFalse;
+                break;
+            }
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_PtrArray(&gramIds);
+    iRelease(lowerWords);
+    return isComplete;
+}
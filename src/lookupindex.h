@@ -0,0 +1,62 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "lookup.h"
+
+#include <the_Foundation/range.h>
+#include <the_Foundation/stringarray.h>
+
+/* In-memory search index of bookmarks, feed entries, and visited URLs for the URL lookup.
+   The index keeps its own copies of the searched fields, so it can be queried in a
+   background thread while the sources are being modified in the main thread. */
+
+iDeclareType(LookupIndex)
+iDeclareTypeConstruction(LookupIndex)
+
+iDeclareType(LookupIndexEntry)
+
+struct Impl_LookupIndexEntry {
+    enum iLookupResultType type;
+    iChar    icon;
+    iString  url;
+    iString  label; /* title of bookmark or feed entry; visited URL */
+    iString  meta;  /* bookmark identity or feed title */
+    iString  tags;
+    iRangecc host;  /* parts of `url` */
+    iRangecc path;
+    iTime    when;
+};
+
+enum iLookupIndexSource {
+    bookmarks_LookupIndexSource = iBit(1),
+    feeds_LookupIndexSource     = iBit(2),
+    visited_LookupIndexSource   = iBit(3),
+};
+
+typedef iBool (*iLookupIndexMatchFunc)(iAny *context, const iLookupIndexEntry *);
+
+void    invalidate_LookupIndex  (iLookupIndex *, int sources);
+void    update_LookupIndex      (iLookupIndex *); /* call in the main thread */
+iBool   search_LookupIndex      (const iLookupIndex *, const iStringArray *words,
+                                 iLookupIndexMatchFunc func, iAny *context);
@@ -35,11 +35,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #endif
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
+#include <SDL_cpuinfo.h>
 #include <SDL_hints.h>
 #include <SDL_render.h>
 #include <SDL_timer.h>
+#include <errno.h>
 
 iDeclareType(GmMediaProps)
 
@@ -65,6 +69,8 @@ static void deinit_GmMediaProps_(iGmMediaProps *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(GmImage)
+iDeclareType(ImageStyleParams)
+iDeclareType(DecodeJob)
 
 struct Impl_GmImage {
     iGmMediaProps props;
@@ -72,35 +78,75 @@ struct Impl_GmImage {
     iInt2         size;
     size_t        numBytes;
     SDL_Texture * texture;
+    iDecodeJob *  job;         /* decoding in a worker thread */
+    uint8_t *     pixels;      /* decoded RGBA waiting for upload, `texSize` */
+    iInt2         texSize;
 };
 
+static void cancelDecoding_GmImage_(iGmImage *d);
+
 void init_GmImage(iGmImage *d, const iBlock *data) {
     init_GmMediaProps_(&d->props);
     initCopy_Block(&d->partialData, data);
     d->size     = zero_I2();
     d->numBytes = 0;
     d->texture  = NULL;
+    d->job      = NULL;
+    d->pixels   = NULL;
+    d->texSize  = zero_I2();
 }
 
 void deinit_GmImage(iGmImage *d) {
+    cancelDecoding_GmImage_(d);
+    free(d->pixels);
     deinit_Block(&d->partialData);
     SDL_DestroyTexture(d->texture);
     deinit_GmMediaProps_(&d->props);
 }
 
-static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgData) {
+/* Theme colors are looked up in the main thread; workers only see these. */
+struct Impl_ImageStyleParams {
+    enum iImageStyle style;
+    iColor           dark;
+    iColor           light;
+    iColor           colorize;
+    float            brighten;
+};
+
+static void init_ImageStyleParams_(iImageStyleParams *d, enum iImageStyle style) {
+    iZap(*d);
+    d->style = style;
+    if (style == bgFg_ImageStyle) {
+        d->dark  = get_Color(tmBackground_ColorId);
+        d->light = get_Color(tmParagraph_ColorId);
+        if (hsl_Color(d->dark).lum > hsl_Color(d->light).lum) {
+            iSwap(iColor, d->dark, d->light);
+        }
+    }
+    else if (style != original_ImageStyle) {
+        d->colorize = (iColor){ 255, 255, 255, 255 };
+        if (style != grayscale_ImageStyle) {
+            d->colorize = get_Color(style == textColorized_ImageStyle ? tmParagraph_ColorId
+                                                                      : tmPreformatted_ColorId);
+            /* Compensate for change in mid-tones. */
+            const iColor colorize = d->colorize;
+            const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
+            d->brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3),
+                                 0.0f, 0.5f);
+        }
+    }
+}
+
+static void applyImageStyle_(const iImageStyleParams *params, iInt2 size, uint8_t *imgData) {
+    const enum iImageStyle style = params->style;
     if (style == original_ImageStyle) {
         return;
     }
     uint8_t *pos       = imgData;
     size_t   numPixels = size.x * size.y;
-    float    brighten  = 0.0f;
     if (style == bgFg_ImageStyle) {
-        iColor dark  = get_Color(tmBackground_ColorId);
-        iColor light = get_Color(tmParagraph_ColorId);
-        if (hsl_Color(dark).lum > hsl_Color(light).lum) {
-            iSwap(iColor, dark, light);
-        }        
+        const iColor dark  = params->dark;
+        const iColor light = params->light;
         while (numPixels-- > 0) {
             iHSLColor hsl = hsl_Color((iColor){ pos[0], pos[1], pos[2], 255 });
             const float s = 1.0f - hsl.lum;
@@ -112,15 +158,8 @@ static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgDat
         }        
         return;
     }
-    iColor colorize = (iColor){ 255, 255, 255, 255 };
-    if (style != grayscale_ImageStyle) {
-        colorize = get_Color(style == textColorized_ImageStyle ? tmParagraph_ColorId
-                                                               : tmPreformatted_ColorId);
-        /* Compensate for change in mid-tones. */
-        const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
-        brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3), 0.0f, 0.5f);
-    }
-    iHSLColor hslColorize = hsl_Color(colorize);
+    const float brighten    = params->brighten;
+    iHSLColor   hslColorize = hsl_Color(params->colorize);
     while (numPixels-- > 0) {
         iHSLColor hsl = hsl_Color((iColor){ pos[0], pos[1], pos[2], 255 });
         iHSLColor out = { hslColorize.hue, hslColorize.sat, hsl.lum, 1.0f };
@@ -133,67 +172,252 @@ static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgDat
     }
 }
 
-void makeTexture_GmImage(iGmImage *d) {
-    iBlock *data     = &d->partialData;
-    d->numBytes      = size_Block(data);
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_DecodeJob {
+    iGmImage *        image;   /* NULL if the image was deleted before decoding finished */
+    iBlock            data;
+    iBool             isWebP;
+    iImageStyleParams style;
+    iInt2             maxSize; /* texture is scaled down to fit */
+    iInt2             texSize;
+    uint8_t *         pixels;  /* RGBA, `texSize`; NULL if decoding failed */
+};
+
+void init_DecodeJob(iDecodeJob *d, iGmImage *image, iInt2 maxSize) {
+    d->image   = image;
+    initCopy_Block(&d->data, &image->partialData);
+    d->isWebP  = cmp_String(&image->props.mime, "image/webp") == 0;
+    init_ImageStyleParams_(&d->style, prefs_App()->imageStyle);
+    d->maxSize = maxSize;
+    d->texSize = zero_I2();
+    d->pixels  = NULL;
+}
+
+void deinit_DecodeJob(iDecodeJob *d) {
+    deinit_Block(&d->data);
+    free(d->pixels);
+}
+
+iDefineTypeConstructionArgs(DecodeJob, (iGmImage *image, iInt2 maxSize), image, maxSize)
+
+static void decode_DecodeJob_(iDecodeJob *d) {
+    /* Called in a worker thread. */
+    iBlock  *data    = &d->data;
+    iInt2    size    = zero_I2();
     uint8_t *imgData = NULL;
-    if (cmp_String(&d->props.mime, "image/webp") == 0) {
+    if (d->isWebP) {
 #if defined (LAGRANGE_ENABLE_WEBP)
-        imgData = WebPDecodeRGBA(constData_Block(data), size_Block(data), &d->size.x, &d->size.y);
+        imgData = WebPDecodeRGBA(constData_Block(data), size_Block(data), &size.x, &size.y);
 #endif        
     }
     else {
         imgData = stbi_load_from_memory(
-            constData_Block(data), (int) size_Block(data), &d->size.x, &d->size.y, NULL, 4);
+            constData_Block(data), (int) size_Block(data), &size.x, &size.y, NULL, 4);
         if (!imgData) {
             fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
         }
     }
+    clear_Block(data);
     if (!imgData) {
-        d->size    = zero_I2();
-        d->texture = NULL;
+        return;
     }
-    else {
-        applyImageStyle_(prefs_App()->imageStyle, d->size, imgData);        
-        /* TODO: Save some memory by checking if the alpha channel is actually in use. */
-        iWindow *window  = get_Window();
-        iInt2    texSize = d->size;
-        /* Resize down to min(maximum texture size, window size). */ {
-            SDL_Rect dispRect;
-            SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
-            const iInt2 maxSize = min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
-                                         texSize : maxTextureSize_Window(window),
-                                         coord_Window(window, dispRect.w, dispRect.h));
-            iInt2 scaled = d->size;
-            if (scaled.x > maxSize.x) {
-                scaled.y = scaled.y * maxSize.x / scaled.x;
-                scaled.x = maxSize.x;
-            }
-            if (scaled.y > maxSize.y) {
-                scaled.x = scaled.x * maxSize.y / scaled.y;
-                scaled.y = maxSize.y;
-            }
-            if (!isEqual_I2(scaled, d->size)) {
-                uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
-                stbir_resize_uint8(imgData, d->size.x, d->size.y, 4 * d->size.x,
-                                   scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
-                free(imgData);
-                imgData = scaledImgData;
-                texSize = scaled;
-                /* We keep d->size for the UI. */
-            }
+    applyImageStyle_(&d->style, size, imgData);
+    /* TODO: Save some memory by checking if the alpha channel is actually in use. */
+    /* Resize down to min(maximum texture size, window size). */ {
+        iInt2 scaled = size;
+        if (scaled.x > d->maxSize.x) {
+            scaled.y = scaled.y * d->maxSize.x / scaled.x;
+            scaled.x = d->maxSize.x;
+        }
+        if (scaled.y > d->maxSize.y) {
+            scaled.x = scaled.x * d->maxSize.y / scaled.y;
+            scaled.y = d->maxSize.y;
+        }
+        if (!isEqual_I2(scaled, size)) {
+            uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
+            stbir_resize_uint8(imgData, size.x, size.y, 4 * size.x,
+                               scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
+            free(imgData);
+            imgData = scaledImgData;
+            size    = scaled;
         }
-        /* Create the texture. */
-        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
-            imgData, texSize.x, texSize.y, 32, texSize.x * 4, SDL_PIXELFORMAT_ABGR8888);
-        /* TODO: In multiwindow case, all windows must have the same shared renderer?
-           Or at least a shared context. */
-        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"); /* linear scaling */
-        d->texture = SDL_CreateTextureFromSurface(renderer_Window(window), surface);
-        SDL_FreeSurface(surface);
-        free(imgData);
     }
-    clear_Block(data);
+    d->texSize = size;
+    d->pixels  = imgData;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(ImageDecoder)
+
+/* Images are decoded, styled, and scaled by a pool of worker threads. Finished jobs wait
+   until the main thread uploads them to textures (see `uploadDecodedImages_Media`). */
+struct Impl_ImageDecoder {
+    iMutex *   mtx;
+    iCondition jobAvailable;
+    iPtrArray  threads;
+    iPtrArray  pending;  /* DecodeJob */
+    iPtrArray  finished; /* DecodeJob */
+    iBool      isQuitting;
+};
+
+static iImageDecoder *imageDecoder_;
+
+static iThreadResult run_ImageDecoder_(iThread *thread) {
+    iImageDecoder *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    for (;;) {
+        while (!d->isQuitting && isEmpty_PtrArray(&d->pending)) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (d->isQuitting) {
+            break;
+        }
+        iDecodeJob *job;
+        take_PtrArray(&d->pending, 0, (void **) &job);
+        if (!job->image) {
+            delete_DecodeJob(job); /* image was deleted */
+            continue;
+        }
+        unlock_Mutex(d->mtx);
+        decode_DecodeJob_(job);
+        lock_Mutex(d->mtx);
+        pushBack_PtrArray(&d->finished, job);
+        postCommand_App("media.decoded");
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+static iImageDecoder *imageDecoder_Media_(void) {
+    if (!imageDecoder_) {
+        iImageDecoder *d = imageDecoder_ = iMalloc(ImageDecoder);
+        d->mtx = new_Mutex();
+        init_Condition(&d->jobAvailable);
+        init_PtrArray(&d->threads);
+        init_PtrArray(&d->pending);
+        init_PtrArray(&d->finished);
+        d->isQuitting = iFalse;
+        const int numThreads = iClamp(SDL_GetCPUCount() - 1, 1, 4);
+        for (int i = 0; i < numThreads; i++) {
+            iThread *thd = new_Thread(run_ImageDecoder_);
+            setUserData_Thread(thd, d);
+            pushBack_PtrArray(&d->threads, thd);
+            start_Thread(thd);
+        }
+    }
+    return imageDecoder_;
+}
+
+void deinitImageDecoder_Media(void) {
+    iImageDecoder *d = imageDecoder_;
+    if (!d) {
+        return;
+    }
+    iGuardMutex(d->mtx, {
+        d->isQuitting = iTrue;
+        signalAll_Condition(&d->jobAvailable);
+    });
+    iForEach(PtrArray, t, &d->threads) {
+        join_Thread(t.ptr);
+        iRelease(t.ptr);
+    }
+    iForEach(PtrArray, p, &d->pending) {
+        delete_DecodeJob(p.ptr);
+    }
+    iForEach(PtrArray, f, &d->finished) {
+        delete_DecodeJob(f.ptr);
+    }
+    deinit_PtrArray(&d->finished);
+    deinit_PtrArray(&d->pending);
+    deinit_PtrArray(&d->threads);
+    deinit_Condition(&d->jobAvailable);
+    delete_Mutex(d->mtx);
+    free(d);
+    imageDecoder_ = NULL;
+}
+
+static void cancelDecoding_GmImage_(iGmImage *d) {
+    if (d->job) {
+        /* The decoder owns the job; it will be deleted when the decoder sees it next. */
+        iGuardMutex(imageDecoder_->mtx, {
+            d->job->image = NULL;
+            d->job = NULL;
+        });
+    }
+}
+
+static iBool readSize_GmImage_(iGmImage *d) {
+    const iBlock *data = &d->partialData;
+    d->size = zero_I2();
+    if (cmp_String(&d->props.mime, "image/webp") == 0) {
+#if defined (LAGRANGE_ENABLE_WEBP)
+        if (!WebPGetInfo(constData_Block(data), size_Block(data), &d->size.x, &d->size.y)) {
+            d->size = zero_I2();
+        }
+#endif
+    }
+    else if (!stbi_info_from_memory(
+                 constData_Block(data), (int) size_Block(data), &d->size.x, &d->size.y, NULL)) {
+        fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
+        d->size = zero_I2();
+    }
+    return d->size.x > 0 && d->size.y > 0;
+}
+
+static void startDecoding_GmImage_(iGmImage *d) {
+    /* The image size is known right away so it can be laid out with a placeholder. */
+    cancelDecoding_GmImage_(d);
+    d->numBytes = size_Block(&d->partialData);
+    SDL_DestroyTexture(d->texture);
+    d->texture = NULL;
+    free(d->pixels);
+    d->pixels = NULL;
+    if (readSize_GmImage_(d)) {
+        iWindow *window = get_Window();
+        SDL_Rect dispRect;
+        SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
+        const iInt2 maxSize = min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
+                                     d->size : maxTextureSize_Window(window),
+                                     coord_Window(window, dispRect.w, dispRect.h));
+        iImageDecoder *dec = imageDecoder_Media_();
+        iDecodeJob    *job = new_DecodeJob(d, maxSize);
+        iGuardMutex(dec->mtx, {
+            d->job = job;
+            pushBack_PtrArray(&dec->pending, job);
+            signal_Condition(&dec->jobAvailable);
+        });
+    }
+    clear_Block(&d->partialData); /* any job has the data now */
+}
+
+static void takePixels_GmImage_(iGmImage *d, iDecodeJob *job) {
+    /* Called in the main thread once decoding is finished. The image may belong to a
+       document that isn't currently shown, so the pixels wait here until it's uploaded. */
+    iAssert(d->job == job);
+    d->job     = NULL;
+    d->pixels  = job->pixels; /* NULL if decoding failed */
+    d->texSize = job->texSize;
+    job->pixels = NULL;
+}
+
+static void makeTexture_GmImage_(iGmImage *d) {
+    /* Called in the main thread. */
+    iAssert(d->texture == NULL);
+    if (!d->pixels) {
+        return; /* keeps the size from the header so the layout doesn't change */
+    }
+    const iInt2 texSize = d->texSize; /* We keep d->size for the UI. */
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        d->pixels, texSize.x, texSize.y, 32, texSize.x * 4, SDL_PIXELFORMAT_ABGR8888);
+    /* TODO: In multiwindow case, all windows must have the same shared renderer?
+       Or at least a shared context. */
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"); /* linear scaling */
+    d->texture = SDL_CreateTextureFromSurface(renderer_Window(get_Window()), surface);
+    SDL_FreeSurface(surface);
+    free(d->pixels);
+    d->pixels = NULL;
 }
 
 iDefineTypeConstructionArgs(GmImage, (const iBlock *data), data)
@@ -235,22 +459,15 @@ struct Impl_GmDownload {
     size_t        rateNumBytes;
     float         currentRate;
     iString *     path;
-    iFile *       file;
+    iBool         isFinished;
 };
 
-static iBool openFile_GmDownload_(iGmDownload *d) {
-    iAssert(!isEmpty_String(&d->props.url));
-    d->path = copy_String(downloadPathForUrl_App(&d->props.url, &d->props.mime));
-    d->file = new_File(d->path);
-    if (!open_File(d->file, writeOnly_FileMode)) {
-        return iFalse;
-    }
-    return iTrue;
-}
+/* The downloaded data itself is written to the file by MediaRequest, as it arrives.
+   GmDownload only keeps track of the progress for presentation. */
 
-static void closeFile_GmDownload_(iGmDownload *d) {
+static void finish_GmDownload_(iGmDownload *d) {
     d->currentRate = (float) (d->numBytes / elapsedSeconds_Time(&d->startTime));
-    iReleasePtr(&d->file);
+    d->isFinished  = iTrue;
 }
 
 void init_GmDownload(iGmDownload *d) {
@@ -261,23 +478,18 @@ void init_GmDownload(iGmDownload *d) {
     d->rateNumBytes  = 0;
     d->currentRate   = 0.0f;
     d->path          = NULL;
-    d->file          = NULL;
+    d->isFinished    = iFalse;
 }
 
 void deinit_GmDownload(iGmDownload *d) {
-    closeFile_GmDownload_(d);
     deinit_GmMediaProps_(&d->props);
     delete_String(d->path);
 }
 
-static void writeToFile_GmDownload_(iGmDownload *d, const iBlock *data) {
+static void updateProgress_GmDownload_(iGmDownload *d, uint64_t numBytes) {
     const static unsigned rateInterval_ = 1000;
-    iAssert(d->file);
-    writeData_File(d->file,
-                   constBegin_Block(data) + d->numBytes,
-                   size_Block(data) - d->numBytes);
-    const size_t newBytes = size_Block(data) - d->numBytes;
-    d->numBytes = size_Block(data);
+    const size_t newBytes = numBytes - d->numBytes;
+    d->numBytes = numBytes;
     d->rateNumBytes += newBytes;
     const uint32_t now = SDL_GetTicks();
     if (now - d->rateStartTime > rateInterval_) {
@@ -335,6 +547,9 @@ size_t memorySize_Media(const iMedia *d) {
             const iInt2 texSize = size_SDLTexture(img->texture);
             memSize += 4 * texSize.x * texSize.y; /* RGBA */
         }
+        else if (img->pixels) {
+            memSize += 4 * img->texSize.x * img->texSize.y;
+        }
         else {
             memSize += size_Block(&img->partialData);
         }
@@ -343,14 +558,11 @@ size_t memorySize_Media(const iMedia *d) {
     iConstForEach(PtrArray, a, &d->items[audio_MediaType]) {
         const iGmAudio *audio = a.ptr;
         if (audio->player) {
-            memSize += sourceDataSize_Player(audio->player);
+            memSize += memorySize_Player(audio->player);
         }
     }
 #endif
-    iConstForEach(PtrArray, n, &d->items[download_MediaType]) {
-        const iGmDownload *down = n.ptr;
-        memSize += down->numBytes;
-    }
+    /* Downloads are written to files and not kept in memory. Audio is mostly spooled, too. */
     return memSize; 
 }
 
@@ -396,7 +608,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
             iAssert(equal_String(&img->props.mime, mime)); /* MIME cannot change */
             set_Block(&img->partialData, data);
             if (!isPartial) {
-                makeTexture_GmImage(img);
+                startDecoding_GmImage_(img);
             }
         }
     }
@@ -410,7 +622,11 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
         else {
             audio = at_PtrArray(&d->items[audio_MediaType], existingIndex);
             iAssert(equal_String(&audio->props.mime, mime)); /* MIME cannot change */
-            updateSourceData_Player(audio->player, mime, data, append_PlayerUpdate);
+            updateSourceData_Player(audio->player,
+                                    mime,
+                                    data,
+                                    flags & streamedData_MediaFlag ? continue_PlayerUpdate
+                                                                   : append_PlayerUpdate);
             if (!isPartial) {
                 updateSourceData_Player(audio->player, NULL, NULL, complete_PlayerUpdate);
             }
@@ -428,17 +644,11 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
             delete_GmDownload(dl);
         }
         else {
+            /* The data is streamed to a file by MediaRequest; see `updateDownload_Media`. */
             dl = at_PtrArray(&d->items[download_MediaType], existingIndex);
             if (isEmpty_String(&dl->props.mime)) {
                 set_String(&dl->props.mime, mime);
             }
-            if (!dl->file) {
-                openFile_GmDownload_(dl);
-            }
-            writeToFile_GmDownload_(dl, data);
-            if (!isPartial) {
-                closeFile_GmDownload_(dl);
-            }
         }
     }
     else if (!isDeleting) {
@@ -450,7 +660,7 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
             set_String(&img->props.mime, mime);
             pushBack_PtrArray(&d->items[image_MediaType], img);
             if (!isPartial) {
-                makeTexture_GmImage(img);
+                startDecoding_GmImage_(img);
             }
             isNew = iTrue;
         }
@@ -526,6 +736,49 @@ SDL_Texture *imageTexture_Media(const iMedia *d, iMediaId imageId) {
     return NULL;
 }
 
+iBool isImageDecoding_Media(const iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        const iGmImage *img = constAt_PtrArray(&d->items[image_MediaType], index);
+        return img->job != NULL || img->pixels != NULL; /* only changed in the main thread */
+    }
+    return iFalse;
+}
+
+iBool uploadDecodedImages_Media(iMedia *d) {
+    iImageDecoder *dec = imageDecoder_;
+    iBool didUpload = iFalse;
+    if (!dec) {
+        return iFalse;
+    }
+    /* All finished jobs are consumed here, including those of other documents (for example,
+       ones kept in the navigation history). Their pixels are uploaded when the document is
+       shown again. */
+    lock_Mutex(dec->mtx);
+    iForEach(PtrArray, i, &dec->finished) {
+        iDecodeJob *job = i.ptr;
+        if (job->image) {
+            if (!job->pixels &&
+                indexOf_PtrArray(&d->items[image_MediaType], job->image) != iInvalidPos) {
+                didUpload = iTrue; /* failed; shown as an error */
+            }
+            takePixels_GmImage_(job->image, job);
+        }
+        delete_DecodeJob(job);
+    }
+    clear_PtrArray(&dec->finished);
+    unlock_Mutex(dec->mtx);
+    iForEach(PtrArray, j, &d->items[image_MediaType]) {
+        iGmImage *img = j.ptr;
+        if (img->pixels) {
+            makeTexture_GmImage_(img);
+            didUpload = iTrue;
+        }
+    }
+    return didUpload;
+}
+
 iBool info_Media(const iMedia *d, iMediaId mediaId, iGmMediaInfo *info_out) {
     /* TODO: Use a hash. */
     const size_t index = index_MediaId(mediaId);
@@ -594,6 +847,25 @@ void pauseAllPlayers_Media(const iMedia *d, iBool setPaused) {
 #endif
 }
 
+void updateDownload_Media(iMedia *d, uint16_t linkId, const iString *mime, const iString *path,
+                          uint64_t numBytes, iBool isFinished) {
+    const iMediaId downloadId = findMediaForLink_Media(d, linkId, download_MediaType);
+    if (!downloadId.id) {
+        return;
+    }
+    iGmDownload *dl = at_PtrArray(&d->items[download_MediaType], index_MediaId(downloadId));
+    if (isEmpty_String(&dl->props.mime) && mime) {
+        set_String(&dl->props.mime, mime);
+    }
+    if (!dl->path && path) {
+        dl->path = copy_String(path);
+    }
+    updateProgress_GmDownload_(dl, numBytes);
+    if (isFinished && !dl->isFinished) {
+        finish_GmDownload_(dl);
+    }
+}
+
 void downloadStats_Media(const iMedia *d, iMediaId downloadId, const iString **path_out,
                          float *bytesPerSecond_out, iBool *isFinished_out) {
     iAssert(downloadId.type == download_MediaType);
@@ -607,8 +879,128 @@ void downloadStats_Media(const iMedia *d, iMediaId downloadId, const iString **p
             *path_out = dl->path;
         }
         *bytesPerSecond_out = dl->currentRate;
-        *isFinished_out = (dl->path && !dl->file);
+        *isFinished_out = (dl->path && dl->isFinished);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+void init_DownloadSink(iDownloadSink *d) {
+    d->req     = NULL;
+    d->path    = NULL;
+    d->file    = NULL;
+    d->error   = 0;
+    d->isSpool = iFalse;
+}
+
+static void fail_DownloadSink_(iDownloadSink *d, int error) {
+    d->error = (error ? error : EIO);
+    if (d->file) {
+        iReleasePtr(&d->file);
+        remove(cstr_String(d->path));
+    }
+}
+
+void deinit_DownloadSink(iDownloadSink *d) {
+    if (d->req) {
+        const iBool isComplete = isFinished_GmRequest(d->req) &&
+                                 isSuccess_GmStatusCode(status_GmRequest(d->req));
+        setBodySink_GmRequest(d->req, NULL, NULL);
+        d->req = NULL;
+        if (!isComplete) {
+            /* Cancelled or abandoned before the body was fully received. */
+            fail_DownloadSink_(d, ECANCELED);
+        }
+    }
+    iReleasePtr(&d->file);
+    if (d->isSpool && d->path) {
+        remove(cstr_String(d->path));
+    }
+    delete_String(d->path);
+}
+
+static void write_DownloadSink_(iAny *context, const iGmResponse *resp, const iBlock *data) {
+    /* Called in the request's thread while the response is locked. */
+    iDownloadSink *d = context;
+    if (d->error) {
+        return;
     }
+    if (!d->file) {
+        if (!d->path) {
+            d->path = copy_String(downloadPathForUrl_App(url_GmRequest(d->req), &resp->meta));
+        }
+        d->file = new_File(d->path);
+        errno   = 0;
+        if (!open_File(d->file, writeOnly_FileMode)) {
+            iReleasePtr(&d->file);
+            fail_DownloadSink_(d, errno);
+            return;
+        }
+    }
+    errno = 0;
+    if (writeData_File(d->file, constData_Block(data), size_Block(data)) != size_Block(data)) {
+        fail_DownloadSink_(d, errno);
+    }
+}
+
+void begin_DownloadSink(iDownloadSink *d, iGmRequest *req) {
+    iAssert(!d->req);
+    d->req = req;
+    setBodySink_GmRequest(req, write_DownloadSink_, d);
+}
+
+void beginSpool_DownloadSink(iDownloadSink *d, iGmRequest *req, const iString *tempPath) {
+    iAssert(!d->path);
+    d->path    = copy_String(tempPath);
+    d->isSpool = iTrue;
+    begin_DownloadSink(d, req);
+}
+
+void end_DownloadSink(iDownloadSink *d) {
+    if (d->req) {
+        setBodySink_GmRequest(d->req, NULL, NULL);
+        d->req = NULL;
+        iReleasePtr(&d->file);
+    }
+}
+
+static iBool copyFile_DownloadSink_(const iString *srcPath, const iString *dstPath) {
+    /* The spool file may be on a different file system, so it can't always be renamed. */
+    iBool  ok  = iFalse;
+    iFile *src = new_File(srcPath);
+    iFile *dst = new_File(dstPath);
+    if (open_File(src, readOnly_FileMode) && open_File(dst, writeOnly_FileMode)) {
+        char   buf[0x10000];
+        size_t num;
+        ok = iTrue;
+        while (ok && (num = readData_File(src, sizeof(buf), buf)) > 0) {
+            ok = (writeData_File(dst, buf, num) == num);
+        }
+        ok = ok && atEnd_File(src);
+    }
+    iRelease(dst);
+    iRelease(src);
+    if (!ok) {
+        remove(cstr_String(dstPath));
+    }
+    return ok;
+}
+
+iBool keep_DownloadSink(iDownloadSink *d, const iString *path) {
+    /* The complete spool file is moved to `path` and will no longer be deleted. */
+    iAssert(!d->req);
+    if (!d->isSpool || !d->path || d->error) {
+        return iFalse;
+    }
+    if (rename(cstr_String(d->path), cstr_String(path)) != 0) {
+        if (!copyFile_DownloadSink_(d->path, path)) {
+            return iFalse;
+        }
+        remove(cstr_String(d->path));
+    }
+    set_String(d->path, path);
+    d->isSpool = iFalse;
+    return iTrue;
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -623,10 +1015,27 @@ static void finished_MediaRequest_(iAnyObject *obj) {
     postCommandf_App("media.finished link:%u request:%p", d->linkId, d);
 }
 
+static void writeAudio_MediaRequest_(iAny *context, const iGmResponse *resp, const iBlock *data) {
+    /* Called in the request's thread while the response is locked. */
+    iMediaRequest *d = context;
+    iUnused(resp);
+    append_Block(d->audioData, data);
+}
+
+static void endAudio_MediaRequest_(iMediaRequest *d) {
+    if (d->audioData) {
+        setBodySink_GmRequest(d->req, NULL, NULL);
+        delete_Block(d->audioData);
+        d->audioData = NULL;
+    }
+}
+
 void init_MediaRequest(iMediaRequest *d, iDocumentWidget *doc, unsigned int linkId,
                        const iString *url, iBool enableFilters) {
     d->doc    = doc;
     d->linkId = linkId;
+    init_DownloadSink(&d->download);
+    d->audioData    = NULL;
     d->req    = new_GmRequest(certs_App());
     setUrl_GmRequest(d->req, url);
     enableFilters_GmRequest(d->req, enableFilters);
@@ -638,14 +1047,51 @@ void init_MediaRequest(iMediaRequest *d, iDocumentWidget *doc, unsigned int link
 void deinit_MediaRequest(iMediaRequest *d) {
     iDisconnect(GmRequest, d->req, updated, d, updated_MediaRequest_);
     iDisconnect(GmRequest, d->req, finished, d, finished_MediaRequest_);
+    deinit_DownloadSink(&d->download);
+    endAudio_MediaRequest_(d);
     iRelease(d->req);
 }
 
+void beginDownload_MediaRequest(iMediaRequest *d) {
+    begin_DownloadSink(&d->download, d->req);
+}
+
+void finishDownload_MediaRequest(iMediaRequest *d) {
+    end_DownloadSink(&d->download);
+}
+
+const iString *downloadPath_MediaRequest(const iMediaRequest *d) {
+    return d->download.path;
+}
+
+int downloadError_MediaRequest(const iMediaRequest *d) {
+    return d->download.error;
+}
+
+void beginAudio_MediaRequest(iMediaRequest *d) {
+    /* The audio player spools the data itself, so it is passed along as it arrives. */
+    if (!d->audioData) {
+        d->audioData = new_Block(0);
+        setBodySink_GmRequest(d->req, writeAudio_MediaRequest_, d);
+    }
+}
+
+iBlock *takeAudioData_MediaRequest(iMediaRequest *d) {
+    iBlock *data = collect_Block(new_Block(0));
+    if (d->audioData) {
+        set_Block(data, d->audioData);
+        clear_Block(d->audioData);
+    }
+    return data;
+}
+
 iMediaRequest *newReused_MediaRequest(iDocumentWidget *doc, unsigned int linkId,
                                       iGmRequest *request) {
     iMediaRequest *d = new_Object(&Class_MediaRequest);
     d->doc = doc;
     d->linkId = linkId;
+    init_DownloadSink(&d->download);
+    d->audioData    = NULL;
     d->req = request; /* takes ownership */
     iConnect(GmRequest, d->req, updated, d, updated_MediaRequest_);
     iConnect(GmRequest, d->req, finished, d, finished_MediaRequest_);
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "fontpack.h"
 
 #include <the_Foundation/block.h>
+#include <the_Foundation/file.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/vec2.h>
 #include <SDL_render.h>
@@ -43,8 +44,9 @@ iDeclareType(Media)
 iDeclareTypeConstruction(Media)
 
 enum iMediaFlags {
-    allowHide_MediaFlag   = iBit(1),
-    partialData_MediaFlag = iBit(2),
+    allowHide_MediaFlag    = iBit(1),
+    partialData_MediaFlag  = iBit(2),
+    streamedData_MediaFlag = iBit(3), /* data only has what was received since last update */
 };
 
 enum iMediaType { /* Note: There is a limited number of bits for these; see GmRun. */
@@ -99,11 +101,16 @@ iLocalDef iBool downloadInfo_Media(const iMedia *d, uint16_t mediaId, iGmMediaIn
 
 iInt2           imageSize_Media         (const iMedia *, iMediaId imageId);
 SDL_Texture *   imageTexture_Media      (const iMedia *, iMediaId imageId);
+iBool           isImageDecoding_Media   (const iMedia *, iMediaId imageId);
+iBool           uploadDecodedImages_Media(iMedia *); /* returns True if any images were finished */
+void            deinitImageDecoder_Media(void);
 
 size_t          numAudio_Media          (const iMedia *);
 iPlayer *       audioPlayer_Media       (const iMedia *, iMediaId audioId);
 void            pauseAllPlayers_Media   (const iMedia *, iBool setPaused);
 
+void            updateDownload_Media    (iMedia *, uint16_t linkId, const iString *mime,
+                                         const iString *path, uint64_t numBytes, iBool isFinished);
 void            downloadStats_Media     (const iMedia *, iMediaId downloadId, const iString **path_out,
                                          float *bytesPerSecond_out, iBool *isFinished_out);
 
@@ -111,6 +118,30 @@ void            downloadStats_Media     (const iMedia *, iMediaId downloadId, co
 
 iDeclareType(GmRequest)
 iDeclareType(DocumentWidget)
+iDeclareType(DownloadSink)
+
+/* Writes the body of a request to a new file in the downloads directory as it arrives,
+   instead of keeping it in memory. A spool file is written elsewhere and only kept if it is
+   moved to its final location. Lock the request's response before accessing the members
+   while the request is ongoing. */
+struct Impl_DownloadSink {
+    iGmRequest *req;   /* set while the body is being written */
+    iString *   path;
+    iFile *     file;
+    int         error; /* `errno` of a failed open or write; the rest of the body is dropped */
+    iBool       isSpool;
+};
+
+void    init_DownloadSink       (iDownloadSink *);
+void    deinit_DownloadSink     (iDownloadSink *); /* an unfinished or spool file is deleted */
+void    begin_DownloadSink      (iDownloadSink *, iGmRequest *req);
+void    beginSpool_DownloadSink (iDownloadSink *, iGmRequest *req, const iString *tempPath);
+void    end_DownloadSink        (iDownloadSink *); /* request has finished; file is complete */
+iBool   keep_DownloadSink       (iDownloadSink *, const iString *path); /* moves a spool file */
+
+iLocalDef iBool isActive_DownloadSink(const iDownloadSink *d) {
+    return d->req != NULL;
+}
 
 iDeclareClass(MediaRequest)
 
@@ -119,6 +150,8 @@ struct Impl_MediaRequest {
     iDocumentWidget *doc;
     unsigned int     linkId;    
     iGmRequest *     req;
+    iDownloadSink    download;
+    iBlock *         audioData; /* body received since last taken by the audio player */
 };
 
 iDeclareObjectConstructionArgs(MediaRequest, iDocumentWidget *doc, unsigned int linkId,
@@ -126,3 +159,9 @@ iDeclareObjectConstructionArgs(MediaRequest, iDocumentWidget *doc, unsigned int
     
 iMediaRequest * newReused_MediaRequest  (iDocumentWidget *doc, unsigned int linkId,
                                          iGmRequest *request);
+void            beginDownload_MediaRequest  (iMediaRequest *); /* stream body to a file */
+void            finishDownload_MediaRequest (iMediaRequest *);
+const iString * downloadPath_MediaRequest   (const iMediaRequest *); /* lock the response first */
+int             downloadError_MediaRequest  (const iMediaRequest *); /* lock the response first */
+void            beginAudio_MediaRequest     (iMediaRequest *); /* body isn't kept in the response */
+iBlock *        takeAudioData_MediaRequest  (iMediaRequest *); /* lock the response first */
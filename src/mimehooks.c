@@ -24,14 +24,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "defs.h"
 #include "gmutil.h"
 #include "gempub.h"
+#include "feedparser.h"
 #include "app.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/process.h>
 #include <the_Foundation/stringlist.h>
-#include <the_Foundation/xml.h>
+#include <the_Foundation/thread.h>
+#include <SDL_cpuinfo.h>
 
 iDefineTypeConstruction(FilterHook)
 
@@ -59,19 +62,130 @@ void setCommand_FilterHook(iFilterHook *d, const iString *command) {
     set_String(&d->command, command);
 }
 
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(FilterJob)
+
+struct Impl_FilterJob {
+    const iStringList *args;
+    const iString *    requestUrl;
+    const iBlock *     body;
+    iProcess *         proc;
+    iBool              isStarted;
+};
+
+iDeclareType(FilterLauncher)
+
+/* Filter processes are started by a single dedicated thread. Creating child processes from
+   multiple background threads concurrently is not safe when the processes are forks: the I/O
+   pipe fds of one child may leak into another. The launcher writes the input and closes the
+   pipe before starting the next process, while the output is read by the requesting thread.
+   This way several filters can be running at the same time. */
+struct Impl_FilterLauncher {
+    iMutex *   mtx;
+    iCondition changed;
+    iThread *  thread;
+    iPtrArray  pending; /* FilterJob */
+    size_t     numRunning;
+    size_t     maxRunning;
+    iBool      isQuitting;
+};
+
+static iFilterLauncher *filterLauncher_;
+
+static iProcess *start_FilterJob_(const iFilterJob *d) {
+    iBeginCollect();
+    iProcess *proc = NULL;
+    for (int attempts = 0; attempts < 3; attempts++) {
+        proc = new_Process();
+        setArguments_Process(proc, d->args);
+        if (!isEmpty_String(d->requestUrl)) {
+            setEnvironment_Process(
+                proc,
+                iClob(newStrings_StringList(
+                    collectNewFormat_String("REQUEST_URL=%s", cstr_String(d->requestUrl)),
+                    NULL)));
+        }
+        if (start_Process(proc)) {
+            writeInput_Process(proc, d->body);
+            break;
+        }
+        iReleasePtr(&proc);
+    }
+    iEndCollect();
+    return proc;
+}
+
+static iThreadResult run_FilterLauncher_(iThread *thread) {
+    iFilterLauncher *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    for (;;) {
+        while (!d->isQuitting &&
+               (isEmpty_PtrArray(&d->pending) || d->numRunning >= d->maxRunning)) {
+            wait_Condition(&d->changed, d->mtx);
+        }
+        if (d->isQuitting) {
+            break;
+        }
+        iFilterJob *job;
+        take_PtrArray(&d->pending, 0, (void **) &job);
+        d->numRunning++;
+        unlock_Mutex(d->mtx);
+        iProcess *proc = start_FilterJob_(job);
+        lock_Mutex(d->mtx);
+        if (!proc) {
+            d->numRunning--;
+        }
+        job->proc      = proc;
+        job->isStarted = iTrue;
+        signalAll_Condition(&d->changed);
+    }
+    /* Jobs that were not started yet will fail. */
+    iForEach(PtrArray, i, &d->pending) {
+        ((iFilterJob *) i.ptr)->isStarted = iTrue;
+    }
+    clear_PtrArray(&d->pending);
+    signalAll_Condition(&d->changed);
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+static void initFilterLauncher_MimeHooks_(void) {
+    if (!filterLauncher_) {
+        iFilterLauncher *d = filterLauncher_ = iMalloc(FilterLauncher);
+        d->mtx = new_Mutex();
+        init_Condition(&d->changed);
+        init_PtrArray(&d->pending);
+        d->numRunning = 0;
+        d->maxRunning = iClamp(SDL_GetCPUCount() - 1, 1, 4);
+        d->isQuitting = iFalse;
+        d->thread = new_Thread(run_FilterLauncher_);
+        setUserData_Thread(d->thread, d);
+        start_Thread(d->thread);
+    }
+}
+
+static void deinitFilterLauncher_MimeHooks_(void) {
+    iFilterLauncher *d = filterLauncher_;
+    if (!d) {
+        return;
+    }
+    iGuardMutex(d->mtx, {
+        d->isQuitting = iTrue;
+        signalAll_Condition(&d->changed);
+    });
+    join_Thread(d->thread);
+    iRelease(d->thread);
+    deinit_PtrArray(&d->pending);
+    deinit_Condition(&d->changed);
+    delete_Mutex(d->mtx);
+    free(d);
+    filterLauncher_ = NULL;
+}
+
 iBlock *run_FilterHook_(const iFilterHook *d, const iString *mime, const iBlock *body,
                         const iString *requestUrl) {
-    static iMutex *mtx_;
-    if (!mtx_) {
-        /* Currently we are starting child processes from multiple background threads.
-           This is apparently not a great idea when the processes are created as forks.
-           What we _should_ probably be doing is using a single dedicated thread to
-           launch the child processes, via a queue of some sort, and wait for the output
-           to be returned via a Condition. For now, we will avoid concurrency problems
-           (mostly related to I/O pipe fds getting confused) by only running a single
-           filter process at a time. */
-        mtx_ = new_Mutex();
-    }
+    iFilterLauncher *launcher = filterLauncher_; /* started when filters are loaded */
     iStringList *args = new_StringList();
     iRangecc     seg  = iNullRange;
     while (nextSplit_Rangecc(range_String(&d->command), ";", &seg)) {
@@ -80,143 +194,54 @@ iBlock *run_FilterHook_(const iFilterHook *d, const iString *mime, const iBlock
     seg = iNullRange;
     while (nextSplit_Rangecc(range_String(mime), ";", &seg)) {
         pushBackRange_StringList(args, seg);
-    }    
-    lock_Mutex(mtx_);
-    iBlock *output = NULL;
-    for (int attempts = 0; attempts < 3; attempts++) {
-        iProcess *proc = new_Process();
-        setArguments_Process(proc, args);
-        if (!isEmpty_String(requestUrl)) {
-            setEnvironment_Process(
-                proc,
-                iClob(newStrings_StringList(
-                    collectNewFormat_String("REQUEST_URL=%s", cstr_String(requestUrl)), NULL)));
+    }
+    iFilterJob job = { .args = args, .requestUrl = requestUrl, .body = body };
+    lock_Mutex(launcher->mtx);
+    if (!launcher->isQuitting) {
+        pushBack_PtrArray(&launcher->pending, &job);
+        signalAll_Condition(&launcher->changed);
+        while (!job.isStarted) {
+            wait_Condition(&launcher->changed, launcher->mtx);
         }
-        if (start_Process(proc)) {
-            writeInput_Process(proc, body);
-            output = readOutputUntilClosed_Process(proc);
-            if (!startsWith_Rangecc(range_Block(output), "20")) {
-                /* Didn't produce valid output. */
-                delete_Block(output);
-                output = NULL;
-            }
-            iRelease(proc);
-            break;
+    }
+    unlock_Mutex(launcher->mtx);
+    iBlock *output = NULL;
+    if (job.proc) {
+        output = readOutputUntilClosed_Process(job.proc);
+        if (!startsWith_Rangecc(range_Block(output), "20")) {
+            /* Didn't produce valid output. */
+            delete_Block(output);
+            output = NULL;
         }
-        iRelease(proc);
+        iRelease(job.proc);
+        iGuardMutex(launcher->mtx, {
+            launcher->numRunning--;
+            signalAll_Condition(&launcher->changed);
+        });
     }
-    unlock_Mutex(mtx_);
     iRelease(args);
     return output;
 }
 
 /*----------------------------------------------------------------------------------------------*/
 
-static iRegExp *xmlMimePattern_(void) {
-    static iRegExp *xmlMime_;
-    if (!xmlMime_) {
-        xmlMime_ = new_RegExp("(application|text)/(atom\\+)?xml", caseInsensitive_RegExpOption);
-    }
-    return xmlMime_;
-}
-
-static iBlock *translateAtomXmlToGeminiFeed_(const iString *mime, const iBlock *source,
-                                             const iString *requestUrl) {
-    iUnused(requestUrl); /* TODO: Use for what? */
-    iRegExpMatch m;
-    init_RegExpMatch(&m);
-    if (!matchString_RegExp(xmlMimePattern_(), mime, &m)) {
+static iBlock *translateFeedToGemini_(const iString *mime, const iBlock *source) {
+    if (!isFeedMime_FeedParser(mime)) {
         return NULL;
     }
-    iBlock *      output = NULL;
-    iXmlDocument *doc    = new_XmlDocument();
-    iString       src;
-    initBlock_String(&src, source); /* assume it's UTF-8 */
-    if (!parse_XmlDocument(doc, &src)) {
-        goto finished;
-    }
-    const iXmlElement *feed = &doc->root;
-    if (!equal_Rangecc(feed->name, "feed")) {
-        goto finished;
-    }
-    if (!equal_Rangecc(attribute_XmlElement(feed, "xmlns"), "http://www.w3.org/2005/Atom")) {
-        goto finished;
-    }
-    iString *title = collect_String(decodedContent_XmlElement(child_XmlElement(feed, "title")));
-    if (isEmpty_String(title)) {
-        goto finished;
-    }
-    iString *subtitle = collect_String(decodedContent_XmlElement(child_XmlElement(feed, "subtitle")));
-    iString out;
+    iBlock *     output = NULL;
+    iString      out;
+    iFeedParser *parser = new_FeedParser();
     init_String(&out);
-    format_String(&out,
-                  "20 text/gemini\r\n"
-                  "# %s\n\n",
-                  cstr_String(title));
-    if (!isEmpty_String(subtitle)) {
-        appendFormat_String(&out, "## %s\n\n", cstr_String(subtitle));
+    setGeminiOutput_FeedParser(parser, &out);
+    write_FeedParser(parser, range_Block(source)); /* assume it's UTF-8 */
+    finish_FeedParser(parser);
+    if (state_FeedParser(parser) == feed_FeedParserState) {
+        output = newCStr_Block("20 text/gemini\r\n");
+        append_Block(output, utf8_String(&out));
     }
-    appendCStr_String(&out, cstr_Lang("feeds.atom.translated"));
-    appendCStr_String(&out, "\n\n");
-    iRegExp *datePattern =
-        iClob(new_RegExp("^\\s*([0-9][0-9][0-9][0-9]-[0-1][0-9]-[0-3][0-9])(T|\\s).*",
-                         caseSensitive_RegExpOption));
-    iBeginCollect();
-    iConstForEach(PtrArray, i, &feed->children) {
-        iEndCollect();
-        iBeginCollect();
-        const iXmlElement *entry = i.ptr;
-        if (!equal_Rangecc(entry->name, "entry")) {
-            continue;
-        }
-        title = collect_String(decodedContent_XmlElement(child_XmlElement(entry, "title")));
-        if (isEmpty_String(title)) {
-            continue;
-        }
-        const iString *published =
-            collect_String(decodedContent_XmlElement(child_XmlElement(entry, "published")));
-        const iString *updated =
-            collect_String(decodedContent_XmlElement(child_XmlElement(entry, "updated")));
-        iRegExpMatch m;
-        init_RegExpMatch(&m);
-        if (!matchString_RegExp(datePattern, updated, &m)) {
-            init_RegExpMatch(&m);
-            if (!matchString_RegExp(datePattern, published, &m)) {
-                continue;
-            }
-        }
-        iRangecc url = iNullRange;
-        iConstForEach(PtrArray, j, &entry->children) {
-            const iXmlElement *link = j.ptr;
-            if (!equal_Rangecc(link->name, "link")) {
-                continue;
-            }
-            const iRangecc href = attribute_XmlElement(link, "href");
-            const iRangecc rel  = attribute_XmlElement(link, "rel");
-            const iRangecc type = attribute_XmlElement(link, "type");
-            if (startsWithCase_Rangecc(href, "gemini:")) {
-                url = href;
-                /* We're happy with the first gemini URL. */
-                /* TODO: Are we? */
-                break;
-            }
-            url = href;
-            iUnused(rel, type);
-        }
-        if (isEmpty_Range(&url)) {
-            continue;
-        }
-        appendFormat_String(&out, "=> %s %s - %s\n",
-                            cstr_Rangecc(url),
-                            cstr_Rangecc(capturedRange_RegExpMatch(&m, 1)),
-                            cstr_String(title));
-    }
-    iEndCollect();
-    output = copy_Block(utf8_String(&out));
     deinit_String(&out);
-finished:
-    delete_XmlDocument(doc);
-    deinit_String(&src);
+    delete_FeedParser(parser);
     return output;
 }
 
@@ -249,6 +274,7 @@ void init_MimeHooks(iMimeHooks *d) {
 }
 
 void deinit_MimeHooks(iMimeHooks *d) {
+    deinitFilterLauncher_MimeHooks_();
     iForEach(PtrArray, i, &d->filters) {
         delete_FilterHook(i.ptr);
     }
@@ -272,11 +298,20 @@ iBool willTryFilter_MimeHooks(const iMimeHooks *d, const iString *mime) {
         }
     }
     /* Built-in filters. */
-    init_RegExpMatch(&m);
-    if (matchString_RegExp(xmlMimePattern_(), mime, &m)) {
-        return iTrue;
+    return isFeedMime_FeedParser(mime);
+}
+
+iBool willTranslateFeed_MimeHooks(const iMimeHooks *d, const iString *mime) {
+    /* User's filters take precedence over the built-in feed translation. */
+    iRegExpMatch m;
+    iConstForEach(PtrArray, i, &d->filters) {
+        const iFilterHook *xc = i.ptr;
+        init_RegExpMatch(&m);
+        if (matchString_RegExp(xc->mimeRegex, mime, &m)) {
+            return iFalse;
+        }
     }
-    return iFalse;
+    return isFeedMime_FeedParser(mime);
 }
 
 iBlock *tryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, const iBlock *body,
@@ -299,14 +334,7 @@ iBlock *tryFilter_MimeHooks(const iMimeHooks *d, const iString *mime, const iBlo
             return result;
         }
     }
-    init_RegExpMatch(&m);
-    if (matchString_RegExp(xmlMimePattern_(), mime, &m)) {
-        iBlock *result = translateAtomXmlToGeminiFeed_(mime, body, requestUrl);
-        if (result) {
-            return result;
-        }
-    }
-    return NULL;
+    return translateFeedToGemini_(mime, body);
 }
 
 void load_MimeHooks(iMimeHooks *d, const char *saveDir) {
@@ -346,6 +374,9 @@ void load_MimeHooks(iMimeHooks *d, const char *saveDir) {
         delete_Block(src);
     }
     iRelease(f);
+    if (!isEmpty_PtrArray(&d->filters)) {
+        initFilterLauncher_MimeHooks_();
+    }
     if (reportError) {
         postCommand_App("~config.error where:mimehooks.txt");
     }
@@ -46,6 +46,7 @@ iDeclareType(MimeHooks)
 iDeclareTypeConstruction(MimeHooks)
 
 iBool       willTryFilter_MimeHooks (const iMimeHooks *, const iString *mime);
+iBool       willTranslateFeed_MimeHooks(const iMimeHooks *, const iString *mime); /* built-in */
 iBlock *    tryFilter_MimeHooks     (const iMimeHooks *, const iString *mime,
                                      const iBlock *body, const iString *requestUrl);
 
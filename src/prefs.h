@@ -207,6 +207,7 @@ struct Impl_Prefs {
     int              maxCacheSize; /* MB */
     int              maxMemorySize; /* MB */
     int              maxUrlSize; /* bytes; longer ones will be disregarded */
+    int              maxFeedRequests; /* concurrent requests while refreshing feeds */
     /* Style */
     iStringSet *     disabledFontPacks;
     int              gemtextAnsiEscapes;
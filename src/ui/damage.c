@@ -0,0 +1,90 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "damage.h"
+
+void init_Damage(iDamage *d) {
+    d->mutex       = new_Mutex();
+    d->rect        = zero_Rect();
+    d->drawnPixels = 0;
+}
+
+void deinit_Damage(iDamage *d) {
+    delete_Mutex(d->mutex);
+}
+
+void add_Damage(iDamage *d, iRect bounds, iRect rect) {
+    rect = intersect_Rect(rect, bounds);
+    if (!isEmpty_Rect(rect)) {
+        lock_Mutex(d->mutex);
+        d->rect = isEmpty_Rect(d->rect) ? rect : union_Rect(d->rect, rect);
+        unlock_Mutex(d->mutex);
+    }
+}
+
+iRect take_Damage(iDamage *d) {
+    lock_Mutex(d->mutex);
+    const iRect rect = d->rect;
+    d->rect = zero_Rect();
+    unlock_Mutex(d->mutex);
+    return rect;
+}
+
+void addDrawn_Damage(iDamage *d, iRect drawn) {
+    /* Only called by the thread that draws the window. */
+    if (!isEmpty_Rect(drawn)) {
+        d->drawnPixels += area_Rect(drawn);
+    }
+}
+
+iBool isDamaging_SDLEvent(const SDL_Event *ev) {
+    /* User events are commands and timer wakeups; widgets refresh themselves when a command
+       changes them. Hovering without a button held only refreshes the affected widgets. */
+    switch (ev->type) {
+        case SDL_MOUSEMOTION:
+            return ev->motion.state != 0;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        case SDL_TEXTINPUT:
+        case SDL_TEXTEDITING:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEWHEEL:
+        case SDL_FINGERDOWN:
+        case SDL_FINGERUP:
+        case SDL_FINGERMOTION:
+        case SDL_MULTIGESTURE:
+        case SDL_WINDOWEVENT:
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+        case SDL_DISPLAYEVENT:
+#endif
+        case SDL_DROPFILE:
+        case SDL_DROPTEXT:
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+        case SDL_APP_WILLENTERFOREGROUND:
+        case SDL_APP_DIDENTERFOREGROUND:
+            return iTrue;
+        default:
+            return iFalse;
+    }
+}
@@ -0,0 +1,50 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/rect.h>
+#include <SDL_events.h>
+
+iDeclareType(Damage)
+
+/* Areas of a window that need to be redrawn in the next frame. Damaged areas are combined
+   into one bounding rectangle. Thread safe, because timers may refresh widgets. */
+struct Impl_Damage {
+    iMutex * mutex;
+    iRect    rect;        /* changed since the previous frame */
+    uint64_t drawnPixels; /* total redrawn in all frames */
+};
+
+void    init_Damage     (iDamage *);
+void    deinit_Damage   (iDamage *);
+
+void    add_Damage      (iDamage *, iRect bounds, iRect rect); /* `rect` is clipped to `bounds` */
+iRect   take_Damage     (iDamage *);
+void    addDrawn_Damage (iDamage *, iRect drawn);
+
+iLocalDef uint64_t drawnPixels_Damage(const iDamage *d) {
+    return d->drawnPixels;
+}
+
+iBool   isDamaging_SDLEvent (const SDL_Event *); /* may change any part of the UI */
@@ -347,6 +347,8 @@ struct Impl_DocumentWidget {
     iString        sourceHeader;
     iString        sourceMime;
     iBlock         sourceContent; /* original content as received, for saving; set on request finish */
+    uint32_t       sourceStream; /* identifies the current request's response */
+    iDownloadSink  sourceDownload; /* unsupported content is written to a file instead */
     iTime          sourceTime;
     iGempub *      sourceGempub; /* NULL unless the page is Gempub content */
     iBanner *      banner;
@@ -381,14 +383,19 @@ static const int homeRowKeys_[] = {
     't', 'y',
 };
 static int docEnum_ = 0;
+static uint32_t lastSourceStream_DocumentWidget_ = 0;
+static const uint32_t layoutSlice_DocumentView_ = 8; /* ms */
 
 static void animate_DocumentWidget_                 (void *ticker);
 static void animateMedia_DocumentWidget_            (iDocumentWidget *d);
 static void updateSideIconBuf_DocumentWidget_       (const iDocumentWidget *d);
 static void prerender_DocumentWidget_               (iAny *);
+static void continueLayout_DocumentWidget_          (iAny *);
 static void scrollBegan_DocumentWidget_             (iAnyObject *, int, uint32_t);
 static void refreshWhileScrolling_DocumentWidget_   (iAny *);
 static iBool requestMedia_DocumentWidget_           (iDocumentWidget *d, iGmLinkId linkId, iBool enableFilters);
+static void setSourceStream_DocumentWidget_         (iDocumentWidget *d, const iString *source,
+                                                     uint32_t stream);
 
 /* TODO: The following methods are called from DocumentView, which goes the wrong way. */
 
@@ -540,6 +547,7 @@ static iChar linkOrdinalChar_DocumentWidget_(const iDocumentWidget *d, size_t or
 void init_DocumentView(iDocumentView *d) {
     d->owner            = NULL;
     d->doc              = new_GmDocument();
+    setLayoutSlice_GmDocument(d->doc, layoutSlice_DocumentView_);
     d->invalidRuns      = new_PtrSet();
     d->drawBufs         = new_DrawBufs();
     d->pageMargin       = 5;
@@ -905,7 +913,34 @@ static int updateScrollMax_DocumentView_(iDocumentView *d) {
     return scrollMax;
 }
 
+static void documentRunsInvalidated_DocumentView_(iDocumentView *d) {
+    d->hoverPre    = NULL;
+    d->hoverAltPre = NULL;
+    d->hoverLink   = NULL;
+    clear_PtrArray(&d->visibleMedia);
+    iZap(d->visibleRuns);
+    iZap(d->renderRuns);
+}
+
+static void layoutBelow_DocumentView_(iDocumentView *d, int docY) {
+    /* Ensure that a full screen of the document is laid out below `docY`. Runs may get
+       reallocated. */
+    const int needed = docY + height_Rect(documentBounds_DocumentView_(d));
+    if (size_GmDocument(d->doc).y >= needed || !isLayoutPending_GmDocument(d->doc)) {
+        return;
+    }
+    while (size_GmDocument(d->doc).y < needed &&
+           continueLayout_GmDocument(d->doc, layoutSlice_DocumentView_)) {}
+    documentRunsInvalidated_DocumentView_(d);
+}
+
 static void updateVisible_DocumentView_(iDocumentView *d) {
+    if (isLayoutPending_GmDocument(d->doc)) {
+        /* The visible part of a long document is laid out right away, the rest in the
+           background. */
+        layoutBelow_DocumentView_(d, visibleRange_DocumentView_(d).end);
+        addTicker_App(continueLayout_DocumentWidget_, d->owner);
+    }
     /* TODO: The concerns of Widget and View are too tangled together here. */
     iChangeFlags(d->owner->flags,
                  centerVertically_DocumentWidgetFlag,
@@ -952,6 +987,7 @@ static void updateVisible_DocumentView_(iDocumentView *d) {
     /* Remember scroll positions of recently visited pages. */ {
         iRecentUrl *recent = mostRecentUrl_History(d->owner->mod.history);
         if (recent && docSize && d->owner->state == ready_RequestState &&
+            !isLayoutPending_GmDocument(d->doc) /* height still growing */ &&
             equal_String(&recent->url, d->owner->mod.url)) {
             recent->normScrollY = normScrollPos_DocumentView_(d);
         }
@@ -965,6 +1001,14 @@ static void updateVisible_DocumentView_(iDocumentView *d) {
     }
 }
 
+static void finishLayout_DocumentView_(iDocumentView *d) {
+    if (isLayoutPending_GmDocument(d->doc)) {
+        finishLayout_GmDocument(d->doc);
+        documentRunsInvalidated_DocumentView_(d);
+        updateVisible_DocumentView_(d);
+    }
+}
+
 static void swap_DocumentView_(iDocumentView *d, iDocumentView *swapBuffersWith) {
     d->scrollY        = swapBuffersWith->scrollY;
     d->scrollY.widget = as_Widget(d->owner);
@@ -1000,15 +1044,6 @@ static void invalidate_DocumentView_(iDocumentView *d) {
     clear_PtrSet(d->invalidRuns);
 }
 
-static void documentRunsInvalidated_DocumentView_(iDocumentView *d) {
-    d->hoverPre    = NULL;
-    d->hoverAltPre = NULL;
-    d->hoverLink   = NULL;
-    clear_PtrArray(&d->visibleMedia);
-    iZap(d->visibleRuns);
-    iZap(d->renderRuns);
-}
-
 static void resetScroll_DocumentView_(iDocumentView *d) {
     reset_SmoothScroll(&d->scrollY);
     d->userHasScrolled = iFalse;
@@ -1058,6 +1093,7 @@ static void scrollTo_DocumentView_(iDocumentView *d, int documentY, iBool center
 }
 
 static void scrollToHeading_DocumentView_(iDocumentView *d, const char *heading) {
+    finishLayout_DocumentView_(d); /* all headings needed */
     iConstForEach(Array, h, headings_GmDocument(d->doc)) {
         const iGmHeading *head = h.value;
         if (startsWithCase_Rangecc(head->text, heading)) {
@@ -1199,23 +1235,33 @@ static iBool updateDocumentWidthRetainingScrollPosition_DocumentView_(iDocumentV
         /* TODO: First *fully* visible run? */
         voffset = visibleRange_DocumentView_(d).start - top_Rect(run->visBounds);
     }
+    const char *lastLoc = (d->visibleRuns.end ? d->visibleRuns.end->text.start : NULL);
     run = NULL;
-    setWidth_GmDocument(d->doc, newWidth, width_Widget(d->owner));
+    /* Only the currently visible part is laid out immediately. The rest of a long document
+       is laid out in small steps afterwards, so resizing the window remains responsive. */
+    beginLayout_GmDocument(
+        d->doc, newWidth, width_Widget(d->owner), lastLoc ? lastLoc : runLoc, layoutSlice_DocumentView_);
     setWidth_Banner(d->owner->banner, newWidth);
     documentRunsInvalidated_DocumentWidget_(d->owner);
     if (runLoc && !keepCenter) {
         run = findRunAtLoc_GmDocument(d->doc, runLoc);
         if (run) {
-            scrollTo_DocumentView_(
-                d, top_Rect(run->visBounds) + lineHeight_Text(paragraph_FontId) + voffset, iFalse);
+            const int runTop = top_Rect(run->visBounds);
+            layoutBelow_DocumentView_(d, runTop);
+            scrollTo_DocumentView_(d, runTop + lineHeight_Text(paragraph_FontId) + voffset, iFalse);
         }
     }
     else if (runLoc && keepCenter) {
         run = findRunAtLoc_GmDocument(d->doc, runLoc);
         if (run) {
-            scrollTo_DocumentView_(d, mid_Rect(run->bounds).y, iTrue);
+            const int runMid = mid_Rect(run->bounds).y;
+            layoutBelow_DocumentView_(d, runMid);
+            scrollTo_DocumentView_(d, runMid, iTrue);
         }
     }
+    if (isLayoutPending_GmDocument(d->doc)) {
+        addTicker_App(continueLayout_DocumentWidget_, d->owner);
+    }
     return iTrue;
 }
 
@@ -1334,6 +1380,10 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
             SDL_RenderCopy(d->paint.dst->render, tex, NULL,
                            &(SDL_Rect){ dst.pos.x, dst.pos.y, dst.size.x, dst.size.y });
         }
+        else if (isImageDecoding_Media(media_GmDocument(d->view->doc), mediaId_GmRun(run))) {
+            /* Placeholder until the texture is ready. */
+            fillRect_Paint(&d->paint, dst, tmBackgroundAltText_ColorId);
+        }
         else {
             drawRect_Paint(&d->paint, dst, tmQuoteIcon_ColorId);
             drawCentered_Text(uiLabel_FontId,
@@ -2402,6 +2452,8 @@ static void replaceDocument_DocumentWidget_(iDocumentWidget *d, iGmDocument *new
     pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
     iRelease(d->view.doc);
     d->view.doc = ref_Object(newDoc);
+    /* Images may have finished decoding while the document was in the history cache. */
+    uploadDecodedImages_Media(media_GmDocument(d->view.doc));
     documentWasChanged_DocumentWidget_(d);
 }
 
@@ -3053,12 +3105,27 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
             }
         }
         else if (setSource) {
-            setSource_DocumentWidget(d, &str);
+            /* Updates of an ongoing response continue the same source. */
+            setSourceStream_DocumentWidget_(d, &str, d->request ? d->sourceStream : 0);
         }
         deinit_String(&str);
     }
 }
 
+static void resetSourceDownload_DocumentWidget_(iDocumentWidget *d) {
+    deinit_DownloadSink(&d->sourceDownload);
+    init_DownloadSink(&d->sourceDownload);
+}
+
+static iBool isDownloadedToFile_(const iString *meta) {
+    /* Fonts and archives are inspected once fully received, so they are kept in memory.
+       Other content that can't be shown is only written to a file. */
+    const iRangecc mime = mediaTypeWithoutParameters_Rangecc(range_String(meta));
+    return !startsWithCase_Rangecc(mime, "font/") &&
+           !equalCase_Rangecc(mime, "application/zip") &&
+           !(startsWithCase_Rangecc(mime, "application/") && endsWithCase_Rangecc(mime, "+zip"));
+}
+
 static iBool fetch_DocumentWidget_(iDocumentWidget *d) {
     iAssert(~d->flags & animationPlaceholder_DocumentWidgetFlag);
     /* We may be instructed to wait before fetching to avoid congestion. */
@@ -3070,6 +3137,7 @@ static iBool fetch_DocumentWidget_(iDocumentWidget *d) {
         d->flags &= ~waitForIdle_DocumentWidgetFlag;
     }
     /* Forget the previous request. */
+    resetSourceDownload_DocumentWidget_(d);
     if (d->request) {
         iRelease(d->request);
         d->request = NULL;
@@ -3084,6 +3152,7 @@ static iBool fetch_DocumentWidget_(iDocumentWidget *d) {
     d->state = fetching_RequestState;
     set_Atomic(&d->isRequestUpdated, iFalse);
     d->request = new_GmRequest(certs_App());
+    d->sourceStream = ++lastSourceStream_DocumentWidget_;
     setUrl_GmRequest(d->request, d->mod.url);
     /* Overriding identity. */
     if (isIdentityPinned_DocumentWidget(d)) {
@@ -3238,6 +3307,7 @@ static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float n
     d->footerButtons = NULL;
     iRelease(d->view.doc);
     d->view.doc = new_GmDocument();
+    setLayoutSlice_GmDocument(d->view.doc, layoutSlice_DocumentView_);
     d->state = fetching_RequestState;
     d->flags &= ~pendingRedirect_DocumentWidgetFlag;
     d->flags |= fromCache_DocumentWidgetFlag;
@@ -3260,6 +3330,9 @@ static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float n
     d->state = ready_RequestState;
     postProcessRequestContent_DocumentWidget_(d, iTrue);
     resetScroll_DocumentView_(&d->view);
+    if (d->initNormScrollY > 0) {
+        finishLayout_DocumentView_(&d->view); /* position is relative to the full height */
+    }
     init_Anim(&d->view.scrollY.pos, d->initNormScrollY * pageHeight_DocumentView_(&d->view));
     updateVisible_DocumentView_(&d->view);
     moveSpan_SmoothScroll(&d->view.scrollY, 0, 0); /* clamp position to new max */
@@ -3272,9 +3345,10 @@ static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float n
 }
 
 static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d, iBool useCachedDoc) {
-    const iRecentUrl *recent = constMostRecentUrl_History(d->mod.history);
+    iRecentUrl *recent = mostRecentUrl_History(d->mod.history);
     setIdentity_DocumentWidget(d, recent ? &recent->setIdentity : NULL);
-    if (recent && recent->cachedResponse && equalCase_String(&recent->url, d->mod.url)) {
+    if (recent && equalCase_String(&recent->url, d->mod.url) &&
+        loadCachedResponse_History(d->mod.history, recent)) {
         iGmDocument *cachedDoc = (useCachedDoc ? recent->cachedDoc : NULL);
         updateFromCachedResponse_DocumentWidget_(
             d, recent->normScrollY, recent->cachedResponse, cachedDoc);
@@ -3584,6 +3658,7 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
                 destroy_Widget(d->footerButtons);
                 d->footerButtons = NULL;
                 d->view.doc = new_GmDocument();
+                setLayoutSlice_GmDocument(d->view.doc, layoutSlice_DocumentView_);
                 resetWideRuns_DocumentView_(&d->view);
                 updateDocument_DocumentWidget_(d, resp, NULL, iTrue);
                 break;
@@ -3653,7 +3728,20 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
                 break;
         }
     }
+    const int downloadError = d->sourceDownload.error;
     unlockResponse_GmRequest(d->request);
+    if (d->flags & drawDownloadCounter_DocumentWidgetFlag &&
+        !isActive_DownloadSink(&d->sourceDownload) && !d->sourceDownload.path &&
+        isDownloadedToFile_(meta_GmRequest(d->request))) {
+        /* Content that isn't presented is not kept in memory. It is spooled to a temporary
+           file until the user decides to save it. */
+        beginSpool_DownloadSink(&d->sourceDownload,
+                                d->request,
+                                temporaryPathForUrl_App(d->mod.url, meta_GmRequest(d->request)));
+    }
+    else if (downloadError && isActive_DownloadSink(&d->sourceDownload)) {
+        cancel_GmRequest(d->request); /* no use receiving the rest */
+    }
 }
 
 static void removeMediaRequest_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
@@ -3669,7 +3757,12 @@ static void removeMediaRequest_DocumentWidget_(iDocumentWidget *d, iGmLinkId lin
 static iBool requestMedia_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId, iBool enableFilters) {
     if (!findMediaRequest_DocumentWidget_(d, linkId)) {
         const iString *mediaUrl = absoluteUrl_String(d->mod.url, linkUrl_GmDocument(d->view.doc, linkId));
-        pushBack_ObjectList(d->media, iClob(new_MediaRequest(d, linkId, mediaUrl, enableFilters)));
+        iMediaRequest *req = new_MediaRequest(d, linkId, mediaUrl, enableFilters);
+        if (findMediaForLink_Media(constMedia_GmDocument(d->view.doc), linkId, download_MediaType).type) {
+            /* Downloads go straight to a file as the data arrives. */
+            beginDownload_MediaRequest(req);
+        }
+        pushBack_ObjectList(d->media, iClob(req));
         invalidate_DocumentWidget_(d);
         return iTrue;
     }
@@ -3680,6 +3773,53 @@ static iBool isDownloadRequest_DocumentWidget(const iDocumentWidget *d, const iM
     return findMediaForLink_Media(constMedia_GmDocument(d->view.doc), req->linkId, download_MediaType).type != 0;
 }
 
+static iBool updateDownload_DocumentWidget_(iDocumentWidget *d, iMediaRequest *req) {
+    /* Returns False if the download failed and was removed. */
+    const iBool isFinished = isFinished_GmRequest(req->req);
+    if (isFinished) {
+        finishDownload_MediaRequest(req);
+    }
+    const size_t numBytes = bodySize_GmRequest(req->req);
+    iGmResponse *resp = lockResponse_GmRequest(req->req);
+    const int error = downloadError_MediaRequest(req);
+    if (!error) {
+        updateDownload_Media(media_GmDocument(d->view.doc),
+                             req->linkId,
+                             &resp->meta,
+                             downloadPath_MediaRequest(req),
+                             numBytes,
+                             isFinished);
+    }
+    unlockResponse_GmRequest(req->req);
+    if (error) {
+        const iGmLinkId linkId = req->linkId;
+        makeSimpleMessage_Widget(uiTextCaution_ColorEscape "${heading.save.error}",
+                                 strerror(error));
+        removeMediaRequest_DocumentWidget_(d, linkId); /* cancels the request */
+        setData_Media(media_GmDocument(d->view.doc), linkId, NULL, NULL, 0);
+        redoLayout_GmDocument(d->view.doc); /* downloader is removed */
+        updateVisible_DocumentView_(&d->view);
+        invalidate_DocumentWidget_(d);
+        refresh_Widget(as_Widget(d));
+        return iFalse;
+    }
+    return iTrue;
+}
+
+#if defined (LAGRANGE_ENABLE_AUDIO)
+static void sniffMediaType_MediaRequest_(iMediaRequest *req) {
+    /* Servers don't always know what a file is; it may still be playable audio. */
+    iGmResponse *resp = lockResponse_GmRequest(req->req);
+    if (startsWith_String(&resp->meta, "application/octet-stream")) {
+        const char *mime = sniffMediaType_Player(&resp->body);
+        if (mime) {
+            setCStr_String(&resp->meta, mime);
+        }
+    }
+    unlockResponse_GmRequest(req->req);
+}
+#endif
+
 static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
     iMediaRequest *req = pointerLabel_Command(cmd, "request");
     iBool isOurRequest = iFalse;
@@ -3696,23 +3836,35 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
     if (equal_Command(cmd, "media.updated")) {
         /* Pass new data to media players. */
         const enum iGmStatusCode code = status_GmRequest(req->req);
-        if (isSuccess_GmStatusCode(code)) {
-            iGmResponse *resp = lockResponse_GmRequest(req->req);
-            if (isDownloadRequest_DocumentWidget(d, req) ||
-                startsWith_String(&resp->meta, "audio/")) {
+        if (isSuccess_GmStatusCode(code) && isDownloadRequest_DocumentWidget(d, req)) {
+            if (!updateDownload_DocumentWidget_(d, req)) {
+                return iTrue; /* request is gone */
+            }
+        }
+        else if (isSuccess_GmStatusCode(code)) {
+#if defined (LAGRANGE_ENABLE_AUDIO)
+            sniffMediaType_MediaRequest_(req);
+#endif
+            iGmResponse *resp    = lockResponse_GmRequest(req->req);
+            const iBool  isAudio = startsWith_String(&resp->meta, "audio/");
+            unlockResponse_GmRequest(req->req);
+            if (isAudio) {
                 /* TODO: Use a helper? This is same as below except for the partialData flag. */
+                beginAudio_MediaRequest(req);
+                resp = lockResponse_GmRequest(req->req);
                 if (setData_Media(media_GmDocument(d->view.doc),
                                   req->linkId,
                                   &resp->meta,
-                                  &resp->body,
-                                  partialData_MediaFlag | allowHide_MediaFlag)) {
+                                  takeAudioData_MediaRequest(req),
+                                  partialData_MediaFlag | allowHide_MediaFlag |
+                                      streamedData_MediaFlag)) {
                     redoLayout_GmDocument(d->view.doc);
                 }
+                unlockResponse_GmRequest(req->req);
                 updateVisible_DocumentView_(&d->view);
                 invalidate_DocumentWidget_(d);
                 refresh_Widget(as_Widget(d));
             }
-            unlockResponse_GmRequest(req->req);
         }
         /* Update the link's progress. */
         invalidateLink_DocumentView_(&d->view, req->linkId);
@@ -3722,15 +3874,36 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
     else if (equal_Command(cmd, "media.finished")) {
         const enum iGmStatusCode code = status_GmRequest(req->req);
         /* Give the media to the document for presentation. */
-        if (isSuccess_GmStatusCode(code)) {
-            if (isDownloadRequest_DocumentWidget(d, req) ||
-                startsWith_String(meta_GmRequest(req->req), "image/") ||
-                startsWith_String(meta_GmRequest(req->req), "audio/")) {
+        if (isSuccess_GmStatusCode(code) && isDownloadRequest_DocumentWidget(d, req)) {
+            if (updateDownload_DocumentWidget_(d, req)) {
+                invalidateLink_DocumentView_(&d->view, req->linkId);
+                refresh_Widget(as_Widget(d));
+            }
+        }
+        else if (isSuccess_GmStatusCode(code)) {
+#if defined (LAGRANGE_ENABLE_AUDIO)
+            sniffMediaType_MediaRequest_(req);
+#endif
+            const iBool isImage = startsWith_String(meta_GmRequest(req->req), "image/");
+            const iBool isAudio = startsWith_String(meta_GmRequest(req->req), "audio/");
+            if (isImage) {
                 setData_Media(media_GmDocument(d->view.doc),
                               req->linkId,
                               meta_GmRequest(req->req),
                               body_GmRequest(req->req),
                               allowHide_MediaFlag);
+            }
+            else if (isAudio) {
+                beginAudio_MediaRequest(req);
+                iGmResponse *resp = lockResponse_GmRequest(req->req);
+                setData_Media(media_GmDocument(d->view.doc),
+                              req->linkId,
+                              &resp->meta,
+                              takeAudioData_MediaRequest(req),
+                              allowHide_MediaFlag | streamedData_MediaFlag);
+                unlockResponse_GmRequest(req->req);
+            }
+            if (isImage || isAudio) {
                 redoLayout_GmDocument(d->view.doc);
                 iZap(d->view.visibleRuns); /* pointers invalidated */
                 updateVisible_DocumentView_(&d->view);
@@ -3766,6 +3939,31 @@ static iBool fetchNextUnfetchedImage_DocumentWidget_(iDocumentWidget *d) {
     return iFalse;
 }
 
+static void showSavedFile_(const iString *savePath, size_t size, const iString *mime) {
+#if defined (iPlatformAppleMobile)
+    iUnused(size, mime);
+    exportDownloadedFile_iOS(savePath);
+#elif defined (iPlatformAndroidMobile)
+    iUnused(size);
+    exportDownloadedFile_Android(savePath, mime);
+#else
+    iUnused(mime);
+    const iBool isMega = size >= 1000000;
+    const iMenuItem items[2] = {
+        { "${dlg.save.opendownload}", 0, 0,
+            format_CStr("!open url:%s", cstrCollect_String(makeFileUrl_String(savePath))) },
+        { "${dlg.message.ok}", 0, 0, "message.ok" },
+    };
+    makeMessage_Widget(uiHeading_ColorEscape "${heading.save}",
+                       format_CStr("%s\n${dlg.save.size} %.3f %s",
+                                   cstr_String(savePath),
+                                   isMega ? size / 1.0e6f : (size / 1.0e3f),
+                                   isMega ? "${mb}" : "${kb}"),
+                       items,
+                       iElemCount(items));
+#endif
+}
+
 static iBool saveToFile_(const iString *savePath, const iBlock *content, const iString *mime,
                          iBool showDialog) {
     iBool ok = iFalse;
@@ -3775,32 +3973,9 @@ static iBool saveToFile_(const iString *savePath, const iBlock *content, const i
         if (open_File(f, writeOnly_FileMode)) {
             write_File(f, content);
             close_File(f);
-            const size_t size   = size_Block(content);
-            const iBool  isMega = size >= 1000000;
-#if defined (iPlatformAppleMobile)
-            if (showDialog) {
-                exportDownloadedFile_iOS(savePath);
-            }
-#elif defined (iPlatformAndroidMobile)
-            if (showDialog) {
-                exportDownloadedFile_Android(savePath, mime);
-            }
-#else
             if (showDialog) {
-                const iMenuItem items[2] = {
-                    { "${dlg.save.opendownload}", 0, 0,
-                        format_CStr("!open url:%s", cstrCollect_String(makeFileUrl_String(savePath))) },
-                    { "${dlg.message.ok}", 0, 0, "message.ok" },
-                };
-                makeMessage_Widget(uiHeading_ColorEscape "${heading.save}",
-                                       format_CStr("%s\n${dlg.save.size} %.3f %s",
-                                                   cstr_String(path_File(f)),
-                                               isMega ? size / 1.0e6f : (size / 1.0e3f),
-                                               isMega ? "${mb}" : "${kb}"),
-                                       items,
-                                       iElemCount(items));
+                showSavedFile_(path_File(f), size_Block(content), mime);
             }
-#endif
             ok = iTrue;
         }
         else {
@@ -3987,7 +4162,7 @@ static iBool handleSwipe_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
                 /* Use a cached document for the layer underneath. */ {
                     lock_History(d->mod.history);
                     iRecentUrl *recent = precedingLocked_History(d->mod.history);
-                    if (recent && recent->cachedResponse) {
+                    if (recent && loadCachedResponse_History(d->mod.history, recent)) {
                         setUrl_DocumentWidget_(swipeIn, &recent->url);
                         updateFromCachedResponse_DocumentWidget_(swipeIn,
                                                                  recent->normScrollY,
@@ -4128,6 +4303,7 @@ static iBool cancelRequest_DocumentWidget_(iDocumentWidget *d, iBool postBack) {
         iWidget *w = as_Widget(d);
         postCommandf_Root(w->root,
                           "document.request.cancelled doc:%p url:%s", d, cstr_String(d->mod.url));
+        resetSourceDownload_DocumentWidget_(d); /* partial file is deleted */
         iReleasePtr(&d->request);
         if (d->state != ready_RequestState) {
             d->state = ready_RequestState;
@@ -4568,6 +4744,13 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         iChangeFlags(d->flags, fromCache_DocumentWidgetFlag | preventInlining_DocumentWidgetFlag,
                      iFalse);
         iChangeFlags(d->flags, proxyRequest_DocumentWidgetFlag, isProxy_GmRequest(d->request));
+        if (isActive_DownloadSink(&d->sourceDownload)) {
+            end_DownloadSink(&d->sourceDownload);
+            if (d->sourceDownload.error) {
+                makeSimpleMessage_Widget(uiTextCaution_ColorEscape "${heading.save.error}",
+                                         strerror(d->sourceDownload.error));
+            }
+        }
         set_Block(&d->sourceContent, body_GmRequest(d->request));
         if (!isSuccess_GmStatusCode(status_GmRequest(d->request))) {
             /* TODO: Why is this here? Can it be removed? */
@@ -4580,6 +4763,9 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         checkResponse_DocumentWidget_(d);
         if (category_GmStatusCode(status_GmRequest(d->request)) == categorySuccess_GmStatusCode &&
             !d->view.userHasScrolled) {
+            if (d->initNormScrollY > 0) {
+                finishLayout_DocumentView_(&d->view);
+            }
             init_Anim(&d->view.scrollY.pos, d->initNormScrollY * pageHeight_DocumentView_(&d->view));
         }
         addBannerWarnings_DocumentWidget_(d);
@@ -4676,6 +4862,14 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     else if (equal_Command(cmd, "media.updated") || equal_Command(cmd, "media.finished")) {
         return handleMediaCommand_DocumentWidget_(d, cmd);
     }
+    else if (equal_Command(cmd, "media.decoded")) {
+        /* Other documents may also have images waiting to be uploaded. */
+        if (uploadDecodedImages_Media(media_GmDocument(d->view.doc))) {
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(w);
+        }
+        return iFalse;
+    }
 #if defined (LAGRANGE_ENABLE_AUDIO)
     else if (equal_Command(cmd, "media.player.started")) {
         /* When one media player starts, pause the others that may be playing. */
@@ -4703,8 +4897,20 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         const iGmLinkId      linkId = argLabel_Command(cmd, "link");
         const iMediaRequest *media  = findMediaRequest_DocumentWidget_(d, linkId);
         if (media) {
+            const iBlock *content = body_GmRequest(media->req);
+#if defined (LAGRANGE_ENABLE_AUDIO)
+            if (media->audioData) {
+                /* Audio isn't kept in the response; the player has the data spooled. */
+                const iMediaId audioId = findMediaForLink_Media(
+                    constMedia_GmDocument(d->view.doc), linkId, audio_MediaType);
+                if (audioId.type) {
+                    content = collect_Block(sourceData_Player(
+                        audioPlayer_Media(constMedia_GmDocument(d->view.doc), audioId)));
+                }
+            }
+#endif
             saveToDownloads_(url_GmRequest(media->req), meta_GmRequest(media->req),
-                             body_GmRequest(media->req), iTrue);
+                             content, iTrue);
         }
     }
     else if (equal_Command(cmd, "document.save") && document_App() == d) {
@@ -4712,6 +4918,34 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             makeSimpleMessage_Widget(uiTextCaution_ColorEscape "${heading.save.incomplete}",
                                      "${dlg.save.incomplete}");
         }
+        else if (isEmpty_Block(&d->sourceContent) && d->sourceDownload.path &&
+                 !d->sourceDownload.error) {
+            /* The content was already written to a file as it arrived. */
+            if (argLabel_Command(cmd, "extview")) {
+                postCommandf_Root(w->root, "!open default:1 mime:%s url:%s",
+                                  cstr_String(&d->sourceMime),
+                                  cstrCollect_String(makeFileUrl_String(d->sourceDownload.path)));
+            }
+            else {
+                errno = 0;
+                if (d->sourceDownload.isSpool &&
+                    !keep_DownloadSink(&d->sourceDownload,
+                                       downloadPathForUrl_App(d->mod.url, &d->sourceMime))) {
+                    makeSimpleMessage_Widget(uiTextCaution_ColorEscape "${heading.save.error}",
+                                             strerror(errno ? errno : EIO));
+                }
+                else {
+                    const iString *path = d->sourceDownload.path;
+                    if (argLabel_Command(cmd, "open")) {
+                        postCommandf_Root(w->root, "!open url:%s",
+                                          cstrCollect_String(makeFileUrl_String(path)));
+                    }
+                    else {
+                        showSavedFile_(path, fileSize_FileInfo(path), &d->sourceMime);
+                    }
+                }
+            }
+        }
         else if (!isEmpty_Block(&d->sourceContent)) {
             if (argLabel_Command(cmd, "extview")) {
                 if (equalCase_Rangecc(urlScheme_String(d->mod.url), "file") &&
@@ -4741,6 +4975,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         return iTrue;
     }
     else if (equal_Command(cmd, "document.reload") && document_Command(cmd) == d) {
+        finishLayout_DocumentView_(&d->view);
         d->initNormScrollY = normScrollPos_DocumentView_(&d->view);
         if (equalCase_Rangecc(urlScheme_String(d->mod.url), "titan")) {
             /* Reopen so the Upload dialog gets shown. */
@@ -4794,6 +5029,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         if (d->request) {
             postCommandf_Root(w->root,
                 "document.request.cancelled doc:%p url:%s", d, cstr_String(d->mod.url));
+            resetSourceDownload_DocumentWidget_(d);
             iReleasePtr(&d->request);
             updateFetchProgress_DocumentWidget_(d);
         }
@@ -4903,6 +5139,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         return iTrue;
     }
     else if (equal_Command(cmd, "scroll.bottom") && document_App() == d) {
+        finishLayout_DocumentView_(&d->view);
         updateScrollMax_DocumentView_(&d->view); /* scrollY.max might not be fully updated */
         init_Anim(&d->view.scrollY.pos, d->view.scrollY.max);
         invalidate_VisBuf(d->view.visBuf);
@@ -4935,6 +5172,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             return iTrue;
         }
         const char *loc = pointerLabel_Command(cmd, "loc");
+        finishLayout_DocumentView_(&d->view);
         const iGmRun *run = findRunAtLoc_GmDocument(d->view.doc, loc);
         if (run) {
             scrollTo_DocumentView_(&d->view, run->visBounds.pos.y, iFalse);
@@ -4960,6 +5198,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             }
             if (d->foundMark.start) {
                 const iGmRun *found;
+                finishLayout_DocumentView_(&d->view);
                 if ((found = findRunAtLoc_GmDocument(d->view.doc, d->foundMark.start)) != NULL) {
                     scrollTo_DocumentView_(&d->view, mid_Rect(found->bounds).y, iTrue);
                 }
@@ -5084,8 +5323,15 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     }
     else if (equal_Command(cmd, "document.setmediatype") && document_App() == d) {
         if (!isRequestOngoing_DocumentWidget(d)) {
-            setUrlAndSource_DocumentWidget(d, d->mod.url, string_Command(cmd, "mime"),
-                                           &d->sourceContent);
+            const iBlock *content = &d->sourceContent;
+            if (isEmpty_Block(content) && d->sourceDownload.path && !d->sourceDownload.error) {
+                /* Viewing it needs the content in memory after all. */
+                iFile *f = iClob(new_File(d->sourceDownload.path));
+                if (open_File(f, readOnly_FileMode)) {
+                    content = collect_Block(readAll_File(f));
+                }
+            }
+            setUrlAndSource_DocumentWidget(d, d->mod.url, string_Command(cmd, "mime"), content);
         }
         return iTrue;
     }
@@ -5211,8 +5457,7 @@ static iBool processMediaEvents_DocumentWidget_(iDocumentWidget *d, const SDL_Ev
             }
             else if (contains_Rect(ui.rewindRect, mouse)) {
                 if (isStarted_Player(plr) && time_Player(plr) > 0.5f) {
-                    stop_Player(plr);
-                    start_Player(plr);
+                    seek_Player(plr, 0);
                     setPaused_Player(plr, iTrue);
                 }
                 refresh_Widget(d);
@@ -5603,6 +5848,7 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
         if (ev->button.button == SDL_BUTTON_RIGHT &&
             contains_Widget(w, init_I2(ev->button.x, ev->button.y))) {
             if (!isVisible_Widget(d->menu)) {
+                finishLayout_DocumentView_(view); /* runs must not move while the menu is open */
                 d->contextLink = view->hoverLink;
                 d->contextPos = init_I2(ev->button.x, ev->button.y);
                 if (d->menu) {
@@ -6161,6 +6407,33 @@ static void checkPendingInvalidation_DocumentWidget_(const iDocumentWidget *d) {
     }
 }
 
+static void continueLayout_DocumentWidget_(iAny *context) {
+    iAssert(isInstance_Object(context, &Class_DocumentWidget));
+    iDocumentWidget *d = context;
+    if (flags_Widget(as_Widget(d)) & destroyPending_WidgetFlag) {
+        return;
+    }
+    /* A new document or a new width cancels the remaining layout of the old one. */
+    if (!isLayoutPending_GmDocument(d->view.doc)) {
+        return;
+    }
+    const int oldHeight = size_GmDocument(d->view.doc).y;
+    if (continueLayout_GmDocument(d->view.doc, layoutSlice_DocumentView_)) {
+        addTicker_App(continueLayout_DocumentWidget_, d);
+    }
+    else {
+        /* The outline and title are complete now. */
+        updateWindowTitle_DocumentWidget_(d);
+        postCommandf_Root(as_Widget(d)->root, "document.layout.finished doc:%p", d);
+    }
+    documentRunsInvalidated_DocumentView_(&d->view); /* GmRuns reallocated */
+    updateVisible_DocumentView_(&d->view);
+    if (visibleRange_DocumentView_(&d->view).end > oldHeight) {
+        invalidate_DocumentWidget_(d); /* newly laid out lines are visible */
+    }
+    refresh_Widget(d);
+}
+
 static void prerender_DocumentWidget_(iAny *context) {
     iAssert(isInstance_Object(context, &Class_DocumentWidget));
     if (current_Root() == NULL) {
@@ -6377,6 +6650,8 @@ void init_DocumentWidget(iDocumentWidget *d) {
     init_String(&d->sourceHeader);
     init_String(&d->sourceMime);
     init_Block(&d->sourceContent, 0);
+    d->sourceStream = 0;
+    init_DownloadSink(&d->sourceDownload);
     iZap(d->sourceTime);
     d->sourceGempub    = NULL;
     d->initNormScrollY = 0;
@@ -6424,12 +6699,14 @@ void deinit_DocumentWidget(iDocumentWidget *d) {
     pauseAllPlayers_Media(media_GmDocument(d->view.doc), iTrue);
     removeTicker_App(animate_DocumentWidget_, d);
     removeTicker_App(prerender_DocumentWidget_, d);
+    removeTicker_App(continueLayout_DocumentWidget_, d);
     removeTicker_App(refreshWhileScrolling_DocumentWidget_, d);
     remove_Periodic(periodic_App(), d);
     delete_Translation(d->translation);
     deinit_DocumentView(&d->view);
     delete_LinkInfo(d->linkInfo);
     iRelease(d->media);
+    deinit_DownloadSink(&d->sourceDownload);
     iRelease(d->request);
     delete_Gempub(d->sourceGempub);
     deinit_String(&d->linePrecedingLink);
@@ -6447,11 +6724,13 @@ void deinit_DocumentWidget(iDocumentWidget *d) {
     deinit_PersistentDocumentState(&d->mod);
 }
 
-void setSource_DocumentWidget(iDocumentWidget *d, const iString *source) {
+static void setSourceStream_DocumentWidget_(iDocumentWidget *d, const iString *source,
+                                            uint32_t stream) {
     setUrl_GmDocument(d->view.doc, d->mod.url);
     const int docWidth = documentWidth_DocumentView_(&d->view);
     setSource_GmDocument(d->view.doc,
                          source,
+                         stream,
                          docWidth,
                          width_Widget(d),
                          isFinished_GmRequest(d->request) ? final_GmDocumentUpdate
@@ -6460,6 +6739,10 @@ void setSource_DocumentWidget(iDocumentWidget *d, const iString *source) {
     documentWasChanged_DocumentWidget_(d);
 }
 
+void setSource_DocumentWidget(iDocumentWidget *d, const iString *source) {
+    setSourceStream_DocumentWidget_(d, source, 0);
+}
+
 iHistory *history_DocumentWidget(iDocumentWidget *d) {
     return d->mod.history;
 }
@@ -672,6 +672,7 @@ void deinit_LabelWidget(iLabelWidget *d) {
 void setFont_LabelWidget(iLabelWidget *d, int fontId) {
     d->font = fontId;
     updateSize_LabelWidget(d);
+    refresh_Widget(d);
 }
 
 void setTextColor_LabelWidget(iLabelWidget *d, int color) {
@@ -723,10 +724,12 @@ void setNoBottomFrame_LabelWidget(iLabelWidget *d, iBool noBottomFrame) {
 
 void setChevron_LabelWidget(iLabelWidget *d, iBool chevron) {
     d->flags.chevron = chevron;
+    refresh_Widget(d);
 }
 
 void setCheckMark_LabelWidget(iLabelWidget *d, iBool checkMark) {
     d->flags.checkMark = checkMark;
+    refresh_Widget(d);
 }
 
 void setWrap_LabelWidget(iLabelWidget *d, iBool wrap) {
@@ -740,6 +743,7 @@ void setTruncateToFit_LabelWidget (iLabelWidget *d, iBool truncateToFit) {
 void setOutline_LabelWidget(iLabelWidget *d, iBool drawAsOutline) {
     if (d) {
         d->flags.drawAsOutline = drawAsOutline;
+        refresh_Widget(d);
     }
 }
 
@@ -758,7 +762,10 @@ void setRemoveTrailingColon_LabelWidget(iLabelWidget *d, iBool removeTrailingCol
 }
 
 void setTextOffset_LabelWidget(iLabelWidget *d, iInt2 offset) {
-    d->labelOffset = offset;
+    if (!isEqual_I2(d->labelOffset, offset)) {
+        d->labelOffset = offset;
+        refresh_Widget(d);
+    }
 }
 
 void updateText_LabelWidget(iLabelWidget *d, const iString *text) {
@@ -790,11 +797,15 @@ void setIcon_LabelWidget(iLabelWidget *d, iChar icon) {
     if (d->icon != icon) {
         d->icon = icon;
         updateSize_LabelWidget(d);
+        refresh_Widget(d);
     }
 }
 
 void setIconColor_LabelWidget(iLabelWidget *d, int color) {
-    d->iconColor = color;
+    if (d->iconColor != color) {
+        d->iconColor = color;
+        refresh_Widget(d);
+    }
 }
 
 iBool checkIcon_LabelWidget(iLabelWidget *d) {
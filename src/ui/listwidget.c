@@ -139,6 +139,21 @@ void addItem_ListWidget(iListWidget *d, iAnyObject *item) {
     pushBack_PtrArray(&d->items, ref_Object(item));
 }
 
+void insertItem_ListWidget(iListWidget *d, size_t index, iAnyObject *item) {
+    ref_Object(item);
+    insert_Array(&d->items, index, &item);
+    d->hoverItem  = iInvalidPos;
+    d->cursorItem = iInvalidPos;
+}
+
+void removeItem_ListWidget(iListWidget *d, size_t index) {
+    void *item = NULL;
+    take_PtrArray(&d->items, index, &item);
+    deref_Object(item);
+    d->hoverItem  = iInvalidPos;
+    d->cursorItem = iInvalidPos;
+}
+
 iScrollWidget *scroll_ListWidget(iListWidget *d) {
     return d->scroll;
 }
@@ -23,10 +23,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "lookupwidget.h"
 
 #include "app.h"
-#include "bookmarks.h"
 #include "command.h"
 #include "documentwidget.h"
-#include "feeds.h"
 #include "gmcerts.h"
 #include "gmutil.h"
 #include "history.h"
@@ -34,8 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "listwidget.h"
 #include "lang.h"
 #include "lookup.h"
+#include "lookupindex.h"
 #include "util.h"
-#include "visited.h"
 
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/thread.h>
@@ -45,16 +43,22 @@ iDeclareType(LookupJob)
 
 struct Impl_LookupJob {
     iRegExp *term;
+    iStringArray *words; /* separate words of the term */
     iTime now;
     iObjectList *docs;
     iPtrArray results;
+    int serial;
+    iAtomicInt *latestSerial; /* job is cancelled when a newer one is submitted */
 };
 
 static void init_LookupJob(iLookupJob *d) {
     d->term = NULL;
+    d->words = new_StringArray();
     initCurrent_Time(&d->now);
     d->docs = NULL;
     init_PtrArray(&d->results);
+    d->serial = 0;
+    d->latestSerial = NULL;
 }
 
 static void deinit_LookupJob(iLookupJob *d) {
@@ -64,10 +68,15 @@ static void deinit_LookupJob(iLookupJob *d) {
     deinit_PtrArray(&d->results);
     iRelease(d->docs);
     iRelease(d->term);
+    iRelease(d->words);
 }
 
 iDefineTypeConstruction(LookupJob)
 
+static iBool isCancelled_LookupJob_(const iLookupJob *d) {
+    return value_Atomic(d->latestSerial) != d->serial;
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(LookupItem)
@@ -153,6 +162,8 @@ struct Impl_LookupWidget {
     iString      pendingTerm;
     iObjectList *pendingDocs;
     iLookupJob * finishedJob;
+    iAtomicInt   jobSerial; /* incremented when a new term is submitted */
+    iBool        isQuitting;
 };
 
 static float scoreMatch_(const iRegExp *pattern, iRangecc text) {
@@ -166,26 +177,19 @@ static float scoreMatch_(const iRegExp *pattern, iRangecc text) {
     return score;
 }
 
-static float bookmarkRelevance_LookupJob_(const iLookupJob *d, const iBookmark *bm) {
-    if (isFolder_Bookmark(bm)) {
-        return 0.0f;
-    }
-    iUrl parts;
-    init_Url(&parts, &bm->url);
-    const float t = scoreMatch_(d->term, range_String(&bm->title));
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
+static float bookmarkRelevance_LookupJob_(const iLookupJob *d, const iLookupIndexEntry *bm) {
+    const float t = scoreMatch_(d->term, range_String(&bm->label));
+    const float h = scoreMatch_(d->term, bm->host);
+    const float p = scoreMatch_(d->term, bm->path);
     const float g = scoreMatch_(d->term, range_String(&bm->tags));
     return h + iMax(p, t) + 2 * g; /* extra weight for tags */
 }
 
-static float feedEntryRelevance_LookupJob_(const iLookupJob *d, const iFeedEntry *entry) {
-    iUrl parts;
-    init_Url(&parts, &entry->url);
-    const float t = scoreMatch_(d->term, range_String(&entry->title));
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
-    const double age = secondsSince_Time(&d->now, &entry->posted) / 3600.0 / 24.0; /* days */
+static float feedEntryRelevance_LookupJob_(const iLookupJob *d, const iLookupIndexEntry *entry) {
+    const float t = scoreMatch_(d->term, range_String(&entry->label));
+    const float h = scoreMatch_(d->term, entry->host);
+    const float p = scoreMatch_(d->term, entry->path);
+    const double age = secondsSince_Time(&d->now, &entry->when) / 3600.0 / 24.0; /* days */
     return (t * 3 + h + p) / (age + 1); /* extra weight for title, recency */
 }
 
@@ -197,78 +201,52 @@ static float identityRelevance_LookupJob_(const iLookupJob *d, const iGmIdentity
     return c + 2 * n; /* extra weight for notes */
 }
 
-static float visitedRelevance_LookupJob_(const iLookupJob *d, const iVisitedUrl *vis) {
-    iUrl parts;
-    init_Url(&parts, &vis->url);
-    const float h = scoreMatch_(d->term, parts.host);
-    const float p = scoreMatch_(d->term, parts.path);
+static float visitedRelevance_LookupJob_(const iLookupJob *d, const iLookupIndexEntry *vis) {
+    const float h = scoreMatch_(d->term, vis->host);
+    const float p = scoreMatch_(d->term, vis->path);
     const double age = secondsSince_Time(&d->now, &vis->when) / 3600.0 / 24.0; /* days */
     return iMax(h, p) / (age + 1); /* extra weight for recency */
 }
 
-static iBool matchBookmark_LookupJob_(void *context, const iBookmark *bm) {
-    return bookmarkRelevance_LookupJob_(context, bm) > 0;
-}
-
 static iBool matchIdentity_LookupJob_(void *context, const iGmIdentity *identity) {
     return identityRelevance_LookupJob_(context, identity) > 0;
 }
 
-static void searchBookmarks_LookupJob_(iLookupJob *d) {
+static iBool matchIndexEntry_LookupJob_(void *context, const iLookupIndexEntry *entry) {
     /* Note: Called in a background thread. */
-    /* TODO: Thread safety! What if a bookmark gets deleted while its being accessed here? */
-    iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, matchBookmark_LookupJob_, d)) {
-        const iBookmark *bm  = i.ptr;
-        iLookupResult *  res = new_LookupResult();
-        res->type            = bookmark_LookupResultType;
-        res->when            = bm->when;
-        res->relevance       = bookmarkRelevance_LookupJob_(d, bm);
-        res->icon            = bm->icon;
-        set_String(&res->label, &bm->title);
-        set_String(&res->url, &bm->url);
-        set_String(&res->meta, &bm->identity);
-        pushBack_PtrArray(&d->results, res);
+    iLookupJob *d = context;
+    float relevance = 0.0f;
+    switch (entry->type) {
+        case bookmark_LookupResultType:
+            relevance = bookmarkRelevance_LookupJob_(d, entry);
+            break;
+        case feedEntry_LookupResultType:
+            relevance = feedEntryRelevance_LookupJob_(d, entry);
+            break;
+        case history_LookupResultType:
+            relevance = visitedRelevance_LookupJob_(d, entry);
+            break;
+        default:
+            break;
     }
-}
-
-static void searchFeeds_LookupJob_(iLookupJob *d) {
-    iConstForEach(PtrArray, i, listEntries_Feeds()) {
-        const iFeedEntry *entry = i.ptr;
-        const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
-        if (!bm) {
-            continue;
-        }
-        const float relevance = feedEntryRelevance_LookupJob_(d, entry);
-        if (relevance > 0) {
-            iLookupResult *res = new_LookupResult();
-            res->type          = feedEntry_LookupResultType;
-            res->when          = entry->posted;
-            res->relevance     = relevance;
-            set_String(&res->url, &entry->url);
-            set_String(&res->meta, &bm->title);
-            set_String(&res->label, &entry->title);
-            res->icon = bm->icon;
-            pushBack_PtrArray(&d->results, res);
-        }
+    if (relevance > 0) {
+        iLookupResult *res = new_LookupResult();
+        res->type          = entry->type;
+        res->relevance     = relevance;
+        res->icon          = entry->icon;
+        res->when          = entry->when;
+        set_String(&res->label, &entry->label);
+        set_String(&res->url, &entry->url);
+        set_String(&res->meta, &entry->meta);
+        pushBack_PtrArray(&d->results, res);
     }
+    return !isCancelled_LookupJob_(d);
 }
 
-static void searchVisited_LookupJob_(iLookupJob *d) {
+static void searchIndex_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
-    /* TODO: Thread safety! Visited URLs may be deleted while being accessed here. */
-    iConstForEach(PtrArray, i, list_Visited(visited_App(), 0)) {
-        const iVisitedUrl *vis = i.ptr;
-        const float relevance = visitedRelevance_LookupJob_(d, vis);
-        if (relevance > 0) {
-            iLookupResult *res = new_LookupResult();
-            res->type = history_LookupResultType;
-            res->relevance = relevance;
-            set_String(&res->label, &vis->url);
-            set_String(&res->url, &vis->url);
-            res->when = vis->when;
-            pushBack_PtrArray(&d->results, res);
-        }
-    }
+    /* Bookmarks, feed entries, and visited URLs. */
+    search_LookupIndex(lookupIndex_App(), d->words, matchIndexEntry_LookupJob_, d);
 }
 
 static void searchHistory_LookupJob_(iLookupJob *d) {
@@ -276,7 +254,7 @@ static void searchHistory_LookupJob_(iLookupJob *d) {
     size_t index = 0;
     iForEach(ObjectList, i, d->docs) {
         iConstForEach(StringArray, j,
-                      searchContents_History(history_DocumentWidget(i.object), d->term)) {
+                      searchContents_History(history_DocumentWidget(i.object), d->term, d->words)) {
             const char *match = cstr_String(j.value);
             const size_t matchLen = argLabel_Command(match, "len");
             iRangecc text;
@@ -318,11 +296,15 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
 //    printf("[LookupWidget] worker is running\n"); fflush(stdout);
     lock_Mutex(d->mtx);
     for (;;) {
-        wait_Condition(&d->jobAvailable, d->mtx);
-        if (isEmpty_String(&d->pendingTerm)) {
-            break; /* Time to quit. */
+        while (!d->isQuitting && isEmpty_String(&d->pendingTerm)) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (d->isQuitting) {
+            break;
         }
         iLookupJob *job = new_LookupJob();
+        job->serial = value_Atomic(&d->jobSerial);
+        job->latestSerial = &d->jobSerial;
         /* Make a regular expression to search for multiple alternative words. */ {
             iString *pattern = new_String();
             iRangecc word = iNullRange;
@@ -333,6 +315,7 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
                 if (isEmpty_Range(&word)) continue;
                 if (!isFirst) appendCStr_String(pattern, ".*");
                 setRange_String(&wordStr, word);
+                pushBack_StringArray(job->words, &wordStr);
                 iConstForEach(String, ch, &wordStr) {
                     /* Escape regular expression characters. */
                     if (isSyntaxChar_RegExp(ch.value)) {
@@ -353,16 +336,21 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
         d->pendingDocs = NULL;
         unlock_Mutex(d->mtx);
         /* Do the lookup. */ {
-            searchBookmarks_LookupJob_(job);
-            searchFeeds_LookupJob_(job);
-            searchVisited_LookupJob_(job);
-            if (termLen >= 3) {
+            searchIndex_LookupJob_(job);
+            if (termLen >= 3 && !isCancelled_LookupJob_(job)) {
                 searchHistory_LookupJob_(job);
             }
-            searchIdentities_LookupJob_(job);
+            if (!isCancelled_LookupJob_(job)) {
+                searchIdentities_LookupJob_(job);
+            }
         }
         /* Submit the result. */
         lock_Mutex(d->mtx);
+        if (isCancelled_LookupJob_(job)) {
+            /* A newer term has been submitted already. */
+            delete_LookupJob(job);
+            continue;
+        }
         if (d->finishedJob) {
             /* Previous results haven't been taken yet. */
             delete_LookupJob(d->finishedJob);
@@ -405,6 +393,8 @@ void init_LookupWidget(iLookupWidget *d) {
     init_String(&d->pendingTerm);
     d->pendingDocs = NULL;
     d->finishedJob = NULL;
+    set_Atomic(&d->jobSerial, 0);
+    d->isQuitting = iFalse;
     updateMetrics_LookupWidget_(d);
     start_Thread(d->work);
 }
@@ -414,6 +404,8 @@ void deinit_LookupWidget(iLookupWidget *d) {
         iGuardMutex(d->mtx, {
             iReleasePtr(&d->pendingDocs);
             clear_String(&d->pendingTerm);
+            d->isQuitting = iTrue;
+            add_Atomic(&d->jobSerial, 1); /* cancel ongoing lookup */
             signal_Condition(&d->jobAvailable);
         });
         join_Thread(d->work);
@@ -426,10 +418,14 @@ void deinit_LookupWidget(iLookupWidget *d) {
 }
 
 void submit_LookupWidget(iLookupWidget *d, const iString *term) {
+    /* An ongoing search must stop before the index can be updated. */
+    add_Atomic(&d->jobSerial, 1);
+    update_LookupIndex(lookupIndex_App());
     iGuardMutex(d->mtx, {
         set_String(&d->pendingTerm, term);
         trim_String(&d->pendingTerm);
         iReleasePtr(&d->pendingDocs);
+        add_Atomic(&d->jobSerial, 1); /* cancel ongoing lookup */
         if (!isEmpty_String(&d->pendingTerm)) {
             d->pendingDocs = listDocuments_App(get_Root()); /* holds reference to all open tabs */
             signal_Condition(&d->jobAvailable);
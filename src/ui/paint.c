@@ -46,6 +46,17 @@ void init_Paint(iPaint *d) {
     d->alpha     = 255;
 }
 
+static iRect drawDamage_Paint_(const iPaint *d) {
+    /* Only the damaged part of the main window's back buffer is being redrawn. Other render
+       targets are drawn without limits. */
+    const iWindow *win = d->dst;
+    if (win && type_Window(win) == main_WindowType && !isEmpty_Rect(win->drawDamage) &&
+        SDL_GetRenderTarget(win->render) == ((const iMainWindow *) win)->backBuf) {
+        return win->drawDamage;
+    }
+    return zero_Rect();
+}
+
 void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
     SDL_Renderer *rend = renderer_Paint_(d);
     if (!d->setTarget) {
@@ -67,11 +78,24 @@ void endTarget_Paint(iPaint *d) {
         d->oldOrigin = zero_I2();
         d->oldTarget = NULL;
         d->setTarget = NULL;        
+        restoreDamageClip_Paint();
+    }
+}
+
+void restoreDamageClip_Paint(void) {
+    /* Changing the render target disables clipping, but drawing must not go outside the
+       damaged area. */
+    iPaint p;
+    init_Paint(&p);
+    const iRect damage = drawDamage_Paint_(&p);
+    if (!isEmpty_Rect(damage)) {
+        SDL_RenderSetClipRect(renderer_Paint_(&p), (const SDL_Rect *) &damage);
     }
 }
 
 void setClip_Paint(iPaint *d, iRect rect) {
     addv_I2(&rect.pos, origin_Paint);
+    const iRect damage = drawDamage_Paint_(d);
     iRect targetRect = zero_Rect();
     SDL_Texture *target = SDL_GetRenderTarget(renderer_Paint_(d));
     if (target) {
@@ -82,8 +106,12 @@ void setClip_Paint(iPaint *d, iRect rect) {
     if (isEqual_I2(zero_I2(), origin_Paint)) {
         rect = intersect_Rect(rect, rect_Root(get_Root()));
     }
+    if (!isEmpty_Rect(damage)) {
+        rect = intersect_Rect(rect, damage);
+    }
     if (isEmpty_Rect(rect)) {
-        rect = init_Rect(0, 0, 1, 1);
+        /* Keep stray pixels inside the area being redrawn. */
+        rect = (iRect){ damage.pos, one_I2() };
     }
     SDL_RenderSetClipRect(renderer_Paint_(d), (const SDL_Rect *) &rect);
 }
@@ -93,6 +121,10 @@ void unsetClip_Paint(iPaint *d) {
         setClip_Paint(d, rect_Root(get_Root()));
         return;
     }
+    if (!isEmpty_Rect(drawDamage_Paint_(d))) {
+        setClip_Paint(d, current_Root() ? rect_Root(get_Root()) : (iRect){ zero_I2(), d->dst->size });
+        return;
+    }
 #if SDL_VERSION_ATLEAST(2, 0, 12)
     SDL_RenderSetClipRect(renderer_Paint_(d), NULL);
 #else
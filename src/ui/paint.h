@@ -43,6 +43,7 @@ void    init_Paint          (iPaint *);
 
 void    beginTarget_Paint   (iPaint *, SDL_Texture *target);
 void    endTarget_Paint     (iPaint *);
+void    restoreDamageClip_Paint (void); /* after switching back to the window's render target */
 
 void    setClip_Paint       (iPaint *, iRect rect);
 void    unsetClip_Paint     (iPaint *);
@@ -133,6 +133,7 @@ struct Impl_SidebarWidget {
     iSidebarItem *    contextItem;  /* list item accessed in the context menu */
     size_t            contextIndex; /* index of list item accessed in the context menu */
     iIntSet *         closedFolders; /* otherwise open */
+    uint32_t          historySerial; /* Visited serial that history items are up to date with */
 };
 
 iDefineObjectConstructionArgs(SidebarWidget, (enum iSidebarSide side), side)
@@ -282,6 +283,138 @@ static const iMenuItem bookmarkModeMenuItems_[] = {
     { reload_Icon " ${bookmarks.reload}", 0, 0, "bookmarks.reload.remote" }
 };
 
+static const size_t maxHistoryItems_SidebarWidget_ = 200;
+
+static iBool isSameDay_Date_(const iDate *a, const iDate *b) {
+    return a->day == b->day && a->month == b->month && a->year == b->year;
+}
+
+static iSidebarItem *newHistoryItem_SidebarWidget_(const iVisitedUrl *visit) {
+    iSidebarItem *item = new_SidebarItem();
+    set_String(&item->url, &visit->url);
+    set_String(&item->label, &visit->url);
+    if (prefs_App()->decodeUserVisibleURLs) {
+        urlDecodePath_String(&item->label);
+    }
+    else {
+        urlEncodePath_String(&item->label);
+    }
+    return item;
+}
+
+static void insertDateSeparator_SidebarWidget_(iSidebarWidget *d, size_t index, const iDate *date) {
+    iDate today;
+    initCurrent_Date(&today);
+    iSidebarItem *sep = new_SidebarItem();
+    sep->listItem.isSeparator = iTrue;
+    const iString *text = collect_String(
+        format_Date(date,
+                    cstr_Lang(date->year != today.year ? "sidebar.date.otheryear"
+                                                       : "sidebar.date.thisyear")));
+    set_String(&sep->meta, text);
+    const int yOffset = itemHeight_ListWidget(d->list) * 2 / 3;
+    sep->id = yOffset;
+    insertItem_ListWidget(d->list, index, sep);
+    iRelease(sep);
+    /* Date separators are two items tall. */
+    sep = new_SidebarItem();
+    sep->listItem.isSeparator = iTrue;
+    sep->id = -itemHeight_ListWidget(d->list) + yOffset;
+    set_String(&sep->meta, text);
+    insertItem_ListWidget(d->list, index + 1, sep);
+    iRelease(sep);
+}
+
+static iBool isSeparator_SidebarWidget_(const iSidebarWidget *d, size_t index) {
+    return index < numItems_ListWidget(d->list) &&
+           ((const iListItem *) constItem_ListWidget(d->list, index))->isSeparator;
+}
+
+static void removeHistoryItem_SidebarWidget_(iSidebarWidget *d, size_t index) {
+    removeItem_ListWidget(d->list, index);
+    /* A date separator without any items is removed as well. */
+    if (index >= 2 && isSeparator_SidebarWidget_(d, index - 1) &&
+        (index == numItems_ListWidget(d->list) || isSeparator_SidebarWidget_(d, index))) {
+        removeItem_ListWidget(d->list, index - 1);
+        removeItem_ListWidget(d->list, index - 2);
+    }
+}
+
+static iBool updateHistoryItems_SidebarWidget_(iSidebarWidget *d) {
+    /* New visits are moved to the top of the list instead of recreating all the items. */
+    const iPtrArray *visits = listNewestSince_Visited(visited_App(), d->historySerial);
+    if (!visits || isEmpty_ListWidget(d->list)) {
+        return iFalse;
+    }
+    d->historySerial = serial_Visited(visited_App());
+    if (isEmpty_PtrArray(visits)) {
+        return iTrue;
+    }
+    iConstForEach(PtrArray, i, visits) {
+        const iVisitedUrl *visit = i.ptr;
+        for (size_t j = 0; j < numItems_ListWidget(d->list); j++) {
+            const iSidebarItem *item = constItem_ListWidget(d->list, j);
+            if (!item->listItem.isSeparator && equal_String(&item->url, &visit->url)) {
+                removeHistoryItem_SidebarWidget_(d, j);
+                break;
+            }
+        }
+    }
+    iDate today;
+    initCurrent_Date(&today);
+    /* Items of the current day have no separator, so the day must not have changed. */
+    if (!isEmpty_ListWidget(d->list) && !isSeparator_SidebarWidget_(d, 0)) {
+        const iSidebarItem *first = constItem_ListWidget(d->list, 0);
+        const iTime when = urlVisitTime_Visited(visited_App(), &first->url);
+        iDate date;
+        init_Date(&date, &when);
+        if (!isSameDay_Date_(&date, &today)) {
+            return iFalse;
+        }
+    }
+    for (size_t i = size_PtrArray(visits); i > 0; i--) {
+        const iVisitedUrl *visit = constAt_PtrArray(visits, i - 1); /* oldest first */
+        if (visit->flags & transient_VisitedUrlFlag) {
+            continue;
+        }
+        iDate date;
+        init_Date(&date, &visit->when);
+        size_t pos = 0;
+        if (!isSameDay_Date_(&date, &today)) {
+            iDate top = today;
+            if (isSeparator_SidebarWidget_(d, 0)) {
+                const iSidebarItem *first = constItem_ListWidget(d->list, 2);
+                const iTime when = urlVisitTime_Visited(visited_App(), &first->url);
+                init_Date(&top, &when);
+            }
+            if (!isSameDay_Date_(&date, &top)) {
+                insertDateSeparator_SidebarWidget_(d, 0, &date);
+            }
+            pos = 2; /* after the separator */
+        }
+        iSidebarItem *item = newHistoryItem_SidebarWidget_(visit);
+        insertItem_ListWidget(d->list, pos, item);
+        iRelease(item);
+    }
+    /* Drop the oldest items beyond the maximum. */
+    size_t numVisits = 0;
+    for (size_t i = 0; i < numItems_ListWidget(d->list); i++) {
+        if (!isSeparator_SidebarWidget_(d, i) && ++numVisits > maxHistoryItems_SidebarWidget_) {
+            while (numItems_ListWidget(d->list) > i) {
+                removeItem_ListWidget(d->list, numItems_ListWidget(d->list) - 1);
+            }
+            break;
+        }
+    }
+    while (isSeparator_SidebarWidget_(d, numItems_ListWidget(d->list) - 1)) {
+        removeItem_ListWidget(d->list, numItems_ListWidget(d->list) - 1);
+    }
+    updateVisible_ListWidget(d->list);
+    invalidate_ListWidget(d->list);
+    updateMouseHover_ListWidget(d->list);
+    return iTrue;
+}
+
 static void updateItemsWithFlags_SidebarWidget_(iSidebarWidget *d, iBool keepActions) {
     const iBool isMobile = (deviceType_App() != desktop_AppDeviceType);
     clear_ListWidget(d->list);
@@ -580,42 +713,16 @@ static void updateItemsWithFlags_SidebarWidget_(iSidebarWidget *d, iBool keepAct
         case history_SidebarMode: {
             iDate on;
             initCurrent_Date(&on);
-            const int thisYear = on.year;
-            iConstForEach(PtrArray, i, list_Visited(visited_App(), 200)) {
+            d->historySerial = serial_Visited(visited_App());
+            iConstForEach(PtrArray, i, list_Visited(visited_App(), maxHistoryItems_SidebarWidget_)) {
                 const iVisitedUrl *visit = i.ptr;
-                iSidebarItem *item = new_SidebarItem();
-                set_String(&item->url, &visit->url);
-                set_String(&item->label, &visit->url);
-                if (prefs_App()->decodeUserVisibleURLs) {
-                    urlDecodePath_String(&item->label);
-                }
-                else {
-                    urlEncodePath_String(&item->label);
-                }
                 iDate date;
                 init_Date(&date, &visit->when);
-                if (date.day != on.day || date.month != on.month || date.year != on.year) {
+                if (!isSameDay_Date_(&date, &on)) {
                     on = date;
-                    /* Date separator. */
-                    iSidebarItem *sep = new_SidebarItem();
-                    sep->listItem.isSeparator = iTrue;
-                    const iString *text = collect_String(
-                        format_Date(&date,
-                                    cstr_Lang(date.year != thisYear ? "sidebar.date.otheryear"
-                                                                    : "sidebar.date.thisyear")));
-                    set_String(&sep->meta, text);
-                    const int yOffset = itemHeight_ListWidget(d->list) * 2 / 3;
-                    sep->id = yOffset;
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
-                    /* Date separators are two items tall. */
-                    sep = new_SidebarItem();
-                    sep->listItem.isSeparator = iTrue;
-                    sep->id = -itemHeight_ListWidget(d->list) + yOffset;
-                    set_String(&sep->meta, text);
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
+                    insertDateSeparator_SidebarWidget_(d, numItems_ListWidget(d->list), &date);
                 }
+                iSidebarItem *item = newHistoryItem_SidebarWidget_(visit);
                 addItem_ListWidget(d->list, item);
                 iRelease(item);
             }
@@ -866,6 +973,7 @@ void init_SidebarWidget(iSidebarWidget *d, enum iSidebarSide side) {
     d->midHeight = 0;
     d->isEditing = iFalse;
     d->numUnreadEntries = 0;
+    d->historySerial = 0;
     d->buttonFont = uiLabel_FontId; /* wiil be changed later */
     d->itemFonts[0] = uiContent_FontId;
     d->itemFonts[1] = uiContentBold_FontId;
@@ -1205,7 +1313,7 @@ iBool handleBookmarkEditorCommands_SidebarWidget_(iWidget *editor, const char *c
             iBookmark *bm = get_Bookmarks(bookmarks_App(), bmId);
             set_String(&bm->title, title);
             if (!isFolder_Bookmark(bm)) {
-                set_String(&bm->url, url);
+                setUrl_Bookmarks(bookmarks_App(), bmId, url);
                 set_String(&bm->tags, tags);
                 set_String(&bm->notes, notes);
                 if (isEmpty_String(icon)) {
@@ -1517,6 +1625,11 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             updateItems_SidebarWidget_(d);
             scrollOffset_ListWidget(d->list, 0);
         }
+        else if (equal_Command(cmd, "document.layout.finished") &&
+                 d->mode == documentOutline_SidebarMode &&
+                 pointerLabel_Command(cmd, "doc") == document_App()) {
+            updateItems_SidebarWidget_(d); /* headings of a long document were laid out in steps */
+        }
         else if (equal_Command(cmd, "sidebar.update")) {
             d->numUnreadEntries = numUnread_Feeds();
             checkModeButtonLayout_SidebarWidget_(d);
@@ -1525,7 +1638,8 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
         else if (equal_Command(cmd, "visited.changed")) {
             d->numUnreadEntries = numUnread_Feeds();
             checkModeButtonLayout_SidebarWidget_(d);
-            if (d->mode == history_SidebarMode || d->mode == feeds_SidebarMode) {
+            if (d->mode == feeds_SidebarMode ||
+                (d->mode == history_SidebarMode && !updateHistoryItems_SidebarWidget_(d))) {
                 updateItems_SidebarWidget_(d);
             }
         }
@@ -1811,7 +1925,8 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             }
             return iTrue;
         }
-        else if (equal_Command(cmd, "feeds.update.finished")) {
+        else if (equal_Command(cmd, "feeds.update.finished") ||
+                 equal_Command(cmd, "feeds.update.loaded")) {
             d->numUnreadEntries = argLabel_Command(cmd, "unread");
             checkModeButtonLayout_SidebarWidget_(d);
             if (d->mode == feeds_SidebarMode) {
@@ -358,6 +358,7 @@ void init_TextBuf(iTextBuf *d, iWrapText *wrapText, int font, int color) {
         draw_WrapText(wrapText, font, zero_I2(), color | fillBackground_ColorId);
         SDL_SetRenderTarget(render, oldTarget);
         origin_Paint = oldOrigin;
+        restoreDamageClip_Paint();
         SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
         setBaseAttributes_Text(-1, -1);
     }
@@ -79,6 +79,31 @@ void    resetMissing_Text       (iText *);
 iBool   checkMissing_Text       (void); /* returns the flag, and clears it */
 SDL_Texture *glyphCache_Text    (void);
 
+iDeclareType(GlyphCacheStats)
+
+struct Impl_GlyphCacheStats {
+    uint32_t hits;      /* glyph drawn from an atlas page */
+    uint32_t misses;    /* glyph had to be rasterized */
+    uint32_t evictions; /* atlas page cleared for reuse */
+    size_t   numPages;
+};
+
+iGlyphCacheStats glyphCacheStats_Text(void);
+
+iDeclareType(FontRunCacheStats)
+
+struct Impl_FontRunCacheStats {
+    uint32_t hits;
+    uint32_t lookups;
+    size_t   size;    /* bytes */
+    size_t   numRuns;
+};
+
+/* Shaped text runs used while `owner` is pinning are not evicted until released. */
+void    pinFontRuns_Text        (const void *owner); /* NULL to stop pinning */
+void    releaseFontRuns_Text    (const void *owner);
+iFontRunCacheStats fontRunCacheStats_Text(void);
+
 /*----------------------------------------------------------------------------------------------*/
 
 int     lineHeight_Text         (int fontId);
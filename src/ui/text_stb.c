@@ -24,7 +24,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 - Text : top-level text renderer instance (one per window)
 - Font : a font's assets for rendering, e.g., metrics and cached glyphs
-- Glyph : hash node; a single cached glyph, with Rect in cache texture
+- Glyph : hash node; a single cached glyph, with Rect in a glyph atlas page
+- GlyphAtlasPage : one cache texture where glyphs are packed in rows of similar height
 - AttributedText : text string to be drawn that is split into sub-runs by attributes (font, color)
 - AttributedRun : a run inside AttributedText
 - GlyphBuffer : HarfBuzz-shaped glyphs corresponding to an AttributedRun
@@ -93,6 +94,7 @@ enum iGlyphFlag {
     rasterized1_GlyphFlag = iBit(2),    /* quarter pixel offset */
     rasterized2_GlyphFlag = iBit(3),    /* half-pixel offset */
     rasterized3_GlyphFlag = iBit(4),    /* three quarters offset */
+    allocated_GlyphFlag   = iBit(5),    /* has a position in an atlas page */
 };
 
 int   enableHalfPixelGlyphs_Text    = iTrue; /* debug setting */
@@ -126,6 +128,7 @@ struct Impl_Glyph {
     float     advance; /* scaled */
     iRect     rect[4]; /* zero and half pixel offset */
     iInt2     d[4];
+    int       page;    /* atlas page of `rect` */
 };
 
 void init_Glyph(iGlyph *d, uint32_t glyphIndex) {
@@ -135,6 +138,7 @@ void init_Glyph(iGlyph *d, uint32_t glyphIndex) {
     d->advance    = 0.0f;
     iZap(d->rect);
     iZap(d->d);
+    d->page       = 0;
 }
 
 void deinit_Glyph(iGlyph *d) {
@@ -157,6 +161,10 @@ iLocalDef void setRasterized_Glyph_(iGlyph *d, int hoff) {
     d->flags |= rasterized0_GlyphFlag << hoff;
 }
 
+iLocalDef iBool isAllocated_Glyph_(const iGlyph *d) {
+    return (d->flags & allocated_GlyphFlag) != 0;
+}
+
 iDefineTypeConstructionArgs(Glyph, (iChar ch), ch)
     
 /*-----------------------------------------------------------------------------------------------*/
@@ -256,6 +264,25 @@ struct Impl_CacheRow {
     iInt2 pos;
 };
 
+iDeclareType(GlyphAtlasPage)
+
+struct Impl_GlyphAtlasPage {
+    SDL_Texture *texture;
+    iArray       rows;     /* CacheRow for each row height */
+    int          bottom;
+    iPtrArray    glyphs;   /* glyphs allocated on this page */
+    uint32_t     lastUsed; /* for choosing which page to evict */
+};
+
+iDeclareType(GlyphDraw)
+
+struct Impl_GlyphDraw {
+    int      page;
+    SDL_Rect src;
+    SDL_Rect dst;
+    iColor   color;
+};
+
 iDeclareType(PrioMapItem)
 struct Impl_PrioMapItem {
     int      priority;
@@ -279,18 +306,31 @@ struct Impl_StbText {
     iArray         fonts; /* fonts currently selected for use (incl. all styles/sizes) */
     int            overrideFontId; /* always checked for glyphs first, regardless of which font is used */    
     iArray         fontPriorityOrder;
-    SDL_Texture *  cache;
-    iInt2          cacheSize;
+    iPtrArray      cachePages; /* GlyphAtlasPage */
+    int            cachePage;  /* page where new glyphs are allocated */
+    iInt2          cacheSize;  /* of each page */
     int            cacheRowAllocStep;
-    int            cacheBottom;
-    iArray         cacheRows;
+    uint32_t       cacheUseCounter;
+    uint8_t        cacheAlpha;
+    iColor         glyphColor;
+    iArray         glyphDraws; /* GlyphDraw: foreground glyphs batched by page */
+    iGlyphCacheStats cacheStats;
     SDL_Palette *  grayscale;
     SDL_Palette *  blackAndWhite; /* unsmoothed glyph palette */
     iBool          missingGlyphs;  /* true if a glyph couldn't be found */
     iChar          missingChars[20]; /* rotating buffer of the latest missing characters */
-    iFontRun *     cachedFontRuns[16]; /* recently generated HarfBuzz glyph buffers */
+    iHash          fontRuns;       /* recently generated HarfBuzz glyph buffers */
+    iFontRun *     fontRunsMru;    /* FontRuns are linked in the order of use */
+    iFontRun *     fontRunsLru;
+    size_t         fontRunsSize;   /* bytes */
+    size_t         fontRunsPinnedSize; /* bytes */
+    const void *   fontRunsPinOwner; /* new and found FontRuns are pinned to this owner */
+    iFontRunCacheStats fontRunStats;
 };
 
+static void clearFontRuns_StbText_(iStbText *d);
+static void removeFontRunPins_StbText_(const iStbText *d);
+
 iLocalDef iStbText *current_StbText_(void) {
     return (iStbText *) current_Text();
 }
@@ -387,8 +427,51 @@ static int maxGlyphHeight_Text_(const iText *d) {
     return 4 * d->contentFontSize * fontSize_UI;
 }
 
+static const size_t maxCachePages_StbText_ = 4;
+
+static iGlyphAtlasPage *addCachePage_StbText_(iStbText *d) {
+    iGlyphAtlasPage *page = iMalloc(GlyphAtlasPage);
+    init_Array(&page->rows, sizeof(iCacheRow));
+    const int textSize = d->base.contentFontSize * fontSize_UI;
+    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
+       once at least one glyph is stored. */
+    for (int h = d->cacheRowAllocStep;
+         h <= 5 * textSize + d->cacheRowAllocStep;
+         h += d->cacheRowAllocStep) {
+        pushBack_Array(&page->rows, &(iCacheRow){ .height = 0 });
+    }
+    page->bottom = 0;
+    init_PtrArray(&page->glyphs);
+    page->lastUsed = d->cacheUseCounter;
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    page->texture = SDL_CreateTexture(d->base.render,
+                                      SDL_PIXELFORMAT_RGBA4444,
+                                      SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                      d->cacheSize.x,
+                                      d->cacheSize.y);
+    SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureAlphaMod(page->texture, d->cacheAlpha);
+    SDL_SetTextureColorMod(page->texture, d->glyphColor.r, d->glyphColor.g, d->glyphColor.b);
+    pushBack_PtrArray(&d->cachePages, page);
+    d->cacheStats.numPages = size_PtrArray(&d->cachePages);
+    return page;
+}
+
+static void clearCachePage_StbText_(iStbText *d, iGlyphAtlasPage *page) {
+    /* The glyphs will be rasterized again when needed. */
+    iForEach(PtrArray, i, &page->glyphs) {
+        ((iGlyph *) i.ptr)->flags = 0;
+    }
+    clear_PtrArray(&page->glyphs);
+    iForEach(Array, r, &page->rows) {
+        *(iCacheRow *) r.value = (iCacheRow){ .height = 0 };
+    }
+    page->bottom = 0;
+    d->cacheStats.evictions++;
+}
+
 static void initCache_StbText_(iStbText *d) {
-    init_Array(&d->cacheRows, sizeof(iCacheRow));
+    init_PtrArray(&d->cachePages);
     const int textSize = d->base.contentFontSize * fontSize_UI;
     iAssert(textSize > 0);
     numOffsetSteps_Glyph_   = get_Window()->pixelRatio < 2.0f   ? 4
@@ -407,26 +490,70 @@ static void initCache_StbText_(iStbText *d) {
         d->cacheSize.x = renderInfo.max_texture_width;
     }
     d->cacheRowAllocStep = iMax(2, textSize / 6);
-    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
-       once at least one glyph is stored. */
-    for (int h = d->cacheRowAllocStep;
-         h <= 5 * textSize + d->cacheRowAllocStep;
-         h += d->cacheRowAllocStep) {
-        pushBack_Array(&d->cacheRows, &(iCacheRow){ .height = 0 });
-    }
-    d->cacheBottom = 0;
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
-    d->cache = SDL_CreateTexture(d->base.render,
-                                 SDL_PIXELFORMAT_RGBA4444,
-                                 SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
-                                 d->cacheSize.x,
-                                 d->cacheSize.y);
-    SDL_SetTextureBlendMode(d->cache, SDL_BLENDMODE_BLEND);
+    /* More pages are added when the first one fills up. */
+    addCachePage_StbText_(d);
+    d->cachePage = 0;
 }
 
 static void deinitCache_StbText_(iStbText *d) {
-    deinit_Array(&d->cacheRows);
-    SDL_DestroyTexture(d->cache);
+    iForEach(PtrArray, i, &d->cachePages) {
+        iGlyphAtlasPage *page = i.ptr;
+        SDL_DestroyTexture(page->texture);
+        deinit_PtrArray(&page->glyphs);
+        deinit_Array(&page->rows);
+        free(page);
+    }
+    deinit_PtrArray(&d->cachePages);
+    d->cacheStats.numPages = 0;
+}
+
+iLocalDef iGlyphAtlasPage *cachePage_StbText_(const iStbText *d, int index) {
+    return at_PtrArray((iPtrArray *) &d->cachePages, index);
+}
+
+static SDL_Texture *useCachePage_StbText_(iStbText *d, int index) {
+    iGlyphAtlasPage *page = cachePage_StbText_(d, index);
+    page->lastUsed = ++d->cacheUseCounter;
+    return page->texture;
+}
+
+static void setGlyphColor_StbText_(iStbText *d, iColor clr) {
+    /* Used when glyphs are drawn immediately instead of batched. */
+    d->glyphColor = clr;
+    iForEach(PtrArray, i, &d->cachePages) {
+        SDL_SetTextureColorMod(((iGlyphAtlasPage *) i.ptr)->texture, clr.r, clr.g, clr.b);
+    }
+}
+
+static void flushGlyphDraws_StbText_(iStbText *d) {
+    /* Glyphs are drawn grouped by page so the texture changes as rarely as possible. */
+    if (isEmpty_Array(&d->glyphDraws)) {
+        return;
+    }
+    SDL_Renderer *render = d->base.render;
+    for (size_t pageIndex = 0; pageIndex < size_PtrArray(&d->cachePages); pageIndex++) {
+        SDL_Texture *tex     = NULL;
+        iColor       lastClr = { 0, 0, 0, 0 };
+        iConstForEach(Array, i, &d->glyphDraws) {
+            const iGlyphDraw *draw = i.value;
+            if (draw->page != (int) pageIndex) {
+                continue;
+            }
+            if (!tex || memcmp(&draw->color, &lastClr, sizeof(iColor))) {
+                if (!tex) {
+                    tex = useCachePage_StbText_(d, pageIndex);
+                }
+                SDL_SetTextureColorMod(tex, draw->color.r, draw->color.g, draw->color.b);
+                lastClr = draw->color;
+            }
+            SDL_RenderCopy(render, tex, &draw->src, &draw->dst);
+        }
+        if (tex) {
+            /* Restore the default color for immediate drawing. */
+            SDL_SetTextureColorMod(tex, d->glyphColor.r, d->glyphColor.g, d->glyphColor.b);
+        }
+    }
+    clear_Array(&d->glyphDraws);
 }
 
 void init_StbText(iStbText *d, SDL_Renderer *render) {
@@ -437,7 +564,18 @@ void init_StbText(iStbText *d, SDL_Renderer *render) {
     init_Array(&d->fontPriorityOrder, sizeof(iPrioMapItem));
     d->missingGlyphs   = iFalse;
     iZap(d->missingChars);
-    iZap(d->cachedFontRuns);
+    init_Hash(&d->fontRuns);
+    d->fontRunsMru      = NULL;
+    d->fontRunsLru      = NULL;
+    d->fontRunsSize       = 0;
+    d->fontRunsPinnedSize = 0;
+    d->fontRunsPinOwner   = NULL;
+    iZap(d->fontRunStats);
+    d->cacheUseCounter = 0;
+    d->cacheAlpha      = 255;
+    d->glyphColor      = (iColor){ 255, 255, 255, 255 };
+    iZap(d->cacheStats);
+    init_Array(&d->glyphDraws, sizeof(iGlyphDraw));
     /* A grayscale palette for rasterized glyphs. */ {
         SDL_Color colors[256];
         for (int i = 0; i < 256; ++i) {
@@ -461,15 +599,20 @@ void init_StbText(iStbText *d, SDL_Renderer *render) {
 }
 
 void deinit_StbText(iStbText *d) {
-#if defined (LAGRANGE_ENABLE_HARFBUZZ)
-    iForIndices(i, d->cachedFontRuns) {
-        delete_FontRun(d->cachedFontRuns[i]);
+#if !defined (NDEBUG)
+    if (d->fontRunStats.lookups) {
+        printf("[Text] font run cache hit rate: %.1f%%\n",
+               100.0f * d->fontRunStats.hits / d->fontRunStats.lookups);
     }
 #endif
+    removeFontRunPins_StbText_(d);
+    clearFontRuns_StbText_(d);
+    deinit_Hash(&d->fontRuns);
     SDL_FreePalette(d->blackAndWhite);
     SDL_FreePalette(d->grayscale);
     deinitFonts_StbText_(d);
     deinitCache_StbText_(d);
+    deinit_Array(&d->glyphDraws);
     deinit_Array(&d->fontPriorityOrder);
     deinit_Array(&d->fonts);
     deinit_Text(&d->base);
@@ -487,13 +630,25 @@ void delete_Text(iText *d) {
 }
 
 void setOpacity_Text(float opacity) {
-    SDL_SetTextureAlphaMod(current_StbText_()->cache, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+    iStbText *d = current_StbText_();
+    flushGlyphDraws_StbText_(d); /* drawn with the previous opacity */
+    d->cacheAlpha = iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f;
+    iForEach(PtrArray, i, &d->cachePages) {
+        SDL_SetTextureAlphaMod(((iGlyphAtlasPage *) i.ptr)->texture, d->cacheAlpha);
+    }
 }
 
 static void resetCache_StbText_(iStbText *d) {
+    flushGlyphDraws_StbText_(d);
     deinitCache_StbText_(d);
+    /* Glyph metrics remain valid, only the cached rasters are lost. */
     iForEach(Array, i, &d->fonts) {
-        clearGlyphs_GlyphTable_(((iFont *) i.value)->table);
+        iGlyphTable *table = ((iFont *) i.value)->table;
+        if (table) {
+            iForEach(Hash, g, &table->glyphs) {
+                ((iGlyph *) g.value)->flags = 0; /* not allocated or rasterized */
+            }
+        }
     }
     initCache_StbText_(d);
 }
@@ -502,6 +657,8 @@ void resetFonts_Text(iText *d) {
     iText *oldActive = current_Text();
     iStbText *s = (iStbText *) d;
     setCurrent_Text(d); /* some routines rely on the global `activeText_` pointer */
+    flushGlyphDraws_StbText_(s);
+    clearFontRuns_StbText_(s); /* shaped with the old fonts */
     deinitFonts_StbText_(s);
     deinitCache_StbText_(s);
     initCache_StbText_(s);
@@ -541,42 +698,39 @@ static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, fl
 #endif
 }
 
-iLocalDef iCacheRow *cacheRow_StbText_(iStbText *d, int height) {
-    return at_Array(&d->cacheRows, (height - 1) / d->cacheRowAllocStep);
+iLocalDef iCacheRow *cacheRow_StbText_(iStbText *d, iGlyphAtlasPage *page, int height) {
+    return at_Array(&page->rows, (height - 1) / d->cacheRowAllocStep);
 }
 
 static iInt2 assignCachePos_Text_(iStbText *d, iInt2 size) {
-    iCacheRow *cur = cacheRow_StbText_(d, size.y);
+    iGlyphAtlasPage *page = cachePage_StbText_(d, d->cachePage);
+    iCacheRow *cur = cacheRow_StbText_(d, page, size.y);
     if (cur->height == 0) {
         /* Begin a new row height. */
         cur->height = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
-        cur->pos.y = d->cacheBottom;
-        d->cacheBottom = cur->pos.y + cur->height;
+        cur->pos.y = page->bottom;
+        page->bottom = cur->pos.y + cur->height;
     }
     iAssert(cur->height >= size.y);
-    /* TODO: Automatically enlarge the cache if running out of space?
-       Maybe make it paged, but beware of texture swapping too often inside a text string. */
     if (cur->pos.x + size.x > d->cacheSize.x) {
-        /* Does not fit on this row, advance to a new location in the cache. */
-        cur->pos.y = d->cacheBottom;
+        /* Does not fit on this row, advance to a new location in the page. */
+        cur->pos.y = page->bottom;
         cur->pos.x = 0;
-        d->cacheBottom += cur->height;
-        iAssert(d->cacheBottom <= d->cacheSize.y);
+        page->bottom += cur->height;
+        iAssert(page->bottom <= d->cacheSize.y);
     }
     const iInt2 assigned = cur->pos;
     cur->pos.x += size.x;
     return assigned;
 }
 
-static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
+static void measure_Font_(iFont *d, iGlyph *glyph, int hoff) {
     iRect *glRect = &glyph->rect[hoff];
     int    x0, y0, x1, y1;
     measureGlyph_FontFile(d->font.file, index_Glyph_(glyph), d->xScale, d->yScale,
                           hoff * offsetStep_Glyph_(),
                           &x0, &y0, &x1, &y1);
     glRect->size = init_I2(x1 - x0, y1 - y0);
-    /* Determine placement in the glyph cache texture, advancing in rows. */
-    glRect->pos    = assignCachePos_Text_(current_StbText_(), glRect->size);
     glyph->d[hoff] = init_I2(x0, y0);
     glyph->d[hoff].y += d->vertOffset;
     if (hoff == 0) { /* hoff>=1 uses same metrics as `glyph` */
@@ -584,6 +738,39 @@ static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
     }
 }
 
+static void reserveCachePage_StbText_(iStbText *d) {
+    /* The current page is full. Add a new page or reuse the least recently drawn one. */
+    iAssert(isEmpty_Array(&d->glyphDraws));
+    if (size_PtrArray(&d->cachePages) < maxCachePages_StbText_) {
+        addCachePage_StbText_(d);
+        d->cachePage = size_PtrArray(&d->cachePages) - 1;
+        return;
+    }
+    int lru = 0;
+    for (size_t i = 1; i < size_PtrArray(&d->cachePages); i++) {
+        if (cachePage_StbText_(d, i)->lastUsed < cachePage_StbText_(d, lru)->lastUsed) {
+            lru = i;
+        }
+    }
+#if !defined (NDEBUG)
+    printf("[Text] glyph cache is full, evicting page %d\n", lru); fflush(stdout);
+#endif
+    clearCachePage_StbText_(d, cachePage_StbText_(d, lru));
+    d->cachePage = lru;
+}
+
+static void allocate_Font_(iFont *d, iGlyph *glyph) {
+    /* Determine placement in the current atlas page, advancing in rows. */
+    iStbText *tx = current_StbText_();
+    for (int hoff = 0; hoff < numOffsetSteps_Glyph_; hoff++) {
+        glyph->rect[hoff].pos = assignCachePos_Text_(tx, glyph->rect[hoff].size);
+    }
+    glyph->page = tx->cachePage;
+    glyph->flags |= allocated_GlyphFlag;
+    pushBack_PtrArray(&cachePage_StbText_(tx, tx->cachePage)->glyphs, glyph);
+    iUnused(d);
+}
+
 iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
     if (isVariationSelector_Char(ch)) {
         return d;
@@ -645,6 +832,9 @@ iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
 }
 
 static iGlyph *glyphByIndex_Font_(iFont *d, uint32_t glyphIndex) {
+    /* Only the metrics of the glyph are needed for measuring and laying out text. A position
+       in the cache texture is reserved when the glyph actually gets rasterized, so measuring
+       a long document does not fill up (or reset) the cache. */
     if (!d->table) {
         d->table = new_GlyphTable();
     }   
@@ -654,26 +844,30 @@ static iGlyph *glyphByIndex_Font_(iFont *d, uint32_t glyphIndex) {
         glyph = node;
     }
     else {
-        iStbText *tx = current_StbText_();
-        /* If the cache is running out of space, clear it and we'll recache what's needed currently. */
-        if (tx->cacheBottom > tx->cacheSize.y - maxGlyphHeight_Text_(&tx->base)) {
-#if !defined (NDEBUG)
-            printf("[Text] glyph cache is full, clearing!\n"); fflush(stdout);
-#endif
-            resetCache_StbText_(tx);
-        }
         glyph = new_Glyph(glyphIndex);
         glyph->font = d;
-        /* New glyphs are always allocated at least. This reserves a position in the cache
-           and updates the glyph metrics. */
         for (int offsetIndex = 0; offsetIndex < numOffsetSteps_Glyph_; offsetIndex++) {
-            allocate_Font_(d, glyph, offsetIndex);
+            measure_Font_(d, glyph, offsetIndex);
         }
         insert_Hash(&d->table->glyphs, &glyph->node);
     }
     return glyph;
 }
 
+static iGlyph *allocatedGlyphByIndex_Font_(iFont *d, uint32_t glyphIndex) {
+    iGlyph *glyph = glyphByIndex_Font_(d, glyphIndex);
+    if (!isAllocated_Glyph_(glyph)) {
+        iStbText *tx = current_StbText_();
+        /* If the page is running out of space, continue on another one. */
+        if (cachePage_StbText_(tx, tx->cachePage)->bottom >
+            tx->cacheSize.y - maxGlyphHeight_Text_(&tx->base)) {
+            reserveCachePage_StbText_(tx);
+        }
+        allocate_Font_(d, glyph);
+    }
+    return glyph;
+}
+
 static iGlyph *glyph_Font_(iFont *d, iChar ch) {
     /* The glyph may actually come from a different font; look up the right font. */
     uint32_t glyphIndex = 0;
@@ -722,17 +916,21 @@ static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t num
     iArray *     rasters = NULL;
     SDL_Texture *oldTarget = NULL;
     iBool        isTargetChanged = iFalse;
+    iStbText *   tx      = current_StbText_();
     iAssert(isExposed_Window(get_Window()));
+    /* Pending glyph draws must be done before any page gets evicted or the render target
+       is changed. */
+    flushGlyphDraws_StbText_(tx);
     /* We'll flush the buffered rasters periodically until everything is cached. */
     size_t index = 0;
     while (index < numGlyphIndices) {
         for (; index < numGlyphIndices; index++) {
             const uint32_t glyphIndex = glyphIndices[index];
-            const int lastCacheBottom = current_StbText_()->cacheBottom;
-            iGlyph *glyph = glyphByIndex_Font_(d, glyphIndex);
-            if (current_StbText_()->cacheBottom < lastCacheBottom) {
-                /* The cache was reset due to running out of space. We need to restart from
-                   the beginning! */
+            const uint32_t lastEvictions = tx->cacheStats.evictions;
+            iGlyph *glyph = allocatedGlyphByIndex_Font_(d, glyphIndex);
+            if (tx->cacheStats.evictions != lastEvictions) {
+                /* A page was evicted and it may have had some of the glyphs we just cached.
+                   We need to restart from the beginning! */
                 bufX = 0;
                 if (rasters) {
                     clear_Array(rasters);
@@ -742,6 +940,7 @@ static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t num
             }
             if (!isFullyRasterized_Glyph_(glyph)) {
                 /* Need to cache this. */
+                tx->cacheStats.misses++;
                 if (buf == NULL) {
                     rasters = new_Array(sizeof(iRasterGlyph));
                     buf     = SDL_CreateRGBSurfaceWithFormat(
@@ -801,11 +1000,14 @@ static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t num
             if (!isTargetChanged) {
                 isTargetChanged = iTrue;
                 oldTarget = SDL_GetRenderTarget(render);
-                SDL_SetRenderTarget(render, current_StbText_()->cache);
             }
 //            printf("copying %zu rasters from %p\n", size_Array(rasters), bufTex); fflush(stdout);
             iConstForEach(Array, i, rasters) {
                 const iRasterGlyph *rg = i.value;
+                SDL_Texture *pageTex = cachePage_StbText_(tx, rg->glyph->page)->texture;
+                if (SDL_GetRenderTarget(render) != pageTex) {
+                    SDL_SetRenderTarget(render, pageTex);
+                }
 //                iAssert(isEqual_I2(rg->rect.size, rg->glyph->rect[rg->hoff].size));
                 const iRect *glRect = &rg->glyph->rect[rg->hoff];
                 SDL_RenderCopy(render,
@@ -829,6 +1031,7 @@ static void cacheGlyphs_Font_(iFont *d, const uint32_t *glyphIndices, size_t num
     }
     if (isTargetChanged) {
         SDL_SetRenderTarget(current_Text()->render, oldTarget);
+        restoreDamageClip_Paint();
     }
 }
 
@@ -1087,10 +1290,15 @@ iLocalDef iBool equal_FontRunArgs(const iFontRunArgs *a, const iFontRunArgs *b)
 }
 
 struct Impl_FontRun {
+    iHashNode       node; /* key is a hash of `textCrc32` and `args` */
     uint32_t        textCrc32;
     iFontRunArgs    args;
     iAttributedText attrText;
     iArray          buffers; /* GlyphBuffers */
+    size_t          memorySize;
+    iFontRun *      prev; /* more recently used */
+    iFontRun *      next; /* less recently used */
+    const void *    pinOwner;
 };
 
 #if defined (LAGRANGE_ENABLE_HARFBUZZ)
@@ -1107,9 +1315,29 @@ static const hb_script_t hbScripts_[max_Script] = {
 };
 #endif
 
+static uint32_t key_FontRun_(const iFontRunArgs *args, uint32_t textCrc32) {
+    return textCrc32 ^ (iCrc32((const char *) args, sizeof(*args)) * 0x9e3779b1u);
+}
+
+static size_t memorySize_FontRun_(const iFontRun *d) {
+    const iAttributedText *attrText = &d->attrText;
+    size_t size = sizeof(iFontRun) + size_Array(&attrText->runs) * sizeof(iAttributedRun);
+    /* Logical and visual text, index maps, and bidi levels. */
+    size += size_Array(&attrText->logical) * (2 * sizeof(iChar) + 3 * sizeof(int) + 1);
+    iConstForEach(Array, i, &d->buffers) {
+        const iGlyphBuffer *buf = i.value;
+        size += sizeof(iGlyphBuffer) +
+                buf->glyphCount * (sizeof(hb_glyph_info_t) + sizeof(hb_glyph_position_t));
+    }
+    return size;
+}
+
 void init_FontRun(iFontRun *d, const iFontRunArgs *args, const iRangecc text, uint32_t crc) {
+    d->node.key  = key_FontRun_(args, crc);
     d->textCrc32 = crc;
     d->args = *args;
+    d->prev = d->next = NULL;
+    d->pinOwner = NULL;
     /* Split the text into a number of attributed runs that specify exactly which
        font is used and other attributes such as color. (HarfBuzz shaping is done
        with one specific font.) */
@@ -1161,6 +1389,7 @@ void init_FontRun(iFontRun *d, const iFontRunArgs *args, const iRangecc text, ui
     for (size_t runIndex = 0; runIndex < runCount; runIndex++) {
         alignOtherFontsVertically_GlyphBuffer_(at_Array(&d->buffers, runIndex), args->font);
     }
+    d->memorySize = memorySize_FontRun_(d);
 }
 
 void deinit_FontRun(iFontRun *d) {
@@ -1318,17 +1547,23 @@ void process_RunLayer_(iRunLayer *d, int layerIndex) {
                 }
                 if (layerIndex == foreground_RunLayerType && !isSpace) {
                     /* Draw the glyph. */
+                    iStbText *tx = current_StbText_();
                     if (!isRasterized_Glyph_(glyph, hoff)) {
-                        cacheSingleGlyph_Font_(runFont, glyphId); /* may cause cache reset */
+                        cacheSingleGlyph_Font_(runFont, glyphId); /* may evict a page */
                         glyph = glyphByIndex_Font_(runFont, glyphId);
                         iAssert(isRasterized_Glyph_(glyph, hoff));
                     }
-                    if (~d->mode & permanentColorFlag_RunMode) {
-                        SDL_SetTextureColorMod(current_StbText_()->cache, fgClr.r, fgClr.g, fgClr.b);
+                    else {
+                        tx->cacheStats.hits++;
                     }
-                    SDL_Rect src;
-                    memcpy(&src, &glyph->rect[hoff], sizeof(SDL_Rect));
-                    SDL_RenderCopy(current_Text()->render, current_StbText_()->cache, &src, &dst);
+                    /* Glyphs are batched and drawn after the layer is done. */
+                    iGlyphDraw draw = { .page  = glyph->page,
+                                        .dst   = dst,
+                                        .color = (~d->mode & permanentColorFlag_RunMode
+                                                      ? fgClr
+                                                      : tx->glyphColor) };
+                    memcpy(&draw.src, &glyph->rect[hoff], sizeof(SDL_Rect));
+                    pushBack_Array(&tx->glyphDraws, &draw);
                 }
 #if 0
                 /* Show spaces and direction. */
@@ -1354,38 +1589,117 @@ void process_RunLayer_(iRunLayer *d, int layerIndex) {
     }   
 }
 
-static unsigned fontRunCacheHits_  = 0;
-static unsigned fontRunCacheTotal_ = 0;
+static const size_t maxFontRunsSize_StbText_       = 4 * 1024 * 1024; /* bytes */
+static const size_t maxPinnedFontRunsSize_StbText_ = 4 * 1024 * 1024;
+
+static void unlinkFontRun_StbText_(iStbText *d, iFontRun *run) {
+    if (run->prev) {
+        run->prev->next = run->next;
+    }
+    else {
+        d->fontRunsMru = run->next;
+    }
+    if (run->next) {
+        run->next->prev = run->prev;
+    }
+    else {
+        d->fontRunsLru = run->prev;
+    }
+    run->prev = run->next = NULL;
+}
+
+static void linkFontRun_StbText_(iStbText *d, iFontRun *run) {
+    /* Becomes the most recently used one. */
+    run->next = d->fontRunsMru;
+    if (d->fontRunsMru) {
+        d->fontRunsMru->prev = run;
+    }
+    d->fontRunsMru = run;
+    if (!d->fontRunsLru) {
+        d->fontRunsLru = run;
+    }
+}
+
+static void removeFontRun_StbText_(iStbText *d, iFontRun *run) {
+    if (run->pinOwner) {
+        d->fontRunsPinnedSize -= run->memorySize;
+    }
+    remove_Hash(&d->fontRuns, run->node.key);
+    unlinkFontRun_StbText_(d, run);
+    d->fontRunsSize -= run->memorySize;
+    delete_FontRun(run);
+}
+
+static void clearFontRuns_StbText_(iStbText *d) {
+    while (d->fontRunsMru) {
+        removeFontRun_StbText_(d, d->fontRunsMru);
+    }
+    iAssert(d->fontRunsSize == 0);
+    iAssert(d->fontRunsPinnedSize == 0);
+}
+
+static void evictFontRuns_StbText_(iStbText *d) {
+    /* Runs pinned during layout are kept, so the cache may exceed its limit by the pinned
+       size. The most recently used run is always kept since it is about to be used. */
+    iFontRun *run = d->fontRunsLru;
+    while (d->fontRunsSize > maxFontRunsSize_StbText_ && run && run != d->fontRunsMru) {
+        iFontRun *prev = run->prev;
+        if (!run->pinOwner) {
+            removeFontRun_StbText_(d, run);
+        }
+        run = prev;
+    }
+}
+
+static void pinFontRun_StbText_(iStbText *d, iFontRun *run) {
+    if (!d->fontRunsPinOwner) {
+        return;
+    }
+    if (run->pinOwner) {
+        run->pinOwner = d->fontRunsPinOwner; /* already counted */
+    }
+    else if (d->fontRunsPinnedSize + run->memorySize <= maxPinnedFontRunsSize_StbText_) {
+        run->pinOwner = d->fontRunsPinOwner;
+        d->fontRunsPinnedSize += run->memorySize;
+    }
+}
+
+static void unpinFontRuns_StbText_(iStbText *d, const void *owner) {
+    for (iFontRun *run = d->fontRunsMru; run; run = run->next) {
+        if (run->pinOwner == owner) {
+            run->pinOwner = NULL;
+            d->fontRunsPinnedSize -= run->memorySize;
+        }
+    }
+    evictFontRuns_StbText_(d);
+}
 
 static iFontRun *makeOrFindCachedFontRun_StbText_(iStbText *d, const iFontRunArgs *runArgs,
                                                   const iRangecc text, iBool *wasFound) {
-    fontRunCacheTotal_++;
-#if 0
-    if (fontRunCacheTotal_ % 100 == 0) {
-        printf("FONT RUN CACHE: %d/%d rate:%.1f%%\n",
-               fontRunCacheHits_,
-               fontRunCacheTotal_,
-               (float) fontRunCacheHits_ / (float) fontRunCacheTotal_ * 100);
-        fflush(stdout);
-    }
-#endif
+    d->fontRunStats.lookups++;
     const uint32_t crc = iCrc32(text.start, size_Range(&text));
-    iForIndices(i, d->cachedFontRuns) {
-        if (d->cachedFontRuns[i] && d->cachedFontRuns[i]->textCrc32 == crc &&
-            equal_FontRunArgs(runArgs, &d->cachedFontRuns[i]->args)) {
-            d->cachedFontRuns[i]->attrText.source = text;
-            fontRunCacheHits_++;
-            *wasFound = iTrue;
-            return d->cachedFontRuns[i];
-        }
+    iFontRun *run = (iFontRun *) value_Hash(&d->fontRuns, key_FontRun_(runArgs, crc));
+    if (run && run->textCrc32 == crc && equal_FontRunArgs(runArgs, &run->args)) {
+        run->attrText.source = text;
+        d->fontRunStats.hits++;
+        unlinkFontRun_StbText_(d, run);
+        linkFontRun_StbText_(d, run);
+        pinFontRun_StbText_(d, run);
+        *wasFound = iTrue;
+        return run;
     }
     *wasFound = iFalse;
-    delete_FontRun(d->cachedFontRuns[iElemCount(d->cachedFontRuns) - 1]);
-    memmove(d->cachedFontRuns + 1,
-            d->cachedFontRuns,
-            sizeof(d->cachedFontRuns) - sizeof(d->cachedFontRuns[0]));
-    d->cachedFontRuns[0] = new_FontRun(runArgs, text, crc);
-    return d->cachedFontRuns[0];
+    if (run) {
+        /* Hash collision; the old run is replaced. */
+        removeFontRun_StbText_(d, run);
+    }
+    run = new_FontRun(runArgs, text, crc);
+    insert_Hash(&d->fontRuns, &run->node);
+    linkFontRun_StbText_(d, run);
+    pinFontRun_StbText_(d, run);
+    d->fontRunsSize += run->memorySize;
+    evictFontRuns_StbText_(d);
+    return run;
 }
 
 static void run_Font_(iFont *d, const iRunArgs *args) {
@@ -1402,10 +1716,10 @@ static void run_Font_(iFont *d, const iRunArgs *args) {
     /* Set the default text foreground color. */
     if (mode & draw_RunMode) {
         const iColor clr = get_Color(args->color);
-        SDL_SetTextureColorMod(current_StbText_()->cache, clr.r, clr.g, clr.b);
+        setGlyphColor_StbText_(current_StbText_(), clr);
     }
     iAssert(args->text.end >= args->text.start);
-    /* We keep a small cache of recently shaped runs because preparing these can be expensive.
+    /* We keep a cache of recently shaped runs because preparing these can be expensive.
        Quite frequently the same text is quickly re-drawn and/or measured (e.g., InputWidget). */
     fontRun = makeOrFindCachedFontRun_StbText_(
         current_StbText_(),
@@ -1747,6 +2061,7 @@ static void run_Font_(iFont *d, const iRunArgs *args) {
             layer.yCursor = yCursor;
             process_RunLayer_(&layer, layerIndex);
         }
+        flushGlyphDraws_StbText_(current_StbText_());
         bounds     = layer.bounds;
         xCursor    = layer.xCursor;            
         xCursorMax = layer.xCursorMax;
@@ -1778,8 +2093,83 @@ static void run_Font_(iFont *d, const iRunArgs *args) {
 #   define run_Font_    runSimple_Font_
 #   include "text_simple.c"
 
+static void clearFontRuns_StbText_(iStbText *d) {
+    iUnused(d); /* nothing is shaped */
+}
+
 #endif /* defined (LAGRANGE_ENABLE_HARFBUZZ) */
 
+/* Owners may be released while another window's Text is current, so each pin remembers
+   whose cache the runs are in. */
+iDeclareType(FontRunPin)
+
+struct Impl_FontRunPin {
+    const void *owner;
+    iStbText *  text;
+};
+
+static iArray *fontRunPins_; /* FontRunPin */
+
+void pinFontRuns_Text(const void *owner) {
+    iStbText *d = current_StbText_();
+    d->fontRunsPinOwner = owner;
+    if (!owner) {
+        return;
+    }
+    if (!fontRunPins_) {
+        fontRunPins_ = new_Array(sizeof(iFontRunPin));
+    }
+    iConstForEach(Array, i, fontRunPins_) {
+        const iFontRunPin *pin = i.value;
+        if (pin->owner == owner && pin->text == d) {
+            return;
+        }
+    }
+    pushBack_Array(fontRunPins_, &(iFontRunPin){ owner, d });
+}
+
+void releaseFontRuns_Text(const void *owner) {
+    if (!fontRunPins_) {
+        return;
+    }
+    iForEach(Array, i, fontRunPins_) {
+        const iFontRunPin *pin = i.value;
+        if (pin->owner == owner) {
+            iStbText *d = pin->text;
+            if (d->fontRunsPinOwner == owner) {
+                d->fontRunsPinOwner = NULL;
+            }
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+            unpinFontRuns_StbText_(d, owner);
+#endif
+            remove_ArrayIterator(&i);
+        }
+    }
+}
+
+static void removeFontRunPins_StbText_(const iStbText *d) {
+    if (!fontRunPins_) {
+        return;
+    }
+    iForEach(Array, i, fontRunPins_) {
+        if (((const iFontRunPin *) i.value)->text == d) {
+            remove_ArrayIterator(&i);
+        }
+    }
+    if (isEmpty_Array(fontRunPins_)) {
+        delete_Array(fontRunPins_);
+        fontRunPins_ = NULL;
+    }
+}
+
+iFontRunCacheStats fontRunCacheStats_Text(void) {
+    const iStbText *d = current_StbText_();
+    iFontRunCacheStats stats = d->fontRunStats;
+    stats.size    = d->fontRunsSize;
+    stats.numRuns = size_Hash(&d->fontRuns);
+    return stats;
+}
+
 void run_Font(iBaseFont *font, const iRunArgs *args) {
     return run_Font_((iFont *) font, args);
 }
@@ -1807,5 +2197,9 @@ void resetMissing_Text(iText *d) {
 }
 
 SDL_Texture *glyphCache_Text(void) {
-    return current_StbText_()->cache;
+    return cachePage_StbText_(current_StbText_(), 0)->texture; /* first atlas page */
+}
+
+iGlyphCacheStats glyphCacheStats_Text(void) {
+    return current_StbText_()->cacheStats;
 }
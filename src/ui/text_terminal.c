@@ -179,6 +179,22 @@ SDL_Texture *glyphCache_Text(void) {
     return NULL;
 }
 
+iGlyphCacheStats glyphCacheStats_Text(void) {
+    return (iGlyphCacheStats){ 0, 0, 0, 0 };
+}
+
+void pinFontRuns_Text(const void *owner) {
+    iUnused(owner);
+}
+
+void releaseFontRuns_Text(const void *owner) {
+    iUnused(owner);
+}
+
+iFontRunCacheStats fontRunCacheStats_Text(void) {
+    return (iFontRunCacheStats){ 0, 0, 0, 0 };
+}
+
 void setOpacity_Text(float opacity) {
     iUnused(opacity);
 }
@@ -293,6 +293,9 @@ void setFlags_Widget(iWidget *d, int64_t flags, iBool set) {
             identify_Widget(d);
         }
 #endif
+        if (d->flags != oldFlags) {
+            refresh_Widget(d); /* flags like selected and hidden change the appearance */
+        }
     }
 }
 
@@ -374,13 +377,17 @@ void setVisualOffset_Widget(iWidget *d, int value, uint32_t span, int animFlags)
 }
 
 void setBackgroundColor_Widget(iWidget *d, int bgColor) {
-    if (d) {
+    if (d && d->bgColor != bgColor) {
         d->bgColor = bgColor;
+        refresh_Widget(d);
     }
 }
 
 void setFrameColor_Widget(iWidget *d, int frameColor) {
-    d->frameColor = frameColor;
+    if (d->frameColor != frameColor) {
+        d->frameColor = frameColor;
+        refresh_Widget(d);
+    }
 }
 
 void setCommandHandler_Widget(iWidget *d, iBool (*handler)(iWidget *, const char *)) {
@@ -1406,8 +1413,11 @@ iBool scrollOverflow_Widget(iWidget *d, int delta) {
     }
     const iInt2 newPos = windowToInner_Widget(d->parent, bounds.pos);
     if (!isEqual_I2(newPos, d->rect.pos)) {
+        /* Everything under the scrolled widget is exposed, too. */
+        iWindow *win = window_Widget(d);
         d->rect.pos = newPos;
-        postRefresh_App();
+        damage_Window(win, (iRect){ zero_I2(), win->size });
+        postDamageRefresh_App();
     }
     return height_Rect(bounds) > height_Rect(winRect);
 }
@@ -1417,12 +1427,15 @@ static uint32_t lastHoverOverflowMotionTime_;
 static void overflowHoverAnimation_(iAny *widget) {
     iWindow *win = window_Widget(widget);
     iInt2 coord = mouseCoord_Window(win, 0);
-    /* A motion event will cause an overflow window to scroll. */
+    /* A motion event will cause an overflow window to scroll. It must look like real motion,
+       including any held buttons, so drags and the window damage are handled the same way. */
     SDL_MouseMotionEvent ev = {
-        .type     = SDL_MOUSEMOTION,
-        .windowID = SDL_GetWindowID(win->win),
-        .x        = coord.x / win->pixelRatio,
-        .y        = coord.y / win->pixelRatio,
+        .type      = SDL_MOUSEMOTION,
+        .timestamp = SDL_GetTicks(),
+        .windowID  = SDL_GetWindowID(win->win),
+        .state     = SDL_GetMouseState(NULL, NULL),
+        .x         = coord.x / win->pixelRatio,
+        .y         = coord.y / win->pixelRatio,
     };
     SDL_PushEvent((SDL_Event *) &ev);
 }
@@ -1746,7 +1759,22 @@ iLocalDef iBool isFullyContainedByOther_Rect(const iRect d, const iRect other) {
     return equal_Rect(intersect_Rect(d, other), d);
 }
 
-static void addToPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs, iRect *fullyMasked) {
+static iBool isDamaged_Widget_(const iWidget *d, iRect bounds, iRect damage) {
+    if (isEmpty_Rect(damage)) {
+        return iTrue; /* everything is being redrawn */
+    }
+    /* Layer effects are drawn outside the bounds. */
+    if (d->flags & mouseModal_WidgetFlag || d->flags2 & fadeBackground_WidgetFlag2) {
+        bounds = rect_Root(d->root);
+    }
+    else if (d->flags & keepOnTop_WidgetFlag) {
+        bounds = expanded_Rect(bounds, init1_I2(12 * gap_UI)); /* soft shadow */
+    }
+    return !isEmpty_Rect(intersect_Rect(bounds, damage));
+}
+
+static void addToPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs, iRect *fullyMasked,
+                                            iRect damage) {
     if (isDrawn_Widget_(d)) {
         iRect bounds = bounds_Widget(d);
         if (d->flags & drawBackgroundToBottom_WidgetFlag) {
@@ -1755,6 +1783,9 @@ static void addToPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs, iR
         if (isFullyContainedByOther_Rect(bounds, *fullyMasked)) {
             return; /* can't be seen */
         }
+        if (!isDamaged_Widget_(d, bounds, damage)) {
+            return; /* previous frame's contents are kept */
+        }
         pushBack_PtrArray(pvs, d);
         if (d->bgColor >= 0 && ~d->flags & noBackground_WidgetFlag &&
             isFullyContainedByOther_Rect(*fullyMasked, bounds)) {
@@ -1765,17 +1796,18 @@ static void addToPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs, iR
 
 static void findPotentiallyVisible_Widget_(const iWidget *d, iPtrArray *pvs) {
     iRect fullyMasked = zero_Rect();
+    const iRect damage = window_Widget(d)->drawDamage;
     if (isRoot_Widget_(d)) {
         iReverseConstForEach(PtrArray, i, onTop_Root(d->root)) {
             const iWidget *top = i.ptr;
             iAssert(top->parent);
-            addToPotentiallyVisible_Widget_(top, pvs, &fullyMasked);
+            addToPotentiallyVisible_Widget_(top, pvs, &fullyMasked, damage);
         }
     }
     iReverseConstForEach(ObjectList, i, d->children) {
         const iWidget *child = i.object;
         if (~child->flags & keepOnTop_WidgetFlag) {
-            addToPotentiallyVisible_Widget_(child, pvs, &fullyMasked);
+            addToPotentiallyVisible_Widget_(child, pvs, &fullyMasked, damage);
         }
     }
 }
@@ -1852,6 +1884,7 @@ static void endBufferDraw_Widget_(const iWidget *d) {
         d->drawBuf->isValid = iTrue;
         SDL_SetRenderTarget(renderer_Window(get_Window()), d->drawBuf->oldTarget);
         origin_Paint = d->drawBuf->oldOrigin;
+        restoreDamageClip_Paint();
 //        printf("endBufferDraw: origin %d,%d\n", origin_Paint.x, origin_Paint.y);
 //        fflush(stdout);
     }    
@@ -2423,7 +2456,12 @@ void refresh_Widget(const iAnyObject *d) {
             w->drawBuf->isValid = iFalse;
         }
     }
-    postRefresh_App();
+    /* Only this widget's area needs to be redrawn. */
+    const iRoot *root = constAs_Widget(d)->root;
+    if (root && root->window) {
+        damage_Window(root->window, boundsForDraw_Widget_(d));
+    }
+    postDamageRefresh_App();
 }
 
 void raise_Widget(iWidget *d) {
@@ -589,6 +589,8 @@ void init_Window(iWindow *d, enum iWindowType type, iRect rect, uint32_t flags)
     d->keyRoot       = NULL;
     d->borderShadow  = NULL;
     d->frameCount    = 0;
+    init_Damage(&d->damage);
+    d->drawDamage    = zero_Rect();
     iZap(d->roots);
     iZap(d->cursors);
     create_Window_(d, rect, flags);
@@ -649,6 +651,7 @@ void deinit_Window(iWindow *d) {
             SDL_FreeCursor(d->cursors[i]);
         }
     }
+    deinit_Damage(&d->damage);
     setCurrent_Window(NULL);
 }
 
@@ -710,6 +713,7 @@ void init_MainWindow(iMainWindow *d, iRect rect) {
     d->place.lastNotifiedSize = zero_I2();
     d->place.snap             = 0;
     d->keyboardHeight         = 0;
+    d->isPresentKept          = iFalse;
     d->backBuf                = NULL;
     const iInt2 minSize =
         (isMobile_Platform() ? zero_I2() /* windows aren't independently resizable */
@@ -720,6 +724,15 @@ void init_MainWindow(iMainWindow *d, iRect rect) {
         SDL_RendererInfo info;
         SDL_GetRendererInfo(d->base.render, &info);
         isOpenGLRenderer_ = !iCmpStr(info.name, "opengl");
+#if !defined (iPlatformTerminal)
+        if (info.flags & SDL_RENDERER_SOFTWARE) {
+            /* Redrawing everything is slow without a GPU. Keeping the previous frame in a
+               back buffer lets us redraw only the damaged parts of the window. The window
+               surface keeps its contents, too, so only the damaged parts are presented. */
+            d->enableBackBuf = iTrue;
+            d->isPresentKept = iTrue;
+        }
+#endif
 #if !defined(NDEBUG) && !defined (iPlatformTerminal)
         printf("[window] max texture size: %d x %d\n",
                info.max_texture_width,
@@ -854,6 +867,15 @@ void invalidate_Window(iAnyWindow *d) {
     invalidate_Window_(d, iFalse);
 }
 
+void damage_Window(iWindow *d, iRect rect) {
+    /* Timers may refresh widgets, so this can be called from any thread. */
+    add_Damage(&d->damage, (iRect){ zero_I2(), d->size }, rect);
+}
+
+uint64_t drawnPixels_Window(const iWindow *d) {
+    return drawnPixels_Damage(&d->damage);
+}
+
 static void invalidate_MainWindow_(iMainWindow *d, iBool forced) {
     invalidate_Window_(as_Window(d), forced);
 }
@@ -1457,7 +1479,8 @@ iBool dispatchEvent_Window(iWindow *d, const SDL_Event *ev) {
         }
     }
     if (d->hover != oldHover) {
-        refresh_Widget(d->hover); /* Note: oldHover may have been deleted */
+        refresh_Widget(d->lastHover); /* Note: oldHover may have been deleted */
+        refresh_Widget(d->hover);
         if (d->hover && d->hover->flags2 & commandOnHover_WidgetFlag2) {
             SDL_UserEvent notif = { .type      = SDL_USEREVENT,
                                     .timestamp = SDL_GetTicks(),
@@ -1551,6 +1574,7 @@ void draw_MainWindow(iMainWindow *d) {
     if (d->isDrawFrozen) {
         return;
     }
+    iBool isNewBackBuf = iFalse;
     isDrawing_ = iTrue;
     if (deviceType_App() == desktop_AppDeviceType) {
         checkPixelRatioChange_Window_(&d->base);
@@ -1576,6 +1600,7 @@ void draw_MainWindow(iMainWindow *d) {
                 if (d->backBuf) {
                     SDL_DestroyTexture(d->backBuf);
                 }
+                isNewBackBuf = iTrue;
                 d->backBuf = SDL_CreateTexture(d->base.render,
                                                SDL_PIXELFORMAT_RGB888,
                                                SDL_TEXTUREACCESS_TARGET,
@@ -1586,6 +1611,29 @@ void draw_MainWindow(iMainWindow *d) {
         }
     }
     setCurrent_Window(d);
+    /* If the previous frame was kept, only the damaged part of the window is redrawn. */ {
+        const iRect winRect = { zero_I2(), w->size };
+        iRect damage = take_Damage(&w->damage);
+        iBool isArranged = iFalse;
+        iForIndices(i, w->roots) {
+            if (w->roots[i] && w->roots[i]->didChangeArrangement) {
+                isArranged = iTrue;
+            }
+        }
+        if (!d->backBuf || isNewBackBuf || isArranged || !isExposed_Window(w)) {
+            damage = winRect;
+        }
+        if (isEmpty_Rect(damage)) {
+            /* Nothing has changed. */
+            drawQuick_MainWindow(d);
+            isDrawing_ = iFalse;
+            return;
+        }
+        w->drawDamage = (equal_Rect(damage, winRect) ? zero_Rect() : damage);
+        if (isExposed_Window(w)) {
+            addDrawn_Damage(&w->damage, damage);
+        }
+    }
     const int   winFlags = SDL_GetWindowFlags(d->base.win);
     const iBool gotFocus = (winFlags & SDL_WINDOW_INPUT_FOCUS) != 0;
     iPaint p;
@@ -1616,7 +1664,14 @@ void draw_MainWindow(iMainWindow *d) {
         }
         unsetClip_Paint(&p); /* update clip to full window */
         SDL_SetRenderDrawColor(w->render, back.r, back.g, back.b, 255);
-        SDL_RenderClear(w->render);
+        if (isEmpty_Rect(w->drawDamage)) {
+            SDL_RenderClear(w->render);
+        }
+        else {
+            /* Clearing ignores the clip rectangle. */
+            SDL_RenderSetClipRect(w->render, (const SDL_Rect *) &w->drawDamage);
+            SDL_RenderFillRect(w->render, NULL);
+        }
     }
     /* Draw widgets. */
     w->frameTime = SDL_GetTicks();
@@ -1694,8 +1749,15 @@ void draw_MainWindow(iMainWindow *d) {
     }
     if (d->backBuf) {
         SDL_SetRenderTarget(d->base.render, NULL);
+        /* Only copy what was redrawn if the window keeps its previous contents. */
+        SDL_RenderSetClipRect(d->base.render,
+                              d->isPresentKept && !isEmpty_Rect(w->drawDamage)
+                                  ? (const SDL_Rect *) &w->drawDamage
+                                  : NULL);
         SDL_RenderCopy(d->base.render, d->backBuf, NULL, NULL);
+        SDL_RenderSetClipRect(d->base.render, NULL);
     }
+    w->drawDamage = zero_Rect();
 #if 0
     /* Text cache debugging. */ {
         SDL_Rect rect = { d->roots[0]->widget->rect.size.x - 640, 0, 640, 2.5 * 640 };
@@ -23,7 +23,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include "root.h"
+#include "damage.h"
 
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/rect.h>
 #include <SDL_events.h>
 #include <SDL_render.h>
@@ -111,6 +113,8 @@ struct Impl_Window {
     SDL_Texture * borderShadow;
     iText *       text;
     unsigned int  frameCount;
+    iDamage       damage;       /* changed since the previous frame; see `damage_Window()` */
+    iRect         drawDamage;   /* limits drawing in the current frame; empty if not limited */
 };
 
 struct Impl_MainWindow {
@@ -125,8 +129,9 @@ struct Impl_MainWindow {
     SDL_Texture * appIcon;
     int           keyboardHeight; /* mobile software keyboards */
     int           maxDrawableHeight;
-    iBool         enableBackBuf; /* only used on macOS with Metal (helps with refresh glitches for some reason??) */
-    SDL_Texture * backBuf; /* enables refreshing the window without redrawing anything */
+    iBool         enableBackBuf; /* macOS with Metal (helps with refresh glitches for some reason??), and software rendering */
+    iBool         isPresentKept; /* presented contents persist between frames (software rendering) */
+    SDL_Texture * backBuf; /* enables refreshing the window without redrawing anything, or only the damaged parts */
 };
 
 iLocalDef enum iWindowType type_Window(const iAnyWindow *d) {
@@ -154,6 +159,8 @@ void        setTitle_Window         (iWindow *, const iString *title);
 iBool       processEvent_Window     (iWindow *, const SDL_Event *);
 iBool       dispatchEvent_Window    (iWindow *, const SDL_Event *);
 void        invalidate_Window       (iAnyWindow *); /* discard all cached graphics */
+void        damage_Window           (iWindow *, iRect rect); /* redraw `rect` in the next frame */
+uint64_t    drawnPixels_Window      (const iWindow *); /* total redrawn; compare with `frameCount` */
 void        draw_Window             (iWindow *);
 void        setUiScale_Window       (iWindow *, float uiScale);
 void        setCursor_Window        (iWindow *, int cursor);
@@ -24,13 +24,37 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "app.h"
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/ptrarray.h>
-#include <the_Foundation/sortedarray.h>
 
 const int maxAge_Visited = 6 * 3600 * 24 * 30; /* six months */
 
+static const char *legacyFileName_Visited_ = "visited.2.txt";
+static const char *fileName_Visited_       = "visited.3.bin";
+static const char *tempFileName_Visited_   = "visited.3.bin.tmp";
+static const char *logFileName_Visited_    = "visited.3.log";
+static const char *magic_Visited_          = "lgVi";
+
+enum iVisitedFileVersion {
+    initial_VisitedFileVersion = 0,
+    /* meta */
+    latest_VisitedFileVersion = initial_VisitedFileVersion,
+};
+
+/* Binary file layout (all integers little-endian, offsets relative to the start of file):
+   - header: magic, version, number of records, hash capacity, arena size (5 x u32)
+   - records: when (u64 seconds), URL offset (u32), URL size (u32), flags (u16), reserved (u16)
+   - hash: capacity x { URL hash (u32), record index + 1 (u32) }, 0 index means empty slot
+   - arena: NUL-terminated URLs
+   Everything is addressed by offset so the file can be used directly as loaded/mapped. */
+enum {
+    headerSize_VisitedFile_ = 20,
+    recordSize_VisitedFile_ = 20,
+    slotSize_VisitedFile_   = 8,
+};
+
 void init_VisitedUrl(iVisitedUrl *d) {
     initCurrent_Time(&d->when);
     init_String(&d->url);
@@ -41,127 +65,500 @@ void deinit_VisitedUrl(iVisitedUrl *d) {
     deinit_String(&d->url);
 }
 
-static int cmpUrl_VisitedUrl_(const void *a, const void *b) {
-    return cmpString_String(&((const iVisitedUrl *) a)->url, &((const iVisitedUrl *) b)->url);
-}
+iDefineTypeConstruction(VisitedUrl)
 
-static int cmpNewer_VisitedUrl_(const void *insert, const void *existing) {
-    return seconds_Time(&((const iVisitedUrl *) insert  )->when) >=
-           seconds_Time(&((const iVisitedUrl *) existing)->when);
+static uint32_t hash_VisitedUrl_(iRangecc url) {
+    return iCrc32(url.start, size_Range(&url));
 }
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(VisitedSlot)
+
+struct Impl_VisitedSlot {
+    uint32_t hash;
+    uint32_t index; /* index in `visited` plus one; zero if the slot is empty */
+};
+
 struct Impl_Visited {
     iMutex *mtx;
-    iSortedArray visited;
+    iPtrArray visited; /* iVisitedUrl *, unordered */
+    iVisitedSlot *slots; /* open addressing with linear probing */
+    size_t capacity; /* power of two */
+    iString log; /* changes not yet appended to the log file */
+    iBool needsRewrite; /* log can't represent the changes, write a new file */
+    iPtrArray recency; /* iVisitedUrl *, ascending by time; rebuilt after loading */
+    iBool isRecencyValid;
+    uint32_t serial; /* incremented on every change visible in the history */
+    uint32_t rebuildSerial; /* latest change that was not just a visit becoming the newest */
 };
 
 iDefineTypeConstruction(Visited)
 
 void init_Visited(iVisited *d) {
     d->mtx = new_Mutex();
-    init_SortedArray(&d->visited, sizeof(iVisitedUrl), cmpUrl_VisitedUrl_);
+    init_PtrArray(&d->visited);
+    d->slots = NULL;
+    d->capacity = 0;
+    init_String(&d->log);
+    d->needsRewrite = iFalse;
+    init_PtrArray(&d->recency);
+    d->isRecencyValid = iTrue;
+    d->serial = 0;
+    d->rebuildSerial = 0;
 }
 
 void deinit_Visited(iVisited *d) {
     iGuardMutex(d->mtx, {
         clear_Visited(d);
-        deinit_SortedArray(&d->visited);
+        deinit_PtrArray(&d->visited);
+        free(d->slots);
+        deinit_String(&d->log);
+        deinit_PtrArray(&d->recency);
     });
     delete_Mutex(d->mtx);
 }
 
+static size_t findSlot_Visited_(const iVisited *d, iRangecc url, uint32_t hash) {
+    /* Returns the slot containing `url`, or the empty slot where it would be inserted. */
+    const size_t mask = d->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const iVisitedSlot *slot = &d->slots[i];
+        if (!slot->index) {
+            return i;
+        }
+        if (slot->hash == hash) {
+            const iVisitedUrl *vis = constAt_PtrArray(&d->visited, slot->index - 1);
+            if (size_String(&vis->url) == size_Range(&url) &&
+                !memcmp(cstr_String(&vis->url), url.start, size_Range(&url))) {
+                return i;
+            }
+        }
+    }
+}
+
+static iVisitedUrl *find_Visited_(const iVisited *d, iRangecc url, size_t *slot_out) {
+    if (!d->capacity) {
+        return NULL;
+    }
+    const size_t slot = findSlot_Visited_(d, url, hash_VisitedUrl_(url));
+    if (slot_out) {
+        *slot_out = slot;
+    }
+    const uint32_t index = d->slots[slot].index;
+    return index ? iConstCast(iVisitedUrl *, constAt_PtrArray(&d->visited, index - 1)) : NULL;
+}
+
+static void rehash_Visited_(iVisited *d, size_t capacity) {
+    free(d->slots);
+    d->capacity = capacity;
+    d->slots = calloc(capacity, sizeof(iVisitedSlot));
+    for (size_t i = 0; i < size_PtrArray(&d->visited); i++) {
+        const iVisitedUrl *vis  = constAt_PtrArray(&d->visited, i);
+        const iRangecc     url  = range_String(&vis->url);
+        const uint32_t     hash = hash_VisitedUrl_(url);
+        d->slots[findSlot_Visited_(d, url, hash)] = (iVisitedSlot){ hash, (uint32_t) i + 1 };
+    }
+}
+
+static int cmpWhen_VisitedUrlPtr_(const void *a, const void *b) {
+    const iVisitedUrl *s = *(const void **) a, *t = *(const void **) b;
+    return cmp_Time(&s->when, &t->when);
+}
+
+static size_t recencyPos_Visited_(const iVisited *d, const iTime *when) {
+    /* Returns the position after all entries that are not later than `when`. */
+    size_t lo = 0, hi = size_PtrArray(&d->recency);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (cmp_Time(&((const iVisitedUrl *) constAt_PtrArray(&d->recency, mid))->when, when) <= 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void addRecency_Visited_(iVisited *d, iVisitedUrl *vis) {
+    if (d->isRecencyValid) {
+        insert_Array(&d->recency, recencyPos_Visited_(d, &vis->when), &vis);
+    }
+}
+
+static void removeRecency_Visited_(iVisited *d, const iVisitedUrl *vis) {
+    if (!d->isRecencyValid) {
+        return;
+    }
+    /* Entries with the same time precede the upper bound. */
+    for (size_t pos = recencyPos_Visited_(d, &vis->when); pos > 0; pos--) {
+        if (constAt_PtrArray(&d->recency, pos - 1) == vis) {
+            remove_Array(&d->recency, pos - 1);
+            return;
+        }
+    }
+    iAssert(iFalse);
+}
+
+static void rebuildRecency_Visited_(iVisited *d) {
+    clear_PtrArray(&d->recency);
+    iConstForEach(PtrArray, i, &d->visited) {
+        pushBack_PtrArray(&d->recency, i.ptr);
+    }
+    sort_Array(&d->recency, cmpWhen_VisitedUrlPtr_);
+    d->isRecencyValid = iTrue;
+}
+
+static void setWhen_Visited_(iVisited *d, iVisitedUrl *vis, iTime when) {
+    removeRecency_Visited_(d, vis);
+    vis->when = when;
+    addRecency_Visited_(d, vis);
+}
+
+static void changed_Visited_(iVisited *d, const iVisitedUrl *newest) {
+    /* Observers can apply a change incrementally only if it made `newest` the latest entry. */
+    d->serial++;
+    if (!newest || !d->isRecencyValid ||
+        constAt_PtrArray(&d->recency, size_PtrArray(&d->recency) - 1) != newest) {
+        d->rebuildSerial = d->serial;
+    }
+}
+
+static void insert_Visited_(iVisited *d, iVisitedUrl *vis) {
+    /* Caller has checked that `vis->url` isn't already present. */
+    pushBack_PtrArray(&d->visited, vis);
+    addRecency_Visited_(d, vis);
+    if (size_PtrArray(&d->visited) * 2 > d->capacity) {
+        rehash_Visited_(d, iMax(256, d->capacity * 2)); /* includes the new one */
+        return;
+    }
+    const iRangecc url  = range_String(&vis->url);
+    const uint32_t hash = hash_VisitedUrl_(url);
+    d->slots[findSlot_Visited_(d, url, hash)] =
+        (iVisitedSlot){ hash, (uint32_t) size_PtrArray(&d->visited) };
+}
+
+static void removeSlot_Visited_(iVisited *d, size_t slot) {
+    /* Backward-shift deletion keeps probe sequences intact without tombstones. */
+    const size_t mask = d->capacity - 1;
+    size_t hole = slot;
+    for (size_t i = (slot + 1) & mask; d->slots[i].index; i = (i + 1) & mask) {
+        const size_t ideal = d->slots[i].hash & mask;
+        if (((i - ideal) & mask) >= ((i - hole) & mask)) {
+            d->slots[hole] = d->slots[i];
+            hole = i;
+        }
+    }
+    d->slots[hole] = (iVisitedSlot){ 0, 0 };
+}
+
+static void remove_Visited_(iVisited *d, size_t slot) {
+    const size_t index = d->slots[slot].index - 1;
+    removeSlot_Visited_(d, slot);
+    removeRecency_Visited_(d, constAt_PtrArray(&d->visited, index));
+    delete_VisitedUrl(at_PtrArray(&d->visited, index));
+    /* Fill the gap with the last URL. */
+    const size_t last = size_PtrArray(&d->visited) - 1;
+    if (index != last) {
+        iVisitedUrl *moved = at_PtrArray(&d->visited, last);
+        size_t movedSlot;
+        find_Visited_(d, range_String(&moved->url), &movedSlot);
+        d->slots[movedSlot].index = (uint32_t) index + 1;
+        set_Array(&d->visited, index, &moved);
+    }
+    popBack_Array(&d->visited);
+}
+
+static void appendLine_VisitedUrl_(const iVisitedUrl *d, iString *out) {
+    appendFormat_String(out,
+                        "%llu %04x %s\n",
+                        (unsigned long long) integralSeconds_Time(&d->when),
+                        d->flags,
+                        cstr_String(&d->url));
+}
+
+static void logVisit_Visited_(iVisited *d, const iVisitedUrl *vis) {
+    if (!d->needsRewrite) {
+        appendLine_VisitedUrl_(vis, &d->log);
+    }
+}
+
+static void logRemoval_Visited_(iVisited *d, const iString *url) {
+    if (!d->needsRewrite) {
+        appendFormat_String(&d->log, "0 0000 %s\n", cstr_String(url));
+    }
+}
+
 void serialize_Visited(const iVisited *d, iStream *out) {
     iString *line = new_String();
     lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->visited.values) {
-        const iVisitedUrl *item = i.value;
-        format_String(line,
-                      "%llu %04x %s\n",
-                      (unsigned long long) integralSeconds_Time(&item->when),
-                      item->flags,
-                      cstr_String(&item->url));
+    iConstForEach(PtrArray, i, &d->visited) {
+        clear_String(line);
+        appendLine_VisitedUrl_(i.ptr, line);
         writeData_Stream(out, cstr_String(line), size_String(line));
     }
     unlock_Mutex(d->mtx);
     delete_String(line);
 }
 
-void save_Visited(const iVisited *d, const char *dirPath) {
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        serialize_Visited(d, stream_File(f));
+static iBool write_Visited_(const iVisited *d, iStream *out) {
+    /* Returns True if everything was written. */
+    uint32_t arenaSize = 0;
+    iConstForEach(PtrArray, i, &d->visited) {
+        arenaSize += size_String(&((const iVisitedUrl *) i.ptr)->url) + 1;
+    }
+    writeData_Stream(out, magic_Visited_, 4);
+    writeU32_Stream(out, latest_VisitedFileVersion);
+    writeU32_Stream(out, (uint32_t) size_PtrArray(&d->visited));
+    writeU32_Stream(out, (uint32_t) d->capacity);
+    writeU32_Stream(out, arenaSize);
+    uint32_t offset = headerSize_VisitedFile_ + recordSize_VisitedFile_ * size_PtrArray(&d->visited) +
+                      slotSize_VisitedFile_ * d->capacity;
+    iConstForEach(PtrArray, j, &d->visited) {
+        const iVisitedUrl *vis = j.ptr;
+        writeU64_Stream(out, integralSeconds_Time(&vis->when));
+        writeU32_Stream(out, offset);
+        writeU32_Stream(out, (uint32_t) size_String(&vis->url));
+        writeU16_Stream(out, vis->flags);
+        writeU16_Stream(out, 0);
+        offset += size_String(&vis->url) + 1;
+    }
+    for (size_t k = 0; k < d->capacity; k++) {
+        writeU32_Stream(out, d->slots[k].hash);
+        writeU32_Stream(out, d->slots[k].index);
+    }
+    iConstForEach(PtrArray, m, &d->visited) {
+        const iString *url = &((const iVisitedUrl *) m.ptr)->url;
+        writeData_Stream(out, cstr_String(url), size_String(url) + 1);
+    }
+    return pos_Stream(out) == offset; /* `offset` is now the end of the arena */
+}
+
+static void appendLog_Visited_(iVisited *d, const char *dirPath) {
+    if (!isEmpty_String(&d->log)) {
+        iFile *f = newCStr_File(concatPath_CStr(dirPath, logFileName_Visited_));
+        if (open_File(f, append_FileMode | text_FileMode)) {
+            write_File(f, &d->log.chars);
+            clear_String(&d->log);
+        }
+        iRelease(f);
+    }
+}
+
+void save_Visited(iVisited *d, const char *dirPath) {
+    const char *tempPath = concatPath_CStr(dirPath, tempFileName_Visited_);
+    lock_Mutex(d->mtx);
+    iFile *f = newCStr_File(tempPath);
+    iBool  ok = iFalse;
+    if (open_File(f, writeOnly_FileMode)) {
+        ok = write_Visited_(d, stream_File(f));
+        close_File(f);
     }
     iRelease(f);
+    if (ok) {
+        commitFile_App(concatPath_CStr(dirPath, fileName_Visited_), tempPath);
+        /* The new file includes everything that was logged. */
+        remove(concatPath_CStr(dirPath, logFileName_Visited_));
+        clear_String(&d->log);
+        d->needsRewrite = iFalse;
+    }
+    else {
+        /* The old file and log are kept as they are. New entries are still appended to
+           the log so they aren't lost; a rewrite is tried again on the next save. */
+        remove(tempPath);
+        d->needsRewrite = iTrue;
+        appendLog_Visited_(d, dirPath);
+    }
+    unlock_Mutex(d->mtx);
 }
 
-void deserialize_Visited(iVisited *d, iStream *ins, iBool mergeKeepingLatest) {
-    const iRangecc src  = range_Block(collect_Block(readAll_Stream(ins)));
-    iRangecc       line = iNullRange;
-    iTime          now;
-    initCurrent_Time(&now);
+void flush_Visited(iVisited *d, const char *dirPath) {
     lock_Mutex(d->mtx);
+    if (d->needsRewrite) {
+        save_Visited(d, dirPath);
+    }
+    else {
+        appendLog_Visited_(d, dirPath);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void apply_Visited_(iVisited *d, iRangecc url, uint64_t seconds, uint16_t flags,
+                           iBool mergeKeepingLatest) {
+    /* Zero timestamp means the URL was removed. */
+    size_t slot;
+    iVisitedUrl *existing = find_Visited_(d, url, &slot);
+    if (!seconds) {
+        if (existing) {
+            remove_Visited_(d, slot);
+        }
+        return;
+    }
+    const iTime when = { .ts = { .tv_sec = seconds } };
+    if (existing) {
+        if (!mergeKeepingLatest || cmp_Time(&when, &existing->when) > 0) {
+            setWhen_Visited_(d, existing, when);
+        }
+        existing->flags = flags;
+        return;
+    }
+    iVisitedUrl *vis = new_VisitedUrl();
+    vis->when  = when;
+    vis->flags = flags;
+    setRange_String(&vis->url, url);
+    insert_Visited_(d, vis);
+}
+
+static void parseLines_Visited_(iVisited *d, iRangecc src, iBool mergeKeepingLatest) {
+    iRangecc line = iNullRange;
+    iTime    now;
+    initCurrent_Time(&now);
     while (nextSplit_Rangecc(src, "\n", &line)) {
         if (size_Range(&line) < 8) continue;
         char *endp = NULL;
         const unsigned long long ts = strtoull(line.start, &endp, 10);
-        if (ts == 0) break;
         const uint32_t flags = (uint32_t) strtoul(skipSpace_CStr(endp), &endp, 16);
-        const char *urlStart = skipSpace_CStr(endp);
-        iVisitedUrl item;
-        item.when.ts = (struct timespec){ .tv_sec = ts };
-        if (~flags & kept_VisitedUrlFlag &&
-            secondsSince_Time(&now, &item.when) > maxAge_Visited) {
+        const iRangecc url = { skipSpace_CStr(endp), line.end };
+        if (ts && ~flags & kept_VisitedUrlFlag && now.ts.tv_sec - (long long) ts > maxAge_Visited) {
             continue; /* Too old. */
         }
-        item.flags = flags;
-        initRange_String(&item.url, (iRangecc){ urlStart, line.end });
-        set_String(&item.url, &item.url);
-        if (mergeKeepingLatest) {
-            /* Check if we already have this. */
-            size_t existingPos;
-            if (locate_SortedArray(&d->visited, &item, &existingPos)) {
-                iVisitedUrl *existing = at_SortedArray(&d->visited, existingPos);
-                max_Time(&existing->when, &item.when);
-                existing->flags = item.flags;
-                continue;
+        apply_Visited_(d, url, ts, flags, mergeKeepingLatest);
+    }
+}
+
+void deserialize_Visited(iVisited *d, iStream *ins, iBool mergeKeepingLatest) {
+    const iRangecc src = range_Block(collect_Block(readAll_Stream(ins)));
+    lock_Mutex(d->mtx);
+    d->isRecencyValid = iFalse;
+    parseLines_Visited_(d, src, mergeKeepingLatest);
+    rebuildRecency_Visited_(d);
+    d->needsRewrite = iTrue; /* not in the log */
+    changed_Visited_(d, NULL);
+    unlock_Mutex(d->mtx);
+}
+
+static uint16_t u16_(const char *p) {
+    const uint8_t *b = (const uint8_t *) p;
+    return (uint16_t) (b[0] | (b[1] << 8));
+}
+
+static uint32_t u32_(const char *p) {
+    const uint8_t *b = (const uint8_t *) p;
+    return (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) |
+           ((uint32_t) b[3] << 24);
+}
+
+static iBool read_Visited_(iVisited *d, const iBlock *data) {
+    const char  *base = constData_Block(data);
+    const size_t size = size_Block(data);
+    if (size < headerSize_VisitedFile_ || memcmp(base, magic_Visited_, 4) ||
+        u32_(base + 4) > latest_VisitedFileVersion) {
+        return iFalse;
+    }
+    const uint32_t count     = u32_(base + 8);
+    const uint32_t capacity  = u32_(base + 12);
+    const uint32_t arenaSize = u32_(base + 16);
+    const size_t   slotsPos  = headerSize_VisitedFile_ + (size_t) recordSize_VisitedFile_ * count;
+    const size_t   arenaPos  = slotsPos + (size_t) slotSize_VisitedFile_ * capacity;
+    if (arenaPos + arenaSize != size || (capacity & (capacity - 1)) || count * 2 > capacity) {
+        return iFalse;
+    }
+    iTime now;
+    initCurrent_Time(&now);
+    iBool isComplete = iTrue;
+    for (uint32_t i = 0; i < count; i++) {
+        const char    *rec       = base + headerSize_VisitedFile_ + recordSize_VisitedFile_ * i;
+        const uint64_t seconds   = u32_(rec) | ((uint64_t) u32_(rec + 4) << 32);
+        const uint32_t urlOffset = u32_(rec + 8);
+        const uint32_t urlSize   = u32_(rec + 12);
+        const uint16_t flags     = u16_(rec + 16);
+        if (urlOffset < arenaPos || urlOffset + urlSize >= size) {
+            isComplete = iFalse;
+            continue;
+        }
+        if (~flags & kept_VisitedUrlFlag && now.ts.tv_sec - (long long) seconds > maxAge_Visited) {
+            isComplete = iFalse; /* Too old. */
+            continue;
+        }
+        iVisitedUrl *vis = new_VisitedUrl();
+        vis->when  = (iTime){ .ts = { .tv_sec = seconds } };
+        vis->flags = flags;
+        setRange_String(&vis->url, (iRangecc){ base + urlOffset, base + urlOffset + urlSize });
+        pushBack_PtrArray(&d->visited, vis);
+    }
+    if (isComplete && capacity) {
+        /* Records are in the same order as in the file, so the hash can be used as is. */
+        free(d->slots);
+        d->capacity = capacity;
+        d->slots = malloc(sizeof(iVisitedSlot) * capacity);
+        for (uint32_t i = 0; i < capacity; i++) {
+            const char *slot = base + slotsPos + slotSize_VisitedFile_ * i;
+            d->slots[i] = (iVisitedSlot){ u32_(slot), u32_(slot + 4) };
+            if (d->slots[i].index > count) {
+                isComplete = iFalse; /* corrupted */
+                break;
             }
         }
-        insert_SortedArray(&d->visited, &item);
     }
-    unlock_Mutex(d->mtx);
+    if (!isComplete || !capacity) {
+        size_t newCapacity = 256;
+        while (size_PtrArray(&d->visited) * 2 > newCapacity) {
+            newCapacity *= 2;
+        }
+        rehash_Visited_(d, newCapacity);
+    }
+    return iTrue;
 }
 
 void load_Visited(iVisited *d, const char *dirPath) {
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
+    iBool isLoaded = iFalse;
+    iGuardMutex(d->mtx, d->isRecencyValid = iFalse);
+    iFile *f = newCStr_File(concatPath_CStr(dirPath, fileName_Visited_));
+    if (open_File(f, readOnly_FileMode)) {
+        iBlock *data = readAll_File(f);
+        iGuardMutex(d->mtx, isLoaded = read_Visited_(d, data));
+        delete_Block(data);
+    }
+    iRelease(f);
+    if (!isLoaded) {
+        /* Older versions used a text file. */
+        f = newCStr_File(concatPath_CStr(dirPath, legacyFileName_Visited_));
+        if (open_File(f, readOnly_FileMode | text_FileMode)) {
+            deserialize_Visited(d, stream_File(f), iFalse /* no merge */);
+        }
+        iRelease(f);
+    }
+    /* Replay changes made since the file was last written. */
+    f = newCStr_File(concatPath_CStr(dirPath, logFileName_Visited_));
     if (open_File(f, readOnly_FileMode | text_FileMode)) {
-        deserialize_Visited(d, stream_File(f), iFalse /* no merge */);
+        iBlock *log = readAll_File(f);
+        iGuardMutex(d->mtx, parseLines_Visited_(d, range_Block(log), iFalse));
+        delete_Block(log);
     }
     iRelease(f);
+    iGuardMutex(d->mtx, {
+        rebuildRecency_Visited_(d);
+        changed_Visited_(d, NULL);
+    });
 }
 
 void clear_Visited(iVisited *d) {
     lock_Mutex(d->mtx);
-    iForEach(Array, v, &d->visited.values) {
-        deinit_VisitedUrl(v.value);
+    iForEach(PtrArray, v, &d->visited) {
+        delete_VisitedUrl(v.ptr);
+    }
+    clear_PtrArray(&d->visited);
+    clear_PtrArray(&d->recency);
+    if (d->slots) {
+        memset(d->slots, 0, sizeof(iVisitedSlot) * d->capacity);
     }
-    clear_SortedArray(&d->visited);
+    clear_String(&d->log);
+    d->needsRewrite = iTrue;
+    changed_Visited_(d, NULL);
     unlock_Mutex(d->mtx);
 }
 
-static size_t find_Visited_(const iVisited *d, const iString *url) {
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    set_String(&visit.url, url);
-    size_t pos = iInvalidPos;
-    iGuardMutex(d->mtx, {
-        locate_SortedArray(&d->visited, &visit, &pos);
-        deinit_VisitedUrl(&visit);
-    });
-    return pos;
-}
-
 void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
     iTime when;
     initCurrent_Time(&when);
@@ -171,71 +568,69 @@ void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
 void visitUrlTime_Visited(iVisited *d, const iString *url, uint16_t visitFlags, iTime when) {
     if (isEmpty_String(url)) return;
     url = canonicalUrl_String(url);
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    visit.when = when;
-    visit.flags = visitFlags;
-    set_String(&visit.url, url);
-    size_t pos;
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &visit, &pos)) {
-        iVisitedUrl *old = at_SortedArray(&d->visited, pos);
-        if (old->flags & kept_VisitedUrlFlag) {
+    iVisitedUrl *vis = find_Visited_(d, range_String(url), NULL);
+    if (vis) {
+        if (vis->flags & kept_VisitedUrlFlag) {
             visitFlags |= kept_VisitedUrlFlag; /* must continue to be kept */
         }
-        if (cmpNewer_VisitedUrl_(&visit, old)) {
-            old->when = visit.when;
-            old->flags = visitFlags;
-            unlock_Mutex(d->mtx);
-            deinit_VisitedUrl(&visit);
-            return;
+        if (seconds_Time(&when) >= seconds_Time(&vis->when)) {
+            setWhen_Visited_(d, vis, when);
+            vis->flags = visitFlags;
+            logVisit_Visited_(d, vis);
+            changed_Visited_(d, vis);
         }
     }
-    insert_SortedArray(&d->visited, &visit);
+    else {
+        vis = new_VisitedUrl();
+        vis->when  = when;
+        vis->flags = visitFlags;
+        set_String(&vis->url, url);
+        insert_Visited_(d, vis);
+        logVisit_Visited_(d, vis);
+        changed_Visited_(d, vis);
+    }
     unlock_Mutex(d->mtx);
 }
 
 void setUrlKept_Visited(iVisited *d, const iString *url, iBool isKept) {
     if (isEmpty_String(url)) return;
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    set_String(&visit.url, canonicalUrl_String(url));
-    size_t pos;
+    url = canonicalUrl_String(url);
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &visit, &pos)) {
-        iVisitedUrl *vis = at_SortedArray(&d->visited, pos);
+    iVisitedUrl *vis = find_Visited_(d, range_String(url), NULL);
+    if (vis) {
         iChangeFlags(vis->flags, kept_VisitedUrlFlag, isKept);
+        logVisit_Visited_(d, vis);
     }
     unlock_Mutex(d->mtx);
-    deinit_VisitedUrl(&visit);
 }
 
 void removeUrl_Visited(iVisited *d, const iString *url) {
     url = canonicalUrl_String(url);
     iGuardMutex(d->mtx, {
-        size_t pos = find_Visited_(d, url);
-        if (pos < size_SortedArray(&d->visited)) {
-            iVisitedUrl *visUrl = at_SortedArray(&d->visited, pos);
-            if (equal_String(&visUrl->url, url)) {
-                deinit_VisitedUrl(visUrl);
-                remove_Array(&d->visited.values, pos);
-            }
+        size_t slot;
+        if (find_Visited_(d, range_String(url), &slot)) {
+            remove_Visited_(d, slot);
+            logRemoval_Visited_(d, url);
+            changed_Visited_(d, NULL);
         }
     });
 }
 
-iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
-    iVisitedUrl item;
-    size_t pos;
-    iZap(item);
-    initCopy_String(&item.url, canonicalUrl_String(url));
+iTime urlVisitTimeRange_Visited(const iVisited *d, iRangecc canonicalUrl) {
+    iTime when;
+    iZap(when);
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &item, &pos)) {
-        item.when = ((const iVisitedUrl *) constAt_SortedArray(&d->visited, pos))->when;
+    const iVisitedUrl *vis = find_Visited_(d, canonicalUrl, NULL);
+    if (vis) {
+        when = vis->when;
     }
     unlock_Mutex(d->mtx);
-    deinit_String(&item.url);
-    return item.when;
+    return when;
+}
+
+iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
+    return urlVisitTimeRange_Visited(d, range_String(canonicalUrl_String(url)));
 }
 
 iBool containsUrl_Visited(const iVisited *d, const iString *url) {
@@ -243,33 +638,49 @@ iBool containsUrl_Visited(const iVisited *d, const iString *url) {
     return isValid_Time(&time);
 }
 
-static int cmpWhenDescending_VisitedUrlPtr_(const void *a, const void *b) {
-    const iVisitedUrl *s = *(const void **) a, *t = *(const void **) b;
-    return -cmp_Time(&s->when, &t->when);
-}
-
 const iPtrArray *list_Visited(const iVisited *d, size_t count) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *vis = i.value;
+        for (size_t i = size_PtrArray(&d->recency); i > 0; i--) {
+            const iVisitedUrl *vis = constAt_PtrArray(&d->recency, i - 1);
             if (~vis->flags & transient_VisitedUrlFlag) {
                 pushBack_PtrArray(urls, vis);
+                if (size_PtrArray(urls) == count) {
+                    break;
+                }
             }
         }
     });
-    sort_Array(urls, cmpWhenDescending_VisitedUrlPtr_);
-    if (count > 0 && size_Array(urls) > count) {
-        resize_Array(urls, count);
+    return urls;
+}
+
+uint32_t serial_Visited(const iVisited *d) {
+    uint32_t serial;
+    iGuardMutex(d->mtx, serial = d->serial);
+    return serial;
+}
+
+const iPtrArray *listNewestSince_Visited(const iVisited *d, uint32_t serial) {
+    iPtrArray *urls = NULL;
+    lock_Mutex(d->mtx);
+    if (serial >= d->rebuildSerial) {
+        /* Each change since `serial` moved one entry to the end. */
+        urls = collectNew_PtrArray();
+        const size_t total = size_PtrArray(&d->recency);
+        const size_t count = iMin(total, (size_t) (d->serial - serial));
+        for (size_t i = 0; i < count; i++) {
+            pushBack_PtrArray(urls, constAt_PtrArray(&d->recency, total - 1 - i));
+        }
     }
+    unlock_Mutex(d->mtx);
     return urls;
 }
 
 const iPtrArray *listKept_Visited(const iVisited *d) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *vis = i.value;
+        iConstForEach(PtrArray, i, &d->visited) {
+            const iVisitedUrl *vis = i.ptr;
             if (vis->flags & kept_VisitedUrlFlag) {
                 pushBack_PtrArray(urls, vis);
             }
@@ -49,16 +49,24 @@ iDeclareTypeConstruction(Visited)
 
 void    clear_Visited           (iVisited *);
 void    load_Visited            (iVisited *, const char *dirPath);
-void    save_Visited            (const iVisited *, const char *dirPath);
+void    save_Visited            (iVisited *, const char *dirPath); /* writes a new file */
+void    flush_Visited           (iVisited *, const char *dirPath); /* appends changes to log */
 void    serialize_Visited       (const iVisited *, iStream *out);
 void    deserialize_Visited     (iVisited *, iStream *ins, iBool mergeKeepingLatest);
 
 iTime   urlVisitTime_Visited    (const iVisited *, const iString *url);
+iTime   urlVisitTimeRange_Visited(const iVisited *, iRangecc canonicalUrl); /* no allocations */
 void    visitUrl_Visited        (iVisited *, const iString *url, uint16_t visitFlags); /* adds URL to the visited URLs set */
 void    visitUrlTime_Visited    (iVisited *, const iString *url, uint16_t visitFlags, iTime when);
 void    setUrlKept_Visited      (iVisited *, const iString *url, iBool isKept); /* URL is marked as (non)discardable */
 void    removeUrl_Visited       (iVisited *, const iString *url);
 iBool   containsUrl_Visited     (const iVisited *, const iString *url);
 
-const iPtrArray *   list_Visited        (const iVisited *, size_t count); /* returns collected */
+const iPtrArray *   list_Visited        (const iVisited *, size_t count); /* returns collected, newest first */
 const iPtrArray *   listKept_Visited    (const iVisited *);
+
+/* The serial number is incremented whenever the history changes. If the changes since
+   `serial` were only visits, the visited URLs are returned newest first so the history
+   can be updated incrementally. */
+uint32_t            serial_Visited          (const iVisited *);
+const iPtrArray *   listNewestSince_Visited (const iVisited *, uint32_t serial); /* NULL if full update needed */
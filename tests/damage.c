@@ -0,0 +1,131 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* Window damage bookkeeping without a window: damaged areas are clipped and combined,
+   taking the damage resets it, concurrent refreshes are not lost, and only input and
+   window events cause the whole window to be redrawn. */
+
+#include "ui/damage.h"
+
+#include <the_Foundation/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int errors_;
+
+static void check_(iBool cond, const char *what) {
+    if (!cond) {
+        fprintf(stderr, "failed: %s\n", what);
+        errors_++;
+    }
+}
+
+static const iRect bounds_ = { { 0, 0 }, { 800, 600 } };
+
+static void testAccumulate_(void) {
+    iDamage dmg;
+    init_Damage(&dmg);
+    check_(isEmpty_Rect(take_Damage(&dmg)), "initially undamaged");
+    add_Damage(&dmg, bounds_, zero_Rect());
+    add_Damage(&dmg, bounds_, init_Rect(900, 700, 10, 10));
+    check_(isEmpty_Rect(take_Damage(&dmg)), "empty and outside areas are ignored");
+    add_Damage(&dmg, bounds_, init_Rect(-10, -10, 20, 20));
+    check_(equal_Rect(take_Damage(&dmg), init_Rect(0, 0, 10, 10)), "clipped to bounds");
+    add_Damage(&dmg, bounds_, init_Rect(10, 10, 10, 10));
+    add_Damage(&dmg, bounds_, init_Rect(100, 50, 20, 30));
+    check_(equal_Rect(take_Damage(&dmg), init_Rect(10, 10, 110, 70)), "combined bounding box");
+    check_(isEmpty_Rect(take_Damage(&dmg)), "taking resets");
+    deinit_Damage(&dmg);
+}
+
+static void testDrawnPixels_(void) {
+    iDamage dmg;
+    init_Damage(&dmg);
+    addDrawn_Damage(&dmg, bounds_);
+    addDrawn_Damage(&dmg, init_Rect(0, 0, 10, 20));
+    addDrawn_Damage(&dmg, zero_Rect());
+    check_(drawnPixels_Damage(&dmg) == 800 * 600 + 10 * 20, "drawn pixels accumulate");
+    deinit_Damage(&dmg);
+}
+
+iDeclareType(Refresher)
+
+struct Impl_Refresher {
+    iDamage *dmg;
+    int      row;
+};
+
+static iThreadResult refreshRow_(iThread *thread) {
+    const iRefresher *d = userData_Thread(thread);
+    for (int x = 0; x < 800; x++) {
+        add_Damage(d->dmg, bounds_, init_Rect(x, d->row, 1, 1));
+    }
+    return 0;
+}
+
+static void testThreads_(void) {
+    iDamage dmg;
+    init_Damage(&dmg);
+    iRefresher refs[4];
+    iThread   *threads[4];
+    for (int i = 0; i < 4; i++) {
+        refs[i]    = (iRefresher){ &dmg, 100 * (i + 1) };
+        threads[i] = new_Thread(refreshRow_);
+        setUserData_Thread(threads[i], &refs[i]);
+        start_Thread(threads[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        join_Thread(threads[i]);
+        iRelease(threads[i]);
+    }
+    check_(equal_Rect(take_Damage(&dmg), init_Rect(0, 100, 800, 301)),
+           "concurrent refreshes are combined");
+    deinit_Damage(&dmg);
+}
+
+static void testEvents_(void) {
+    SDL_Event ev = { .type = SDL_USEREVENT };
+    check_(!isDamaging_SDLEvent(&ev), "commands do not damage the window");
+    ev = (SDL_Event){ .motion = { .type = SDL_MOUSEMOTION } };
+    check_(!isDamaging_SDLEvent(&ev), "hovering does not damage the window");
+    ev.motion.state = SDL_BUTTON_LMASK;
+    check_(isDamaging_SDLEvent(&ev), "dragging damages the window");
+    ev = (SDL_Event){ .key = { .type = SDL_KEYDOWN } };
+    check_(isDamaging_SDLEvent(&ev), "key presses damage the window");
+    ev = (SDL_Event){ .button = { .type = SDL_MOUSEBUTTONDOWN } };
+    check_(isDamaging_SDLEvent(&ev), "clicks damage the window");
+    ev = (SDL_Event){ .window = { .type = SDL_WINDOWEVENT } };
+    check_(isDamaging_SDLEvent(&ev), "window events damage the window");
+}
+
+int main(int argc, char **argv) {
+    iUnused(argc, argv);
+    init_Foundation();
+    testAccumulate_();
+    testDrawnPixels_();
+    testThreads_();
+    testEvents_();
+    printf("damage: %d errors\n", errors_);
+    deinit_Foundation();
+    return errors_ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* Stress test for the lock-free SampleBuf: a producer thread and a consumer thread that
+   behaves like the audio callback move a running counter through the buffer. The counter
+   must arrive intact and in order, the producer must never be left waiting, and wakeups
+   must not pile up in the semaphore. When the consumer is paced like a real audio device,
+   it should also not run dry. */
+
+#include "audio/buf.h"
+
+#include <the_Foundation/thread.h>
+#include <SDL_timer.h>
+#include <stdlib.h>
+
+iDeclareType(StressTest)
+
+struct Impl_StressTest {
+    iSampleBuf *buf;
+    uint32_t    total;     /* samples to move */
+    size_t      maxChunk;  /* producer writes 1...maxChunk samples at a time */
+    size_t      period;    /* consumer reads this many per callback; 0 for random, unpaced */
+    uint32_t    received;
+    int         errors;
+    int         dropouts;
+    int         callbacks;
+};
+
+static const uint32_t timeLimit_StressTest_ = 30000; /* ms */
+
+static iThreadResult produce_StressTest_(iThread *thread) {
+    iStressTest *d = userData_Thread(thread);
+    uint32_t *chunk = malloc(sizeof(uint32_t) * d->maxChunk);
+    uint32_t  next  = 0;
+    while (next < d->total) {
+        const size_t n = iMin(1 + rand() % d->maxChunk, d->total - next);
+        while (vacancy_SampleBuf(d->buf) < n) {
+            waitVacancy_SampleBuf(d->buf, n, NULL, NULL);
+        }
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = next++;
+        }
+        write_SampleBuf(d->buf, chunk, n);
+    }
+    free(chunk);
+    return 0;
+}
+
+static iThreadResult consume_StressTest_(iThread *thread) {
+    iStressTest *d = userData_Thread(thread);
+    const size_t maxRead = d->period ? d->period : d->maxChunk;
+    uint32_t *samples = malloc(sizeof(uint32_t) * maxRead);
+    const uint32_t startTime = SDL_GetTicks();
+    iBool isPrimed = iFalse;
+    while (d->received < d->total) {
+        if (SDL_GetTicks() - startTime > timeLimit_StressTest_) {
+            fprintf(stderr, "timed out after receiving %u samples\n", d->received);
+            d->errors++;
+            break;
+        }
+        const size_t avail = size_SampleBuf(d->buf);
+        size_t n = d->period ? d->period : (size_t) (1 + rand() % maxRead);
+        if (d->period) {
+            /* Like the audio callback: never blocks, and reads once per period. */
+            isPrimed |= isFull_SampleBuf(d->buf);
+            if (isPrimed && avail < n && d->received + avail < d->total) {
+                d->dropouts++;
+            }
+            d->callbacks++;
+        }
+        n = iMin(n, avail);
+        read_SampleBuf(d->buf, n, samples);
+        wake_SampleBuf(d->buf);
+        for (size_t i = 0; i < n; i++) {
+            if (samples[i] != d->received + i) {
+                if (d->errors++ < 10) {
+                    fprintf(stderr, "expected %u, got %u\n",
+                            (unsigned) (d->received + i), samples[i]);
+                }
+            }
+        }
+        d->received += n;
+        if (d->period) {
+            SDL_Delay(1);
+        }
+    }
+    free(samples);
+    return 0;
+}
+
+static int run_StressTest_(const char *name, size_t bufSize, size_t maxChunk, size_t period,
+                           uint32_t total) {
+    iStressTest test = { .buf      = new_SampleBuf(AUDIO_S32LSB, 1, bufSize),
+                         .total    = total,
+                         .maxChunk = maxChunk,
+                         .period   = period };
+    iThread *producer = new_Thread(produce_StressTest_);
+    iThread *consumer = new_Thread(consume_StressTest_);
+    setUserData_Thread(producer, &test);
+    setUserData_Thread(consumer, &test);
+    start_Thread(producer);
+    start_Thread(consumer);
+    join_Thread(consumer);
+    if (test.received == test.total) {
+        join_Thread(producer);
+    }
+    const int pending = (int) SDL_SemValue(test.buf->moreNeeded);
+    if (pending > 1) {
+        fprintf(stderr, "%d wakeups left in the semaphore\n", pending);
+        test.errors++;
+    }
+    /* A few dropouts may happen if the system is busy, but not regularly. */
+    if (period && test.dropouts > test.callbacks / 100) {
+        fprintf(stderr, "%d dropouts in %d callbacks\n", test.dropouts, test.callbacks);
+        test.errors++;
+    }
+    printf("%s: %u samples, %d dropouts, %d errors\n",
+           name, test.received, test.dropouts, test.errors);
+    if (test.received == test.total) {
+        iRelease(consumer);
+        iRelease(producer);
+        delete_SampleBuf(test.buf);
+    }
+    return test.errors;
+}
+
+int main(int argc, char **argv) {
+    iUnused(argc, argv);
+    init_Foundation();
+    srand(1);
+    int errors = 0;
+    /* Unpaced reads of random size exercise the wraparound and the wakeup handshake. */
+    errors += run_StressTest_("unpaced", 1000, 300, 0, 20000000);
+    errors += run_StressTest_("tiny", 2, 2, 0, 1000000);
+    /* Paced like a 48 kHz device with 1 ms callbacks. */
+    errors += run_StressTest_("paced", 8192, 2048, 48, 48 * 1000);
+    deinit_Foundation();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}